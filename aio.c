@@ -0,0 +1,237 @@
+/*
+*  aio.c - E/S assincrona sobre o virtual FS: filas de submissao e de
+*          conclusao atendidas por um conjunto de threads
+*
+*  Autores: Lara Dias - 202376010, Sarah Cristina - 202376034, Willian Santos
+*  Projeto: Trabalho Pratico II - Sistemas Operacionais
+*  Organizacao: Universidade Federal de Juiz de Fora
+*  Departamento: Dep. Ciencia da Computacao
+*
+*/
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "aio.h"
+#include "vfs.h"
+
+// Pedido em andamento: fica na fila de submissão até uma thread executá-lo
+typedef struct aio_req {
+    AIOSubmission sqe;                     // Cópia do pedido submetido
+    struct aio_req *next;                  // Próximo na fila de submissão / lista livre
+} aio_req_t;
+
+struct aioctx {
+    pthread_mutex_t lock;                  // Protege todos os campos abaixo
+    pthread_cond_t work_cv;                // Sinaliza pedidos novos ou liberados
+    pthread_cond_t done_cv;                // Sinaliza novas conclusões
+    aio_req_t *reqs;                       // Pedidos pré-alocados (depth)
+    aio_req_t *free_reqs;                  // Pedidos livres
+    aio_req_t *sq_head, *sq_tail;          // Fila de submissão (ordem de chegada)
+    AIOCompletion *cq;                     // Anel de conclusões (depth)
+    unsigned int cq_head;                  // Próxima conclusão a colher
+    unsigned int cq_count;                 // Conclusões não colhidas
+    unsigned int depth;                    // Capacidade das filas
+    unsigned int in_flight;                // Submetidos e ainda não colhidos
+    int *running_fd;                       // Descritor em execução por thread (0 = nenhum)
+    pthread_t *workers;                    // Threads executoras
+    unsigned int num_workers;              // Número de threads executoras
+    int stopping;                          // 1 = aioDestroy chamado
+};
+
+// Argumento de cada thread executora
+typedef struct {
+    AIOContext *ctx;
+    unsigned int id;
+} aio_worker_arg_t;
+
+// Verifica se o pedido r, da fila de submissão, pode ser executado agora:
+// aberturas sempre podem; os demais esperam os pedidos anteriores sobre o
+// mesmo descritor, na fila ou em execução
+static int aio_runnable(AIOContext *ctx, aio_req_t *r) {
+    if (r->sqe.op == AIO_OP_OPEN) return 1;
+    for (unsigned int w = 0; w < ctx->num_workers; w++)
+        if (ctx->running_fd[w] == r->sqe.fd) return 0;
+    for (aio_req_t *p = ctx->sq_head; p != r; p = p->next)
+        if (p->sqe.op != AIO_OP_OPEN && p->sqe.fd == r->sqe.fd) return 0;
+    return 1;
+}
+
+// Retira da fila de submissão o primeiro pedido executável
+// Retorna o pedido ou NULL se nenhum puder ser executado agora
+static aio_req_t *aio_take(AIOContext *ctx) {
+    aio_req_t *prev = NULL;
+    for (aio_req_t *r = ctx->sq_head; r; prev = r, r = r->next) {
+        if (!aio_runnable(ctx, r)) continue;
+        if (prev) prev->next = r->next;
+        else ctx->sq_head = r->next;
+        if (ctx->sq_tail == r) ctx->sq_tail = prev;
+        r->next = NULL;
+        return r;
+    }
+    return NULL;
+}
+
+// Executa um pedido através do VFS
+// Retorna o valor devolvido pela função correspondente
+static int aio_execute(const AIOSubmission *sqe) {
+    switch (sqe->op) {
+        case AIO_OP_OPEN:  return vfsOpen(sqe->path);
+        case AIO_OP_READ:  return vfsRead(sqe->fd, sqe->buf, sqe->nbytes);
+        case AIO_OP_WRITE: return vfsWrite(sqe->fd, sqe->buf, sqe->nbytes);
+        case AIO_OP_FSYNC: return vfsSync(sqe->fd);
+        case AIO_OP_CLOSE: return vfsClose(sqe->fd);
+        default:           return -1;
+    }
+}
+
+// Laço de uma thread executora: retira pedidos, executa-os fora do lock e
+// publica as conclusões, até o contexto ser destruído e a fila esvaziar
+static void *aio_worker(void *p) {
+    aio_worker_arg_t *arg = p;
+    AIOContext *ctx = arg->ctx;
+    unsigned int id = arg->id;
+    free(arg);
+
+    pthread_mutex_lock(&ctx->lock);
+    for (;;) {
+        aio_req_t *r = aio_take(ctx);
+        if (!r) {
+            if (ctx->stopping && !ctx->sq_head) break;
+            pthread_cond_wait(&ctx->work_cv, &ctx->lock);
+            continue;
+        }
+        if (r->sqe.op != AIO_OP_OPEN) ctx->running_fd[id] = r->sqe.fd;
+        pthread_mutex_unlock(&ctx->lock);
+
+        int result = aio_execute(&r->sqe);
+
+        pthread_mutex_lock(&ctx->lock);
+        ctx->running_fd[id] = 0;
+        AIOCompletion *cqe = &ctx->cq[(ctx->cq_head + ctx->cq_count) % ctx->depth];
+        cqe->userTag = r->sqe.userTag;
+        cqe->result = result;
+        ctx->cq_count++;
+        r->next = ctx->free_reqs;
+        ctx->free_reqs = r;
+        pthread_cond_broadcast(&ctx->done_cv);
+        pthread_cond_broadcast(&ctx->work_cv); // o descritor pode ter liberado outros pedidos
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+// Libera a memória de um contexto (as threads já devem ter terminado)
+static void aio_free(AIOContext *ctx) {
+    pthread_cond_destroy(&ctx->done_cv);
+    pthread_cond_destroy(&ctx->work_cv);
+    pthread_mutex_destroy(&ctx->lock);
+    free(ctx->workers);
+    free(ctx->running_fd);
+    free(ctx->cq);
+    free(ctx->reqs);
+    free(ctx);
+}
+
+//Funcao que cria um contexto com capacidade para queueDepth pedidos em
+//andamento (submetidos e ainda nao colhidos) e numWorkers threads
+//executoras. Retorna ponteiro para o contexto ou NULL em caso de falha
+AIOContext* aioCreate (unsigned int queueDepth, unsigned int numWorkers) {
+    if (queueDepth == 0 || numWorkers == 0) return NULL;
+    AIOContext *ctx = calloc(1, sizeof(AIOContext));
+    if (!ctx) return NULL;
+
+    ctx->depth = queueDepth;
+    ctx->reqs = calloc(queueDepth, sizeof(aio_req_t));
+    ctx->cq = calloc(queueDepth, sizeof(AIOCompletion));
+    ctx->running_fd = calloc(numWorkers, sizeof(int));
+    ctx->workers = calloc(numWorkers, sizeof(pthread_t));
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->work_cv, NULL);
+    pthread_cond_init(&ctx->done_cv, NULL);
+    if (!ctx->reqs || !ctx->cq || !ctx->running_fd || !ctx->workers) {
+        aio_free(ctx);
+        return NULL;
+    }
+    for (unsigned int i = 0; i < queueDepth; i++) {
+        ctx->reqs[i].next = ctx->free_reqs;
+        ctx->free_reqs = &ctx->reqs[i];
+    }
+
+    for (unsigned int w = 0; w < numWorkers; w++) {
+        aio_worker_arg_t *arg = malloc(sizeof(aio_worker_arg_t));
+        if (arg) {
+            arg->ctx = ctx;
+            arg->id = w;
+        }
+        if (!arg || pthread_create(&ctx->workers[w], NULL, aio_worker, arg) != 0) {
+            free(arg);
+            break;
+        }
+        ctx->num_workers++;
+    }
+    if (ctx->num_workers == 0) {
+        aio_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+//Funcao que espera os pedidos ja submetidos terminarem e libera o
+//contexto. Conclusoes nao colhidas sao descartadas
+void aioDestroy (AIOContext *ctx) {
+    if (!ctx) return;
+    pthread_mutex_lock(&ctx->lock);
+    ctx->stopping = 1;
+    pthread_cond_broadcast(&ctx->work_cv);
+    pthread_mutex_unlock(&ctx->lock);
+    for (unsigned int w = 0; w < ctx->num_workers; w++)
+        pthread_join(ctx->workers[w], NULL);
+    aio_free(ctx);
+}
+
+//Funcao que coloca ate count pedidos de sqes na fila de submissao, sem
+//esperar sua execucao. Retorna o numero de pedidos aceitos, que e' menor
+//que count se a fila encher, ou -1 em caso de erro
+int aioSubmit (AIOContext *ctx, const AIOSubmission *sqes, unsigned int count) {
+    if (!ctx || (!sqes && count > 0)) return -1;
+
+    unsigned int accepted = 0;
+    pthread_mutex_lock(&ctx->lock);
+    while (accepted < count && ctx->in_flight < ctx->depth && !ctx->stopping) {
+        aio_req_t *r = ctx->free_reqs;
+        ctx->free_reqs = r->next;
+        r->sqe = sqes[accepted++];
+        r->next = NULL;
+        if (ctx->sq_tail) ctx->sq_tail->next = r;
+        else ctx->sq_head = r;
+        ctx->sq_tail = r;
+        ctx->in_flight++;
+    }
+    if (accepted > 0) pthread_cond_broadcast(&ctx->work_cv);
+    pthread_mutex_unlock(&ctx->lock);
+    return (int)accepted;
+}
+
+//Funcao que retira ate maxCount conclusoes da fila de conclusao para cqes,
+//esperando ate que haja pelo menos minCount. Retorna o numero de conclusoes
+//retiradas ou -1 em caso de erro
+int aioReap (AIOContext *ctx, AIOCompletion *cqes, unsigned int maxCount,
+             unsigned int minCount) {
+    if (!ctx || (!cqes && maxCount > 0)) return -1;
+    if (minCount > maxCount) minCount = maxCount;
+
+    pthread_mutex_lock(&ctx->lock);
+    // Não espera por mais conclusões do que há pedidos em andamento
+    while (ctx->cq_count < minCount && ctx->cq_count < ctx->in_flight)
+        pthread_cond_wait(&ctx->done_cv, &ctx->lock);
+
+    unsigned int n = 0;
+    while (n < maxCount && ctx->cq_count > 0) {
+        cqes[n++] = ctx->cq[ctx->cq_head];
+        ctx->cq_head = (ctx->cq_head + 1) % ctx->depth;
+        ctx->cq_count--;
+        ctx->in_flight--;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return (int)n;
+}
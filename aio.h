@@ -0,0 +1,63 @@
+/*
+*  aio.h - API de E/S assincrona sobre o virtual FS
+*
+*  Autores: Lara Dias - 202376010, Sarah Cristina - 202376034, Willian Santos
+*  Projeto: Trabalho Pratico II - Sistemas Operacionais
+*  Organizacao: Universidade Federal de Juiz de Fora
+*  Departamento: Dep. Ciencia da Computacao
+*
+*/
+
+#ifndef AIO_H
+#define AIO_H
+
+//Operacoes que podem ser submetidas
+#define AIO_OP_OPEN 1                      // vfsOpen (path)
+#define AIO_OP_READ 2                      // vfsRead (fd, buf, nbytes)
+#define AIO_OP_WRITE 3                     // vfsWrite (fd, buf, nbytes)
+#define AIO_OP_FSYNC 4                     // vfsSync (fd)
+#define AIO_OP_CLOSE 5                     // vfsClose (fd)
+
+//Pedido colocado na fila de submissao. Pedidos sobre o mesmo descritor
+//sao executados na ordem de submissao; pedidos sobre descritores
+//diferentes (e aberturas) podem ser executados em paralelo
+typedef struct {
+    int op;                                // Operacao (AIO_OP_*)
+    int fd;                                // Descritor (READ, WRITE, FSYNC, CLOSE)
+    const char *path;                      // Caminho do arquivo (OPEN)
+    char *buf;                             // Buffer de dados (READ, WRITE)
+    unsigned int nbytes;                   // Tamanho de buf (READ, WRITE)
+    unsigned long long userTag;            // Valor devolvido na conclusao
+} AIOSubmission;
+
+//Conclusao de um pedido, retirada da fila de conclusao
+typedef struct {
+    unsigned long long userTag;            // userTag do pedido
+    int result;                            // Retorno da funcao do VFS correspondente
+} AIOCompletion;
+
+//Tipo para representacao de um contexto de E/S assincrona: filas de
+//submissao e de conclusao e o conjunto de threads que executa os pedidos
+typedef struct aioctx AIOContext;
+
+//Funcao que cria um contexto com capacidade para queueDepth pedidos em
+//andamento (submetidos e ainda nao colhidos) e numWorkers threads
+//executoras. Retorna ponteiro para o contexto ou NULL em caso de falha
+AIOContext* aioCreate (unsigned int queueDepth, unsigned int numWorkers);
+
+//Funcao que espera os pedidos ja submetidos terminarem e libera o
+//contexto. Conclusoes nao colhidas sao descartadas
+void aioDestroy (AIOContext *ctx);
+
+//Funcao que coloca ate count pedidos de sqes na fila de submissao, sem
+//esperar sua execucao. Retorna o numero de pedidos aceitos, que e' menor
+//que count se a fila encher, ou -1 em caso de erro
+int aioSubmit (AIOContext *ctx, const AIOSubmission *sqes, unsigned int count);
+
+//Funcao que retira ate maxCount conclusoes da fila de conclusao para cqes,
+//esperando ate que haja pelo menos minCount. Retorna o numero de conclusoes
+//retiradas ou -1 em caso de erro
+int aioReap (AIOContext *ctx, AIOCompletion *cqes, unsigned int maxCount,
+             unsigned int minCount);
+
+#endif
@@ -0,0 +1,168 @@
+/*
+*  dcache.c - Cache de entradas de diretorio (dentry cache) do MyFS
+*
+*  Autores: Lara Dias - 202376010, Sarah Cristina - 202376034, Willian Santos
+*  Projeto: Trabalho Pratico II - Sistemas Operacionais
+*  Organizacao: Universidade Federal de Juiz de Fora
+*  Departamento: Dep. Ciencia da Computacao
+*
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dcache.h"
+
+#define DCACHE_BUCKETS 256                 // Número de listas da tabela hash
+
+// Entrada do cache: fica em uma lista da tabela hash e na lista LRU
+typedef struct dentry {
+    unsigned int parent;                   // I-node do diretório pai
+    unsigned int inumber;                  // I-node da entrada (0 = negativa)
+    unsigned int type;                     // Tipo da entrada
+    char *name;                            // Nome da entrada
+    struct dentry *hash_next;              // Próxima entrada na mesma lista hash
+    struct dentry *lru_prev, *lru_next;    // Vizinhos na lista LRU
+} dentry_t;
+
+struct dcache {
+    dentry_t *buckets[DCACHE_BUCKETS];     // Tabela hash
+    dentry_t *lru_head, *lru_tail;         // Mais recente / menos recente
+    unsigned int count;                    // Entradas presentes
+    unsigned int max_entries;              // Capacidade
+    pthread_mutex_t lock;                  // Protege a tabela e a lista LRU
+};
+
+// Calcula a posição de (parent, name) na tabela hash (FNV-1a)
+static unsigned int dcache_hash(unsigned int parent, const char *name) {
+    unsigned int h = 2166136261u ^ parent;
+    for (; *name; name++) {
+        h ^= (unsigned char)*name;
+        h *= 16777619u;
+    }
+    return h % DCACHE_BUCKETS;
+}
+
+// Retira uma entrada da lista LRU
+static void lru_unlink(DCache *c, dentry_t *e) {
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+    else c->lru_head = e->lru_next;
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+    else c->lru_tail = e->lru_prev;
+    e->lru_prev = e->lru_next = NULL;
+}
+
+// Coloca uma entrada no início (mais recente) da lista LRU
+static void lru_push_front(DCache *c, dentry_t *e) {
+    e->lru_prev = NULL;
+    e->lru_next = c->lru_head;
+    if (c->lru_head) c->lru_head->lru_prev = e;
+    c->lru_head = e;
+    if (!c->lru_tail) c->lru_tail = e;
+}
+
+// Procura (parent, name); se prev não for NULL, recebe o antecessor na lista hash
+static dentry_t *dcache_find(DCache *c, unsigned int parent, const char *name, dentry_t **prev) {
+    dentry_t *p = NULL;
+    for (dentry_t *e = c->buckets[dcache_hash(parent, name)]; e; p = e, e = e->hash_next) {
+        if (e->parent == parent && strcmp(e->name, name) == 0) {
+            if (prev) *prev = p;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// Remove uma entrada do cache e libera sua memória
+static void dcache_remove(DCache *c, dentry_t *e) {
+    dentry_t *prev = NULL;
+    dcache_find(c, e->parent, e->name, &prev);
+    if (prev) prev->hash_next = e->hash_next;
+    else c->buckets[dcache_hash(e->parent, e->name)] = e->hash_next;
+    lru_unlink(c, e);
+    c->count--;
+    free(e->name);
+    free(e);
+}
+
+//Funcao que cria um cache vazio com capacidade para maxEntries entradas.
+//Retorna ponteiro para o cache ou NULL se nao houver memoria suficiente
+DCache* dcacheCreate (unsigned int maxEntries) {
+    DCache *c = calloc(1, sizeof(DCache));
+    if (!c) return NULL;
+    c->max_entries = (maxEntries ? maxEntries : 1);
+    pthread_mutex_init(&c->lock, NULL);
+    return c;
+}
+
+//Funcao que libera um cache e todas as suas entradas
+void dcacheDestroy (DCache *c) {
+    if (!c) return;
+    while (c->lru_head) dcache_remove(c, c->lru_head);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+//Funcao que procura o nome name no diretorio de i-node parent. Se presente,
+//copia o i-node (0 para entrada negativa) para *inumber e o tipo para *type.
+//Retorna 1 se a entrada estiver no cache ou 0 caso contrario
+int dcacheLookup (DCache *c, unsigned int parent, const char *name,
+                  unsigned int *inumber, unsigned int *type) {
+    if (!c || !name) return 0;
+    pthread_mutex_lock(&c->lock);
+    dentry_t *e = dcache_find(c, parent, name, NULL);
+    if (e) {
+        lru_unlink(c, e);
+        lru_push_front(c, e);
+        if (inumber) *inumber = e->inumber;
+        if (type) *type = e->type;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return (e != NULL);
+}
+
+//Funcao que insere (ou atualiza) a entrada (parent, name) -> inumber no cache.
+//inumber igual a 0 registra uma entrada negativa. Quando o cache esta cheio,
+//a entrada usada ha mais tempo e' descartada
+void dcacheInsert (DCache *c, unsigned int parent, const char *name,
+                   unsigned int inumber, unsigned int type) {
+    if (!c || !name) return;
+    pthread_mutex_lock(&c->lock);
+    dentry_t *e = dcache_find(c, parent, name, NULL);
+    if (e) {
+        e->inumber = inumber;
+        e->type = type;
+        lru_unlink(c, e);
+        lru_push_front(c, e);
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+    if (c->count >= c->max_entries) dcache_remove(c, c->lru_tail);
+
+    e = calloc(1, sizeof(dentry_t));
+    if (e) e->name = strdup(name);
+    if (!e || !e->name) {
+        free(e);
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+    e->parent = parent;
+    e->inumber = inumber;
+    e->type = type;
+
+    unsigned int h = dcache_hash(parent, name);
+    e->hash_next = c->buckets[h];
+    c->buckets[h] = e;
+    lru_push_front(c, e);
+    c->count++;
+    pthread_mutex_unlock(&c->lock);
+}
+
+//Funcao que remove a entrada (parent, name) do cache, se existir
+void dcacheInvalidate (DCache *c, unsigned int parent, const char *name) {
+    if (!c || !name) return;
+    pthread_mutex_lock(&c->lock);
+    dentry_t *e = dcache_find(c, parent, name, NULL);
+    if (e) dcache_remove(c, e);
+    pthread_mutex_unlock(&c->lock);
+}
@@ -0,0 +1,41 @@
+/*
+*  dcache.h - Cache de entradas de diretorio (dentry cache) do MyFS
+*
+*  Autores: Lara Dias - 202376010, Sarah Cristina - 202376034, Willian Santos
+*  Projeto: Trabalho Pratico II - Sistemas Operacionais
+*  Organizacao: Universidade Federal de Juiz de Fora
+*  Departamento: Dep. Ciencia da Computacao
+*
+*/
+
+#ifndef DCACHE_H
+#define DCACHE_H
+
+//Tipo para representacao de um cache de entradas de diretorio, que associa
+//(i-node do diretorio pai, nome) ao i-node da entrada. Entradas negativas
+//(nome inexistente) sao guardadas com i-node 0
+typedef struct dcache DCache;
+
+//Funcao que cria um cache vazio com capacidade para maxEntries entradas.
+//Retorna ponteiro para o cache ou NULL se nao houver memoria suficiente
+DCache* dcacheCreate (unsigned int maxEntries);
+
+//Funcao que libera um cache e todas as suas entradas
+void dcacheDestroy (DCache *c);
+
+//Funcao que procura o nome name no diretorio de i-node parent. Se presente,
+//copia o i-node (0 para entrada negativa) para *inumber e o tipo para *type.
+//Retorna 1 se a entrada estiver no cache ou 0 caso contrario
+int dcacheLookup (DCache *c, unsigned int parent, const char *name,
+                  unsigned int *inumber, unsigned int *type);
+
+//Funcao que insere (ou atualiza) a entrada (parent, name) -> inumber no cache.
+//inumber igual a 0 registra uma entrada negativa. Quando o cache esta cheio,
+//a entrada usada ha mais tempo e' descartada
+void dcacheInsert (DCache *c, unsigned int parent, const char *name,
+                   unsigned int inumber, unsigned int type);
+
+//Funcao que remove a entrada (parent, name) do cache, se existir
+void dcacheInvalidate (DCache *c, unsigned int parent, const char *name);
+
+#endif
@@ -6,7 +6,10 @@
 *  Organizacao: Universidade Federal de Juiz de Fora
 *  Departamento: Dep. Ciencia da Computacao
 *
-*  => NAO MODIFIQUE ESTE ARQUIVO <=
+*  Este arquivo era fornecido pronto e nao devia ser modificado. Deixou de
+*  ser congelado porque o mapa de blocos com indirecao, os dados guardados
+*  no proprio i-node, a tabela de i-nodes dividida em grupos e a alocacao
+*  de i-nodes em blocos dependem do formato do i-node, privado a este modulo
 *
 */
 
@@ -15,6 +18,10 @@
 
 #include "disk.h"
 
+//Flag combinada ao tipo de arquivo indicando que os dados do arquivo estao
+//guardados no proprio i-node, no espaco dos enderecos de blocos
+#define INODE_FLAG_INLINEDATA 0x100
+
 //Tipo para representacao de i-nodes
 typedef struct inode Inode;
 
@@ -27,6 +34,10 @@ unsigned int inodeAreaBeginSector ( void );
 //Funcao que retorna o numero de enderecos de blocos que cabem em um i-node
 unsigned int inodeNumBlockAddresses ( void );
 
+//Funcao que retorna o numero maximo de bytes de dados que podem ser
+//guardados no proprio i-node (ver INODE_FLAG_INLINEDATA)
+unsigned int inodeNumInlineBytes ( void );
+
 //Funcao que cria um i-node vazio, identificado pelo seu numero (number),
 //que deve ser unico no sistema de arquivos. Retorna ponteiro para o i-node
 //criado ou NULL se nao houver memoria suficiente ou number invalido. A funcao
@@ -35,8 +46,9 @@ unsigned int inodeNumBlockAddresses ( void );
 Inode* inodeCreate (unsigned int number, Disk *d);
 
 //Funcao que limpa todo o conteudo de um i-node. O i-node e' salvo em disco,
-//sobrescrevendo-o se ja existente. Retorna 0 se bem sucedido ou -1, caso
-//contrario
+//sobrescrevendo-o se ja existente. Os blocos de dados e de indirecao sao
+//devolvidos por meio da funcao registrada em inodeSetBlockAllocator.
+//Retorna 0 se bem sucedido ou -1, caso contrario
 int inodeClear (Inode *i);
 
 //Funcao que persiste um i-node em seu disco. Retorna 0 se gravacao bem sucedida
@@ -48,6 +60,23 @@ int inodeSave (Inode *i);
 //i-node lido ou NULL em caso de falha.
 Inode* inodeLoad (unsigned int number, Disk *d);
 
+//Funcao que recupera do disco count i-nodes consecutivos, a partir do i-node
+//de numero first, lendo com uma unica requisicao ao disco cada trecho de
+//setores consecutivos da tabela. Os i-nodes sao copiados para inodes[0] a
+//inodes[count-1]. Retorna 0 se bem sucedido ou -1 em caso de falha (nenhum
+//i-node e' retornado)
+int inodeLoadMany (unsigned int first, unsigned int count, Disk *d,
+                   Inode **inodes);
+
+//Funcao que devolve a memoria de um i-node obtido de inodeCreate, inodeLoad
+//ou inodeLoadMany. O i-node nao e' salvo em disco. i pode ser NULL
+void inodeFree (Inode *i);
+
+//Funcao que informa quantos i-nodes ja' foram entregues por inodeCreate,
+//inodeLoad e inodeLoadMany (allocs) e quantos blocos de i-nodes foram
+//obtidos do malloc para isso (chunks). Qualquer um pode ser NULL
+void inodeAllocStats (unsigned long *allocs, unsigned long *chunks);
+
 //Funcao que modifica o tipo de arquivo referente a um i-node
 void inodeSetFileType (Inode *i, unsigned int fileType);
 
@@ -66,16 +95,25 @@ void inodeSetPermission (Inode *i, unsigned int permission);
 //Funcao que modifica o contador de referencia do arquivo referente a um i-node
 void inodeSetRefCount (Inode *i, unsigned int refCount);
 
-//Funcao que adiciona um endereco ao fim do array de blocos de um i-node
-//Retorna -1 caso a inclusao do endereco nao seja bem sucedida
-//E' a unica funcao que salva automaticamente o i-node em disco
+//Funcao que adiciona um endereco ao fim do mapa de blocos de um i-node.
+//Os 5 primeiros blocos sao enderecados diretamente; os seguintes, por
+//blocos de indirecao simples, dupla e tripla, obtidos pela funcao registrada
+//em inodeSetBlockAllocator. Retorna -1 caso a inclusao do endereco nao seja
+//bem sucedida. O i-node e' salvo automaticamente em disco
 int inodeAddBlock (Inode *i, unsigned int blockAddr);
 
+//Funcao que adiciona os count enderecos de addrs ao fim do mapa de blocos de
+//um i-node, como inodeAddBlock, mas gravando cada bloco de indirecao
+//alterado e o proprio i-node uma unica vez. Retorna o numero de enderecos
+//incluidos e salvos em disco (menor que count em caso de falha)
+unsigned int inodeAddBlocks (Inode *i, const unsigned int *addrs,
+                             unsigned int count);
+
 //Funcao que retorna o numero de um i-node.
 unsigned int inodeGetNumber (Inode *i);
 
-//Funcao que retorna o numero de um i-node.
-unsigned int inodeGetNextNumber (Inode *i);
+//Funcao que retorna o numero de blocos mapeados por um i-node.
+unsigned int inodeGetNumBlocks (Inode *i);
 
 //Funcao que retorna o tipo de arquivo referente a um i-node.
 unsigned int inodeGetFileType (Inode *i);
@@ -95,13 +133,95 @@ unsigned int inodeGetPermission (Inode *i);
 //Funcao que retorna o contador de referencias do arquivo referente a um i-node
 unsigned int inodeGetRefCount (Inode *i);
 
-//Funcao que retorna o endereco correspondente a um bloco (blockNum) no array
-//de blocos de um i-node. O i-node precisa ser o primeiro de sua cadeia.
+//Funcao que retorna o endereco correspondente a um bloco (blockNum) no mapa
+//de blocos de um i-node, percorrendo no maximo tres blocos de indirecao.
 //Retorna 0 se o bloco nao possuir endereco em blockNum
 unsigned int inodeGetBlockAddr (Inode *i, unsigned int blockNum);
 
+//Funcao que copia para addrs os enderecos de count blocos consecutivos do
+//mapa de blocos de um i-node, a partir do bloco first, lendo cada bloco de
+//indirecao do trecho uma unica vez. Retorna o numero de enderecos copiados,
+//menor que count se o mapa terminar antes ou se algum bloco de indirecao nao
+//puder ser lido
+unsigned int inodeGetBlockAddrs (Inode *i, unsigned int first,
+                                 unsigned int count, unsigned int *addrs);
+
+//Funcao que troca por blockAddr o endereco de um bloco (blockNum) ja mapeado
+//por um i-node. O bloco anterior nao e' devolvido. O i-node (ou o bloco de
+//indirecao que guarda o endereco) e' salvo em disco. Retorna 0 se bem
+//sucedido ou -1 caso contrario
+int inodeSetBlockAddr (Inode *i, unsigned int blockNum,
+                       unsigned int blockAddr);
+
+//Funcao que faz um i-node vazio (dst) mapear os mesmos blocos de dados que
+//outro (src), na mesma ordem. Os blocos de indirecao de src sao copiados para
+//blocos novos, obtidos pela funcao registrada em inodeSetBlockAllocator; os
+//blocos de dados passam a ser compartilhados. Tipo, tamanho e demais
+//atributos nao sao copiados. dst e' salvo em disco. Retorna 0 se bem
+//sucedido ou -1 caso contrario
+int inodeShareBlocks (Inode *dst, Inode *src);
+
+//Funcao que percorre o mapa de blocos de um i-node, chamando fn para cada
+//bloco de indirecao (level de 1 a 3, antes dos blocos abaixo dele) e para o
+//endereco de cada um dos blocos de dados mapeados (level 0, na ordem do
+//arquivo, inclusive enderecos 0). Se fn retornar um valor diferente de 0
+//para um bloco de indirecao, os blocos abaixo dele nao sao visitados. Nada e'
+//percorrido em um i-node com INODE_FLAG_INLINEDATA. Retorna 0 se bem
+//sucedido ou -1 se algum bloco de indirecao nao puder ser lido
+int inodeWalkBlocks (Inode *i,
+                     int (*fn)(unsigned int blockAddr, int level, void *arg),
+                     void *arg);
+
+//Funcao que troca todos os enderecos do mapa de blocos de um i-node pelos
+//devolvidos por fn, chamada como em inodeWalkBlocks (cada bloco de indirecao
+//antes dos blocos abaixo dele, os de dados na ordem do arquivo). Os blocos de
+//indirecao sao regravados nos novos enderecos, que devem ser diferentes dos
+//antigos; o conteudo dos blocos de dados nao e' copiado. O i-node so' e'
+//salvo depois de toda a nova arvore estar gravada, entao a troca e' feita de
+//uma vez pela gravacao do setor do i-node. Os blocos antigos nao sao
+//devolvidos. Retorna 0 se bem sucedido ou -1 caso contrario (o i-node
+//continua com os enderecos antigos)
+int inodeRelocate (Inode *i,
+                   unsigned int (*fn)(unsigned int blockAddr, int level,
+                                      void *arg),
+                   void *arg);
+
+//Funcao que copia para buf nbytes dos dados guardados no proprio i-node, a
+//partir da posicao offset. Retorna o numero de bytes copiados ou -1 se o
+//i-node nao possuir a flag INODE_FLAG_INLINEDATA
+int inodeReadInlineData (Inode *i, unsigned int offset, unsigned char *buf,
+                         unsigned int nbytes);
+
+//Funcao que copia nbytes de buf para os dados guardados no proprio i-node, a
+//partir da posicao offset. O i-node nao e' salvo em disco. Retorna o numero
+//de bytes copiados ou -1 se o i-node nao possuir a flag
+//INODE_FLAG_INLINEDATA ou se os dados nao couberem no i-node
+int inodeWriteInlineData (Inode *i, unsigned int offset,
+                          const unsigned char *buf, unsigned int nbytes);
+
+//Funcao que remove a flag INODE_FLAG_INLINEDATA de um i-node, zerando o
+//espaco de enderecos de blocos para que o arquivo passe a usar blocos.
+//O i-node nao e' salvo em disco
+void inodeClearInlineData (Inode *i);
+
 //Funcao que encontra um i-node livre em um disco, a partir do i-node de numero
-//startFrom. Retorna o numero do inode livre encontrado ou 0 se nao encontrado.
+//startFrom. Um i-node e' livre se nao possuir tipo nem blocos. Retorna o
+//numero do inode livre encontrado ou 0 se nao encontrado.
 unsigned int inodeFindFreeInode (unsigned int startFrom, Disk *d);
 
+//Funcao que registra as funcoes usadas pelos i-nodes para obter (allocFn) e
+//devolver (releaseFn) blocos do disco, necessarias aos blocos de indirecao.
+//allocFn deve retornar o endereco de um bloco livre ou 0 se nao houver
+void inodeSetBlockAllocator (unsigned int (*allocFn)(Disk *d),
+                             void (*releaseFn)(Disk *d,
+                                               unsigned int blockAddr));
+
+//Funcao que registra a funcao usada para localizar o setor de cada i-node,
+//para sistemas de arquivos que dividem a tabela de i-nodes em grupos.
+//sectorFn deve retornar o setor do i-node de numero number ou 0 se o numero
+//nao for valido no disco d; os i-nodes de um mesmo setor devem ser numeros
+//consecutivos, a partir de um multiplo de inodeNumInodesPerSector mais 1.
+//Com sectorFn NULL, a tabela e' contigua a partir de inodeAreaBeginSector
+void inodeSetLayout (unsigned long (*sectorFn)(Disk *d, unsigned int number));
+
 #endif
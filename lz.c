@@ -0,0 +1,131 @@
+/*
+*  lz.c - Compressao LZ77 rapida (no estilo do LZ4) para os dados do MyFS
+*
+*  Autores: Lara Dias - 202376010, Sarah Cristina - 202376034, Willian Santos
+*  Projeto: Trabalho Pratico II - Sistemas Operacionais
+*  Organizacao: Universidade Federal de Juiz de Fora
+*  Departamento: Dep. Ciencia da Computacao
+*
+*/
+
+#include <string.h>
+#include "lz.h"
+
+#define LZ_MIN_MATCH 4                     // Menor repetição codificada
+#define LZ_LAST_LITERALS 5                 // Bytes finais sempre guardados como literais
+#define LZ_HASH_BITS 12                    // Bits da tabela de posições
+#define LZ_HASH_SIZE (1u << LZ_HASH_BITS)
+#define LZ_MAX_OFFSET 65535                // Maior distância de uma repetição
+
+// Posição na tabela de hash dos 4 bytes em p (hash multiplicativo de Knuth)
+static unsigned int lz_hash(const unsigned char *p) {
+    unsigned int v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Grava o excedente len de um comprimento (acima de 15) em bytes de 255
+// mais um byte final menor que 255
+static void lz_put_length(unsigned char *dst, unsigned int *op, unsigned int len) {
+    for (; len >= 255; len -= 255) dst[(*op)++] = 255;
+    dst[(*op)++] = (unsigned char)len;
+}
+
+// Grava uma sequência: lit_len literais seguidos de uma repetição de
+// match_len bytes a offset bytes para trás (match_len 0 = só literais, a
+// última sequência)
+// Retorna 0 em caso de sucesso ou -1 se não couber em dst
+static int lz_emit(unsigned char *dst, unsigned int cap, unsigned int *op, const unsigned char *lit,
+                   unsigned int lit_len, unsigned int offset, unsigned int match_len) {
+    unsigned int need = 1 + lit_len + lit_len / 255 + 1 + (match_len ? 2 + match_len / 255 + 1 : 0);
+    if (*op + need > cap) return -1;
+
+    unsigned int token = *op;
+    dst[(*op)++] = (unsigned char)((lit_len < 15 ? lit_len : 15) << 4);
+    if (lit_len >= 15) lz_put_length(dst, op, lit_len - 15);
+    memcpy(dst + *op, lit, lit_len);
+    *op += lit_len;
+    if (match_len == 0) return 0;
+
+    dst[(*op)++] = (unsigned char)(offset & 0xFF);
+    dst[(*op)++] = (unsigned char)(offset >> 8);
+    match_len -= LZ_MIN_MATCH;
+    dst[token] |= (unsigned char)(match_len < 15 ? match_len : 15);
+    if (match_len >= 15) lz_put_length(dst, op, match_len - 15);
+    return 0;
+}
+
+//Funcao que comprime srcLen bytes de src para dst, que tem espaco para
+//dstCap bytes. O resultado e' uma sequencia de pares (literais, repeticao)
+//no formato de blocos do LZ4. Retorna o tamanho comprimido ou -1 se ele
+//nao couber em dstCap (dados pouco compressiveis) ou srcLen passar de
+//LZ_MAX_INPUT
+int lzCompress (const unsigned char *src, unsigned int srcLen,
+                unsigned char *dst, unsigned int dstCap) {
+    unsigned short table[LZ_HASH_SIZE];    // Última posição (+1) de cada hash; 0 = nenhuma
+    unsigned int ip = 0, anchor = 0, op = 0;
+    if (srcLen > LZ_MAX_INPUT) return -1;
+    memset(table, 0, sizeof(table));
+
+    while (ip + LZ_MIN_MATCH + LZ_LAST_LITERALS <= srcLen) {
+        unsigned int h = lz_hash(src + ip);
+        unsigned int cand = table[h];
+        table[h] = (unsigned short)(ip + 1);
+        if (cand == 0 || ip - (cand - 1) > LZ_MAX_OFFSET || memcmp(src + cand - 1, src + ip, LZ_MIN_MATCH) != 0) {
+            ip++;
+            continue;
+        }
+        cand--;
+
+        // Estende a repetição, deixando os últimos bytes como literais
+        unsigned int len = LZ_MIN_MATCH;
+        while (ip + len < srcLen - LZ_LAST_LITERALS && src[cand + len] == src[ip + len]) len++;
+        if (lz_emit(dst, dstCap, &op, src + anchor, ip - anchor, ip - cand, len) < 0) return -1;
+
+        // Registra uma posição dentro da repetição para achar a próxima
+        table[lz_hash(src + ip + len - 2)] = (unsigned short)(ip + len - 1);
+        ip += len;
+        anchor = ip;
+    }
+    if (lz_emit(dst, dstCap, &op, src + anchor, srcLen - anchor, 0, 0) < 0) return -1;
+    return (int)op;
+}
+
+//Funcao que descomprime os srcLen bytes de src, produzidos por lzCompress,
+//para dst, que tem espaco para dstCap bytes. Retorna o numero de bytes
+//produzidos ou -1 se os dados estiverem corrompidos ou nao couberem em dst
+int lzDecompress (const unsigned char *src, unsigned int srcLen,
+                  unsigned char *dst, unsigned int dstCap) {
+    unsigned int ip = 0, op = 0;
+    while (ip < srcLen) {
+        unsigned int token = src[ip++], b;
+
+        unsigned int lit_len = token >> 4;
+        if (lit_len == 15)
+            do {
+                if (ip >= srcLen) return -1;
+                lit_len += (b = src[ip++]);
+            } while (b == 255);
+        if (lit_len > srcLen - ip || lit_len > dstCap - op) return -1;
+        memcpy(dst + op, src + ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+        if (ip == srcLen) break;           // Última sequência: só literais
+
+        if (srcLen - ip < 2) return -1;
+        unsigned int offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        unsigned int match_len = token & 15;
+        if (match_len == 15)
+            do {
+                if (ip >= srcLen) return -1;
+                match_len += (b = src[ip++]);
+            } while (b == 255);
+        match_len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || match_len > dstCap - op) return -1;
+
+        // Byte a byte: a repetição pode se sobrepor ao trecho que copia
+        for (unsigned int i = 0; i < match_len; i++, op++) dst[op] = dst[op - offset];
+    }
+    return (int)op;
+}
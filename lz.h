@@ -0,0 +1,31 @@
+/*
+*  lz.h - Compressao LZ77 rapida (no estilo do LZ4) para os dados do MyFS
+*
+*  Autores: Lara Dias - 202376010, Sarah Cristina - 202376034, Willian Santos
+*  Projeto: Trabalho Pratico II - Sistemas Operacionais
+*  Organizacao: Universidade Federal de Juiz de Fora
+*  Departamento: Dep. Ciencia da Computacao
+*
+*/
+
+#ifndef LZ_H
+#define LZ_H
+
+//Tamanho maximo da entrada de lzCompress, em bytes (deslocamentos de 16 bits)
+#define LZ_MAX_INPUT 65535
+
+//Funcao que comprime srcLen bytes de src para dst, que tem espaco para
+//dstCap bytes. O resultado e' uma sequencia de pares (literais, repeticao)
+//no formato de blocos do LZ4. Retorna o tamanho comprimido ou -1 se ele
+//nao couber em dstCap (dados pouco compressiveis) ou srcLen passar de
+//LZ_MAX_INPUT
+int lzCompress (const unsigned char *src, unsigned int srcLen,
+                unsigned char *dst, unsigned int dstCap);
+
+//Funcao que descomprime os srcLen bytes de src, produzidos por lzCompress,
+//para dst, que tem espaco para dstCap bytes. Retorna o numero de bytes
+//produzidos ou -1 se os dados estiverem corrompidos ou nao couberem em dst
+int lzDecompress (const unsigned char *src, unsigned int srcLen,
+                  unsigned char *dst, unsigned int dstCap);
+
+#endif
@@ -6,7 +6,9 @@
 *  Organizacao: Universidade Federal de Juiz de Fora
 *  Departamento: Dep. Ciencia da Computacao
 *
-*  => NAO MODIFIQUE ESTE ARQUIVO <=
+*  Este arquivo era fornecido pronto e nao devia ser modificado. Deixou de
+*  ser congelado para que a simulacao exercite as operacoes acrescentadas
+*  ao VFS
 *
 */
 
@@ -17,7 +19,7 @@
 #include "vfs.h"
 #include "inode.h"
 
-#define MAX_CONNECTEDDISKS 1
+#define MAX_CONNECTEDDISKS 8
 
 #define RESULT_MSGDELAY 1000
 
@@ -27,18 +29,59 @@
 typedef struct fd {
 	int status; //Status do descritor de arquivos: 0 fechado, 1 aberto
 	int type;   //Tipo do arquivo, conforme FILETYPE_* (vfs.h)
+	int fd;     //Descritor devolvido pelo VFS (nao e' um indice de fds)
 	char path[MAX_FILENAME_LENGTH+1]; //Caminho do arquivo/diretorio
 } FD;
 
 Disk *disks[MAX_CONNECTEDDISKS]; //Discos conectados ao sistema
 unsigned int connectedDisks = 0; //Numero de discos conectados
+int memberOf[MAX_CONNECTEDDISKS]; //Volume do qual cada disco e' membro (NO_ID: nenhum)
 
 Disk *rd = NULL;	//Disco montado como sistema de arquivos raiz 
 int rfsid = NO_ID;	//ID do sistema de arquivo montado como raiz
+char mountPath[MAX_CONNECTEDDISKS][MAX_FILENAME_LENGTH+1]; //Ponto de montagem
+			//(fora da raiz) de cada disco ("": nao montado)
 
 FD fds[MAX_FDS];	//Status, tipo e path dos descritores de arquivo
 unsigned int fdc = 0;	//Numero de descritores de arquivos abertos	
 
+//Funcao interna que retorna a entrada de fds do descritor fd aberto ou,
+//se fd for 0, uma entrada livre. Retorna NULL se nao houver
+FD* __fdFind (int fd) {
+	for (int a=0; a<MAX_FDS; a++)
+		if ( fd ? (fds[a].status && fds[a].fd == fd) : !fds[a].status )
+			return &fds[a];
+	return NULL;
+}
+
+//Funcao interna que retorna o caminho associado ao descritor fd
+const char* __fdPath (int fd) {
+	FD *f = __fdFind (fd);
+	return (f ? f->path : "");
+}
+
+//Funcao interna que registra o descritor fd, aberto sobre path, em uma
+//entrada livre de fds
+void __fdAdd (int fd, int type, const char *path) {
+	FD *f = __fdFind (0);
+	f->status = 1;
+	f->type = type;
+	f->fd = fd;
+	strcpy (f->path, path);
+	fdc++;
+}
+
+//Funcao interna que libera a entrada de fds do descritor fd
+void __fdRemove (int fd) {
+	FD *f = __fdFind (fd);
+	if (!f) return;
+	f->status = 0;
+	f->type = 0;
+	f->fd = 0;
+	strcpy (f->path, "");
+	fdc--;
+}
+
 //Interface para contruir novo disco ou reconstruir disco existente (formatacao
 //de baixo nivel). Para construcao de novo disco, e' previsto que o disco nao
 //esteja conectado ao sistema hipotetico
@@ -109,10 +152,14 @@ void doDiskList (void) {
 	else {
 		printf ("\n-- DiskList: Listing...\n");
 		for (int id = 0; id<MAX_CONNECTEDDISKS; id++) {
+			if (!disks[id]) continue;
 			printf ("-- DiskID: %d; NumCylinders: %lu; "
-			        "DataSize: %lu\n",
+			        "DataSize: %lu",
 				id, diskGetNumCylinders(disks[id]),
 				diskGetSize(disks[id]));
+			if (memberOf[id] != NO_ID)
+				printf ("; Member of volume %d", memberOf[id]);
+			printf ("\n");
 		}
 	}
 	SLEEP(RESULT_MSGDELAY);
@@ -166,6 +213,76 @@ void doDiskReadPrintSectors (void) {
 	SLEEP (RESULT_MSGDELAY);
 }
 
+//Interface para combinar discos conectados em um volume com faixas (RAID-0)
+//ou espelhado (RAID-1), que passa a ser visto como mais um disco conectado
+void doDiskVolume (int mirrored) {
+	int numMembers, id = -1;
+	unsigned long stripeSectors = 0;
+	Disk *members[MAX_CONNECTEDDISKS];
+	int memberIds[MAX_CONNECTEDDISKS];
+	const char *op = (mirrored ? "DiskMirror" : "DiskStripe");
+
+	for (int a=0; a<MAX_CONNECTEDDISKS; a++)
+		if (!disks[a]) { 
+			id = a;
+			break;
+		}
+	if ( id == -1 ) {
+		printf ("\n!! %s: FAILED. "
+		        "Maximum number of connected disks reached!\n", op);
+		SLEEP (RESULT_MSGDELAY);
+		return;
+	}
+	printf ("\n>> %s: Number of member disks (0: cancel): ", op);
+	scanf (" %d", &numMembers);
+	if ( numMembers <= 0 ) return;
+	if ( numMembers > MAX_CONNECTEDDISKS - 1 ) {
+		printf ("\n!! %s: FAILED. Too many members!\n", op);
+		SLEEP (RESULT_MSGDELAY);
+		return;
+	}
+	for (int m=0; m<numMembers; m++) {
+		printf (">> %s: Disk ID of member %d: ", op, m);
+		scanf (" %d", &memberIds[m]);
+		int mid = memberIds[m];
+		int repeated = 0;
+		for (int p=0; p<m; p++)
+			if (memberIds[p] == mid) repeated = 1;
+		if ( mid < 0 || mid > MAX_CONNECTEDDISKS - 1 || !disks[mid]
+		     || disks[mid] == rd || memberOf[mid] != NO_ID
+		     || repeated ) {
+			printf ("\n!! %s: FAILED. Invalid or busy "
+			        "disk identifier!\n", op);
+			SLEEP (RESULT_MSGDELAY);
+			return;
+		}
+		members[m] = disks[mid];
+	}
+	if (mirrored) {
+		printf ("\n-- Mirroring... "); fflush (stdout);
+		disks[id] = diskCreateMirrored (id, members, numMembers);
+	}
+	else {
+		printf (">> %s: Stripe size in # of sectors (e.g. 64): ", op);
+		scanf (" %lu", &stripeSectors);
+		printf ("\n-- Striping... "); fflush (stdout);
+		disks[id] = diskCreateStriped (id, members, numMembers,
+		                               stripeSectors);
+	}
+	if (disks[id]) {
+		for (int m=0; m<numMembers; m++)
+			memberOf[memberIds[m]] = id;
+		connectedDisks++;
+		printf ("Volume %d successfully created with %d disks\n",
+		        id, numMembers);
+	}
+	else
+		printf ("\n!! %s: FAILED. Invalid %s or "
+		        "not enough memory\n", op,
+		        (mirrored ? "member disks" : "stripe size"));
+	SLEEP (RESULT_MSGDELAY);
+}
+
 //Interface para desconectar um disco do sistema operacional hipotetico
 void doDiskDisconnect ( int id ) {
 	if ( !connectedDisks )
@@ -181,11 +298,19 @@ void doDiskDisconnect ( int id ) {
 		else if (disks[id] == rd) 
 			printf ("\n!! DiskDisconnect: FAILED. Cannot "
 			        "disconnect the root filesystem disk\n");
+		else if (mountPath[id][0])
+			printf ("\n!! DiskDisconnect: FAILED. Disk is "
+			        "mounted at %s\n", mountPath[id]);
+		else if (memberOf[id] != NO_ID)
+			printf ("\n!! DiskDisconnect: FAILED. Disk is a "
+			        "member of volume %d\n", memberOf[id]);
 		else {
 			printf ("\n-- Disconnecting... "); fflush (stdout);
 			if ( diskDisconnect (disks[id]) > -1 ) {
 				printf ("Disk %d successfully disconnected."
 					"\n", id);
+				for (int a=0; a<MAX_CONNECTEDDISKS; a++)
+					if (memberOf[a] == id) memberOf[a] = NO_ID;
 				disks[id] = NULL;
 				connectedDisks--;
 			}
@@ -213,6 +338,9 @@ void doFSFormat (void) {
 		else if (disks[id] == rd) 
 			printf ("\n!! DiskFormat: FAILED. "
 			        "Cannot format the root filesystem disk\n");
+		else if (mountPath[id][0])
+			printf ("\n!! DiskFormat: FAILED. "
+			        "Cannot format a mounted disk\n");
 		else {
 			int fsid, bs;
 			printf (">> DiskFormat: Filesystem ID: ");
@@ -270,6 +398,97 @@ void doFSMountRoot (void) {
 	SLEEP (RESULT_MSGDELAY);
 }
 
+//Interface para montar um disco conectado ao sistema operacional hipotetico
+//em um caminho da arvore unica, abaixo da raiz
+void doFSMount (void) {
+	if ( !rd )
+		printf ("\n!! Mount: FAILED. No root filesystem mounted!\n");
+	else {
+		int id;
+		printf ("\n>> Mount: Disk ID: ");
+		scanf (" %u", &id);
+		if ( id > MAX_CONNECTEDDISKS - 1 || !disks[id])
+			printf ("\n!! Mount: FAILED. "
+			        "Invalid identifier!\n");
+		else {
+			int fsid;
+			char path[MAX_FILENAME_LENGTH+1];
+			printf (">> Mount: Filesystem ID: ");
+			scanf (" %u", &fsid);
+			printf (">> Mount: Mount point (absolute path): ");
+			scanf (" %255s", path);
+			printf ("\n-- Mounting... "); fflush (stdout);
+			if ( strcmp (path, "/") != 0
+			     && vfsMount (disks[id], fsid, path) > -1 ) {
+				printf ("Disk %d successfully mounted at "
+				        "%s.\n", id, path);
+				strcpy (mountPath[id], path);
+			}
+			else
+				printf ("\n!! Mount: FAILED. Invalid mount "
+				        "point, disk already mounted or "
+				        "operation failed!\n");
+		}
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para desmontar o sistema de arquivos montado no disco id, fora
+//da raiz
+void doFSUnmount (int id) {
+	if ( id == NO_ID ) {
+		printf ("\n>> Unmount: Disk ID: ");
+		scanf (" %u", &id);
+	}
+	if ( id > MAX_CONNECTEDDISKS - 1 || !disks[id] || !mountPath[id][0] )
+		printf ("\n!! Unmount: FAILED. Disk is not mounted "
+		        "below the root!\n");
+	else {
+		printf ("\n-- Unmounting... "); fflush (stdout);
+		if ( vfsUnmount (mountPath[id]) > -1 ) {
+			printf ("Disk %d successfully unmounted from %s.\n",
+			        id, mountPath[id]);
+			mountPath[id][0] = '\0';
+		}
+		else
+			printf ("\n!! Unmount: FAILED. Filesystem is busy "
+			        "or operation failed!\n");
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para criar (create=1) ou remover (create=0) um snapshot do
+//sistema de arquivos MyFS montado em um disco
+void doFSSnapshot (int create) {
+	int id;
+	printf ("\n>> Snapshot: Disk ID: ");
+	scanf (" %u", &id);
+	if ( id > MAX_CONNECTEDDISKS - 1 || !disks[id]
+	     || (disks[id] != rd && !mountPath[id][0]) )
+		printf ("\n!! Snapshot: FAILED. Disk is not mounted!\n");
+	else if ( create ) {
+		int snap = myFSSnapshotCreate (disks[id]);
+		if ( snap > 0 )
+			printf ("\n-- Snapshot %d of disk %d created.\n",
+			        snap, id);
+		else
+			printf ("\n!! Snapshot: FAILED. Not a MyFS disk or "
+			        "no free snapshot slots!\n");
+	}
+	else {
+		int snap;
+		printf (">> Snapshot: Snapshot ID: ");
+		scanf (" %u", &snap);
+		if ( myFSSnapshotDelete (disks[id], snap) > -1 )
+			printf ("\n-- Snapshot %d of disk %d removed.\n",
+			        snap, id);
+		else
+			printf ("\n!! Snapshot: FAILED. Invalid snapshot "
+			        "or snapshot in use!\n");
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
 //Interface para mostrar os dados sobre descritores de arquivo em uso no
 //sistema operacional hipotetico
 void doFSShowFDs (void) {
@@ -280,12 +499,12 @@ void doFSShowFDs (void) {
 			printf ("\n!! ShowFDs: No file descriptors in use!\n");
 		else {
 			printf("\n-- ShowFDs: Showing...\n");
-			for (int fd = 1; fd<=MAX_FDS; fd++)
-				if ( fds[fd-1].status ) {
+			for (int a=0; a<MAX_FDS; a++)
+				if ( fds[a].status ) {
 					printf ("-- FD: %3d;   "
 					        "Type: %3d;   Path: %s\n",
-					        fd, fds[fd-1].type,
-					        fds[fd-1].path);
+					        fds[a].fd, fds[a].type,
+					        fds[a].path);
 				}
 		}
 	}
@@ -332,10 +551,7 @@ void doFileOpen (void) {
 	       	if ( fd > 0 ) {
 			printf ("File %s successfully opened as FD %d.\n",
 			        filePath, fd);
-			fds[fd-1].status = 1;
-			fds[fd-1].type = FILETYPE_REGULAR;
-			strcpy (fds[fd-1].path, filePath);
-			fdc++;
+			__fdAdd (fd, FILETYPE_REGULAR, filePath);
 		}
 		else
 			printf ("\n!! FileOpen: FAILED. Invalid path or"
@@ -362,7 +578,7 @@ void doFileReadPrint (void) {
 		rbytes = vfsRead (fd, buffer, nbytes);
 		if ( rbytes > -1 ) {
 			printf ("File %s successfully read. %d bytes read.\n",
-			        fds[fd-1].path, rbytes);
+			        __fdPath(fd), rbytes);
 			for (int a=0; a<rbytes; a++)
 				printf ("%c",buffer[a]);
 			if (rbytes > 0) printf ("\n");
@@ -390,15 +606,16 @@ void doFileWrite (void) {
 		scanf (" %u", &nbytes);
 		printf ("\n-- Writing... "); fflush (stdout);
 		buffer = malloc (sizeof(unsigned char[nbytes]));
-		if ( fd <= MAX_FDS && fds[fd-1].status ) {
-			int pathlen = strlen(fds[fd-1].path);
+		if ( __fdFind (fd) ) {
+			const char *path = __fdPath(fd);
+			int pathlen = strlen(path);
 			for (int a=0; a<nbytes; a++)
-				buffer[a] = fds[fd-1].path[a%pathlen];
+				buffer[a] = path[a%pathlen];
 		}
 		wbytes = vfsWrite (fd, buffer, nbytes);
 		if ( wbytes > -1 )
 			printf ("File %s successfully wrote. %d bytes "
-			        "wrote.\n", fds[fd-1].path, wbytes);
+			        "wrote.\n", __fdPath(fd), wbytes);
 		else
 			printf ("\n!! FileWrite: FAILED. Invalid file "
 			        "descriptor or i-node saving failure!\n");
@@ -420,11 +637,8 @@ void doFileClose (int fd) {
 		printf ("\n-- Closing... "); fflush (stdout);
 		if ( vfsClose(fd) > -1 ) {
 			printf ("File %s successfully closed.\n", 
-			        fds[fd-1].path);
-			fds[fd-1].status = 0;
-			fds[fd-1].type = 0;
-			strcpy (fds[fd-1].path, "");
-			fdc--;
+			        __fdPath(fd));
+			__fdRemove (fd);
 		}
 		else
 			printf ("\n!! FileClose: FAILED. Invalid file "
@@ -433,6 +647,29 @@ void doFileClose (int fd) {
 	SLEEP (RESULT_MSGDELAY);
 }
 
+//Interface para clonagem de um arquivo regular, sem copia dos dados
+void doFileClone (void) {
+	if ( !rd )
+		printf ("\n!! FileClone: FAILED. No root filesystem "
+		        "mounted!\n");
+	else {
+		char srcPath[MAX_FILENAME_LENGTH+1];
+		char dstPath[MAX_FILENAME_LENGTH+1];
+		printf ("\n>> FileClone: Source file path: ");
+		scanf (" %s", srcPath);
+		printf ("\n>> FileClone: New file path (same mount point): ");
+		scanf (" %s", dstPath);
+		printf ("\n-- Cloning... "); fflush (stdout);
+		if ( vfsClone(srcPath, dstPath) == 0 )
+			printf ("File %s successfully cloned as %s.\n",
+			        srcPath, dstPath);
+		else
+			printf ("\n!! FileClone: FAILED. Invalid paths, existing "
+			        "target or no i-nodes available!\n");
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
 //Interface para abrir um diretorio, criando-o se nao existir
 void doDirOpen (void) {
 	if ( !rd )
@@ -451,10 +688,7 @@ void doDirOpen (void) {
 	       	if ( fd > 0 ) {
 			printf ("Directory %s successfully opened as FD %d.\n",
 			       	dirPath, fd);
-			fds[fd-1].status = 1;
-			fds[fd-1].type = FILETYPE_DIR;
-			strcpy (fds[fd-1].path, dirPath);
-			fdc++;
+			__fdAdd (fd, FILETYPE_DIR, dirPath);
 		}
 		else
 			printf ("\n!! DirOpen: FAILED. Invalid path or"
@@ -463,22 +697,28 @@ void doDirOpen (void) {
 	SLEEP (RESULT_MSGDELAY);
 }
 
-//Interface para ler e listar entradas de um diretorio aberto
+//Interface para ler e listar entradas de um diretorio aberto. As entradas
+//sao obtidas em lote (vfsGetdents), varias por chamada
 void doDirList (void) {
 	if ( !rd )
 		printf ("\n!! DirList: FAILED. No root filesystem mounted!\n");
 	else {
 		int fd, res;
-		char entryname[MAX_FILENAME_LENGTH+1];
-		unsigned int inumber;
+		char entries[4096];
 		printf ("\n>> DirList: Directory descriptor (#): ");
 		scanf (" %u", &fd);
 		printf ("\n-- DirList: Listing...\n"); fflush (stdout);
-		res = vfsReaddir (fd, entryname, &inumber);
+		res = vfsGetdents (fd, entries, sizeof(entries), 1);
 		while ( res > 0 ) {
-			printf ("-- Inode #: %5d     Name: %s\n",
-			        inumber, entryname);
-			res = vfsReaddir (fd, entryname, &inumber);
+			for (int off = 0; off < res; ) {
+				VFSDirent *e = (VFSDirent *) &entries[off];
+				printf ("-- Inode #: %5u     Size: %8u     "
+				        "Name: %s%s\n", e->inumber, e->size,
+				        e->name,
+				        (e->type == FILETYPE_DIR ? "/" : ""));
+				off += e->reclen;
+			}
+			res = vfsGetdents (fd, entries, sizeof(entries), 1);
 		}
 		if ( res == -1 )
 			printf ("\n!! DirList: FAILED. Invalid file "
@@ -506,7 +746,7 @@ void doDirLink (void) {
 		if ( vfsLink (fd, entryname, inumber) == 0 )
 			printf ("Entry %s successfully linked to i-node %d "
 			        "in directory %s\n",
-			        entryname, inumber, fds[fd-1].path);
+			        entryname, inumber, __fdPath(fd));
 		else
 			printf ("\n!! DirLink: FAILED. Invalid file "
 			        "descriptor or i-node!\n");
@@ -529,7 +769,7 @@ void doDirUnlink (void) {
 		printf ("\n-- Unlinking... "); fflush (stdout);
 		if ( vfsUnlink (fd, entryname) == 0 )
 			printf ("Entry %s successfully unlinked from "
-			        "directory %s\n", entryname, fds[fd-1].path);
+			        "directory %s\n", entryname, __fdPath(fd));
 		else
 			printf ("\n!! DirUnlink: FAILED. Invalid file "
 			        "descriptor or entry name!\n");
@@ -551,11 +791,8 @@ void doDirClose (int fd) {
 		printf ("\n-- Closing... "); fflush (stdout);
 		if ( vfsClosedir(fd) > -1 ) {
 			printf ("Directory %s successfully closed.\n",
-			        fds[fd-1].path);
-			fds[fd-1].status = 0;
-			fds[fd-1].type = 0;
-			strcpy (fds[fd-1].path, "");
-			fdc--;
+			        __fdPath(fd));
+			__fdRemove (fd);
 		}
 		else
 			printf ("\n!! DirClose: FAILED. Invalid file "
@@ -571,19 +808,22 @@ void doDirClose (int fd) {
 char sanitizeBeforeQuit () {
 	//Fechando arquivos/diretorios abertos
 	if (fdc)
-		for (int a=1; a<=MAX_FDS; a++)
-			if ( fds[a-1].status ) {
-				if ( fds[a-1].type == FILETYPE_REGULAR )
-					doFileClose(a);
-				else doDirClose(a);
+		for (int a=0; a<MAX_FDS; a++)
+			if ( fds[a].status ) {
+				if ( fds[a].type == FILETYPE_REGULAR )
+					doFileClose(fds[a].fd);
+				else doDirClose(fds[a].fd);
 			}
-	//Desmontando a raiz do sistema de arquivos
+	//Desmontando os demais pontos de montagem e depois a raiz
+	for (int a=0; a<MAX_CONNECTEDDISKS; a++)
+		if (mountPath[a][0]) doFSUnmount(a);
 	if (rd) doFSUnmountRoot();
 
-	//Desconectando discos
-	if (connectedDisks)
+	//Desconectando discos (volumes antes dos seus membros)
+	for (int pass=0; connectedDisks && pass<MAX_CONNECTEDDISKS; pass++)
 		for (int a=0; a<MAX_CONNECTEDDISKS; a++)
-			if (disks[a]) doDiskDisconnect(a);
+			if (disks[a] && memberOf[a] == NO_ID)
+				doDiskDisconnect(a);
 
 	if (rd || connectedDisks)
 		return ' ';
@@ -627,6 +867,7 @@ void fileMenuSelection (void) {
 		          "     [R]ead bytes from file\n"
 		          "     [W]rite bytes to file\n"
 			  "     [C]lose file\n"
+		          "     c[L]one file\n"
 		          "     [<]back to MAIN menu\n"
 		          "\n>> Your selection: ", connectedDisks,
 			  (rd ? diskGetId(rd) : -1));
@@ -636,10 +877,101 @@ void fileMenuSelection (void) {
 			case 'R': case 'r': doFileReadPrint(); break;
 			case 'W': case 'w': doFileWrite(); break;
 			case 'C': case 'c': doFileClose(NO_ID); break;
+			case 'L': case 'l': doFileClone(); break;
 		}
 	}
 }
 
+//Interface para o modo de deduplicacao de um disco montado: liga, desliga
+//ou procura blocos repetidos nos arquivos ja gravados
+void doFSDedup (void) {
+	int id;
+	char option;
+	printf ("\n>> Dedup: Disk ID: ");
+	scanf (" %u", &id);
+	if ( id > MAX_CONNECTEDDISKS - 1 || !disks[id]
+	     || (disks[id] != rd && !mountPath[id][0]) ) {
+		printf ("\n!! Dedup: FAILED. Disk is not mounted!\n");
+		SLEEP (RESULT_MSGDELAY);
+		return;
+	}
+	printf (">> Dedup: [O]n, o[F]f or [S]can existing files: ");
+	scanf (" %c", &option);
+	if ( option == 'S' || option == 's' ) {
+		printf ("\n-- Scanning... "); fflush (stdout);
+		int saved = myFSDedupScan (disks[id]);
+		if ( saved > -1 )
+			printf ("%d blocks freed on disk %d.\n", saved, id);
+		else
+			printf ("\n!! Dedup: FAILED. Not a MyFS disk or "
+			        "read-only disk!\n");
+	}
+	else if ( myFSSetDedup (disks[id], option == 'O' || option == 'o') > -1 )
+		printf ("\n-- Dedup mode of disk %d is %s.\n", id,
+		        (option == 'O' || option == 'o') ? "on" : "off");
+	else
+		printf ("\n!! Dedup: FAILED. Not a MyFS disk or "
+		        "read-only disk!\n");
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para ligar ou desligar a compressao dos arquivos novos de um
+//disco montado
+void doFSCompress (void) {
+	int id;
+	char option;
+	printf ("\n>> Compression: Disk ID: ");
+	scanf (" %u", &id);
+	if ( id > MAX_CONNECTEDDISKS - 1 || !disks[id]
+	     || (disks[id] != rd && !mountPath[id][0]) ) {
+		printf ("\n!! Compression: FAILED. Disk is not mounted!\n");
+		SLEEP (RESULT_MSGDELAY);
+		return;
+	}
+	printf (">> Compression of new files: [O]n or o[F]f: ");
+	scanf (" %c", &option);
+	if ( myFSSetCompression (disks[id], option == 'O' || option == 'o') > -1 )
+		printf ("\n-- New files on disk %d are %s.\n", id,
+		        (option == 'O' || option == 'o') ? "compressed"
+		                                         : "not compressed");
+	else
+		printf ("\n!! Compression: FAILED. Not a MyFS disk or "
+		        "read-only disk!\n");
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para desfragmentar os arquivos de um disco montado ou so' medir
+//a fragmentacao deles
+void doFSDefrag (void) {
+	int id;
+	char option;
+	MyFSDefragReport r;
+	printf ("\n>> Defrag: Disk ID: ");
+	scanf (" %u", &id);
+	if ( id > MAX_CONNECTEDDISKS - 1 || !disks[id]
+	     || (disks[id] != rd && !mountPath[id][0]) ) {
+		printf ("\n!! Defrag: FAILED. Disk is not mounted!\n");
+		SLEEP (RESULT_MSGDELAY);
+		return;
+	}
+	printf (">> Defrag: [M]easure only or [D]efragment: ");
+	scanf (" %c", &option);
+	printf ("\n-- Working... "); fflush (stdout);
+	int moved = myFSDefrag (disks[id], NULL, option == 'M' || option == 'm', &r);
+	if ( moved > -1 ) {
+		printf ("%d of %u files moved (%u skipped).\n", moved,
+		        r.filesScanned, r.filesSkipped);
+		printf ("-- Extents: %u before, %u after.\n", r.extentsBefore,
+		        r.extentsAfter);
+		printf ("-- Sequential read seeks: %.0f ms before, %.0f ms "
+		        "after.\n", r.readMsBefore, r.readMsAfter);
+	}
+	else
+		printf ("\n!! Defrag: FAILED. Not a MyFS disk or "
+		        "read-only disk!\n");
+	SLEEP (RESULT_MSGDELAY);
+}
+
 //Interface para o menu de selecao de operacoes de gerenciamento de um
 //sistema de arquivos
 void fsMenuSelection (void) {
@@ -650,7 +982,14 @@ void fsMenuSelection (void) {
 			  "     [L]ist supported filesystems\n"
 		          "     [F]ormat a disk (high-level format)\n"
 		          "     [M]ount root filesystem\n"
+		          "     [A]ttach a disk at a mount point\n"
 		          "     [S]how file descriptors in use\n"
+			  "     [D]etach a disk from its mount point\n"
+			  "     [N]ew snapshot of a mounted disk\n"
+			  "     [R]emove a snapshot\n"
+			  "     d[E]duplication of a mounted disk\n"
+			  "     [C]ompression of new files on a mounted disk\n"
+			  "     defra[G]ment a mounted disk\n"
 			  "     [U]mount root filesystem\n"
 		          "     [<]back to MAIN menu\n"
 		          "\n>> Your selection: ", connectedDisks,
@@ -662,6 +1001,13 @@ void fsMenuSelection (void) {
 					    break;
 			case 'F': case 'f': doFSFormat(); break;
 			case 'M': case 'm': doFSMountRoot(); break;
+			case 'A': case 'a': doFSMount(); break;
+			case 'D': case 'd': doFSUnmount(NO_ID); break;
+			case 'N': case 'n': doFSSnapshot(1); break;
+			case 'R': case 'r': doFSSnapshot(0); break;
+			case 'E': case 'e': doFSDedup(); break;
+			case 'C': case 'c': doFSCompress(); break;
+			case 'G': case 'g': doFSDefrag(); break;
 			case 'S': case 's': doFSShowFDs(); break;
 			case 'U': case 'u': doFSUnmountRoot(); break;
 		}
@@ -678,6 +1024,8 @@ void diskMenuSelection (void) {
 		          "     [C]onnect a disk\n"
 			  "     [L]ist connected disks\n"
 			  "     [R]ead/print sector range from a disk\n"
+			  "     [S]tripe disks into a RAID-0 volume\n"
+			  "     [M]irror disks into a RAID-1 volume\n"
 		          "     [D]isconnect a disk\n"
 		          "     [<]back to MAIN menu\n"
 		          "\n>> Your selection: ", connectedDisks,
@@ -689,6 +1037,8 @@ void diskMenuSelection (void) {
 			case 'C': case 'c': doDiskConnect(NULL); break;
 			case 'L': case 'l': doDiskList(); break;
 			case 'R': case 'r': doDiskReadPrintSectors(); break;
+			case 'S': case 's': doDiskVolume(0); break;
+			case 'M': case 'm': doDiskVolume(1); break;
 			case 'D': case 'd': doDiskDisconnect(NO_ID); break;
 		}
 	}
@@ -724,12 +1074,15 @@ int main (int argc, char* argv[]) {
 
 	installMyFS();
 
-	for (int a=0; a<MAX_CONNECTEDDISKS; a++)
+	for (int a=0; a<MAX_CONNECTEDDISKS; a++) {
 		disks[a] = NULL;
-	for (int a=1; a<=MAX_FDS; a++) {
-		fds[a-1].status = 0;
-		fds[a-1].type = 0;
-		strcpy (fds[a-1].path, "");
+		memberOf[a] = NO_ID;
+	}
+	for (int a=0; a<MAX_FDS; a++) {
+		fds[a].status = 0;
+		fds[a].type = 0;
+		fds[a].fd = 0;
+		strcpy (fds[a].path, "");
 	}
 
 	if (argc > 1) 
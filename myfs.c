@@ -8,25 +8,81 @@
 *
 */
 
+#define _GNU_SOURCE // mremap, para instalar de uma vez as páginas mapeadas
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "myfs.h"
 #include "vfs.h"
 #include "inode.h"
 #include "util.h"
 #include "disk.h"
+#include "dcache.h"
+#include "lz.h"
+#include "sha256.h"
 
 //Declaracoes globais
 //...
 //...
 #define MYFS 0x4D794653          // assinatura do nosso SF
-#define MAX_FILENAME_LEN 14                // Comprimento máximo do nome de um arquivo
-#define DIR_ENTRY_SIZE 16                  // Tamanho da entrada de diretório (2+14 bytes)
-#define MAX_OPEN_FILES 20                  // Máximo de arquivos/diretórios abertos
+#define DIR_REC_HEADER 8                   // Cabeçalho da entrada de diretório (4+2+1+1 bytes)
+#define DIR_REC_LEN(name_len) ((DIR_REC_HEADER + (name_len) + 3) & ~3u) // Tamanho minimo alinhado a 4
+#define FD_CHUNK_SIZE 64                   // Entradas acrescentadas à tabela de descritores por vez
+#define FD_MAX_CHUNKS 1024                 // Máximo de blocos da tabela (65536 descritores)
+#define FD_INDEX_BITS 17                   // Bits do descritor com o índice da entrada (+1)
+#define FD_GEN_MASK ((1u << (VFS_FSFD_BITS - FD_INDEX_BITS)) - 1) // Geração: o VFS reserva os bits acima de VFS_FSFD_BITS
 #define ROOT_INODE_NUM 1                   // I-node do diretório raiz (sempre 1)
 #define INODE_TYPE_REGULAR 1               // Tipo de i-node: arquivo regular
 #define INODE_TYPE_DIRECTORY 2             // Tipo de i-node: diretório
+#define DCACHE_ENTRIES 1024                // Capacidade do cache de entradas de diretório
+#define INODE_LOCKS 64                     // Locks de i-node (cada i-node usa o lock numero % INODE_LOCKS)
+#define ALLOC_GROUPS_MAX 8                 // Máximo de grupos de alocação de blocos
+#define ALLOC_GROUP_MIN_BLOCKS 128         // Tamanho mínimo de um grupo de alocação (em blocos)
+#define BITMAP_BLOCKS (512 * 8)            // Blocos cobertos pelo mapa de bits (1 setor)
+#define IO_RUN_MAX 64                      // Máximo de blocos consecutivos por requisição ao disco
+#define MYFS_MAX_MOUNTS 8                  // Máximo de volumes MyFS montados ao mesmo tempo
+#define SNAP_MAX 4                         // Máximo de snapshots por volume
+#define SNAP_MAP_PAIRS 63                  // Pares (setor, cópia) por bloco da lista de cópias
+#define SB_FLAG_SNAPSHOT 1                 // Superbloco de um snapshot: volume somente leitura
+#define REFCOUNT_SECTORS (BITMAP_BLOCKS / 512) // Setores da tabela de referências (1 byte por bloco)
+#define REFCOUNT_MAX 255                   // Máximo de referências extras a um bloco
+#define SB_FLAG_DEDUP 2                    // Modo de deduplicação ligado (myFSSetDedup)
+#define DEDUP_INDEX_ENTRIES 4096           // Entradas do índice de conteúdo dos blocos
+#define DEDUP_LOCKS 16                     // Locks do índice (entrada i usa o lock i % DEDUP_LOCKS)
+#define DEDUP_BATCH 16                     // Blocos deduplicados por gravação da tabela de referências
+#define SB_FLAG_COMPRESS 4                 // Arquivos novos comprimidos (myFSSetCompression)
+#define SB_FLAG_CHECKSUMS 8                // Todos os setores gravados na formatação: toda leitura é conferida
+#define SB_FLAG_BITMAP_STALE 16            // Montado para escrita: o mapa de bits no disco pode estar atrasado
+#define FORMAT_ZERO_RUN 64                 // Setores zerados por requisição na formatação
+#define INODE_FLAG_COMPRESSED 0x200        // Flag do tipo de i-node: dados em grupos comprimidos
+#define COMPRESS_GROUP_BLOCKS 8            // Blocos por grupo comprimido (4 KB)
+#define COMPRESS_GROUP_BYTES (COMPRESS_GROUP_BLOCKS * 512)
+#define COMPRESS_HEADER 2                  // Cabeçalho do grupo comprimido: tamanho dos dados LZ
+#define COMPRESS_HOLE 0xFFFFFFFFu          // Endereço dos blocos que um grupo comprimido dispensa
+#define INODE_TYPE_FLAGS (INODE_FLAG_INLINEDATA | INODE_FLAG_COMPRESSED) // Flags fora do tipo da entrada
+#define FSCK_FREE 0                        // Verificação: i-node livre
+#define FSCK_USED 1                        // Verificação: i-node em uso e válido
+#define FSCK_BAD 2                         // Verificação: i-node inválido (esvaziado no reparo)
+#define FSCK_THREADS_DEFAULT 4             // Threads da verificação quando não indicado
+#define FSCK_THREADS_MAX 32                // Máximo de threads da verificação
+#define FSCK_CHUNK_INODES 256              // I-nodes lidos por requisição na verificação
+#define FSCK_CACHED 1                      // Verificação: setor no cache
+#define FSCK_WANTED 2                      // Verificação: setor a ler na próxima varredura
+#define FSCK_PREFETCH_ROUNDS 5             // Varreduras da leitura antecipada (tabela, 3 níveis de indireção e dados)
+#define DEFRAG_LIST_CHUNK 64               // Entradas acrescentadas por vez à lista de blocos de um arquivo
+#define FORMAT_BYTES_PER_INODE 640         // Padrão de bytes do disco por i-node (10% dos setores para i-nodes)
+#define FORMAT_RESERVED_MAX 50             // Maior porcentagem de blocos reservados
+#define READ_PAGES_MAX (IO_RUN_MAX * 512)  // Maior leitura de myFSReadPages (bytes)
+#define MMAP_MAX 64                        // Máximo de mapeamentos (myFSMmap) ao mesmo tempo
+#define MMAP_ABSENT 0                      // Página mapeada ainda não carregada
+#define MMAP_CLEAN 1                       // Página carregada, igual ao arquivo
+#define MMAP_DIRTY 2                       // Página alterada desde a última gravação
 
 // ================= Estruturas de dados ===============
 
@@ -40,197 +96,3676 @@ typedef struct {
     unsigned int data_start_block;         // Primeiro bloco da área de dados
     unsigned int free_blocks;              // Blocos disponíveis
     unsigned int root_inode;               // I-node do diretório raiz
+    unsigned int flags;                    // SB_FLAG_*
+    unsigned int snap_sb_block[SNAP_MAX];  // Cópia do superbloco de cada snapshot (0 = livre)
+    unsigned int snap_bitmap_block[SNAP_MAX]; // Mapa de bits congelado de cada snapshot
+    unsigned int snap_map_block[SNAP_MAX]; // Primeiro bloco da lista de cópias (0 = vazia)
+    unsigned int refcount_block[REFCOUNT_SECTORS]; // Blocos da tabela de referências (0 = setor todo zerado)
+    unsigned int cg_count;                 // Grupos de cilindros (0 = tabela de i-nodes única)
+    unsigned int cg_sectors;               // Setores de cada grupo (o último leva o resto do disco)
+    unsigned int cg_inode_blocks;          // Setores de i-nodes no início de cada grupo
+    unsigned int bytes_per_inode;          // Densidade de i-nodes pedida na formatação (0 = volume antigo)
+    unsigned int reserved_blocks;          // Blocos livres que os dados de arquivos não podem ocupar
+    unsigned int journal_start;            // Primeiro bloco da área do diário
+    unsigned int journal_blocks;           // Blocos da área do diário (0 = sem diário)
 } superblock_t;
 
-// Entrada de diretório (16 bytes: 2 + 14)
+// Entrada de diretório de tamanho variável (formato em disco, como no ext2):
+//   bytes 0-3: número do i-node (0 = entrada livre)
+//   bytes 4-5: tamanho do registro (rec_len), até a próxima entrada
+//   byte  6  : comprimento do nome (name_len)
+//   byte  7  : tipo do i-node da entrada (INODE_TYPE_*)
+//   bytes 8- : nome, sem '\0'
+// Os registros de um bloco sempre cobrem o bloco inteiro.
 typedef struct {
-    unsigned short inode_number;           // Número do i-node (2 bytes)
-    char filename[MAX_FILENAME_LEN];       // Nome do arquivo (14 bytes)
+    unsigned int inode_number;             // Número do i-node
+    unsigned int rec_len;                  // Tamanho do registro em bytes
+    unsigned int name_len;                 // Comprimento do nome
+    unsigned int type;                     // Tipo do i-node da entrada
+    const char *name;                      // Nome (aponta para o bloco)
 } dir_entry_t;
 
+// Grupo de alocação: faixa contígua da área de dados, com lock, contador
+// de blocos livres e ponto de partida da busca próprios
+typedef struct {
+    pthread_mutex_t lock;                  // Protege free_count, hint e os bits da faixa
+    unsigned int first_block;              // Primeiro bloco do grupo
+    unsigned int end_block;                // Bloco seguinte ao último do grupo
+    unsigned int free_count;               // Blocos livres no grupo
+    unsigned int hint;                     // Bloco onde a próxima busca começa
+} alloc_group_t;
+
+// Snapshot: o volume como estava num instante, somente leitura. Os setores
+// em uso naquele instante (metadados e blocos marcados no mapa de bits
+// congelado) são copiados para blocos novos antes da primeira escrita sobre
+// eles; a lista de cópias (pares setor -> cópia) fica em blocos encadeados
+typedef struct {
+    Disk *disk;                            // Disco do volume
+    unsigned int limit;                    // Setores cobertos (tamanho de copy_of)
+    unsigned char frozen[512];             // Mapa de bits congelado
+    atomic_uint *copy_of;                  // Cópia de cada setor (0 = ainda no lugar original)
+    unsigned int map_tail;                 // Último bloco da lista de cópias (0 = nenhum)
+    unsigned int map_tail_count;           // Pares no último bloco
+    Disk *view;                            // Visão aberta por myFSSnapshotOpen (NULL = nenhuma)
+} snapshot_t;
+
+// Entrada do índice de deduplicação: um bloco de dados e o resumo SHA-256
+// do seu conteúdo, que não muda enquanto o bloco estiver no índice
+typedef struct {
+    unsigned char digest[SHA256_DIGEST_SIZE]; // Resumo do conteúdo
+    unsigned int block;                    // Bloco indexado (0 = entrada livre)
+} dedup_entry_t;
+
+// Volume montado: tudo o que o MyFS mantém em memória sobre um disco. Cada
+// disco montado tem o seu, então vários volumes podem estar montados e ser
+// usados em paralelo
+typedef struct {
+    Disk *disk;                            // Disco do volume
+    superblock_t sb;                       // Cópia do superbloco em memória
+    unsigned char *block_bitmap;           // Mapa de bits (1 bit por bloco)
+    DCache *dentry_cache;                  // Cache (diretório pai, nome) -> i-node
+    alloc_group_t alloc_groups[ALLOC_GROUPS_MAX]; // Grupos de alocação da área de dados
+    unsigned int num_alloc_groups;         // Grupos em uso (0 = sem sistema carregado)
+    atomic_uint free_total;                // Soma dos free_count dos grupos
+    atomic_uint bitmap_version;            // Alterações feitas no mapa de bits
+    unsigned int bitmap_saved_version;     // Última versão gravada (sob bitmap_io_lock)
+    atomic_uint open_count;                // Descritores abertos no volume
+    pthread_rwlock_t inode_locks[INODE_LOCKS]; // Leitores/escritor por i-node
+    pthread_mutex_t bitmap_io_lock;        // Gravação do mapa de bits
+    pthread_mutex_t inode_alloc_lock;      // Busca/criação de i-nodes
+    pthread_mutex_t sb_lock;               // Registros de snapshots e gravação do superbloco
+    int read_only;                         // Volume montado a partir de um snapshot
+    snapshot_t *snaps[SNAP_MAX];           // Snapshots do volume (NULL = livre)
+    atomic_uint snap_count;                // Snapshots existentes (0 = escritas sem verificação)
+    unsigned char snap_held[512];          // União dos mapas congelados: blocos que o alocador evita
+    unsigned char snap_owned[512];         // Blocos com dados dos snapshots (cópias e listas)
+    pthread_rwlock_t snap_lock;            // Escritas no disco (leitura) x criação/remoção (escrita)
+    pthread_mutex_t snap_copy_lock;        // Cópia de setores e listas de cópias
+    pthread_mutex_t snap_admin_lock;       // Criação, remoção e visões de snapshots
+    unsigned char *refcount;               // Referências extras a cada bloco de dados (0 = um só dono)
+    pthread_mutex_t refcount_lock;         // Alterações e gravação da tabela de referências
+    unsigned char ref_dirty[REFCOUNT_SECTORS]; // Setores da tabela alterados e ainda não gravados
+    atomic_int dedup_enabled;              // Modo de deduplicação (cópia de SB_FLAG_DEDUP)
+    dedup_entry_t *dedup_index;            // Índice conteúdo -> bloco (só em memória)
+    pthread_mutex_t dedup_locks[DEDUP_LOCKS]; // Locks das entradas do índice
+    atomic_int compress_enabled;           // Arquivos novos comprimidos (cópia de SB_FLAG_COMPRESS)
+    atomic_uint cg_dir_next;               // Grupo de cilindros por onde começa a escolha do próximo diretório
+    int verify_all;                        // Ligou diskSetVerifyAll (SB_FLAG_CHECKSUMS); desligado em mount_destroy
+    Disk *check_view;                      // Visão de leitura de myFSCheck sobre o volume (NULL = nenhuma)
+} myfs_mount_t;
+
+// Verificação de um volume desmontado (myFSCheck). As contagens por i-node
+// e por bloco são preenchidas pelas threads que percorrem a tabela de i-nodes
+typedef struct {
+    myfs_mount_t *m;                       // Superbloco, mapa de bits e tabela de referências lidos do disco
+    int repair;                            // Corrige os problemas encontrados
+    unsigned int threads;                  // Threads por passagem
+    unsigned int limit;                    // Blocos cobertos pelo mapa de bits
+    unsigned char *state;                  // FSCK_* de cada i-node (índice = número)
+    unsigned char *type;                   // Tipo (sem flags) de cada i-node em uso
+    atomic_uint *links;                    // Entradas de diretório que apontam para cada i-node
+    atomic_uint *data_uses;                // Referências de arquivos a cada bloco
+    atomic_uint *meta_uses;                // Usos de cada bloco como metadado (indireção, tabelas, snapshots)
+    Disk *view;                            // Visão lida pelas passagens, atendida pelo cache
+    unsigned char *cache;                  // Setores lidos antecipadamente (índice = setor)
+    unsigned char *cached;                 // 0, FSCK_CACHED ou FSCK_WANTED para cada setor do cache
+    unsigned int cache_sectors;            // Setores cobertos pelo cache
+    int collecting;                        // Leitura antecipada: setores fora do cache são anotados
+} fsck_t;
+
+// Faixa [first, end) da tabela de i-nodes percorrida por uma thread da verificação
+typedef struct {
+    fsck_t *c;                             // Verificação em andamento
+    unsigned int first;                    // Primeiro i-node da faixa
+    unsigned int end;                      // I-node seguinte ao último da faixa
+    void (*fn)(fsck_t *c, unsigned int inum, Inode *inode, MyFSCheckReport *r); // Passagem
+    MyFSCheckReport report;                // Problemas encontrados pela thread
+} fsck_range_t;
+
+// Argumento das funções chamadas por inodeWalkBlocks na verificação
+typedef struct {
+    fsck_t *c;                             // Verificação em andamento
+    unsigned int inum;                     // I-node percorrido
+    int compressed;                        // Arquivo comprimido: COMPRESS_HOLE é um endereço válido
+    unsigned int bad;                      // Endereços inválidos encontrados
+    MyFSCheckReport *r;                    // Problemas da thread
+    int directory;                         // Leitura antecipada: os blocos de dados também são lidos
+} fsck_walk_t;
+
+// Blocos de um arquivo na desfragmentação, na ordem de inodeWalkBlocks
+// (buracos de fora), e a faixa contígua para onde eles vão
+typedef struct {
+    myfs_mount_t *m;                       // Volume do arquivo
+    unsigned int *blocks;                  // Endereço de cada bloco
+    unsigned char *levels;                 // Nível de cada bloco (0 = dados, 1 a 3 = indireção)
+    unsigned int count;                    // Blocos na lista
+    unsigned int cap;                      // Capacidade de blocks e levels
+    int shared;                            // Algum bloco compartilhado com outro arquivo
+    int failed;                            // Falta de memória ao montar a lista
+    unsigned int run;                      // Primeiro bloco da faixa nova
+    unsigned int next;                     // Blocos da faixa já entregues a inodeRelocate
+} defrag_list_t;
+
+// Páginas entregues por myFSReadPages: os setores lidos do disco, a partir
+// do bloco (ou grupo comprimido) onde a leitura começa, que ficam fixados
+// até myFSReleasePages
+struct MyFSPages {
+    unsigned int size;                     // Bytes de data
+    unsigned char data[];                  // Setores lidos, na ordem do arquivo
+};
+
+// Cursor sobre o vetor de trechos (iovec) de uma leitura ou escrita
+typedef struct {
+    const struct iovec *iov;               // Trechos do chamador
+    int iovcnt;                            // Número de trechos
+    int index;                             // Trecho atual
+    size_t offset;                         // Bytes já usados do trecho atual
+} iov_cursor_t;
+
+// Trecho de arquivo mapeado em memória por myFSMmap
+typedef struct {
+    unsigned char *base;                   // Início da região (alinhado à página)
+    size_t length;                         // Tamanho da região (páginas inteiras)
+    size_t page_size;                      // Tamanho da página do sistema
+    unsigned int offset;                   // Posição no arquivo do início da região
+    int fd;                                // Descritor próprio do arquivo (mantém o volume em uso)
+    int writable;                          // Volume aceita escrita
+    unsigned char *state;                  // MMAP_* de cada página
+    pthread_mutex_t lock;                  // Carga e gravação das páginas
+} mmap_t;
+
+// Falta de página de um mapeamento, atendida pelo paginador (mmap_pager_loop)
+typedef struct mmap_req {
+    mmap_t *mp;                            // Mapeamento da página
+    size_t page;                           // Página tocada
+    int handled;                           // Resultado de mmap_service
+    sem_t done;                            // Sinalizado pelo paginador ao terminar
+    struct mmap_req *next;                 // Próximo pedido pendente
+} mmap_req_t;
+
 // Controle de arquivo/diretório aberto
 typedef struct {
-    int is_used;                           // 1=aberto, 0=fechado
+    atomic_uint state;                     // (geração << 1) | 1 se aberto, 0 no bit 0 se livre
+    atomic_uint next_free;                 // Próxima entrada livre (índice + 1, 0 = fim da lista)
+    myfs_mount_t *mnt;                     // Volume do arquivo
     unsigned int inode_number;             // I-node associado
     unsigned int current_position;         // Posição no arquivo (cursor)
     int is_directory;                      // 1=diretorio, 0=arquivo
-    unsigned int dir_read_position;        // Posição na leitura do diretório
+    unsigned int dir_read_position;        // Posição (em bytes) na leitura do diretório
 } open_file_t;
 
-// ================= Variáveis globais ===============
+// ================= Variáveis globais ===============
+
+static _Atomic(myfs_mount_t *) mounts[MYFS_MAX_MOUNTS]; // Volumes montados (NULL = livre)
+static pthread_mutex_t mounts_lock = PTHREAD_MUTEX_INITIALIZER; // Inclusão/retirada em mounts
+static atomic_uint next_thread_ticket;     // Distribui as threads entre os grupos
+static _Thread_local int thread_ticket = -1; // Ticket da thread (-1 = ainda sem ticket)
+static _Thread_local int snap_copying;     // 1 = thread copiando setores para um snapshot
+static _Thread_local unsigned int alloc_goal; // I-node alterado pela thread, cujo grupo recebe os blocos (0 = nenhum)
+
+// ================= Sincronização ===============
+// Ordem de aquisição: lock de i-node -> inode_alloc_lock -> lock de grupo
+// de alocação -> bitmap_io_lock, todos do mesmo volume. Nenhuma operação
+// segura dois locks de i-node, nem dois locks de grupo, ao mesmo tempo.
+// Snapshots: snap_admin_lock -> snap_lock -> snap_copy_lock -> sb_lock ->
+// locks do alocador. refcount_lock vem depois do lock de i-node e antes de
+// sb_lock e dos locks do alocador. Um lock do índice de deduplicação vem
+// depois do lock de i-node e antes de refcount_lock. Escritas no disco fora dos setores 0 e 1 obtêm
+// snap_lock para leitura (snap_write_hook) com, no máximo, um lock de
+// i-node ou snap_admin_lock.
+
+// Obtém o lock de leitura (compartilhado) do i-node inum do volume m
+static void inode_rdlock(myfs_mount_t *m, unsigned int inum) {
+    pthread_rwlock_rdlock(&m->inode_locks[inum % INODE_LOCKS]);
+}
+
+// Obtém o lock de escrita (exclusivo) do i-node inum do volume m. Os blocos
+// alocados pela thread até a liberação do lock são do i-node, então a busca
+// começa no grupo de cilindros dele (alloc_goal)
+static void inode_wrlock(myfs_mount_t *m, unsigned int inum) {
+    pthread_rwlock_wrlock(&m->inode_locks[inum % INODE_LOCKS]);
+    alloc_goal = inum;
+}
+
+// Libera o lock do i-node inum do volume m
+static void inode_unlock(myfs_mount_t *m, unsigned int inum) {
+    alloc_goal = 0;
+    pthread_rwlock_unlock(&m->inode_locks[inum % INODE_LOCKS]);
+}
+
+// ================= Volumes montados ===============
+
+// Retorna o volume montado sobre o disco d ou NULL se d não estiver montado
+static myfs_mount_t *mount_of(Disk *d) {
+    for (int i = 0; i < MYFS_MAX_MOUNTS; i++) {
+        myfs_mount_t *m = atomic_load_explicit(&mounts[i], memory_order_acquire);
+        if (m && (m->disk == d || (m->check_view != NULL && m->check_view == d))) return m;
+    }
+    return NULL;
+}
+
+// Cria o contexto (ainda não publicado em mounts) de um volume sobre o disco d
+// Retorna o contexto ou NULL se não houver memória
+static myfs_mount_t *mount_create(Disk *d) {
+    myfs_mount_t *m = calloc(1, sizeof(myfs_mount_t));
+    if (!m) return NULL;
+    m->dentry_cache = dcacheCreate(DCACHE_ENTRIES);
+    m->refcount = calloc(BITMAP_BLOCKS, 1);
+    m->dedup_index = calloc(DEDUP_INDEX_ENTRIES, sizeof(dedup_entry_t));
+    if (!m->dentry_cache || !m->refcount || !m->dedup_index) {
+        if (m->dentry_cache) dcacheDestroy(m->dentry_cache);
+        free(m->refcount);
+        free(m->dedup_index);
+        free(m);
+        return NULL;
+    }
+    m->disk = d;
+    for (int i = 0; i < INODE_LOCKS; i++)
+        pthread_rwlock_init(&m->inode_locks[i], NULL);
+    for (int g = 0; g < ALLOC_GROUPS_MAX; g++)
+        pthread_mutex_init(&m->alloc_groups[g].lock, NULL);
+    pthread_mutex_init(&m->bitmap_io_lock, NULL);
+    pthread_mutex_init(&m->inode_alloc_lock, NULL);
+    pthread_mutex_init(&m->sb_lock, NULL);
+    pthread_rwlock_init(&m->snap_lock, NULL);
+    pthread_mutex_init(&m->snap_copy_lock, NULL);
+    pthread_mutex_init(&m->snap_admin_lock, NULL);
+    pthread_mutex_init(&m->refcount_lock, NULL);
+    for (int i = 0; i < DEDUP_LOCKS; i++)
+        pthread_mutex_init(&m->dedup_locks[i], NULL);
+    return m;
+}
+
+// Libera o contexto de um volume (já retirado de mounts)
+static void mount_destroy(myfs_mount_t *m) {
+    if (m->verify_all) diskSetVerifyAll(m->disk, 0);
+    for (int i = 0; i < INODE_LOCKS; i++)
+        pthread_rwlock_destroy(&m->inode_locks[i]);
+    for (int g = 0; g < ALLOC_GROUPS_MAX; g++)
+        pthread_mutex_destroy(&m->alloc_groups[g].lock);
+    pthread_mutex_destroy(&m->bitmap_io_lock);
+    pthread_mutex_destroy(&m->inode_alloc_lock);
+    pthread_mutex_destroy(&m->sb_lock);
+    pthread_rwlock_destroy(&m->snap_lock);
+    pthread_mutex_destroy(&m->snap_copy_lock);
+    pthread_mutex_destroy(&m->snap_admin_lock);
+    pthread_mutex_destroy(&m->refcount_lock);
+    for (int i = 0; i < DEDUP_LOCKS; i++)
+        pthread_mutex_destroy(&m->dedup_locks[i]);
+    for (int k = 0; k < SNAP_MAX; k++) {
+        if (!m->snaps[k]) continue;
+        free(m->snaps[k]->copy_of);
+        free(m->snaps[k]);
+    }
+    dcacheDestroy(m->dentry_cache);
+    free(m->block_bitmap);
+    free(m->refcount);
+    free(m->dedup_index);
+    free(m);
+}
+
+// Publica o volume m em mounts
+// Retorna 0 em caso de sucesso ou -1 se o disco já estiver montado ou a
+// tabela estiver cheia
+static int mount_attach(myfs_mount_t *m) {
+    int ret = -1;
+    pthread_mutex_lock(&mounts_lock);
+    if (!mount_of(m->disk)) {
+        for (int i = 0; i < MYFS_MAX_MOUNTS && ret < 0; i++) {
+            if (atomic_load(&mounts[i])) continue;
+            atomic_store_explicit(&mounts[i], m, memory_order_release);
+            ret = 0;
+        }
+    }
+    pthread_mutex_unlock(&mounts_lock);
+    return ret;
+}
+
+// Retira o volume m de mounts
+static void mount_detach(myfs_mount_t *m) {
+    pthread_mutex_lock(&mounts_lock);
+    for (int i = 0; i < MYFS_MAX_MOUNTS; i++)
+        if (atomic_load(&mounts[i]) == m) atomic_store(&mounts[i], NULL);
+    pthread_mutex_unlock(&mounts_lock);
+}
+
+// ================= Tabela de descritores ===============
+// A tabela cresce em blocos de FD_CHUNK_SIZE entradas, que nunca são
+// liberados nem movidos. As entradas livres formam uma pilha sem locks
+// (Treiber), cujo topo leva um contador de versão contra o problema ABA.
+// O descritor entregue ao usuário é (geração << FD_INDEX_BITS) | (índice + 1);
+// a geração muda a cada fechamento, então um descritor antigo não alcança
+// o arquivo que reaproveitou a entrada.
+
+static _Atomic(open_file_t *) fd_chunks[FD_MAX_CHUNKS]; // Blocos da tabela
+static atomic_uint fd_num_chunks;          // Blocos já reservados
+static atomic_ullong fd_free_top;          // (versão << 32) | (índice + 1) do topo; 0 = vazia
+
+// Retorna a entrada de índice slot ou NULL se seu bloco não existir
+static open_file_t *fd_slot(unsigned int slot) {
+    if (slot >= FD_MAX_CHUNKS * FD_CHUNK_SIZE) return NULL;
+    open_file_t *chunk = atomic_load_explicit(&fd_chunks[slot / FD_CHUNK_SIZE],
+                                              memory_order_acquire);
+    return chunk ? &chunk[slot % FD_CHUNK_SIZE] : NULL;
+}
+
+// Empilha na lista livre a cadeia que começa na entrada first e termina
+// em last (as entradas intermediárias já estão ligadas por next_free)
+static void fd_push_free(unsigned int first, open_file_t *last) {
+    unsigned long long top = atomic_load(&fd_free_top), new_top;
+    do {
+        atomic_store_explicit(&last->next_free, (unsigned int)top, memory_order_relaxed);
+        new_top = (((top >> 32) + 1) << 32) | (first + 1);
+    } while (!atomic_compare_exchange_weak(&fd_free_top, &top, new_top));
+}
+
+// Desempilha uma entrada livre
+// Retorna seu índice ou -1 se a lista estiver vazia
+static int fd_pop_free(void) {
+    unsigned long long top = atomic_load(&fd_free_top), new_top;
+    do {
+        unsigned int first = (unsigned int)top;
+        if (first == 0) return -1;
+        unsigned int next = atomic_load(&fd_slot(first - 1)->next_free);
+        new_top = (((top >> 32) + 1) << 32) | next;
+    } while (!atomic_compare_exchange_weak(&fd_free_top, &top, new_top));
+    return (int)(unsigned int)top - 1;
+}
+
+// Acrescenta um bloco à tabela. A primeira entrada fica com quem chamou
+// e as demais vão para a lista livre. O bloco é alocado antes de o contador
+// avançar, para que uma falha de memória não deixe um índice sem bloco
+// Retorna o índice da entrada reservada ou -1 se a tabela estiver no máximo
+// ou não houver memória
+static int fd_grow(void) {
+    open_file_t *chunk = calloc(FD_CHUNK_SIZE, sizeof(open_file_t));
+    if (!chunk) return -1;
+    unsigned int c = atomic_load(&fd_num_chunks);
+    do {
+        if (c >= FD_MAX_CHUNKS) {
+            free(chunk);
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(&fd_num_chunks, &c, c + 1));
+
+    unsigned int base = c * FD_CHUNK_SIZE;
+    for (unsigned int i = 1; i + 1 < FD_CHUNK_SIZE; i++)
+        atomic_init(&chunk[i].next_free, base + i + 2);
+    atomic_store_explicit(&fd_chunks[c], chunk, memory_order_release);
+    fd_push_free(base + 1, &chunk[FD_CHUNK_SIZE - 1]);
+    return (int)base;
+}
+
+// Reserva uma entrada na tabela, já preenchida com o volume, o i-node e o
+// tipo (arquivo/diretório) informados
+// Retorna o descritor (> 0) ou -1 se não houver entradas
+static int alloc_fd(myfs_mount_t *m, unsigned int inode_number, int is_directory) {
+    int slot = fd_pop_free();
+    if (slot < 0) slot = fd_grow();
+    if (slot < 0) return -1;
+
+    open_file_t *of = fd_slot(slot);
+    of->mnt = m;
+    of->inode_number = inode_number;
+    of->current_position = 0;
+    of->is_directory = is_directory;
+    of->dir_read_position = 0;
+
+    // Publica a entrada só depois de preenchida
+    unsigned int gen = atomic_load(&of->state) >> 1;
+    atomic_store_explicit(&of->state, (gen << 1) | 1, memory_order_release);
+    atomic_fetch_add(&m->open_count, 1);
+    return (int)((gen << FD_INDEX_BITS) | (slot + 1));
+}
+
+// Retorna a entrada do descritor fd ou NULL se fd for inválido, estiver
+// fechado ou pertencer a uma geração anterior da entrada
+static open_file_t *fd_get(int fd) {
+    if (fd <= 0) return NULL;
+    unsigned int slot = ((unsigned int)fd & ((1u << FD_INDEX_BITS) - 1)) - 1;
+    unsigned int gen = (unsigned int)fd >> FD_INDEX_BITS;
+    open_file_t *of = fd_slot(slot);
+    if (!of || atomic_load_explicit(&of->state, memory_order_acquire) != ((gen << 1) | 1))
+        return NULL;
+    return of;
+}
+
+// Fecha o descritor fd, avançando a geração da entrada e devolvendo-a à
+// lista livre
+// Retorna 0 em caso de sucesso ou -1 se fd não estiver aberto
+static int free_fd(int fd) {
+    open_file_t *of = fd_get(fd);
+    if (!of) return -1;
+    unsigned int gen = (unsigned int)fd >> FD_INDEX_BITS;
+    unsigned int expected = (gen << 1) | 1;
+    myfs_mount_t *m = of->mnt;
+    // Só um fechamento concorrente do mesmo descritor vence
+    if (!atomic_compare_exchange_strong(&of->state, &expected, ((gen + 1) & FD_GEN_MASK) << 1))
+        return -1;
+    atomic_fetch_sub(&m->open_count, 1);
+    fd_push_free(((unsigned int)fd & ((1u << FD_INDEX_BITS) - 1)) - 1, of);
+    return 0;
+}
+
+// ================= Funções auxiliares ===============
+
+// Retorna o total de blocos livres dos grupos de alocação, mantido junto
+// com o contador de cada grupo, sem passar pelos locks dos grupos
+static unsigned int count_free_blocks(myfs_mount_t *m) {
+    return atomic_load(&m->free_total);
+}
+
+// Codifica o superbloco em memória (m->sb) em buf, com free_blocks blocos
+// livres. Sem with_snaps, os registros de snapshots ficam vazios
+static void sb_encode(myfs_mount_t *m, unsigned char *buf, unsigned int free_blocks, int with_snaps) {
+    memset(buf, 0, 512);
+    unsigned int buffer_pos = 0;
+    ul2char(m->sb.magic_number, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(m->sb.block_size, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(m->sb.total_blocks, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(m->sb.inode_start_block, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(m->sb.inode_count, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(m->sb.data_start_block, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(free_blocks, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(m->sb.root_inode, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(m->sb.flags, &buf[buffer_pos]); buffer_pos += 4;
+    for (int k = 0; with_snaps && k < SNAP_MAX; k++) {
+        ul2char(m->sb.snap_sb_block[k], &buf[buffer_pos + 12 * k]);
+        ul2char(m->sb.snap_bitmap_block[k], &buf[buffer_pos + 12 * k + 4]);
+        ul2char(m->sb.snap_map_block[k], &buf[buffer_pos + 12 * k + 8]);
+    }
+    buffer_pos += 12 * SNAP_MAX;
+    for (int i = 0; i < REFCOUNT_SECTORS; i++)
+        ul2char(m->sb.refcount_block[i], &buf[buffer_pos + 4 * i]);
+    buffer_pos += 4 * REFCOUNT_SECTORS;
+    ul2char(m->sb.cg_count, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(m->sb.cg_sectors, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(m->sb.cg_inode_blocks, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(m->sb.bytes_per_inode, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(m->sb.reserved_blocks, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(m->sb.journal_start, &buf[buffer_pos]); buffer_pos += 4;
+    ul2char(m->sb.journal_blocks, &buf[buffer_pos]);
+}
+
+// Decodifica em m->sb o superbloco lido em buf (o inverso de sb_encode)
+static void sb_decode(myfs_mount_t *m, unsigned char *buf) {
+    unsigned int pos = 0;
+    char2ul(&buf[pos], &m->sb.magic_number); pos += 4;
+    char2ul(&buf[pos], &m->sb.block_size); pos += 4;
+    char2ul(&buf[pos], &m->sb.total_blocks); pos += 4;
+    char2ul(&buf[pos], &m->sb.inode_start_block); pos += 4;
+    char2ul(&buf[pos], &m->sb.inode_count); pos += 4;
+    char2ul(&buf[pos], &m->sb.data_start_block); pos += 4;
+    char2ul(&buf[pos], &m->sb.free_blocks); pos += 4;
+    char2ul(&buf[pos], &m->sb.root_inode); pos += 4;
+    char2ul(&buf[pos], &m->sb.flags); pos += 4;
+    for (int k = 0; k < SNAP_MAX; k++) {
+        char2ul(&buf[pos + 12 * k], &m->sb.snap_sb_block[k]);
+        char2ul(&buf[pos + 12 * k + 4], &m->sb.snap_bitmap_block[k]);
+        char2ul(&buf[pos + 12 * k + 8], &m->sb.snap_map_block[k]);
+    }
+    pos += 12 * SNAP_MAX;
+    for (int i = 0; i < REFCOUNT_SECTORS; i++)
+        char2ul(&buf[pos + 4 * i], &m->sb.refcount_block[i]);
+    pos += 4 * REFCOUNT_SECTORS;
+    char2ul(&buf[pos], &m->sb.cg_count); pos += 4;
+    char2ul(&buf[pos], &m->sb.cg_sectors); pos += 4;
+    char2ul(&buf[pos], &m->sb.cg_inode_blocks); pos += 4;
+    char2ul(&buf[pos], &m->sb.bytes_per_inode); pos += 4;
+    char2ul(&buf[pos], &m->sb.reserved_blocks); pos += 4;
+    char2ul(&buf[pos], &m->sb.journal_start); pos += 4;
+    char2ul(&buf[pos], &m->sb.journal_blocks);
+}
+
+// Grava o superbloco em memória (m->sb) no disco do volume (bloco 0)
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int save_superblock(myfs_mount_t *m) {
+    unsigned char superblock_buffer[512];
+    unsigned int free_blocks = (m->num_alloc_groups > 0 ? count_free_blocks(m) : m->sb.free_blocks);
+
+    pthread_mutex_lock(&m->sb_lock);
+    sb_encode(m, superblock_buffer, free_blocks, 1);
+    int ret = diskWriteSector(m->disk, 0, superblock_buffer);
+    pthread_mutex_unlock(&m->sb_lock);
+    return ret;
+}
+
+// Num volume com SB_FLAG_CHECKSUMS, passa a conferir todas as leituras do
+// disco, inclusive as de setores com o campo ECC de setor nunca escrito (que
+// então só aparece num setor corrompido), e relê o superbloco assim
+// Retorna 0 em caso de sucesso ou -1 se o superbloco não conferir
+static int verify_all_sectors(myfs_mount_t *m) {
+    unsigned char buf[512];
+    if (!(m->sb.flags & SB_FLAG_CHECKSUMS)) return 0;
+    diskSetVerifyAll(m->disk, 1);
+    m->verify_all = 1;
+    return (diskReadSector(m->disk, 0, buf) == 0 ? 0 : -1);
+}
+
+// Bits do mapa são lidos e alterados atomicamente, pois save_bitmap copia
+// o setor inteiro enquanto outros grupos alteram seus próprios bytes
+static int bitmap_test(myfs_mount_t *m, unsigned int block_num) {
+    return __atomic_load_n(&m->block_bitmap[block_num / 8], __ATOMIC_RELAXED) & (1 << (block_num % 8));
+}
+
+static void bitmap_set(myfs_mount_t *m, unsigned int block_num) {
+    __atomic_fetch_or(&m->block_bitmap[block_num / 8], (unsigned char)(1 << (block_num % 8)), __ATOMIC_RELAXED);
+    atomic_fetch_add(&m->bitmap_version, 1);
+}
+
+static void bitmap_clear(myfs_mount_t *m, unsigned int block_num) {
+    __atomic_fetch_and(&m->block_bitmap[block_num / 8], (unsigned char)~(1 << (block_num % 8)), __ATOMIC_RELAXED);
+    atomic_fetch_add(&m->bitmap_version, 1);
+}
+
+// Mapas de 512 bytes dos snapshots (snap_held e snap_owned), alterados
+// atomicamente como o mapa de bits
+static int map_test(unsigned char *map, unsigned int block_num) {
+    return __atomic_load_n(&map[block_num / 8], __ATOMIC_RELAXED) & (1 << (block_num % 8));
+}
+
+static void map_set(unsigned char *map, unsigned int block_num) {
+    __atomic_fetch_or(&map[block_num / 8], (unsigned char)(1 << (block_num % 8)), __ATOMIC_RELAXED);
+}
+
+static void map_clear(unsigned char *map, unsigned int block_num) {
+    __atomic_fetch_and(&map[block_num / 8], (unsigned char)~(1 << (block_num % 8)), __ATOMIC_RELAXED);
+}
+
+// Grava o mapa de bits em memória no disco (bloco 1). Uma gravação leva
+// as alterações de todas as threads feitas até a cópia; quem chega depois
+// de uma gravação que já inclui sua alteração não regrava o setor. Alocar e
+// liberar blocos só altera a memória: o mapa vai ao disco em myFSSync e na
+// desmontagem, e SB_FLAG_BITMAP_STALE no superbloco avisa a montagem
+// seguinte quando ele pode não ter as últimas alterações
+static int save_bitmap(myfs_mount_t *m) {
+    unsigned int my_version = atomic_load(&m->bitmap_version);
+    int ret = 0;
+
+    pthread_mutex_lock(&m->bitmap_io_lock);
+    if ((int)(my_version - m->bitmap_saved_version) > 0) {
+        unsigned char block_buffer[512];
+        unsigned int version = atomic_load(&m->bitmap_version);
+        for (int i = 0; i < 512; i++)
+            block_buffer[i] = __atomic_load_n(&m->block_bitmap[i], __ATOMIC_RELAXED);
+        ret = diskWriteSector(m->disk, 1, block_buffer);
+        if (ret == 0) m->bitmap_saved_version = version;
+    }
+    pthread_mutex_unlock(&m->bitmap_io_lock);
+    return ret;
+}
+
+// Retorna o grupo de cilindros do i-node inum ou -1 se o volume tiver uma
+// tabela de i-nodes única
+static int inode_group(myfs_mount_t *m, unsigned int inum) {
+    if (m->sb.cg_count == 0 || inum < 1 || inum > m->sb.inode_count) return -1;
+    return (int)((inum - 1) / (m->sb.cg_inode_blocks * inodeNumInodesPerSector()));
+}
+
+// Retorna o primeiro setor de i-nodes do grupo de cilindros g (no grupo 0,
+// logo depois do superbloco e do mapa de bits)
+static unsigned int group_inode_start(myfs_mount_t *m, unsigned int g) {
+    return (g == 0 ? m->sb.inode_start_block : g * m->sb.cg_sectors);
+}
+
+// Verifica se o bloco block_num guarda metadados fixos do volume: superbloco,
+// mapa de bits, área do diário ou setores de i-nodes de algum grupo
+static int layout_meta(myfs_mount_t *m, unsigned int block_num) {
+    if (block_num < m->sb.data_start_block) return 1;
+    if (block_num - m->sb.journal_start < m->sb.journal_blocks) return 1;
+    if (m->sb.cg_count == 0) return 0;
+    unsigned int g = block_num / m->sb.cg_sectors;
+    return g < m->sb.cg_count && block_num - group_inode_start(m, g) < m->sb.cg_inode_blocks;
+}
+
+// Divide a área de dados em até ALLOC_GROUPS_MAX grupos de alocação e conta
+// os blocos livres de cada um no mapa de bits já carregado. As divisas
+// internas caem em múltiplos de 8, para que dois grupos nunca alterem o
+// mesmo byte do mapa
+static void setup_alloc_groups(myfs_mount_t *m) {
+    unsigned int first = m->sb.data_start_block;
+    unsigned int end = (m->sb.total_blocks < BITMAP_BLOCKS ? m->sb.total_blocks : BITMAP_BLOCKS);
+    if (end < first) end = first;
+
+    unsigned int n = (end - first) / ALLOC_GROUP_MIN_BLOCKS;
+    if (n < 1) n = 1;
+    if (n > ALLOC_GROUPS_MAX) n = ALLOC_GROUPS_MAX;
+    unsigned int span = (end - first) / n, total = 0;
+    // Com grupos de cilindros, cada um é um grupo de alocação (os setores de
+    // i-nodes do início estão marcados no mapa e nunca são entregues)
+    if (m->sb.cg_count > 0) {
+        n = m->sb.cg_count;
+        span = m->sb.cg_sectors;
+    }
+
+    for (unsigned int g = 0; g < n; g++) {
+        alloc_group_t *grp = &m->alloc_groups[g];
+        pthread_mutex_lock(&grp->lock);
+        if (m->sb.cg_count > 0) {
+            grp->first_block = (g == 0 ? first : g * span);
+            grp->end_block = (g == n - 1 ? end : (g + 1) * span);
+        } else {
+            grp->first_block = (g == 0 ? first : (first + g * span + 7) & ~7u);
+            grp->end_block = (g == n - 1 ? end : (first + (g + 1) * span + 7) & ~7u);
+        }
+        if (grp->end_block > end) grp->end_block = end;
+        grp->hint = grp->first_block;
+        grp->free_count = 0;
+        for (unsigned int b = grp->first_block; b < grp->end_block; b++)
+            if (!bitmap_test(m, b)) grp->free_count++;
+        total += grp->free_count;
+        pthread_mutex_unlock(&grp->lock);
+    }
+    atomic_store(&m->free_total, total);
+    m->num_alloc_groups = n;
+    m->bitmap_saved_version = atomic_load(&m->bitmap_version);
+}
+
+// Procura um bloco livre no grupo grp, a partir da dica do grupo, e o
+// marca como ocupado
+// Retorna o número do bloco ou -1 se o grupo estiver cheio
+static int group_alloc(myfs_mount_t *m, alloc_group_t *grp) {
+    int found = -1;
+    pthread_mutex_lock(&grp->lock);
+    unsigned int size = grp->end_block - grp->first_block;
+    if (grp->free_count > 0) {
+        unsigned int start = (grp->hint - grp->first_block) % size;
+        for (unsigned int i = 0; i < size; i++) {
+            unsigned int block_num = grp->first_block + (start + i) % size;
+            // Blocos livres ainda guardados por um snapshot não são usados
+            if (!bitmap_test(m, block_num) && !map_test(m->snap_held, block_num)) {
+                bitmap_set(m, block_num);
+                grp->free_count--;
+                atomic_fetch_sub(&m->free_total, 1);
+                grp->hint = block_num + 1;
+                found = (int)block_num;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&grp->lock);
+    return found;
+}
+
+// Retorna o grupo de alocação por onde as buscas da thread começam: o grupo
+// de cilindros do i-node que ela altera ou, sem ele, o grupo da thread. Num
+// volume sem grupos de cilindros, a tabela de i-nodes fica toda no início do
+// disco e cada bloco anexado também grava o i-node, então os blocos de
+// arquivos começam pelo primeiro grupo, o mais perto da tabela: um grupo por
+// thread poria cada escritor a buscas de ida e volta dela.
+// Deve haver algum grupo (num_alloc_groups maior que 0)
+static unsigned int home_group(myfs_mount_t *m) {
+    int g = inode_group(m, alloc_goal);
+    if (g >= 0 && (unsigned int)g < m->num_alloc_groups) return (unsigned int)g;
+    if (alloc_goal != 0) return 0;
+    if (thread_ticket < 0) thread_ticket = (int)atomic_fetch_add(&next_thread_ticket, 1);
+    return (unsigned int)thread_ticket % m->num_alloc_groups;
+}
+
+// Encontra um bloco livre e o marca como ocupado. A busca começa no grupo
+// dado por home_group (o lock de um grupo só cobre a busca no mapa em
+// memória) e passa aos demais grupos quando ele enche
+// Retorna o número do bloco encontrado ou -1 se não houver blocos livres
+static int find_free_block(myfs_mount_t *m) {
+    if (m->num_alloc_groups == 0) return -1;
+
+    unsigned int home = home_group(m);
+    for (unsigned int i = 0; i < m->num_alloc_groups; i++) {
+        int block_num = group_alloc(m, &m->alloc_groups[(home + i) % m->num_alloc_groups]);
+        if (block_num != -1) return block_num;  // Retorna o número do bloco livre encontrado
+    }
+    return -1;  // Não há blocos livres
+}
+
+// Encontra um bloco livre para dados de arquivos, que não ocupam os blocos
+// reservados na formatação (sb.reserved_blocks): com o volume quase cheio,
+// ainda sobram blocos para diretórios, blocos de indireção e snapshots
+// Retorna o número do bloco ou -1 se só restarem blocos reservados
+static int find_data_block(myfs_mount_t *m) {
+    if (m->sb.reserved_blocks > 0 && count_free_blocks(m) <= m->sb.reserved_blocks) return -1;
+    return find_free_block(m);
+}
+
+// Reserva n blocos livres consecutivos (desfragmentação). A faixa não cruza
+// a divisa de um grupo, então cada grupo é examinado só sob o seu lock,
+// começando pelo grupo da thread; dentro do grupo fica a menor faixa livre
+// que comporta os n blocos, para não partir as maiores
+// Retorna o primeiro bloco da faixa ou -1 se nenhum grupo tiver uma
+static int alloc_run(myfs_mount_t *m, unsigned int n) {
+    if (m->num_alloc_groups == 0 || n == 0) return -1;
+
+    unsigned int home = home_group(m);
+    for (unsigned int i = 0; i < m->num_alloc_groups; i++) {
+        alloc_group_t *grp = &m->alloc_groups[(home + i) % m->num_alloc_groups];
+        unsigned int best_len = 0;
+        int found = -1;
+
+        pthread_mutex_lock(&grp->lock);
+        for (unsigned int b = grp->first_block; b < grp->end_block && grp->free_count >= n;) {
+            // Como em group_alloc, blocos ainda guardados por um snapshot não são usados
+            unsigned int start = b;
+            while (b < grp->end_block && !bitmap_test(m, b) && !map_test(m->snap_held, b)) b++;
+            if (b - start >= n && (found == -1 || b - start < best_len)) {
+                found = (int)start;
+                best_len = b - start;
+            }
+            if (b == start) b++;
+        }
+        if (found != -1) {
+            for (unsigned int k = 0; k < n; k++) bitmap_set(m, (unsigned int)found + k);
+            grp->free_count -= n;
+            atomic_fetch_sub(&m->free_total, n);
+        }
+        pthread_mutex_unlock(&grp->lock);
+        if (found != -1) return found;
+    }
+    return -1;
+}
+
+// Devolve os count blocos de blocks ao mapa de bits, marcando-os como livres
+// nos seus grupos
+static void release_blocks(myfs_mount_t *m, const unsigned int *blocks, unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        for (unsigned int g = 0; g < m->num_alloc_groups; g++) {
+            alloc_group_t *grp = &m->alloc_groups[g];
+            if (blocks[i] < grp->first_block || blocks[i] >= grp->end_block) continue;
+
+            pthread_mutex_lock(&grp->lock);
+            if (bitmap_test(m, blocks[i])) {
+                bitmap_clear(m, blocks[i]);
+                grp->free_count++;
+                atomic_fetch_add(&m->free_total, 1);
+            }
+            pthread_mutex_unlock(&grp->lock);
+            break;
+        }
+    }
+}
+
+// Devolve um bloco ao mapa de bits, marcando-o como livre no seu grupo
+static void release_block(myfs_mount_t *m, unsigned int block_num) {
+    release_blocks(m, &block_num, 1);
+}
+
+// ================= Blocos compartilhados ===============
+// Um clone (myFSClone) usa os mesmos blocos de dados do arquivo original. A
+// tabela de referências guarda, para cada bloco, quantos arquivos além do
+// primeiro o usam (0 = um só dono, o caso comum). Só os setores da tabela
+// com algum bloco compartilhado ocupam blocos do disco. Antes da primeira
+// escrita, um bloco compartilhado é trocado por uma cópia (unshare_block).
+
+// Verifica se o bloco block_num é usado por mais de um arquivo
+static int ref_shared(myfs_mount_t *m, unsigned int block_num) {
+    return block_num < BITMAP_BLOCKS && __atomic_load_n(&m->refcount[block_num], __ATOMIC_RELAXED) != 0;
+}
+
+// Grava o setor da tabela de referências que contém o bloco block_num,
+// reservando-lhe um bloco na primeira gravação. Deve ser chamada com
+// refcount_lock
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int ref_save(myfs_mount_t *m, unsigned int block_num) {
+    unsigned int i = block_num / 512;
+    if (m->sb.refcount_block[i] != 0) {
+        if (diskWriteSector(m->disk, m->sb.refcount_block[i], &m->refcount[512 * i]) < 0) return -1;
+        m->ref_dirty[i] = 0;
+        return 0;
+    }
+
+    int new_block = find_free_block(m);
+    if (new_block == -1) return -1;
+    if (diskWriteSector(m->disk, new_block, &m->refcount[512 * i]) < 0) {
+        release_block(m, new_block);
+        return -1;
+    }
+    m->ref_dirty[i] = 0;
+    pthread_mutex_lock(&m->sb_lock);
+    m->sb.refcount_block[i] = new_block;
+    pthread_mutex_unlock(&m->sb_lock);
+    return save_superblock(m);
+}
+
+// Acrescenta, só em memória, uma referência a cada um dos count blocos de
+// blocks. Os setores alterados ficam marcados em ref_dirty até ref_flush
+// Retorna 0 em caso de sucesso ou -1 se algum bloco já tiver REFCOUNT_MAX
+// referências extras (nada é alterado)
+static int ref_hold(myfs_mount_t *m, const unsigned int *blocks, unsigned int count) {
+    unsigned int done = 0;
+
+    pthread_mutex_lock(&m->refcount_lock);
+    for (; done < count; done++) {
+        unsigned int b = blocks[done];
+        if (b >= BITMAP_BLOCKS || m->refcount[b] == REFCOUNT_MAX) break;
+        __atomic_store_n(&m->refcount[b], m->refcount[b] + 1, __ATOMIC_RELAXED);
+    }
+    if (done < count) {
+        // Desfaz os incrementos
+        while (done > 0) {
+            unsigned int b = blocks[--done];
+            __atomic_store_n(&m->refcount[b], m->refcount[b] - 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&m->refcount_lock);
+        return -1;
+    }
+    for (unsigned int i = 0; i < count; i++) m->ref_dirty[blocks[i] / 512] = 1;
+    pthread_mutex_unlock(&m->refcount_lock);
+    return 0;
+}
+
+// Grava os setores da tabela de referências marcados em ref_dirty
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int ref_flush(myfs_mount_t *m) {
+    int ret = 0;
+    pthread_mutex_lock(&m->refcount_lock);
+    for (int i = 0; i < REFCOUNT_SECTORS && ret == 0; i++)
+        if (m->ref_dirty[i] && ref_save(m, i * 512) < 0) ret = -1;
+    pthread_mutex_unlock(&m->refcount_lock);
+    return ret;
+}
+
+// Acrescenta uma referência a cada um dos count blocos de blocks, que um
+// arquivo novo passa a usar. As referências são gravadas antes de o arquivo
+// novo existir: uma falha no meio só deixa referências a mais
+// Retorna 0 em caso de sucesso ou -1 se algum bloco já tiver REFCOUNT_MAX
+// referências extras (nada é alterado) ou a gravação falhar
+static int ref_get_blocks(myfs_mount_t *m, const unsigned int *blocks, unsigned int count) {
+    if (ref_hold(m, blocks, count) < 0) return -1;
+    return ref_flush(m);
+}
+
+// Retira uma referência ao bloco block_num. Sem referências extras, o bloco
+// tinha um só dono e volta ao mapa de bits
+// Retorna 1 se o bloco foi devolvido ou 0 se ainda tem donos
+static int ref_put(myfs_mount_t *m, unsigned int block_num) {
+    int last = 1;
+    if (block_num < BITMAP_BLOCKS) {
+        pthread_mutex_lock(&m->refcount_lock);
+        if (m->refcount[block_num] > 0) {
+            __atomic_store_n(&m->refcount[block_num], m->refcount[block_num] - 1, __ATOMIC_RELAXED);
+            m->ref_dirty[block_num / 512] = 1;
+            ref_save(m, block_num);
+            last = 0;
+        }
+        pthread_mutex_unlock(&m->refcount_lock);
+    }
+    if (last) release_block(m, block_num);
+    return last;
+}
+
+// ================= Deduplicação ===============
+// No modo de deduplicação (myFSSetDedup), um bloco inteiro escrito com o
+// mesmo conteúdo de um bloco do índice passa a ser uma referência a ele
+// (ver dedup_write_blocks); myFSDedupScan faz o mesmo com os blocos já
+// gravados. O índice fica só em memória e guarda uma referência a cada
+// bloco indexado: assim o bloco é compartilhado e nenhum arquivo o altera
+// no lugar (map_block o troca por uma cópia), então o conteúdo indexado
+// continua válido. Uma entrada substituída devolve sua referência.
+// Os blocos são comparados pelo resumo SHA-256, sem ler o candidato do
+// disco. A referência do índice fica só em memória (o índice se perde numa
+// queda); a de um arquivo vai ao disco antes de o arquivo apontar para o
+// bloco (ver dedup_write_blocks).
+
+// Posição no índice do bloco de resumo digest
+static unsigned int dedup_slot(const unsigned char *digest) {
+    unsigned int v;
+    memcpy(&v, digest, sizeof(v));
+    return v % DEDUP_INDEX_ENTRIES;
+}
+
+// Procura no índice um bloco de resumo digest e acrescenta-lhe, só em
+// memória, uma referência (gravada por ref_flush)
+// Retorna o bloco encontrado ou 0 se não houver
+static unsigned int dedup_lookup(myfs_mount_t *m, const unsigned char *digest) {
+    unsigned int slot = dedup_slot(digest), found = 0;
+    dedup_entry_t *e = &m->dedup_index[slot];
+
+    pthread_mutex_lock(&m->dedup_locks[slot % DEDUP_LOCKS]);
+    if (e->block != 0 && memcmp(e->digest, digest, SHA256_DIGEST_SIZE) == 0 &&
+        ref_hold(m, &e->block, 1) == 0)
+        found = e->block;
+    pthread_mutex_unlock(&m->dedup_locks[slot % DEDUP_LOCKS]);
+    return found;
+}
+
+// Coloca no índice o bloco block_num, de resumo digest, no lugar da entrada
+// que ocupava a mesma posição
+static void dedup_insert(myfs_mount_t *m, const unsigned char *digest, unsigned int block_num) {
+    unsigned int slot = dedup_slot(digest);
+    dedup_entry_t *e = &m->dedup_index[slot];
+
+    pthread_mutex_lock(&m->dedup_locks[slot % DEDUP_LOCKS]);
+    if (e->block != block_num && ref_hold(m, &block_num, 1) == 0) {
+        unsigned int old = e->block;
+        memcpy(e->digest, digest, SHA256_DIGEST_SIZE);
+        e->block = block_num;
+        if (old != 0) ref_put(m, old);
+    }
+    pthread_mutex_unlock(&m->dedup_locks[slot % DEDUP_LOCKS]);
+}
+
+// Esvazia o índice, devolvendo as referências que ele guardava
+static void dedup_clear(myfs_mount_t *m) {
+    for (unsigned int slot = 0; slot < DEDUP_INDEX_ENTRIES; slot++) {
+        dedup_entry_t *e = &m->dedup_index[slot];
+        pthread_mutex_lock(&m->dedup_locks[slot % DEDUP_LOCKS]);
+        if (e->block != 0) ref_put(m, e->block);
+        e->block = 0;
+        pthread_mutex_unlock(&m->dedup_locks[slot % DEDUP_LOCKS]);
+    }
+}
+
+// Adaptador de find_free_block para o alocador de blocos de indirecao dos
+// i-nodes (inodeSetBlockAllocator), que identifica o volume pelo disco e
+// usa 0 para indicar falha
+static unsigned int alloc_inode_block(Disk *d) {
+    myfs_mount_t *m = mount_of(d);
+    int block_num = (m ? find_free_block(m) : -1);
+    return (block_num == -1 ? 0 : (unsigned int)block_num);
+}
+
+// Adaptador de ref_put para inodeSetBlockAllocator: um bloco de dados
+// compartilhado só volta ao mapa de bits com a última referência, e os
+// blocos dispensados de um grupo comprimido (COMPRESS_HOLE) não existem
+static void free_inode_block(Disk *d, unsigned int block_num) {
+    myfs_mount_t *m = mount_of(d);
+    if (m && block_num != COMPRESS_HOLE) ref_put(m, block_num);
+}
+
+// Localiza o setor do i-node number para inodeSetLayout: com grupos de
+// cilindros, cada grupo guarda uma fatia da tabela no seu início
+// Retorna o setor ou 0 se o número não for um i-node do volume
+static unsigned long inode_sector_of(Disk *d, unsigned int number) {
+    unsigned int per_sector = inodeNumInodesPerSector();
+    myfs_mount_t *m = mount_of(d);
+    if (!m) return inodeAreaBeginSector() + (number - 1) / per_sector;
+    if (number < 1 || number > m->sb.inode_count) return 0;
+    if (m->sb.cg_count == 0) return m->sb.inode_start_block + (number - 1) / per_sector;
+
+    unsigned int per_group = m->sb.cg_inode_blocks * per_sector, g = (number - 1) / per_group;
+    return group_inode_start(m, g) + ((number - 1) % per_group) / per_sector;
+}
+
+// Procura um i-node livre para um arquivo novo, como no FFS: um arquivo fica
+// no grupo de cilindros do i-node near (o diretório pai ou o original de um
+// clone) e um diretório, em rodízio, num grupo com pelo menos a média de
+// blocos livres, para espalhar as árvores pelo disco. Deve ser chamada com
+// inode_alloc_lock
+// Retorna o número do i-node ou 0 se não houver i-nodes livres
+static unsigned int find_free_inode(myfs_mount_t *m, unsigned int near, int directory) {
+    int g = inode_group(m, near);
+    unsigned int n = (m->num_alloc_groups < m->sb.cg_count ? m->num_alloc_groups : m->sb.cg_count);
+    if (g >= 0 && directory && n > 0) {
+        unsigned int free_count[ALLOC_GROUPS_MAX], total = 0;
+        for (unsigned int i = 0; i < n; i++) {
+            pthread_mutex_lock(&m->alloc_groups[i].lock);
+            free_count[i] = m->alloc_groups[i].free_count;
+            pthread_mutex_unlock(&m->alloc_groups[i].lock);
+            total += free_count[i];
+        }
+        unsigned int first = atomic_load(&m->cg_dir_next) % n;
+        for (unsigned int i = 0; i < n; i++) {
+            g = (int)((first + i) % n);
+            if (free_count[g] * n >= total) break;
+        }
+        atomic_store(&m->cg_dir_next, (unsigned int)g + 1);
+    }
+    unsigned int start = (g > 0 ? (unsigned int)g * m->sb.cg_inode_blocks * inodeNumInodesPerSector() + 1 : 1);
+    unsigned int inumber = inodeFindFreeInode(start, m->disk);
+    if (inumber == 0 && start > 1) inumber = inodeFindFreeInode(1, m->disk);
+    return inumber;
+}
+
+// ================= Snapshots ===============
+// Um snapshot congela o volume sem copiar nada na criação: guarda o mapa de
+// bits e o superbloco daquele instante e, a partir daí, cada setor ainda
+// compartilhado com o volume (metadados ou bloco marcado no mapa congelado)
+// é copiado para um bloco novo antes de ser sobrescrito (snap_write_hook).
+// A visão de um snapshot (myFSSnapshotOpen) lê as cópias e, para os setores
+// ainda não copiados, o lugar original.
+
+// Reserva um bloco para dados de snapshots (cópia ou lista de cópias)
+// Retorna o número do bloco ou -1 se não houver blocos livres
+static int snap_alloc_block(myfs_mount_t *m) {
+    int block_num = find_free_block(m);
+    if (block_num != -1) map_set(m->snap_owned, block_num);
+    return block_num;
+}
+
+// Devolve um bloco de dados de snapshots ao mapa de bits
+static void snap_release_block(myfs_mount_t *m, unsigned int block_num) {
+    map_clear(m->snap_owned, block_num);
+    release_block(m, block_num);
+}
+
+// Verifica se o setor s ainda é compartilhado entre o volume e o snapshot sn,
+// isto é, se precisa ser copiado antes de ser sobrescrito
+static int snap_holds(myfs_mount_t *m, snapshot_t *sn, unsigned long s) {
+    if (s >= sn->limit || atomic_load_explicit(&sn->copy_of[s], memory_order_acquire) != 0)
+        return 0;
+    return layout_meta(m, s) || (sn->frozen[s / 8] & (1 << (s % 8)));
+}
+
+// Acrescenta o par (setor s -> cópia copy) à lista de cópias do snapshot de
+// posição k. Um bloco novo da lista só é ligado ao anterior (ou ao registro
+// do superbloco) depois de gravado. Deve ser chamada com snap_copy_lock
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int snap_map_append(myfs_mount_t *m, int k, unsigned int s, unsigned int copy) {
+    snapshot_t *sn = m->snaps[k];
+    unsigned char block_buf[512];
+    unsigned int target = sn->map_tail;
+
+    if (target == 0 || sn->map_tail_count == SNAP_MAP_PAIRS) {
+        int new_block = snap_alloc_block(m);
+        if (new_block == -1) return -1;
+        memset(block_buf, 0, 512);
+        ul2char(1, &block_buf[4]);
+        ul2char(s, &block_buf[8]);
+        ul2char(copy, &block_buf[12]);
+        if (diskWriteSector(m->disk, new_block, block_buf) < 0) {
+            snap_release_block(m, new_block);
+            return -1;
+        }
+        if (target != 0) {
+            if (diskReadSector(m->disk, target, block_buf) < 0) return -1;
+            ul2char(new_block, &block_buf[0]);
+            if (diskWriteSector(m->disk, target, block_buf) < 0) return -1;
+        } else {
+            pthread_mutex_lock(&m->sb_lock);
+            m->sb.snap_map_block[k] = new_block;
+            pthread_mutex_unlock(&m->sb_lock);
+            if (save_superblock(m) < 0) return -1;
+        }
+        sn->map_tail = new_block;
+        sn->map_tail_count = 1;
+        return 0;
+    }
+
+    if (diskReadSector(m->disk, target, block_buf) < 0) return -1;
+    ul2char(sn->map_tail_count + 1, &block_buf[4]);
+    ul2char(s, &block_buf[8 + 8 * sn->map_tail_count]);
+    ul2char(copy, &block_buf[12 + 8 * sn->map_tail_count]);
+    if (diskWriteSector(m->disk, target, block_buf) < 0) return -1;
+    sn->map_tail_count++;
+    return 0;
+}
+
+// Copia o conteúdo atual do setor s para um bloco novo do snapshot de
+// posição k, antes que seja sobrescrito. Deve ser chamada com snap_copy_lock
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int snap_preserve(myfs_mount_t *m, int k, unsigned int s) {
+    unsigned char block_buf[512];
+    if (diskReadSector(m->disk, s, block_buf) < 0) return -1;
+
+    int copy = snap_alloc_block(m);
+    if (copy == -1) {
+        printf("[Snapshot] Erro: Disco cheio ao preservar o setor %u\n", s);
+        return -1;
+    }
+    if (diskWriteSector(m->disk, copy, block_buf) < 0 ||
+        snap_map_append(m, k, s, copy) < 0) {
+        snap_release_block(m, copy);
+        return -1;
+    }
+    // A partir daqui as visões leem a cópia
+    atomic_store_explicit(&m->snaps[k]->copy_of[s], copy, memory_order_release);
+    return 0;
+}
+
+// Chamada pelo disco antes de cada escrita no volume (ver diskSetWriteHook):
+// copia, para cada snapshot, os setores do trecho que ele ainda compartilha.
+// As escritas da própria cópia só atingem blocos que nenhum snapshot guarda
+// Retorna 0 se a escrita pode prosseguir ou -1 se a cópia falhar
+static int snap_write_hook(Disk *d, unsigned long addr, unsigned long count, void *arg) {
+    myfs_mount_t *m = arg;
+    (void)d;
+    // Superbloco e mapa de bits (setores 0 e 1) são copiados na criação do
+    // snapshot; suas gravações, feitas com sb_lock ou bitmap_io_lock, não
+    // precisam de snap_lock
+    if (snap_copying || addr + count <= 2 || atomic_load(&m->snap_count) == 0) return 0;
+
+    int ret = 0;
+    pthread_rwlock_rdlock(&m->snap_lock);
+    for (unsigned long s = addr; s < addr + count && ret == 0; s++) {
+        for (int k = 0; k < SNAP_MAX && ret == 0; k++) {
+            if (!m->snaps[k] || !snap_holds(m, m->snaps[k], s)) continue;
+            pthread_mutex_lock(&m->snap_copy_lock);
+            snap_copying = 1;
+            if (snap_holds(m, m->snaps[k], s)) ret = snap_preserve(m, k, (unsigned int)s);
+            snap_copying = 0;
+            pthread_mutex_unlock(&m->snap_copy_lock);
+        }
+    }
+    pthread_rwlock_unlock(&m->snap_lock);
+    return ret;
+}
+
+// Lê o setor addr como estava no instante do snapshot sn (leitura da visão
+// criada por myFSSnapshotOpen). Um setor lido do lugar original é conferido
+// de novo: se foi copiado durante a leitura, é relido da cópia
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int snap_view_read(void *arg, unsigned long addr, unsigned char *data) {
+    snapshot_t *sn = arg;
+    if (addr >= sn->limit) return diskReadSector(sn->disk, addr, data);
+
+    unsigned int copy = atomic_load_explicit(&sn->copy_of[addr], memory_order_acquire);
+    if (copy != 0) return diskReadSector(sn->disk, copy, data);
+    if (diskReadSector(sn->disk, addr, data) < 0) return -1;
+    copy = atomic_load_explicit(&sn->copy_of[addr], memory_order_acquire);
+    return (copy != 0 ? diskReadSector(sn->disk, copy, data) : 0);
+}
+
+// Recalcula snap_held, a união dos mapas congelados dos snapshots
+// Deve ser chamada com snap_lock obtido para escrita
+static void snap_update_held(myfs_mount_t *m) {
+    for (int i = 0; i < 512; i++) {
+        unsigned char held = 0;
+        for (int k = 0; k < SNAP_MAX; k++)
+            if (m->snaps[k]) held |= m->snaps[k]->frozen[i];
+        __atomic_store_n(&m->snap_held[i], held, __ATOMIC_RELAXED);
+    }
+}
+
+// Cria em memória um snapshot vazio (sem mapa congelado nem cópias) sobre
+// os blocos sb_block e bitmap_block, que guardam o superbloco e o mapa de
+// bits do instante do snapshot
+// Retorna o snapshot ou NULL se não houver memória
+static snapshot_t *snap_new(myfs_mount_t *m, unsigned int sb_block, unsigned int bitmap_block) {
+    snapshot_t *sn = calloc(1, sizeof(snapshot_t));
+    if (!sn) return NULL;
+    sn->disk = m->disk;
+    sn->limit = (m->sb.total_blocks < BITMAP_BLOCKS ? m->sb.total_blocks : BITMAP_BLOCKS);
+    sn->copy_of = calloc(sn->limit, sizeof(atomic_uint));
+    if (!sn->copy_of) { free(sn); return NULL; }
+    atomic_init(&sn->copy_of[0], sb_block);
+    atomic_init(&sn->copy_of[1], bitmap_block);
+    return sn;
+}
+
+// Carrega o snapshot de posição k, registrado no superbloco: mapa congelado
+// e lista de cópias. Os blocos do snapshot são marcados em snap_owned
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int snap_load(myfs_mount_t *m, int k) {
+    unsigned char block_buf[512];
+    snapshot_t *sn = snap_new(m, m->sb.snap_sb_block[k], m->sb.snap_bitmap_block[k]);
+    if (!sn) return -1;
+    if (diskReadSector(m->disk, m->sb.snap_bitmap_block[k], sn->frozen) < 0) {
+        free(sn->copy_of); free(sn);
+        return -1;
+    }
+    map_set(m->snap_owned, m->sb.snap_sb_block[k]);
+    map_set(m->snap_owned, m->sb.snap_bitmap_block[k]);
+
+    for (unsigned int b = m->sb.snap_map_block[k]; b != 0; ) {
+        if (diskReadSector(m->disk, b, block_buf) < 0) {
+            free(sn->copy_of); free(sn);
+            return -1;
+        }
+        unsigned int next, count, orig, copy;
+        char2ul(&block_buf[0], &next);
+        char2ul(&block_buf[4], &count);
+        if (count > SNAP_MAP_PAIRS) count = SNAP_MAP_PAIRS;
+        for (unsigned int i = 0; i < count; i++) {
+            char2ul(&block_buf[8 + 8 * i], &orig);
+            char2ul(&block_buf[12 + 8 * i], &copy);
+            if (orig < sn->limit) atomic_init(&sn->copy_of[orig], copy);
+            map_set(m->snap_owned, copy);
+        }
+        map_set(m->snap_owned, b);
+        sn->map_tail = b;
+        sn->map_tail_count = count;
+        b = next;
+    }
+    m->snaps[k] = sn;
+    atomic_fetch_add(&m->snap_count, 1);
+    return 0;
+}
+
+// Retira o snapshot de posição k do volume e do superbloco e devolve seus
+// blocos (cópias, mapa congelado, superbloco e lista de cópias). Só as
+// alterações em memória são feitas com snap_lock; as escritas no disco
+// continuam enquanto os blocos são devolvidos
+// Deve ser chamada com snap_admin_lock
+static void snap_remove(myfs_mount_t *m, int k) {
+    snapshot_t *sn = m->snaps[k];
+    pthread_rwlock_wrlock(&m->snap_lock);
+    m->snaps[k] = NULL;
+    snap_update_held(m);
+    atomic_fetch_sub(&m->snap_count, 1);
+    pthread_rwlock_unlock(&m->snap_lock);
+
+    pthread_mutex_lock(&m->sb_lock);
+    unsigned int map_block = m->sb.snap_map_block[k];
+    m->sb.snap_sb_block[k] = 0;
+    m->sb.snap_bitmap_block[k] = 0;
+    m->sb.snap_map_block[k] = 0;
+    pthread_mutex_unlock(&m->sb_lock);
+    save_superblock(m);
+
+    for (unsigned int s = 0; s < sn->limit; s++) {
+        unsigned int copy = atomic_load(&sn->copy_of[s]);
+        if (copy != 0) snap_release_block(m, copy);
+    }
+    unsigned char block_buf[512];
+    while (map_block != 0 && diskReadSector(m->disk, map_block, block_buf) == 0) {
+        unsigned int next;
+        char2ul(&block_buf[0], &next);
+        snap_release_block(m, map_block);
+        map_block = next;
+    }
+    free(sn->copy_of);
+    free(sn);
+}
+
+// Move os dados embutidos de um i-node (INODE_FLAG_INLINEDATA) para um
+// bloco de dados, quando o arquivo cresce alem do espaco do i-node.
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int promote_inline(myfs_mount_t *m, Inode *inode) {
+    unsigned char block_buf[512];
+    memset(block_buf, 0, 512);
+    inodeReadInlineData(inode, 0, block_buf, inodeGetFileSize(inode));
+    inodeClearInlineData(inode);
+    if (inodeGetFileSize(inode) == 0) return inodeSave(inode);
+
+    int new_blk = find_data_block(m);
+    if (new_blk == -1) return -1;
+    if (diskWriteSector(m->disk, new_blk, block_buf) < 0) return -1;
+    return inodeAddBlock(inode, new_blk);
+}
+
+// ================= Entradas de diretório ===============
+
+// Decodifica a entrada de diretório que começa em p
+static void dir_rec_decode(unsigned char *p, dir_entry_t *entry) {
+    char2ul(p, &entry->inode_number);
+    entry->rec_len = p[4] | (p[5] << 8);
+    entry->name_len = p[6];
+    entry->type = p[7];
+    entry->name = (const char *)(p + DIR_REC_HEADER);
+}
+
+// Codifica uma entrada de diretório em p
+static void dir_rec_encode(unsigned char *p, unsigned int inumber, unsigned int rec_len,
+                           const char *name, unsigned int name_len, unsigned int type) {
+    ul2char(inumber, p);
+    p[4] = rec_len & 0xFF;
+    p[5] = (rec_len >> 8) & 0xFF;
+    p[6] = name_len;
+    p[7] = type;
+    if (name_len) memcpy(p + DIR_REC_HEADER, name, name_len);
+}
+
+// Prepara um bloco de diretório vazio: uma única entrada livre cobrindo o bloco
+static void dir_init_block(myfs_mount_t *m, unsigned char *block_buf) {
+    memset(block_buf, 0, 512);
+    dir_rec_encode(block_buf, 0, m->sb.block_size, NULL, 0, 0);
+}
+
+// Verifica se uma entrada decodificada é válida dentro de um bloco
+static int dir_rec_valid(myfs_mount_t *m, const dir_entry_t *entry, unsigned int off) {
+    return entry->rec_len >= DIR_REC_HEADER && (entry->rec_len & 3) == 0 &&
+           off + entry->rec_len <= m->sb.block_size &&
+           DIR_REC_HEADER + entry->name_len <= entry->rec_len;
+}
+
+// Procura name no diretório dir_inode; o tipo da entrada é copiado para *type
+// Retorna o número do i-node da entrada ou 0 se não encontrada
+static unsigned int dir_lookup(myfs_mount_t *m, Inode *dir_inode, const char *name, unsigned int *type) {
+    unsigned int name_len = strlen(name);
+    unsigned int num_blocks = inodeGetNumBlocks(dir_inode);
+    unsigned char block_buf[512];
+
+    for (unsigned int i = 0; i < num_blocks; i++) {
+        unsigned int addr = inodeGetBlockAddr(dir_inode, i);
+        if (addr == 0 || diskReadSector(m->disk, addr, block_buf) < 0) continue;
+
+        dir_entry_t entry;
+        for (unsigned int off = 0; off < m->sb.block_size; off += entry.rec_len) {
+            dir_rec_decode(block_buf + off, &entry);
+            if (!dir_rec_valid(m, &entry, off)) break;
+            if (entry.inode_number != 0 && entry.name_len == name_len &&
+                memcmp(entry.name, name, name_len) == 0) {
+                if (type) *type = entry.type;
+                return entry.inode_number;
+            }
+        }
+    }
+    return 0;
+}
+
+// Grava o registro de uma nova entrada em um bloco do diretório (ver dir_add_entry)
+static int dir_insert_record(myfs_mount_t *m, Inode *dir_inode, const char *name, unsigned int inumber,
+                             unsigned int type) {
+    unsigned int name_len = strlen(name);
+    unsigned int needed = DIR_REC_LEN(name_len);
+    unsigned int num_blocks = inodeGetNumBlocks(dir_inode);
+    unsigned char block_buf[512];
+
+    if (name_len == 0 || name_len > MAX_FILENAME_LENGTH) return -1;
+    if (dir_lookup(m, dir_inode, name, NULL) != 0) return -1; // Já existe
+
+    for (unsigned int i = 0; i < num_blocks; i++) {
+        unsigned int addr = inodeGetBlockAddr(dir_inode, i);
+        if (addr == 0 || diskReadSector(m->disk, addr, block_buf) < 0) continue;
+
+        dir_entry_t entry;
+        for (unsigned int off = 0; off < m->sb.block_size; off += entry.rec_len) {
+            dir_rec_decode(block_buf + off, &entry);
+            if (!dir_rec_valid(m, &entry, off)) break;
+
+            // Entrada livre grande o suficiente
+            if (entry.inode_number == 0 && entry.rec_len >= needed) {
+                dir_rec_encode(block_buf + off, inumber, entry.rec_len, name, name_len, type);
+                return diskWriteSector(m->disk, addr, block_buf) < 0 ? -1 : 0;
+            }
+            // Entrada ocupada com folga: divide o registro
+            unsigned int used = DIR_REC_LEN(entry.name_len);
+            if (entry.inode_number != 0 && entry.rec_len - used >= needed) {
+                unsigned int rest = entry.rec_len - used;
+                dir_rec_encode(block_buf + off, entry.inode_number, used, entry.name, entry.name_len,
+                               entry.type);
+                dir_rec_encode(block_buf + off + used, inumber, rest, name, name_len, type);
+                return diskWriteSector(m->disk, addr, block_buf) < 0 ? -1 : 0;
+            }
+        }
+    }
+
+    // Nenhum espaço: aloca novo bloco para o diretório
+    int new_block = find_free_block(m);
+    if (new_block == -1) return -1; // Disco cheio
+    dir_init_block(m, block_buf);
+    dir_rec_encode(block_buf, inumber, m->sb.block_size, name, name_len, type);
+    if (diskWriteSector(m->disk, new_block, block_buf) < 0 || inodeAddBlock(dir_inode, new_block) < 0) {
+        release_block(m, new_block);
+        return -1;
+    }
+    inodeSetFileSize(dir_inode, inodeGetNumBlocks(dir_inode) * m->sb.block_size);
+    return inodeSave(dir_inode);
+}
+
+// Adiciona a entrada (name -> inumber, do tipo type) ao diretório dir_inode,
+// reaproveitando espaço livre de entradas existentes ou alocando um novo bloco
+// Retorna 0 em caso de sucesso ou -1 se o nome já existir ou faltar espaço
+static int dir_add_entry(myfs_mount_t *m, Inode *dir_inode, const char *name, unsigned int inumber,
+                         unsigned int type) {
+    int ret = dir_insert_record(m, dir_inode, name, inumber, type);
+    if (ret == 0) dcacheInsert(m->dentry_cache, inodeGetNumber(dir_inode), name, inumber, type);
+    return ret;
+}
+
+// Remove a entrada name do diretório dir_inode. O espaço é incorporado à
+// entrada anterior do bloco (ou a entrada é marcada livre, se for a primeira)
+// Retorna o número do i-node removido ou 0 se a entrada não existir
+static unsigned int dir_remove_entry(myfs_mount_t *m, Inode *dir_inode, const char *name) {
+    unsigned int name_len = strlen(name);
+    unsigned int num_blocks = inodeGetNumBlocks(dir_inode);
+    unsigned char block_buf[512];
+
+    for (unsigned int i = 0; i < num_blocks; i++) {
+        unsigned int addr = inodeGetBlockAddr(dir_inode, i);
+        if (addr == 0 || diskReadSector(m->disk, addr, block_buf) < 0) continue;
+
+        dir_entry_t entry, prev;
+        int prev_off = -1;
+        for (unsigned int off = 0; off < m->sb.block_size; off += entry.rec_len) {
+            dir_rec_decode(block_buf + off, &entry);
+            if (!dir_rec_valid(m, &entry, off)) break;
+
+            if (entry.inode_number != 0 && entry.name_len == name_len &&
+                memcmp(entry.name, name, name_len) == 0) {
+                unsigned int inumber = entry.inode_number;
+                unsigned int rec_len = entry.rec_len;
+
+                // Junta com a entrada seguinte, se estiver livre
+                if (off + rec_len < m->sb.block_size) {
+                    dir_entry_t next;
+                    dir_rec_decode(block_buf + off + rec_len, &next);
+                    if (dir_rec_valid(m, &next, off + rec_len) && next.inode_number == 0)
+                        rec_len += next.rec_len;
+                }
+                if (prev_off >= 0) {
+                    dir_rec_decode(block_buf + prev_off, &prev);
+                    dir_rec_encode(block_buf + prev_off, prev.inode_number,
+                                   prev.rec_len + rec_len, prev.name, prev.name_len, prev.type);
+                } else {
+                    dir_rec_encode(block_buf + off, 0, rec_len, NULL, 0, 0);
+                }
+                if (diskWriteSector(m->disk, addr, block_buf) < 0) return 0;
+                // A partir de agora o nome é conhecido como inexistente
+                dcacheInsert(m->dentry_cache, inodeGetNumber(dir_inode), name, 0, 0);
+                return inumber;
+            }
+            prev_off = off;
+        }
+    }
+    return 0;
+}
+
+// Verifica se o diretório dir_inode não possui nenhuma entrada em uso
+static int dir_is_empty(myfs_mount_t *m, Inode *dir_inode) {
+    unsigned int num_blocks = inodeGetNumBlocks(dir_inode);
+    unsigned char block_buf[512];
+
+    for (unsigned int i = 0; i < num_blocks; i++) {
+        unsigned int addr = inodeGetBlockAddr(dir_inode, i);
+        if (addr == 0 || diskReadSector(m->disk, addr, block_buf) < 0) continue;
+
+        dir_entry_t entry;
+        for (unsigned int off = 0; off < m->sb.block_size; off += entry.rec_len) {
+            dir_rec_decode(block_buf + off, &entry);
+            if (!dir_rec_valid(m, &entry, off)) break;
+            if (entry.inode_number != 0) return 0;
+        }
+    }
+    return 1;
+}
+
+// ================= Resolução de caminhos ===============
+
+// Procura name no diretório de i-node dir_inumber, consultando primeiro o
+// cache de entradas. Em caso de falta no cache, lê o diretório e guarda o
+// resultado, inclusive quando o nome não existe (entrada negativa)
+// Retorna o i-node da entrada (tipo em *type) ou 0 se não existir
+static unsigned int lookup_entry(myfs_mount_t *m, unsigned int dir_inumber, const char *name,
+                                 unsigned int *type) {
+    unsigned int inumber = 0, t = 0;
+
+    if (!dcacheLookup(m->dentry_cache, dir_inumber, name, &inumber, &t)) {
+        // O resultado entra no cache ainda sob o lock do diretório, para que
+        // uma criação concorrente não seja encoberta por uma entrada negativa
+        inode_rdlock(m, dir_inumber);
+        Inode *dir_inode = inodeLoad(dir_inumber, m->disk);
+        if (dir_inode) {
+            inumber = dir_lookup(m, dir_inode, name, &t);
+            inodeFree(dir_inode);
+            dcacheInsert(m->dentry_cache, dir_inumber, name, inumber, t);
+        }
+        inode_unlock(m, dir_inumber);
+    }
+    if (type) *type = t;
+    return inumber;
+}
+
+// Separa o caminho absoluto path em diretório pai e última componente,
+// percorrendo as componentes intermediárias (que devem ser diretórios).
+// O i-node do pai é copiado para *parent e a última componente para name
+// (MAX_FILENAME_LENGTH+1 bytes), que fica vazio se path for a raiz
+// Retorna 0 em caso de sucesso ou -1 se o caminho for inválido
+static int resolve_parent(myfs_mount_t *m, const char *path, unsigned int *parent, char *name) {
+    if (!path || path[0] != '/') return -1;
+
+    unsigned int dir = m->sb.root_inode;
+    const char *p = path;
+    name[0] = '\0';
+
+    while (1) {
+        while (*p == '/') p++;
+        if (*p == '\0') break;
+
+        const char *end = strchr(p, '/');
+        if (!end) end = p + strlen(p);
+        size_t len = end - p;
+        if (len > MAX_FILENAME_LENGTH) return -1;
+
+        // A componente anterior passa a ser o diretório corrente
+        if (name[0] != '\0') {
+            unsigned int type = 0;
+            unsigned int next = lookup_entry(m, dir, name, &type);
+            if (next == 0 || type != INODE_TYPE_DIRECTORY) return -1;
+            dir = next;
+        }
+
+        memcpy(name, p, len);
+        name[len] = '\0';
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return -1;
+        p = end;
+    }
+
+    *parent = dir;
+    return 0;
+}
+
+// Cria um i-node do tipo inode_type e o liga como name no diretório de
+// i-node dir_inumber. Se outra thread já tiver criado o nome, usa a entrada
+// existente. O tipo da entrada resultante é copiado para *type
+// Retorna o número do i-node ou 0 em caso de falha
+static unsigned int create_entry(myfs_mount_t *m, unsigned int dir_inumber, const char *name,
+                                 unsigned int inode_type, unsigned int *type) {
+    inode_wrlock(m, dir_inumber);
+    Inode *dir_inode = inodeLoad(dir_inumber, m->disk);
+    if (!dir_inode) { inode_unlock(m, dir_inumber); return 0; }
+
+    unsigned int inumber = dir_lookup(m, dir_inode, name, type);
+    if (inumber != 0) {
+        inodeFree(dir_inode);
+        inode_unlock(m, dir_inumber);
+        return inumber;
+    }
+
+    pthread_mutex_lock(&m->inode_alloc_lock);
+    inumber = find_free_inode(m, dir_inumber, (inode_type & ~INODE_TYPE_FLAGS) == INODE_TYPE_DIRECTORY);
+    Inode *new_inode = (inumber ? inodeCreate(inumber, m->disk) : NULL);
+    if (new_inode) {
+        inodeSetFileType(new_inode, inode_type);
+        inodeSave(new_inode);
+    }
+    pthread_mutex_unlock(&m->inode_alloc_lock);
+
+    if (!new_inode) {
+        fprintf(stderr, "[Open] Erro: Sem inodes livres\n");
+        inodeFree(dir_inode);
+        inode_unlock(m, dir_inumber);
+        return 0;
+    }
+
+    *type = inode_type & ~INODE_TYPE_FLAGS;
+    if (dir_add_entry(m, dir_inode, name, inumber, *type) < 0) {
+        fprintf(stderr, "[Open] Erro critico: falha ao gravar entrada no dir\n");
+        inodeClear(new_inode); // devolve o i-node
+        inumber = 0;
+    }
+    inodeFree(new_inode);
+    inodeFree(dir_inode);
+    inode_unlock(m, dir_inumber);
+    return inumber;
+}
+
+// Cria um i-node, ainda sem nome, com o conteúdo do arquivo regular de
+// i-node src_inum: dados embutidos são copiados e blocos de dados passam a
+// ser compartilhados (só os blocos de indireção são copiados)
+// Retorna o número do i-node criado ou 0 em caso de falha
+static unsigned int clone_inode(myfs_mount_t *m, unsigned int src_inum) {
+    inode_rdlock(m, src_inum);
+    Inode *src = inodeLoad(src_inum, m->disk);
+    if (!src) { inode_unlock(m, src_inum); return 0; }
+
+    int inline_data = (inodeGetFileType(src) & INODE_FLAG_INLINEDATA) != 0;
+    unsigned int nblocks = (inline_data ? 0 : inodeGetNumBlocks(src));
+    unsigned int *blocks = calloc(nblocks + 1, sizeof(unsigned int)), nrefs = 0;
+    int ok = (blocks != NULL), refs = 0, in_dst = 0;
+
+    // As referências aos blocos são gravadas antes de o clone apontar para
+    // eles (os blocos dispensados de um grupo comprimido ficam de fora)
+    for (unsigned int i = 0; ok && i < nblocks; i++) {
+        unsigned int addr = inodeGetBlockAddr(src, i);
+        ok = (addr != 0);
+        if (addr != COMPRESS_HOLE) blocks[nrefs++] = addr;
+    }
+    if (ok && ref_get_blocks(m, blocks, nrefs) < 0) {
+        printf("[Clone] Erro: Falha ao registrar os blocos compartilhados\n");
+        ok = 0;
+    }
+    refs = ok;
+
+    Inode *dst = NULL;
+    unsigned int inumber = 0;
+    if (ok) {
+        pthread_mutex_lock(&m->inode_alloc_lock);
+        inumber = find_free_inode(m, src_inum, 0);
+        dst = (inumber ? inodeCreate(inumber, m->disk) : NULL);
+        if (dst) {
+            inodeSetFileType(dst, inodeGetFileType(src));
+            inodeSave(dst);
+        }
+        pthread_mutex_unlock(&m->inode_alloc_lock);
+        if (!dst) fprintf(stderr, "[Clone] Erro: Sem inodes livres\n");
+    }
+
+    ok = (dst != NULL);
+    if (dst) {
+        if (inline_data) {
+            unsigned char data[64];
+            int n = inodeReadInlineData(src, 0, data, inodeGetFileSize(src));
+            ok = (n >= 0 && inodeWriteInlineData(dst, 0, data, n) == n);
+        } else {
+            ok = in_dst = (inodeShareBlocks(dst, src) == 0);
+        }
+        inodeSetFileSize(dst, inodeGetFileSize(src));
+        if (ok && inodeSave(dst) < 0) ok = 0;
+        if (!ok) inodeClear(dst); // devolve o i-node e as referências que ele já tinha
+    }
+    if (!ok && refs && !in_dst)
+        for (unsigned int i = 0; i < nrefs; i++) ref_put(m, blocks[i]);
+
+    inodeFree(dst);
+    free(blocks);
+    inodeFree(src);
+    inode_unlock(m, src_inum);
+    return ok ? inumber : 0;
+}
+
+// ================= Vetores de trechos ===============
+// Leituras e escritas percorrem os buffers do chamador por um cursor sobre
+// um vetor de trechos (iov_cursor_t): myFSRead e myFSWrite usam um vetor de
+// um trecho só, e myFSReadv e myFSWritev atendem o vetor inteiro numa única
+// passagem pelo arquivo (um i-node carregado e um tamanho atualizado).
+
+// Página de zeros: lida nos buracos de um arquivo (blocos sem endereço) e
+// referenciada por myFSReadPages
+static const unsigned char zero_page[512];
+
+// Retorna quantos bytes contíguos restam no trecho atual do cursor c, cujo
+// endereço vai para *ptr (trechos vazios são pulados; 0 = fim do vetor)
+static size_t iov_contig(iov_cursor_t *c, unsigned char **ptr) {
+    while (c->index < c->iovcnt && c->offset == c->iov[c->index].iov_len) {
+        c->index++;
+        c->offset = 0;
+    }
+    if (c->index == c->iovcnt) return 0;
+    *ptr = (unsigned char *)c->iov[c->index].iov_base + c->offset;
+    return c->iov[c->index].iov_len - c->offset;
+}
+
+// Avança o cursor c em n bytes. Com src, os bytes de src são espalhados
+// pelos trechos (leitura); com dst, os dos trechos são juntados em dst
+// (escrita); sem nenhum dos dois, só pula os bytes
+static void iov_copy(iov_cursor_t *c, const unsigned char *src, unsigned char *dst, size_t n) {
+    while (n > 0) {
+        unsigned char *ptr;
+        size_t len = iov_contig(c, &ptr);
+        if (len == 0) return;
+        if (len > n) len = n;
+        if (src) {
+            memcpy(ptr, src, len);
+            src += len;
+        }
+        if (dst) {
+            memcpy(dst, ptr, len);
+            dst += len;
+        }
+        c->offset += len;
+        n -= len;
+    }
+}
+
+// Prepara o cursor c sobre os iovcnt trechos de iov
+// Retorna o total de bytes dos trechos ou -1 se o vetor for inválido
+static long iov_start(iov_cursor_t *c, const struct iovec *iov, int iovcnt) {
+    size_t total = 0;
+    if (iovcnt < 0 || (iovcnt > 0 && !iov)) return -1;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > 0 && !iov[i].iov_base) return -1;
+        if (iov[i].iov_len > 0x7FFFFFFF - total) return -1;
+        total += iov[i].iov_len;
+    }
+    c->iov = iov;
+    c->iovcnt = iovcnt;
+    c->index = 0;
+    c->offset = 0;
+    return (long)total;
+}
+
+// ================= Compressão ===============
+// Um arquivo com INODE_FLAG_COMPRESSED guarda seus dados em grupos de
+// COMPRESS_GROUP_BLOCKS blocos. O mapa de blocos do i-node continua com uma
+// entrada por bloco do arquivo: num grupo comprimido em k setores, as k
+// primeiras entradas apontam para eles e as demais valem COMPRESS_HOLE. O
+// primeiro setor começa com o tamanho dos dados LZ (COMPRESS_HEADER bytes).
+// Um grupo que não poupa nenhum setor é gravado sem compressão. Escritas
+// regravam o grupo inteiro, reaproveitando os setores que não são
+// compartilhados com clones.
+
+// Número de blocos do arquivo no grupo g (o último grupo pode ser menor)
+static unsigned int group_blocks(Inode *inode, unsigned int g) {
+    unsigned int first = g * COMPRESS_GROUP_BLOCKS, n = inodeGetNumBlocks(inode);
+    if (n <= first) return 0;
+    return (n - first < COMPRESS_GROUP_BLOCKS ? n - first : COMPRESS_GROUP_BLOCKS);
+}
+
+// Lê os count setores de addrs para data, com uma requisição ao disco por
+// trecho de endereços consecutivos
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int read_sectors(myfs_mount_t *m, const unsigned int *addrs, unsigned int count,
+                        unsigned char *data) {
+    for (unsigned int i = 0, run; i < count; i += run) {
+        for (run = 1; i + run < count && addrs[i + run] == addrs[i] + run; run++);
+        if (diskReadSectors(m->disk, addrs[i], run, data + i * 512) < 0) return -1;
+    }
+    return 0;
+}
+
+// Grava data nos count setores de addrs (ver read_sectors)
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int write_sectors(myfs_mount_t *m, const unsigned int *addrs, unsigned int count,
+                         const unsigned char *data) {
+    for (unsigned int i = 0, run; i < count; i += run) {
+        for (run = 1; i + run < count && addrs[i + run] == addrs[i] + run; run++);
+        if (diskWriteSectors(m->disk, addrs[i], run, (unsigned char *)data + i * 512) < 0) return -1;
+    }
+    return 0;
+}
+
+// Lê o grupo g do arquivo para data (group_blocks * 512 bytes),
+// descomprimindo-o se preciso
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int group_load(myfs_mount_t *m, Inode *inode, unsigned int g, unsigned char *data) {
+    unsigned char packed[COMPRESS_GROUP_BYTES];
+    unsigned int addrs[COMPRESS_GROUP_BLOCKS], n = group_blocks(inode, g), k = 0;
+    // Os endereços do grupo inteiro saem de uma só leitura do bloco de indireção
+    if (inodeGetBlockAddrs(inode, g * COMPRESS_GROUP_BLOCKS, n, addrs) != n) return -1;
+    for (unsigned int i = 0; i < n; i++) {
+        if (addrs[i] == 0) return -1;
+        if (addrs[i] != COMPRESS_HOLE) k++;
+    }
+    if (k == n) return read_sectors(m, addrs, n, data);
+
+    if (read_sectors(m, addrs, k, packed) < 0) return -1;
+    unsigned int len = packed[0] | (packed[1] << 8);
+    if (len > k * 512 - COMPRESS_HEADER ||
+        lzDecompress(packed + COMPRESS_HEADER, len, data, n * 512) != (int)(n * 512)) {
+        printf("[Read] Erro: grupo comprimido %u do i-node %u corrompido\n", g, inodeGetNumber(inode));
+        return -1;
+    }
+    return 0;
+}
+
+// Grava data como o grupo g do arquivo, com new_n blocos (old_n antes da
+// escrita), comprimindo-o se isso poupar algum setor
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int group_store(myfs_mount_t *m, Inode *inode, unsigned int g, const unsigned char *data,
+                       unsigned int old_n, unsigned int new_n) {
+    unsigned char packed[COMPRESS_GROUP_BYTES];
+    unsigned int first = g * COMPRESS_GROUP_BLOCKS, old[COMPRESS_GROUP_BLOCKS], addrs[COMPRESS_GROUP_BLOCKS];
+    unsigned int need = new_n, nold = 0, reused = 0;
+    const unsigned char *src = data;
+
+    int len = (new_n > 1 ? lzCompress(data, new_n * 512, packed + COMPRESS_HEADER,
+                                      (new_n - 1) * 512 - COMPRESS_HEADER) : -1);
+    if (len >= 0) {
+        packed[0] = (unsigned char)(len & 0xFF);
+        packed[1] = (unsigned char)(len >> 8);
+        need = (COMPRESS_HEADER + len + 511) / 512;
+        memset(packed + COMPRESS_HEADER + len, 0, need * 512 - COMPRESS_HEADER - len);
+        src = packed;
+    }
+
+    // Setores do grupo antigo que só este arquivo usa são regravados no lugar
+    unsigned int got = inodeGetBlockAddrs(inode, first, old_n, old);
+    for (unsigned int i = 0; i < got; i++)
+        if (old[i] != 0 && old[i] != COMPRESS_HOLE) old[nold++] = old[i];
+    for (unsigned int i = 0; i < nold && reused < need; i++)
+        if (!ref_shared(m, old[i])) {
+            addrs[reused++] = old[i];
+            old[i] = 0;
+        }
+    for (unsigned int i = reused; i < need; i++) {
+        int new_blk = find_data_block(m);
+        if (new_blk == -1) {
+            printf("[Write] Erro: Disco cheio (grupo comprimido)\n");
+            while (i > reused) release_block(m, addrs[--i]);
+            return -1;
+        }
+        addrs[i] = new_blk;
+    }
+    if (write_sectors(m, addrs, need, src) < 0) {
+        for (unsigned int i = reused; i < need; i++) release_block(m, addrs[i]);
+        return -1;
+    }
+
+    // Só as entradas que mudaram são regravadas no mapa
+    int ret = 0;
+    for (unsigned int i = 0; i < new_n && ret == 0; i++) {
+        unsigned int addr = (i < need ? addrs[i] : COMPRESS_HOLE);
+        if (i >= old_n)
+            ret = inodeAddBlock(inode, addr);
+        else if (inodeGetBlockAddr(inode, first + i) != addr)
+            ret = inodeSetBlockAddr(inode, first + i, addr);
+    }
+    for (unsigned int i = 0; i < nold; i++)
+        if (old[i] != 0) ref_put(m, old[i]);
+    return ret;
+}
+
+// Lê nbytes (já limitados ao tamanho do arquivo) do arquivo comprimido a
+// partir de pos para os trechos do cursor c. Grupos pedidos por inteiro,
+// num só trecho, são descomprimidos direto nele
+// Retorna o número de bytes lidos ou -1 em caso de falha
+static int compressed_read(myfs_mount_t *m, Inode *inode, unsigned int pos, iov_cursor_t *c,
+                           unsigned int nbytes) {
+    unsigned char group_buf[COMPRESS_GROUP_BYTES];
+    unsigned int read_count = 0;
+    while (read_count < nbytes) {
+        unsigned int g = pos / COMPRESS_GROUP_BYTES, offset = pos % COMPRESS_GROUP_BYTES;
+        unsigned int chunk = COMPRESS_GROUP_BYTES - offset;
+        if (chunk > nbytes - read_count) chunk = nbytes - read_count;
+
+        unsigned char *dst = NULL;
+        size_t contig = iov_contig(c, &dst);
+        unsigned int whole = group_blocks(inode, g) * 512;
+        int direct = (offset == 0 && nbytes - read_count >= whole && contig >= whole);
+        if (group_load(m, inode, g, direct ? dst : group_buf) < 0)
+            return read_count > 0 ? (int)read_count : -1;
+        iov_copy(c, direct ? NULL : group_buf + offset, NULL, chunk);
+        pos += chunk;
+        read_count += chunk;
+    }
+    return read_count;
+}
+
+// Escreve nbytes dos trechos do cursor c no arquivo comprimido a partir de
+// pos, regravando cada grupo alterado uma só vez
+// Retorna o número de bytes escritos
+static int compressed_write(myfs_mount_t *m, Inode *inode, unsigned int pos, iov_cursor_t *c,
+                            unsigned int nbytes) {
+    unsigned char group_buf[COMPRESS_GROUP_BYTES];
+    unsigned int written_count = 0;
+    while (written_count < nbytes) {
+        unsigned int g = pos / COMPRESS_GROUP_BYTES, offset = pos % COMPRESS_GROUP_BYTES;
+        unsigned int chunk = COMPRESS_GROUP_BYTES - offset;
+        if (chunk > nbytes - written_count) chunk = nbytes - written_count;
+
+        // O conteúdo antigo só é lido se parte dele sobreviver à escrita
+        unsigned int old_n = group_blocks(inode, g);
+        unsigned int new_n = (offset + chunk + 511) / 512;
+        if (new_n < old_n) new_n = old_n;
+        memset(group_buf, 0, COMPRESS_GROUP_BYTES);
+        if (old_n > 0 && (offset > 0 || chunk < old_n * 512) && group_load(m, inode, g, group_buf) < 0)
+            break;
+        iov_copy(c, NULL, group_buf + offset, chunk);
+        if (group_store(m, inode, g, group_buf, old_n, new_n) < 0) {
+            printf("[Write] Erro: falha ao gravar grupo comprimido\n");
+            break;
+        }
+        pos += chunk;
+        written_count += chunk;
+    }
+    return written_count;
+}
+
+// ================= Leitura e escrita ===============
+
+// Lê nbytes do arquivo aberto of a partir do cursor para os trechos de c
+// Deve ser chamada com o lock do i-node do arquivo obtido (ver myFSRead)
+static int file_read(open_file_t *of, iov_cursor_t *c, unsigned int nbytes) {
+    myfs_mount_t *m = of->mnt;
+    Inode *inode = inodeLoad(of->inode_number, m->disk);
+    if (!inode) return -1;
+
+    unsigned int size = inodeGetFileSize(inode);
+    unsigned int pos = of->current_position;
+    
+    if (pos >= size) { inodeFree(inode); return 0; }
+    if (pos + nbytes > size) nbytes = size - pos;
+
+    // Arquivo pequeno: dados guardados no proprio i-node
+    if (inodeGetFileType(inode) & INODE_FLAG_INLINEDATA) {
+        unsigned char inline_buf[512];
+        int n = inodeReadInlineData(inode, pos, inline_buf, nbytes);
+        inodeFree(inode);
+        if (n < 0) return -1;
+        iov_copy(c, inline_buf, NULL, n);
+        of->current_position = pos + n;
+        return n;
+    }
+
+    if (inodeGetFileType(inode) & INODE_FLAG_COMPRESSED) {
+        int n = compressed_read(m, inode, pos, c, nbytes);
+        inodeFree(inode);
+        if (n < 0) return -1;
+        of->current_position = pos + n;
+        return n;
+    }
+
+    unsigned int read_count = 0;
+    unsigned char block_buf[512];
+
+    while (read_count < nbytes) {
+        unsigned int blk_idx = pos / 512;
+        unsigned int offset = pos % 512;
+        unsigned int chunk = 512 - offset;
+        if (chunk > nbytes - read_count) chunk = nbytes - read_count;
+
+        unsigned int addr = inodeGetBlockAddr(inode, blk_idx);
+
+        // Blocos inteiros com endereços consecutivos vão ao disco numa única
+        // requisição, direto para o trecho do chamador (num volume com
+        // faixas, os membros atendem suas partes em paralelo)
+        unsigned char *dst = NULL;
+        size_t contig = iov_contig(c, &dst);
+        if (addr != 0 && offset == 0 && nbytes - read_count >= 512 && contig >= 512) {
+            unsigned int run = 1;
+            while (run < IO_RUN_MAX && nbytes - read_count >= (run + 1) * 512 && contig >= (run + 1) * 512 &&
+                   inodeGetBlockAddr(inode, blk_idx + run) == addr + run)
+                run++;
+            if (diskReadSectors(m->disk, addr, run, dst) < 0) {
+                inodeFree(inode); return -1;
+            }
+            iov_copy(c, NULL, NULL, run * 512);
+            pos += run * 512;
+            read_count += run * 512;
+            continue;
+        }
+
+        if (addr != 0) {
+            if (diskReadSector(m->disk, addr, block_buf) < 0) {
+                inodeFree(inode); return -1;
+            }
+            iov_copy(c, block_buf + offset, NULL, chunk);
+        } else {
+            iov_copy(c, zero_page + offset, NULL, chunk);
+        }
+        
+        pos += chunk;
+        read_count += chunk;
+    }
+
+    of->current_position = pos;
+    inodeFree(inode);
+    return read_count;
+
+}
+
+// Acrescenta o trecho (base, len) a iov, que tem *used de iovcnt entradas
+// usadas, emendando-o na última entrada se vier logo depois dela na memória
+// Retorna 0 em caso de sucesso ou -1 se iov estiver cheio
+static int iov_append(struct iovec *iov, int iovcnt, int *used, const unsigned char *base, unsigned int len) {
+    if (*used > 0 && (const unsigned char *)iov[*used - 1].iov_base + iov[*used - 1].iov_len == base) {
+        iov[*used - 1].iov_len += len;
+        return 0;
+    }
+    if (*used == iovcnt) return -1;
+    iov[*used].iov_base = (void *)base;
+    iov[*used].iov_len = len;
+    (*used)++;
+    return 0;
+}
+
+// Lê até nbytes do arquivo aberto of a partir do cursor sem copiá-los: os
+// setores vão do disco direto para páginas novas (*pages), que iov passa a
+// referenciar, e os buracos referenciam zero_page. Arquivos comprimidos são
+// descomprimidos nas páginas e só os dados embutidos no i-node são copiados
+// Deve ser chamada com o lock do i-node do arquivo obtido (ver myFSReadPages)
+// Retorna o número de entradas de iov preenchidas ou -1 em caso de falha
+static int file_read_pages(open_file_t *of, unsigned int nbytes, struct iovec *iov, int iovcnt,
+                           MyFSPages **pages) {
+    myfs_mount_t *m = of->mnt;
+    Inode *inode = inodeLoad(of->inode_number, m->disk);
+    if (!inode) return -1;
+
+    unsigned int size = inodeGetFileSize(inode), pos = of->current_position, ft = inodeGetFileType(inode);
+    if (pos >= size || iovcnt <= 0) { inodeFree(inode); return 0; }
+    if (nbytes > READ_PAGES_MAX) nbytes = READ_PAGES_MAX;
+    if (pos + nbytes > size) nbytes = size - pos;
+
+    // As páginas começam no bloco (ou grupo comprimido) do cursor
+    unsigned int unit = (ft & INODE_FLAG_COMPRESSED ? COMPRESS_GROUP_BYTES : 512);
+    unsigned int base = (ft & INODE_FLAG_INLINEDATA ? pos : pos - pos % unit);
+    unsigned int span = (pos + nbytes - base + unit - 1) / unit * unit;
+    MyFSPages *p = malloc(sizeof(MyFSPages) + span);
+    if (!p) { inodeFree(inode); return -1; }
+    p->size = span;
+
+    int used = 0, ok = 1;
+    unsigned int done = 0;
+    if (ft & INODE_FLAG_INLINEDATA) {
+        int n = inodeReadInlineData(inode, pos, p->data, nbytes);
+        ok = n >= 0 && iov_append(iov, iovcnt, &used, p->data, (unsigned int)n) == 0;
+        if (ok) done = (unsigned int)n;
+    } else if (ft & INODE_FLAG_COMPRESSED) {
+        for (unsigned int g = base / unit; ok && g * unit < pos + nbytes; g++)
+            ok = group_load(m, inode, g, p->data + (g * unit - base)) == 0;
+        if (ok) ok = iov_append(iov, iovcnt, &used, p->data + (pos - base), nbytes) == 0;
+        if (ok) done = nbytes;
+    } else {
+        while (done < nbytes) {
+            unsigned int blk_idx = (pos + done) / 512, offset = (pos + done) % 512;
+            unsigned int addr = inodeGetBlockAddr(inode, blk_idx);
+            unsigned int chunk = 512 - offset, run = 1;
+            if (addr != 0) {
+                // Blocos consecutivos no disco vão para as páginas numa única requisição
+                while (run < IO_RUN_MAX && done + chunk + run * 512 - 512 < nbytes &&
+                       inodeGetBlockAddr(inode, blk_idx + run) == addr + run)
+                    run++;
+                chunk += (run - 1) * 512;
+            }
+            if (chunk > nbytes - done) chunk = nbytes - done;
+
+            const unsigned char *src = zero_page + offset;
+            if (addr != 0) {
+                src = p->data + (blk_idx * 512 - base) + offset;
+                if (diskReadSectors(m->disk, addr, run, p->data + (blk_idx * 512 - base)) < 0) {
+                    ok = done > 0;
+                    break;
+                }
+            }
+            if (iov_append(iov, iovcnt, &used, src, chunk) < 0) break;
+            done += chunk;
+        }
+    }
+    inodeFree(inode);
+    if (!ok || used == 0) {
+        free(p);
+        if (!ok) return -1;
+        *pages = NULL;
+        return 0;
+    }
+    of->current_position = pos + done;
+    *pages = p;
+    return used;
+}
+
+// Troca o bloco compartilhado addr, de índice blk_idx no arquivo, por uma
+// cópia só deste arquivo. Se whole for 1, quem chama sobrescreve o bloco
+// inteiro: o conteúdo não é copiado e *is_new recebe 1
+// Retorna o endereço da cópia ou 0 em caso de falha
+static unsigned int unshare_block(myfs_mount_t *m, Inode *inode, unsigned int blk_idx,
+                                  unsigned int addr, int whole, int *is_new) {
+    unsigned char block_buf[512];
+    int new_blk = find_data_block(m);
+    if (new_blk == -1) {
+        printf("[Write] Erro: Disco cheio (copia de bloco compartilhado)\n");
+        return 0;
+    }
+    if ((!whole && (diskReadSector(m->disk, addr, block_buf) < 0 ||
+                    diskWriteSector(m->disk, new_blk, block_buf) < 0)) ||
+        inodeSetBlockAddr(inode, blk_idx, new_blk) < 0) {
+        release_block(m, new_blk);
+        return 0;
+    }
+    ref_put(m, addr);
+    *is_new = whole;
+    return new_blk;
+}
+
+// Retorna o endereço do bloco blk_idx do arquivo, alocando-o se ainda não
+// existir (nesse caso *is_new recebe 1). O bloco novo não é zerado: quem
+// chama o preenche. Um bloco compartilhado com outro arquivo é trocado por
+// uma cópia (whole = 1 indica que o bloco inteiro será sobrescrito)
+// Retorna 0 em caso de falha
+static unsigned int map_block(myfs_mount_t *m, Inode *inode, unsigned int blk_idx, int whole,
+                              int *is_new) {
+    unsigned int addr = inodeGetBlockAddr(inode, blk_idx);
+    *is_new = 0;
+    if (addr != 0 && ref_shared(m, addr)) return unshare_block(m, inode, blk_idx, addr, whole, is_new);
+    if (addr != 0) return addr;
+
+    int new_blk = find_data_block(m);
+    if (new_blk == -1) {
+        printf("[Write] Erro: Disco cheio (find_data_block)\n");
+        return 0;
+    }
+    if (inodeAddBlock(inode, new_blk) < 0) {
+        printf("[Write] Erro: inodeAddBlock falhou\n");
+        release_block(m, new_blk);
+        return 0;
+    }
+    *is_new = 1;
+    return new_blk;
+}
+
+// Grava data como os count (até DEDUP_BATCH) blocos inteiros do arquivo a
+// partir de blk_idx, no modo de deduplicação: cada bloco com o mesmo
+// conteúdo de um bloco do índice (ou de um bloco anterior do mesmo lote)
+// passa a ser uma referência a ele; os demais são gravados e entram no
+// índice. As referências obtidas vão ao disco numa só gravação da tabela,
+// antes de o mapa do arquivo apontar para os blocos
+// Retorna o número de blocos gravados (menor que count em caso de falha)
+static unsigned int dedup_write_blocks(myfs_mount_t *m, Inode *inode, unsigned int blk_idx,
+                                       const unsigned char *data, unsigned int count) {
+    unsigned char digest[DEDUP_BATCH][SHA256_DIGEST_SIZE];
+    unsigned int addr[DEDUP_BATCH];        // Bloco que cada posição passa a usar
+    unsigned char held[DEDUP_BATCH];       // 1 = referência extra obtida para addr
+    unsigned char fresh[DEDUP_BATCH];      // 1 = bloco novo, ainda fora do mapa
+    unsigned int n = 0, done = 0;
+    int refs = 0;
+
+    // Bloco de cada posição: do índice, igual a um anterior do lote ou do
+    // próprio arquivo (o mesmo, se só dele, ou um novo), já com os dados
+    for (; n < count; n++) {
+        const unsigned char *blk = data + n * 512;
+        sha256Digest(blk, 512, digest[n]);
+        held[n] = fresh[n] = 0;
+        addr[n] = dedup_lookup(m, digest[n]);
+        for (unsigned int j = 0; addr[n] == 0 && j < n; j++)
+            if (!held[j] && memcmp(digest[j], digest[n], SHA256_DIGEST_SIZE) == 0 &&
+                ref_hold(m, &addr[j], 1) == 0)
+                addr[n] = addr[j];
+        if (addr[n] != 0) {
+            held[n] = 1;
+            refs = 1;
+            continue;
+        }
+        unsigned int old = inodeGetBlockAddr(inode, blk_idx + n);
+        if (old != 0 && !ref_shared(m, old)) {
+            addr[n] = old;
+        } else {
+            int new_blk = find_data_block(m);
+            if (new_blk == -1) {
+                printf("[Write] Erro: Disco cheio (find_data_block)\n");
+                break;
+            }
+            addr[n] = new_blk;
+            fresh[n] = 1;
+        }
+        if (diskWriteSector(m->disk, addr[n], (unsigned char *)blk) < 0) {
+            if (fresh[n]) release_block(m, addr[n]);
+            break;
+        }
+    }
+
+    int ok = (!refs || ref_flush(m) == 0);
+    while (ok && done < n) {
+        unsigned int b = blk_idx + done, old = inodeGetBlockAddr(inode, b), mapped = 1;
+        if (b >= inodeGetNumBlocks(inode)) {
+            // Fim do arquivo: os blocos restantes entram no mapa de uma vez
+            mapped = inodeAddBlocks(inode, &addr[done], n - done);
+            ok = (mapped == n - done);
+        } else if (old != addr[done] && inodeSetBlockAddr(inode, b, addr[done]) < 0) {
+            mapped = 0;
+            ok = 0;
+        }
+        for (unsigned int end = done + mapped; done < end; done++, old = 0) {
+            // A referência obtida sobra se o arquivo já usava o bloco; senão,
+            // o bloco substituído perde a sua
+            if (old == addr[done]) {
+                if (held[done]) ref_put(m, addr[done]);
+            } else if (old != 0) {
+                ref_put(m, old);
+            }
+            if (!held[done]) dedup_insert(m, digest[done], addr[done]);
+            held[done] = fresh[done] = 0;
+        }
+    }
+
+    // Posições que ficaram fora do mapa devolvem as referências e depois os
+    // blocos novos (um deles pode ter sido referenciado por outra posição)
+    for (unsigned int i = done; i < n; i++)
+        if (held[i]) ref_put(m, addr[i]);
+    for (unsigned int i = done; i < n; i++)
+        if (fresh[i]) release_block(m, addr[i]);
+    return done;
+}
+
+// Escreve nbytes dos trechos de c no arquivo aberto of a partir do cursor
+// Deve ser chamada com o lock exclusivo do i-node do arquivo (ver myFSWrite)
+static int file_write(open_file_t *of, iov_cursor_t *c, unsigned int nbytes) {
+    myfs_mount_t *m = of->mnt;
+    unsigned int inum = of->inode_number;
+    Inode *inode = inodeLoad(inum, m->disk);
+    if (!inode) {
+        printf("[Write] Erro: inodeLoad falhou para inumber %u\n", inum);
+        return -1;
+    }
+
+    unsigned int pos = of->current_position;
+    unsigned int written_count = 0;
+    unsigned char block_buf[512];
+
+    if (inodeGetFileType(inode) & INODE_FLAG_INLINEDATA) {
+        // Ainda cabe no i-node: uma unica gravacao do setor do i-node
+        if (pos + nbytes <= inodeNumInlineBytes()) {
+            unsigned char inline_buf[512];
+            iov_copy(c, NULL, inline_buf, nbytes);
+            inodeWriteInlineData(inode, pos, inline_buf, nbytes);
+            pos += nbytes;
+            if (pos > inodeGetFileSize(inode)) inodeSetFileSize(inode, pos);
+            if (inodeSave(inode) < 0) { inodeFree(inode); return -1; }
+            of->current_position = pos;
+            inodeFree(inode);
+            return nbytes;
+        }
+        if (promote_inline(m, inode) < 0) {
+            printf("[Write] Erro: falha ao mover dados embutidos para bloco\n");
+            inodeFree(inode);
+            return -1;
+        }
+    }
+
+    if (inodeGetFileType(inode) & INODE_FLAG_COMPRESSED) {
+        written_count = compressed_write(m, inode, pos, c, nbytes);
+        pos += written_count;
+        if (pos > inodeGetFileSize(inode)) {
+            inodeSetFileSize(inode, pos);
+            inodeSave(inode);
+        }
+        of->current_position = pos;
+        inodeFree(inode);
+        return written_count;
+    }
+
+    while (written_count < nbytes) {
+        unsigned int blk_idx = pos / 512;
+        unsigned int offset = pos % 512;
+        unsigned int chunk = 512 - offset;
+        if (chunk > nbytes - written_count) chunk = nbytes - written_count;
+
+        // Modo de deduplicação: cada bloco inteiro passa pelo índice (juntado
+        // em block_buf se estiver em mais de um trecho)
+        unsigned char *src = NULL;
+        size_t contig = iov_contig(c, &src);
+        if (chunk == 512 && atomic_load(&m->dedup_enabled)) {
+            unsigned char batch_buf[DEDUP_BATCH * 512];
+            unsigned int count = (nbytes - written_count) / 512;
+            if (count > DEDUP_BATCH) count = DEDUP_BATCH;
+            const unsigned char *data = src;
+            if (contig < count * 512) {
+                iov_copy(c, NULL, batch_buf, count * 512);
+                data = batch_buf;
+            }
+            unsigned int done = dedup_write_blocks(m, inode, blk_idx, data, count);
+            if (data == src) iov_copy(c, NULL, NULL, done * 512);
+            pos += done * 512;
+            written_count += done * 512;
+            if (done < count) {
+                printf("[Write] Erro: falha na escrita deduplicada\n");
+                break;
+            }
+            continue;
+        }
+
+        int is_new;
+        unsigned int addr = map_block(m, inode, blk_idx, chunk == 512, &is_new);
+        if (addr == 0) break;
+
+        // Blocos inteiros com endereços consecutivos vão ao disco numa única
+        // requisição, direto do trecho do chamador
+        if (offset == 0 && nbytes - written_count >= 512 && contig >= 512) {
+            unsigned int run = 1;
+            while (run < IO_RUN_MAX && nbytes - written_count >= (run + 1) * 512 && contig >= (run + 1) * 512 &&
+                   map_block(m, inode, blk_idx + run, 1, &is_new) == addr + run)
+                run++;
+            if (diskWriteSectors(m->disk, addr, run, src) < 0) {
+                printf("[Write] Erro: diskWriteSectors falhou\n");
+                break;
+            }
+            iov_copy(c, NULL, NULL, run * 512);
+            pos += run * 512;
+            written_count += run * 512;
+            continue;
+        }
+
+        if (is_new)
+            memset(block_buf, 0, 512);
+        else if (chunk < 512)
+            diskReadSector(m->disk, addr, block_buf);
+
+        iov_copy(c, NULL, block_buf + offset, chunk);
+        if (diskWriteSector(m->disk, addr, block_buf) < 0) {
+            printf("[Write] Erro: diskWriteSector falhou\n");
+            break;
+        }
+
+        pos += chunk;
+        written_count += chunk;
+    }
+
+    if (pos > inodeGetFileSize(inode)) {
+        inodeSetFileSize(inode, pos);
+        inodeSave(inode);
+    }
+
+    of->current_position = pos;
+    inodeFree(inode);
+    return written_count;
+}
+
+// Lê a próxima entrada do diretório aberto of
+// Deve ser chamada com o lock do i-node do diretório (ver myFSReadDir)
+static int dir_read_next(open_file_t *of, char *filename, unsigned int *inumber) {
+    myfs_mount_t *m = of->mnt;
+    // Carrega o i-node do diretório a partir do número armazenado no descritor
+    Inode *dir_inode = inodeLoad(of->inode_number, m->disk);
+    if (!dir_inode)
+        return -1;
+
+    // Buffer para leitura do bloco do disco
+    unsigned char block[512];
+
+    while (1)
+    {
+        // Posição atual do cursor no diretório (byte da próxima entrada)
+        unsigned int pos = of->dir_read_position;
+
+        // Calcula qual bloco do diretório contém a entrada atual
+        unsigned int block_index = pos / m->sb.block_size;
+
+        // Calcula o deslocamento da entrada dentro do bloco
+        unsigned int offset = pos % m->sb.block_size;
+
+        // Obtém o endereço do bloco no disco a partir do i-node
+        unsigned int block_addr = inodeGetBlockAddr(dir_inode, block_index);
+
+        // Se não houver bloco associado, chegou ao fim do diretório
+        if (block_addr == 0) {
+            inodeFree(dir_inode);
+            return 0; // fim do diretório
+        }
+
+        // Lê o bloco do disco
+        if (diskReadSector(m->disk, block_addr, block) < 0) {
+            inodeFree(dir_inode);
+            return -1;
+        }
+
+        // Percorre as entradas restantes do bloco
+        dir_entry_t entry;
+        for (; offset < m->sb.block_size; offset += entry.rec_len) {
+            dir_rec_decode(block + offset, &entry);
+            if (!dir_rec_valid(m, &entry, offset)) break;
+            if (entry.inode_number == 0) continue; // Entrada livre
+
+            // Copia o nome do arquivo, terminando com '\0'
+            memcpy(filename, entry.name, entry.name_len);
+            filename[entry.name_len] = '\0';
+
+            // Retorna o número do i-node associado à entrada
+            *inumber = entry.inode_number;
+
+            // Avança o cursor do diretório para a próxima entrada
+            of->dir_read_position =
+                block_index * m->sb.block_size + offset + entry.rec_len;
+            inodeFree(dir_inode);
+            return 1;
+        }
+
+        // Fim do bloco: segue para o próximo
+        of->dir_read_position = (block_index + 1) * m->sb.block_size;
+    }
+}
+
+// Preenche buf com entradas do diretório aberto of
+// Deve ser chamada com o lock do i-node do diretório (ver myFSGetDents)
+static int dir_read_bulk(open_file_t *of, char *buf, unsigned int nbytes, int withAttrs) {
+    myfs_mount_t *m = of->mnt;
+    // O i-node do diretório é carregado uma única vez para todo o lote
+    Inode *dir_inode = inodeLoad(of->inode_number, m->disk);
+    if (!dir_inode)
+        return -1;
+
+    unsigned int pos = of->dir_read_position;
+    unsigned int filled = 0;
+    unsigned char block[512];
+    int full = 0;
+
+    for (unsigned int block_index = pos / m->sb.block_size; !full; block_index++) {
+        unsigned int block_addr = inodeGetBlockAddr(dir_inode, block_index);
+        if (block_addr == 0) break; // fim do diretório
+
+        if (diskReadSector(m->disk, block_addr, block) < 0) {
+            inodeFree(dir_inode);
+            return filled ? (int)filled : -1;
+        }
+
+        unsigned int offset = (block_index == pos / m->sb.block_size ?
+                               pos % m->sb.block_size : 0);
+        dir_entry_t entry;
+        for (; offset < m->sb.block_size; offset += entry.rec_len) {
+            dir_rec_decode(block + offset, &entry);
+            if (!dir_rec_valid(m, &entry, offset)) break;
+            pos = block_index * m->sb.block_size + offset;
+            if (entry.inode_number == 0) continue; // Entrada livre
+
+            // Entrada não cabe mais no buffer do chamador
+            unsigned int reclen = (sizeof(VFSDirent) + entry.name_len + 1 + 3) & ~3u;
+            if (filled + reclen > nbytes) { full = 1; break; }
+
+            VFSDirent *out = (VFSDirent *)(buf + filled);
+            out->inumber = entry.inode_number;
+            out->reclen = reclen;
+            out->namelen = entry.name_len;
+            out->type = (entry.type == INODE_TYPE_DIRECTORY ? FILETYPE_DIR : FILETYPE_REGULAR);
+            out->size = 0;
+            memcpy(out->name, entry.name, entry.name_len);
+            out->name[entry.name_len] = '\0';
+
+            // Modo "readdirplus": atributos vindos do i-node da entrada
+            if (withAttrs) {
+                Inode *child = inodeLoad(entry.inode_number, m->disk);
+                if (child) {
+                    out->size = inodeGetFileSize(child);
+                    inodeFree(child);
+                }
+            }
+            filled += reclen;
+        }
+        if (!full) pos = (block_index + 1) * m->sb.block_size;
+    }
+
+    of->dir_read_position = pos;
+    inodeFree(dir_inode);
+
+    // Buffer pequeno demais até para a primeira entrada
+    if (filled == 0 && full) return -1;
+    return filled;
+}
+
+// ================= Mapeamento em memória ===============
+// myFSMmap reserva uma região sem acesso (PROT_NONE) para o trecho do
+// arquivo. O primeiro acesso a uma página gera uma falta (SIGSEGV), que
+// mmap_fault repassa ao paginador, uma thread que lê a página do arquivo e
+// a libera só para leitura; a primeira escrita numa página carregada gera
+// outra falta, que a marca como suja e a libera para escrita. Como no
+// userfaultfd, a thread que tocou a página só espera: o tratador do sinal
+// não usa malloc nem locks do MyFS. myFSMsync e myFSMunmap gravam as
+// páginas sujas no arquivo e as protegem de novo contra escrita.
+
+static _Atomic(mmap_t *) mmap_table[MMAP_MAX]; // Mapeamentos ativos (NULL = livre)
+static pthread_mutex_t mmap_table_lock = PTHREAD_MUTEX_INITIALIZER; // Inclusão e remoção na tabela
+static pthread_once_t mmap_once = PTHREAD_ONCE_INIT;
+static int mmap_ready;                     // Paginador e tratador instalados
+static struct sigaction mmap_old_segv, mmap_old_bus; // Tratadores anteriores, para faltas alheias
+static _Thread_local void *mmap_retry_addr; // Falta da thread repetida numa página só de leitura
+static _Atomic(mmap_req_t *) mmap_reqs;    // Pilha de faltas pendentes
+static sem_t mmap_pending;                 // Acorda o paginador
+
+// Retorna o mapeamento que contém addr ou NULL se addr não for de nenhum
+static mmap_t *mmap_find(const void *addr) {
+    const unsigned char *a = addr;
+    for (int i = 0; i < MMAP_MAX; i++) {
+        mmap_t *mp = atomic_load(&mmap_table[i]);
+        if (mp && a >= mp->base && a < mp->base + mp->length) return mp;
+    }
+    return NULL;
+}
+
+// Carrega a página page do mapeamento mp a partir do arquivo (o que passa
+// do fim do arquivo fica zerado) e a libera para leitura. A página é lida
+// numa página anônima à parte e só então posta no lugar, de uma vez, por
+// mremap: até lá, a página do mapeamento continua sem acesso e qualquer
+// thread que a toque espera pela falta, em vez de ver a página pela metade
+// ou ter a sua escrita coberta pela carga. Deve ser chamada com mp->lock
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int mmap_load(mmap_t *mp, size_t page) {
+    open_file_t *of = fd_get(mp->fd);
+    unsigned char *addr = mp->base + page * mp->page_size;
+    if (!of) return -1;
+    unsigned char *scratch = mmap(NULL, mp->page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (scratch == MAP_FAILED) return -1;
+
+    struct iovec iov = { scratch, mp->page_size };
+    iov_cursor_t c;
+    iov_start(&c, &iov, 1);
+    inode_rdlock(of->mnt, of->inode_number);
+    of->current_position = mp->offset + page * mp->page_size;
+    int n = file_read(of, &c, mp->page_size);
+    inode_unlock(of->mnt, of->inode_number);
+    if (n < 0 || mprotect(scratch, mp->page_size, PROT_READ) != 0 ||
+        mremap(scratch, mp->page_size, mp->page_size, MREMAP_MAYMOVE | MREMAP_FIXED, addr) == MAP_FAILED) {
+        munmap(scratch, mp->page_size);
+        return -1;
+    }
+    mp->state[page] = MMAP_CLEAN;
+    return 0;
+}
+
+// Grava no arquivo as páginas sujas first..last-1 do mapeamento mp, só até
+// o fim atual do arquivo (o mapeamento não aumenta o arquivo), e as protege
+// de novo contra escrita. Deve ser chamada com mp->lock
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int mmap_flush(mmap_t *mp, size_t first, size_t last) {
+    open_file_t *of = fd_get(mp->fd);
+    if (!of) return -1;
+    int ret = 0;
+    for (size_t page = first; page < last; page++) {
+        if (mp->state[page] != MMAP_DIRTY) continue;
+        // Protegida antes da gravação: uma escrita durante ela suja a página de novo
+        unsigned char *addr = mp->base + page * mp->page_size;
+        if (mprotect(addr, mp->page_size, PROT_READ) != 0) {
+            ret = -1;
+            continue;
+        }
+        mp->state[page] = MMAP_CLEAN;
+
+        unsigned long pos = mp->offset + page * mp->page_size;
+        inode_wrlock(of->mnt, of->inode_number);
+        Inode *inode = inodeLoad(of->inode_number, of->mnt->disk);
+        unsigned int size = (inode ? inodeGetFileSize(inode) : 0);
+        inodeFree(inode);
+        if (!inode) {
+            ret = -1;
+        } else if (pos < size) {
+            unsigned int len = (size - pos < mp->page_size ? size - pos : mp->page_size);
+            struct iovec iov = { addr, len };
+            iov_cursor_t c;
+            iov_start(&c, &iov, 1);
+            of->current_position = pos;
+            if (file_write(of, &c, len) != (int)len) ret = -1;
+        }
+        inode_unlock(of->mnt, of->inode_number);
+    }
+    return ret;
+}
+
+// Atende a falta na página page do mapeamento mp: carrega a página tocada
+// pela primeira vez ou marca como suja a que recebe a primeira escrita
+// Retorna 1 se a falta foi atendida, 2 se a página já está carregada só
+// para leitura num volume somente leitura (uma leitura que perdeu a corrida
+// com a carga ou uma escrita, que não pode ser atendida) ou 0 se a leitura
+// da página falhou
+static int mmap_service(mmap_t *mp, size_t page) {
+    int handled = 0;
+    pthread_mutex_lock(&mp->lock);
+    if (mp->state[page] == MMAP_ABSENT) {
+        handled = mmap_load(mp, page) == 0;
+    } else if (mp->state[page] == MMAP_CLEAN && !mp->writable) {
+        handled = 2;
+    } else if (mp->state[page] == MMAP_CLEAN) {
+        handled = mprotect(mp->base + page * mp->page_size, mp->page_size, PROT_READ | PROT_WRITE) == 0;
+        if (handled) mp->state[page] = MMAP_DIRTY;
+    } else {
+        handled = 1;                       // Já atendida por outra thread
+    }
+    pthread_mutex_unlock(&mp->lock);
+    return handled;
+}
+
+// Paginador: atende as faltas pendentes enquanto o programa existir
+static void *mmap_pager_loop(void *arg) {
+    (void)arg;
+    for (;;) {
+        while (sem_wait(&mmap_pending) != 0);
+        mmap_req_t *req = atomic_exchange(&mmap_reqs, NULL);
+        while (req) {
+            mmap_req_t *next = req->next;  // req deixa de existir depois do sem_post
+            req->handled = mmap_service(req->mp, req->page);
+            sem_post(&req->done);
+            req = next;
+        }
+    }
+    return NULL;
+}
+
+// Tratador de SIGSEGV e SIGBUS: entrega a falta num mapeamento ao paginador
+// e espera. Uma falta fora dos mapeamentos (ou que não possa ser atendida)
+// é repassada ao tratador anterior; mmap_fault continua instalado para as
+// faltas seguintes. Sem tratador anterior, volta a ação padrão do sinal, que
+// termina o programa quando a instrução é repetida
+static void mmap_fault(int sig, siginfo_t *info, void *context) {
+    mmap_t *mp = mmap_find(info->si_addr);
+    int handled = 0;
+    if (mp) {
+        mmap_req_t req;
+        req.mp = mp;
+        req.page = ((unsigned char *)info->si_addr - mp->base) / mp->page_size;
+        req.handled = 0;
+        sem_init(&req.done, 0, 0);
+        req.next = atomic_load(&mmap_reqs);
+        while (!atomic_compare_exchange_weak(&mmap_reqs, &req.next, &req));
+        sem_post(&mmap_pending);
+        while (sem_wait(&req.done) != 0);
+        sem_destroy(&req.done);
+        handled = req.handled;
+    }
+    // Página só de leitura: uma leitura que perdeu a corrida com a carga passa
+    // ao ser repetida; a mesma falta outra vez é uma escrita
+    if (handled == 2) {
+        handled = (mmap_retry_addr != info->si_addr);
+        mmap_retry_addr = (handled ? info->si_addr : NULL);
+    } else {
+        mmap_retry_addr = NULL;
+    }
+    if (handled) return;
+
+    struct sigaction *old = (sig == SIGSEGV ? &mmap_old_segv : &mmap_old_bus);
+    if (old->sa_flags & SA_SIGINFO) {
+        old->sa_sigaction(sig, info, context);
+    } else if (old->sa_handler != SIG_DFL && old->sa_handler != SIG_IGN) {
+        old->sa_handler(sig);
+    } else {
+        // Ignorar uma falta só a repetiria para sempre: ação padrão nos dois casos
+        struct sigaction dfl;
+        memset(&dfl, 0, sizeof(dfl));
+        dfl.sa_handler = SIG_DFL;
+        sigemptyset(&dfl.sa_mask);
+        sigaction(sig, &dfl, NULL);
+    }
+}
+
+// Cria o paginador e instala mmap_fault (uma vez), guardando os tratadores
+// anteriores
+static void mmap_install_handler(void) {
+    pthread_t pager;
+    sem_init(&mmap_pending, 0, 0);
+    if (pthread_create(&pager, NULL, mmap_pager_loop, NULL) != 0) return;
+    pthread_detach(pager);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = mmap_fault;
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, &mmap_old_segv);
+    sigaction(SIGBUS, &sa, &mmap_old_bus);
+    mmap_ready = 1;
+}
+
+// Retorna o intervalo de páginas [*first, *last) do mapeamento mp coberto
+// por length bytes a partir de addr (limitado ao fim da região)
+static void mmap_range(mmap_t *mp, const void *addr, size_t length, size_t *first, size_t *last) {
+    size_t start = (const unsigned char *)addr - mp->base;
+    size_t end = (length > mp->length - start ? mp->length : start + length);
+    *first = start / mp->page_size;
+    *last = (end + mp->page_size - 1) / mp->page_size;
+}
+
+// Verifica se os length bytes a partir de addr tocam alguma região de myFSMmap
+static int mmap_overlaps(const void *addr, size_t length) {
+    const unsigned char *a = addr;
+    for (int i = 0; i < MMAP_MAX && length > 0; i++) {
+        mmap_t *mp = atomic_load(&mmap_table[i]);
+        if (mp && a < mp->base + mp->length && mp->base < a + length) return 1;
+    }
+    return 0;
+}
+
+// Verifica se algum dos iovcnt trechos de iov (ou o próprio vetor) toca uma
+// região de myFSMmap. Uma página dessas ainda não carregada, ou protegida de
+// novo por myFSMsync, gera uma falta que o paginador atende com o lock do
+// i-node do arquivo mapeado e o do disco; a thread que a tocou não pode
+// estar segurando nenhum deles, então os dados desses trechos passam por um
+// buffer intermediário copiado fora dos locks (ver file_read_iov)
+static int iov_mapped(const struct iovec *iov, int iovcnt) {
+    if (iovcnt <= 0) return 0;
+    if (mmap_overlaps(iov, (size_t)iovcnt * sizeof(struct iovec))) return 1;
+    for (int i = 0; i < iovcnt; i++)
+        if (mmap_overlaps(iov[i].iov_base, iov[i].iov_len)) return 1;
+    return 0;
+}
+
+// Lê nbytes do arquivo de of, a partir do cursor, para os iovcnt trechos de
+// iov, com o lock de leitura do i-node. Se algum trecho for de uma região
+// de myFSMmap, a leitura vai para um buffer intermediário, espalhado pelos
+// trechos só depois de soltar o lock
+// Retorna o número de bytes lidos ou -1 em caso de falha
+static int file_read_iov(open_file_t *of, const struct iovec *iov, int iovcnt, unsigned int nbytes) {
+    iov_cursor_t c;
+    struct iovec bounce_iov = { NULL, nbytes };
+    if (iov_mapped(iov, iovcnt)) {
+        bounce_iov.iov_base = malloc(nbytes > 0 ? nbytes : 1);
+        if (!bounce_iov.iov_base) return -1;
+        iov_start(&c, &bounce_iov, 1);
+    } else {
+        iov_start(&c, iov, iovcnt);
+    }
+
+    unsigned int inum = of->inode_number;
+    inode_rdlock(of->mnt, inum);
+    int ret = file_read(of, &c, nbytes);
+    inode_unlock(of->mnt, inum);
+
+    if (bounce_iov.iov_base) {
+        iov_start(&c, iov, iovcnt);
+        if (ret > 0) iov_copy(&c, bounce_iov.iov_base, NULL, (size_t)ret);
+        free(bounce_iov.iov_base);
+    }
+    return ret;
+}
+
+// Grava no arquivo de of, a partir do cursor, nbytes dos iovcnt trechos de
+// iov, com o lock de escrita do i-node. Trechos de uma região de myFSMmap
+// são juntados num buffer intermediário antes de obter o lock (ver
+// iov_mapped)
+// Retorna o número de bytes gravados ou -1 em caso de falha
+static int file_write_iov(open_file_t *of, const struct iovec *iov, int iovcnt, unsigned int nbytes) {
+    iov_cursor_t c;
+    struct iovec bounce_iov = { NULL, nbytes };
+    iov_start(&c, iov, iovcnt);
+    if (iov_mapped(iov, iovcnt)) {
+        bounce_iov.iov_base = malloc(nbytes > 0 ? nbytes : 1);
+        if (!bounce_iov.iov_base) return -1;
+        iov_copy(&c, NULL, bounce_iov.iov_base, nbytes);
+        iov_start(&c, &bounce_iov, 1);
+    }
+
+    unsigned int inum = of->inode_number;
+    inode_wrlock(of->mnt, inum);
+    int ret = file_write(of, &c, nbytes);
+    inode_unlock(of->mnt, inum);
+    free(bounce_iov.iov_base);
+    return ret;
+}
 
-static superblock_t sb_cache;              // Cópia do superbloco em memória
-static int fs_mounted = 0;                 // 1=montado, 0=não montado
-static unsigned char *block_bitmap = NULL; // Mapa de bits (1 bit por bloco)
-static open_file_t open_files_table[MAX_OPEN_FILES]; // Tabela de arquivos abertos
-static Disk *current_disk= NULL;              // Ponteiro para o disco atual
-// ================= Funções auxiliares ===============
+// ================= Verificação do volume ===============
+// myFSCheck percorre a tabela de i-nodes em três passagens, cada uma dividida
+// em faixas entre threads: (1) valida cada i-node e os endereços dos seus
+// blocos; (2) confere as entradas dos diretórios, contando as que apontam
+// para cada i-node; (3) conta os donos de cada bloco. O mapa de bits e a
+// tabela de referências esperados saem dessas contagens, somadas aos
+// metadados fixos, aos setores da tabela de referências e aos blocos dos
+// snapshots.
+// O disco tem uma só cabeça: threads lendo faixas diferentes da tabela e
+// blocos espalhados só trocariam de cilindro umas contra as outras. Por isso,
+// antes das passagens, a thread que chama lê para um cache a tabela de
+// i-nodes, os blocos de indireção e os blocos dos diretórios, em varreduras
+// por ordem de endereço (fsck_prefetch). As passagens leem da visão
+// c->view, atendida pelo cache, e as threads só dividem o trabalho de CPU.
 
-// Encontra um bloco livre no mapa de bits
-// Retorna o número do bloco encontrado ou -1 se não houver blocos livres
-static int find_free_block(Disk *d) {
-    unsigned int total_blocks = sb_cache.total_blocks;
-    
-    // Percorre a partir da área de dados
-    for (unsigned int block_num = sb_cache.data_start_block; block_num < total_blocks; block_num++) {
-        int byte_index = block_num / 8;      // Qual byte no bitmap
-        int bit_index = block_num % 8;       // Qual bit dentro do byte
-        
-        // Verifica se o bit está livre (0)
-        if ((block_bitmap[byte_index] & (1 << bit_index)) == 0) {
-            // Marca o bloco como ocupado
-            block_bitmap[byte_index] |= (1 << bit_index);
-            sb_cache.free_blocks--;
-            
-            // Salva o bitmap atualizado no disco (bloco 1)
-            unsigned char block_buffer[512];
-            memcpy(block_buffer, block_bitmap, 512);
-            diskWriteSector(d, 1, block_buffer);
-            
-            // Salva o superbloco atualizado no disco (bloco 0)
-            unsigned char superblock_buffer[512];
-            memset(superblock_buffer, 0, 512);
-            
-            unsigned int buffer_pos = 0;
-            ul2char(sb_cache.magic_number, &superblock_buffer[buffer_pos]); buffer_pos += 4;
-            ul2char(sb_cache.block_size, &superblock_buffer[buffer_pos]); buffer_pos += 4;
-            ul2char(sb_cache.total_blocks, &superblock_buffer[buffer_pos]); buffer_pos += 4;
-            ul2char(sb_cache.inode_start_block, &superblock_buffer[buffer_pos]); buffer_pos += 4;
-            ul2char(sb_cache.inode_count, &superblock_buffer[buffer_pos]); buffer_pos += 4;
-            ul2char(sb_cache.data_start_block, &superblock_buffer[buffer_pos]); buffer_pos += 4;
-            ul2char(sb_cache.free_blocks, &superblock_buffer[buffer_pos]); buffer_pos += 4;
-            ul2char(sb_cache.root_inode, &superblock_buffer[buffer_pos]); buffer_pos += 4;
-            
-            diskWriteSector(d, 0, superblock_buffer);
-            
-            return block_num;  // Retorna o número do bloco livre encontrado
+// Soma os problemas encontrados por uma thread (src) ao total (dst)
+static void fsck_report_add(MyFSCheckReport *dst, const MyFSCheckReport *src) {
+    dst->badSuperblock += src->badSuperblock;
+    dst->badInodes += src->badInodes;
+    dst->badBlockRefs += src->badBlockRefs;
+    dst->badEntries += src->badEntries;
+    dst->orphanInodes += src->orphanInodes;
+    dst->leakedBlocks += src->leakedBlocks;
+    dst->missingBlocks += src->missingBlocks;
+    dst->badRefcounts += src->badRefcounts;
+    dst->crossLinked += src->crossLinked;
+    dst->repaired += src->repaired;
+}
+
+// Verifica se block_num pode ser um bloco de dados ou de indireção do volume
+static int fsck_block_valid(fsck_t *c, unsigned int block_num) {
+    return block_num < c->limit && !layout_meta(c->m, block_num);
+}
+
+// Leitura de um setor da visão c->view: do cache, se estiver nele; senão,
+// do disco ou, na leitura antecipada, anotado para a próxima varredura
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int fsck_view_read(void *arg, unsigned long addr, unsigned char *data) {
+    fsck_t *c = arg;
+    if (addr < c->cache_sectors) {
+        unsigned char st = __atomic_load_n(&c->cached[addr], __ATOMIC_ACQUIRE);
+        if (st == FSCK_CACHED) {
+            memcpy(data, c->cache + addr * 512, 512);
+            return 0;
+        }
+        if (c->collecting) {
+            __atomic_store_n(&c->cached[addr], FSCK_WANTED, __ATOMIC_RELAXED);
+            return -1;
         }
     }
-    
-    return -1;  // Não há blocos livres
+    if (c->collecting) return -1;
+    return diskReadSector(c->m->disk, addr, data);
+}
+
+// Tira do cache o setor sector, regravado no disco por um reparo
+static void fsck_cache_drop(fsck_t *c, unsigned long sector) {
+    if (sector < c->cache_sectors) __atomic_store_n(&c->cached[sector], 0, __ATOMIC_RELEASE);
+}
+
+// Esvazia o i-node inum sem devolver seus blocos: o mapa de bits e a tabela
+// de referências são refeitos no fim da verificação
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+static int fsck_clear_inode(fsck_t *c, unsigned int inum) {
+    Inode *inode = inodeCreate(inum, c->m->disk);
+    inodeFree(inode);
+    fsck_cache_drop(c, inode_sector_of(c->m->disk, inum));
+    return inode ? 0 : -1;
+}
+
+// Chamada por inodeWalkBlocks na passagem 1: conta os endereços fora da
+// área de dados. Blocos de indireção inválidos não são seguidos
+static int fsck_walk_validate(unsigned int block_num, int level, void *arg) {
+    fsck_walk_t *w = arg;
+    if (level == 0 && (block_num == 0 || (w->compressed && block_num == COMPRESS_HOLE))) return 0;
+    if (fsck_block_valid(w->c, block_num)) return 0;
+    w->bad++;
+    return 1;
+}
+
+// Passagem 1: classifica o i-node inum (livre, em uso ou inválido). Um
+// i-node livre precisa guardar o próprio número, pois é ele que
+// inodeFindFreeInode entrega; o tamanho precisa caber nos blocos mapeados
+static void fsck_scan_inode(fsck_t *c, unsigned int inum, Inode *inode, MyFSCheckReport *r) {
+    if (!inode) {
+        printf("[Fsck] I-node %u: setor ilegível\n", inum);
+        c->state[inum] = FSCK_BAD;
+        r->badInodes++;
+        return;
+    }
+    unsigned int ft = inodeGetFileType(inode);
+    unsigned int type = ft & ~INODE_TYPE_FLAGS;
+    unsigned int num_blocks = inodeGetNumBlocks(inode);
+    unsigned int size = inodeGetFileSize(inode);
+    int own_number = (inodeGetNumber(inode) == inum);
+
+    if (ft == 0 && num_blocks == 0) {
+        c->state[inum] = FSCK_FREE;
+        if (own_number) return;
+        printf("[Fsck] I-node %u: livre, mas gravado com o número %u\n", inum, inodeGetNumber(inode));
+        r->badInodes++;
+        if (c->repair && fsck_clear_inode(c, inum) == 0) r->repaired++;
+        return;
+    }
+
+    int valid = own_number && (type == INODE_TYPE_REGULAR || type == INODE_TYPE_DIRECTORY) &&
+                (type == INODE_TYPE_REGULAR || (ft & INODE_TYPE_FLAGS) == 0) &&
+                (ft & INODE_TYPE_FLAGS) != INODE_TYPE_FLAGS &&
+                (!(ft & INODE_FLAG_INLINEDATA) || num_blocks == 0);
+    fsck_walk_t w = { .c = c, .inum = inum, .compressed = (ft & INODE_FLAG_COMPRESSED) != 0, .r = r };
+    if (!valid) {
+        printf("[Fsck] I-node %u: número, tipo (0x%x) ou flags inválidos\n", inum, ft);
+        r->badInodes++;
+    } else if (inodeWalkBlocks(inode, fsck_walk_validate, &w) < 0 || w.bad > 0) {
+        printf("[Fsck] I-node %u: %u endereço(s) de bloco inválido(s) ou ilegível(is)\n", inum,
+               w.bad ? w.bad : 1);
+        r->badBlockRefs += (w.bad ? w.bad : 1);
+        valid = 0;
+    }
+
+    if (!valid) {
+        // A raiz nunca é esvaziada: sem ela o volume não tem árvore
+        c->state[inum] = FSCK_BAD;
+        if (c->repair && inum != c->m->sb.root_inode && fsck_clear_inode(c, inum) == 0) {
+            c->state[inum] = FSCK_FREE;
+            r->repaired++;
+        }
+        return;
+    }
+
+    c->state[inum] = FSCK_USED;
+    c->type[inum] = type;
+    unsigned int max_size = (ft & INODE_FLAG_INLINEDATA ? inodeNumInlineBytes() : num_blocks * 512);
+    if (size > max_size || (type == INODE_TYPE_DIRECTORY && size != max_size)) {
+        printf("[Fsck] I-node %u: tamanho %u incompatível com os blocos mapeados\n", inum, size);
+        r->badInodes++;
+        // O i-node da passagem vem da visão, que não aceita escritas
+        Inode *fix = (c->repair ? inodeLoad(inum, c->m->disk) : NULL);
+        if (fix) {
+            inodeSetFileSize(fix, max_size);
+            if (inodeSave(fix) == 0) r->repaired++;
+            inodeFree(fix);
+            fsck_cache_drop(c, inode_sector_of(c->m->disk, inum));
+        }
+    }
+}
+
+// Confere as entradas do bloco block_num do diretório dir_inum. Entradas
+// para i-nodes livres (ou de tipo diferente) são liberadas no reparo, e um
+// registro inválido vira uma entrada livre até o fim do bloco
+static void fsck_dir_block(fsck_t *c, unsigned int dir_inum, unsigned int block_num, MyFSCheckReport *r) {
+    myfs_mount_t *m = c->m;
+    unsigned char block_buf[512];
+    int dirty = 0;
+
+    if (diskReadSector(c->view, block_num, block_buf) < 0) {
+        printf("[Fsck] Diretório %u: bloco %u ilegível\n", dir_inum, block_num);
+        r->badEntries++;
+        return;
+    }
+    dir_entry_t entry;
+    for (unsigned int off = 0; off < m->sb.block_size; off += entry.rec_len) {
+        dir_rec_decode(block_buf + off, &entry);
+        if (!dir_rec_valid(m, &entry, off)) {
+            printf("[Fsck] Diretório %u: registro inválido no bloco %u\n", dir_inum, block_num);
+            r->badEntries++;
+            if (c->repair) {
+                dir_rec_encode(block_buf + off, 0, m->sb.block_size - off, NULL, 0, 0);
+                dirty = 1;
+                r->repaired++;
+            }
+            break;
+        }
+        if (entry.inode_number == 0) continue;
+
+        unsigned int t = entry.inode_number;
+        int target_ok = t >= 1 && t <= m->sb.inode_count &&
+                        ((c->state[t] == FSCK_USED && c->type[t] == entry.type) ||
+                         (c->state[t] == FSCK_BAD && !c->repair));
+        if (entry.name_len > 0 && target_ok) {
+            atomic_fetch_add(&c->links[t], 1);
+            continue;
+        }
+        printf("[Fsck] Diretório %u: entrada \"%.*s\" aponta para o i-node %u, livre ou de outro tipo\n",
+               dir_inum, (int)entry.name_len, entry.name, t);
+        r->badEntries++;
+        if (c->repair) {
+            dir_rec_encode(block_buf + off, 0, entry.rec_len, NULL, 0, 0);
+            dirty = 1;
+            r->repaired++;
+        }
+    }
+    if (dirty) {
+        diskWriteSector(m->disk, block_num, block_buf);
+        fsck_cache_drop(c, block_num);
+    }
+}
+
+// Chamada por inodeWalkBlocks na passagem 2 para os blocos de um diretório
+static int fsck_walk_dir(unsigned int block_num, int level, void *arg) {
+    fsck_walk_t *w = arg;
+    if (level == 0 && fsck_block_valid(w->c, block_num)) fsck_dir_block(w->c, w->inum, block_num, w->r);
+    return 0;
+}
+
+// Passagem 2: confere as entradas do i-node inum, se for um diretório
+static void fsck_scan_dir(fsck_t *c, unsigned int inum, Inode *inode, MyFSCheckReport *r) {
+    if (!inode || c->state[inum] != FSCK_USED || c->type[inum] != INODE_TYPE_DIRECTORY) return;
+    fsck_walk_t w = { .c = c, .inum = inum, .r = r };
+    inodeWalkBlocks(inode, fsck_walk_dir, &w);
+}
+
+// Chamada por inodeWalkBlocks na passagem 3: conta um dono para cada bloco
+// válido (endereços inválidos só aparecem em i-nodes mantidos sem reparo)
+static int fsck_walk_count(unsigned int block_num, int level, void *arg) {
+    fsck_walk_t *w = arg;
+    if (!fsck_block_valid(w->c, block_num)) return 1;
+    atomic_fetch_add(level > 0 ? &w->c->meta_uses[block_num] : &w->c->data_uses[block_num], 1);
+    return 0;
+}
+
+// Passagem 3: conta os blocos do i-node inum, se estiver em uso
+static void fsck_count_blocks(fsck_t *c, unsigned int inum, Inode *inode, MyFSCheckReport *r) {
+    if (!inode || c->state[inum] == FSCK_FREE) return;
+    fsck_walk_t w = { .c = c, .inum = inum, .r = r };
+    inodeWalkBlocks(inode, fsck_walk_count, &w);
+}
+
+// Lê para o cache os setores marcados com FSCK_WANTED, por ordem de endereço
+// e com uma requisição por trecho consecutivo. Um trecho que falhe é lido
+// setor a setor; os setores ilegíveis ficam fora do cache
+// Retorna o número de setores pedidos
+static unsigned int fsck_fetch(fsck_t *c) {
+    unsigned int fetched = 0;
+    for (unsigned int s = 0, run; s < c->cache_sectors; s += run) {
+        run = 1;
+        if (c->cached[s] != FSCK_WANTED) continue;
+        while (run < IO_RUN_MAX && s + run < c->cache_sectors && c->cached[s + run] == FSCK_WANTED) run++;
+        int ok = (diskReadSectors(c->m->disk, s, run, c->cache + s * 512) == 0);
+        for (unsigned int i = s; i < s + run; i++)
+            c->cached[i] = (ok || diskReadSector(c->m->disk, i, c->cache + i * 512) == 0 ? FSCK_CACHED : 0);
+        fetched += run;
+    }
+    return fetched;
+}
+
+// Chamada por inodeWalkBlocks na leitura antecipada: os blocos de
+// indireção são lidos pela visão (e anotados se faltarem); os blocos de
+// dados de um diretório são anotados
+static int fsck_walk_prefetch(unsigned int block_num, int level, void *arg) {
+    fsck_walk_t *w = arg;
+    if (!fsck_block_valid(w->c, block_num)) return 1;
+    if (level == 0 && w->directory && w->c->cached[block_num] == 0) w->c->cached[block_num] = FSCK_WANTED;
+    return 0;
+}
+
+// Lê para o cache, antes das passagens, a tabela de i-nodes e depois, a cada
+// varredura, o nível seguinte das árvores de indireção e os blocos dos
+// diretórios. Cada varredura percorre os i-nodes já em cache anotando os
+// setores que faltam e os lê em ordem de endereço (fsck_fetch)
+static void fsck_prefetch(fsck_t *c) {
+    myfs_mount_t *m = c->m;
+    unsigned int count = m->sb.inode_count, per_sector = inodeNumInodesPerSector();
+    Inode *inodes[FSCK_CHUNK_INODES];
+
+    for (unsigned int inum = 1; inum <= count; inum += per_sector) {
+        unsigned long sector = inode_sector_of(m->disk, inum);
+        if (sector < c->cache_sectors) c->cached[sector] = FSCK_WANTED;
+    }
+    c->collecting = 1;
+    for (int round = 0; round < FSCK_PREFETCH_ROUNDS && fsck_fetch(c) > 0; round++) {
+        for (unsigned int first = 1; first <= count; first += FSCK_CHUNK_INODES) {
+            unsigned int n = count + 1 - first;
+            if (n > FSCK_CHUNK_INODES) n = FSCK_CHUNK_INODES;
+            if (inodeLoadMany(first, n, c->view, inodes) < 0)
+                for (unsigned int i = 0; i < n; i++) inodes[i] = inodeLoad(first + i, c->view);
+            for (unsigned int i = 0; i < n; i++) {
+                if (!inodes[i]) continue;
+                unsigned int ft = inodeGetFileType(inodes[i]);
+                fsck_walk_t w = { .c = c, .inum = first + i, .compressed = (ft & INODE_FLAG_COMPRESSED) != 0,
+                                  .directory = (ft & ~INODE_TYPE_FLAGS) == INODE_TYPE_DIRECTORY };
+                inodeWalkBlocks(inodes[i], fsck_walk_prefetch, &w);
+                inodeFree(inodes[i]);
+            }
+        }
+    }
+    c->collecting = 0;
+}
+
+// Percorre a faixa de i-nodes de uma thread, lendo FSCK_CHUNK_INODES i-nodes
+// por requisição à visão. Se a leitura de um trecho falhar, seus i-nodes
+// são lidos um a um (um setor ilegível só afeta os seus)
+static void *fsck_range_thread(void *arg) {
+    fsck_range_t *rg = arg;
+    Inode *inodes[FSCK_CHUNK_INODES];
+
+    for (unsigned int first = rg->first; first < rg->end; first += FSCK_CHUNK_INODES) {
+        unsigned int count = rg->end - first;
+        if (count > FSCK_CHUNK_INODES) count = FSCK_CHUNK_INODES;
+        if (inodeLoadMany(first, count, rg->c->view, inodes) < 0)
+            for (unsigned int i = 0; i < count; i++) inodes[i] = inodeLoad(first + i, rg->c->view);
+        for (unsigned int i = 0; i < count; i++) {
+            rg->fn(rg->c, first + i, inodes[i], &rg->report);
+            inodeFree(inodes[i]);
+        }
+    }
+    return NULL;
+}
+
+// Executa a passagem fn sobre todos os i-nodes, com a tabela dividida em
+// faixas contíguas (alinhadas aos setores de i-nodes) entre as threads. Os
+// problemas encontrados são somados a *total
+static void fsck_run(fsck_t *c, void (*fn)(fsck_t *, unsigned int, Inode *, MyFSCheckReport *),
+                     MyFSCheckReport *total) {
+    fsck_range_t ranges[FSCK_THREADS_MAX];
+    pthread_t threads[FSCK_THREADS_MAX];
+    int started[FSCK_THREADS_MAX] = {0};
+    unsigned int count = c->m->sb.inode_count, per_sector = inodeNumInodesPerSector();
+    unsigned int span = ((count + c->threads - 1) / c->threads + per_sector - 1) / per_sector * per_sector;
+
+    for (unsigned int t = 0; t < c->threads; t++) {
+        memset(&ranges[t], 0, sizeof(fsck_range_t));
+        ranges[t].c = c;
+        ranges[t].fn = fn;
+        ranges[t].first = 1 + t * span;
+        ranges[t].end = (t * span + span < count ? 1 + t * span + span : count + 1);
+        if (ranges[t].first >= ranges[t].end) continue;
+        // Sem uma thread nova, a faixa é percorrida pela thread atual
+        if (t > 0 && pthread_create(&threads[t], NULL, fsck_range_thread, &ranges[t]) == 0)
+            started[t] = 1;
+    }
+    if (ranges[0].first < ranges[0].end) fsck_range_thread(&ranges[0]);
+    for (unsigned int t = 1; t < c->threads; t++) {
+        if (started[t]) pthread_join(threads[t], NULL);
+        else if (ranges[t].first < ranges[t].end) fsck_range_thread(&ranges[t]);
+    }
+    for (unsigned int t = 0; t < c->threads; t++) fsck_report_add(total, &ranges[t].report);
+}
+
+// Conta um uso como metadado do bloco block_num, referenciado pelo
+// superbloco (what descreve o uso nas mensagens)
+// Retorna 0 ou -1 se o bloco estiver fora da área de dados
+static int fsck_meta_block(fsck_t *c, unsigned int block_num, const char *what, MyFSCheckReport *r) {
+    if (!fsck_block_valid(c, block_num)) {
+        printf("[Fsck] Superbloco: %s no bloco inválido %u\n", what, block_num);
+        r->badSuperblock++;
+        return -1;
+    }
+    atomic_fetch_add(&c->meta_uses[block_num], 1);
+    return 0;
+}
+
+// Conta os blocos dos snapshots registrados no superbloco: cópia do
+// superbloco, mapa de bits congelado, lista de cópias e as cópias
+static void fsck_count_snapshots(fsck_t *c, MyFSCheckReport *r) {
+    myfs_mount_t *m = c->m;
+    unsigned char block_buf[512];
+
+    for (int k = 0; k < SNAP_MAX; k++) {
+        if (m->sb.snap_sb_block[k] == 0) continue;
+        fsck_meta_block(c, m->sb.snap_sb_block[k], "superbloco de snapshot", r);
+        fsck_meta_block(c, m->sb.snap_bitmap_block[k], "mapa de bits de snapshot", r);
+
+        // A lista nunca tem mais blocos que o volume (evita voltas em ciclos)
+        unsigned int b = m->sb.snap_map_block[k];
+        for (unsigned int steps = 0; b != 0 && steps < c->limit; steps++) {
+            if (fsck_meta_block(c, b, "lista de cópias de snapshot", r) < 0) break;
+            if (diskReadSector(m->disk, b, block_buf) < 0) {
+                printf("[Fsck] Snapshot %d: lista de cópias ilegível no bloco %u\n", k + 1, b);
+                r->badSuperblock++;
+                break;
+            }
+            unsigned int next, count, copy;
+            char2ul(&block_buf[0], &next);
+            char2ul(&block_buf[4], &count);
+            if (count > SNAP_MAP_PAIRS) count = SNAP_MAP_PAIRS;
+            for (unsigned int i = 0; i < count; i++) {
+                char2ul(&block_buf[12 + 8 * i], &copy);
+                fsck_meta_block(c, copy, "cópia de snapshot", r);
+            }
+            b = next;
+        }
+    }
+}
+
+// Valida os campos do superbloco já decodificado em c->m->sb
+// Retorna 0 ou -1 se a geometria for inválida (volume não verificável)
+static int fsck_check_superblock(fsck_t *c, MyFSCheckReport *r) {
+    superblock_t *sb = &c->m->sb;
+    unsigned int per_sector = inodeNumInodesPerSector();
+
+    if (sb->magic_number != MYFS) {
+        printf("[Fsck] Superbloco: assinatura inválida (não é um volume MyFS)\n");
+        r->badSuperblock++;
+        return -1;
+    }
+    if (sb->block_size != 512 || sb->total_blocks == 0 ||
+        sb->total_blocks > diskGetNumSectors(c->m->disk) ||
+        sb->inode_start_block != inodeAreaBeginSector() || sb->inode_count == 0 ||
+        sb->data_start_block != sb->inode_start_block + (sb->cg_count > 0 ? sb->cg_inode_blocks :
+                                (sb->inode_count + per_sector - 1) / per_sector) ||
+        sb->data_start_block >= sb->total_blocks ||
+        sb->root_inode < 1 || sb->root_inode > sb->inode_count) {
+        printf("[Fsck] Superbloco: geometria inválida (blocos, área de i-nodes ou raiz)\n");
+        r->badSuperblock++;
+        return -1;
+    }
+    // Grupos de cilindros: cada um com a sua fatia da tabela de i-nodes
+    if (sb->cg_count > 0 &&
+        (sb->cg_count > ALLOC_GROUPS_MAX || sb->cg_inode_blocks == 0 ||
+         sb->cg_sectors <= sb->data_start_block || sb->cg_count * sb->cg_sectors > sb->total_blocks ||
+         (unsigned long)sb->cg_count * sb->cg_sectors > BITMAP_BLOCKS ||
+         sb->inode_count != sb->cg_count * sb->cg_inode_blocks * per_sector)) {
+        printf("[Fsck] Superbloco: grupos de cilindros inválidos\n");
+        r->badSuperblock++;
+        return -1;
+    }
+    if (sb->journal_blocks > 0 && (sb->journal_start < sb->data_start_block ||
+                                   sb->journal_blocks > sb->total_blocks - sb->journal_start)) {
+        printf("[Fsck] Superbloco: área do diário inválida\n");
+        r->badSuperblock++;
+        return -1;
+    }
+    if (sb->reserved_blocks >= sb->total_blocks) {
+        printf("[Fsck] Superbloco: %u blocos reservados num volume de %u\n", sb->reserved_blocks,
+               sb->total_blocks);
+        r->badSuperblock++;
+        if (c->repair) {
+            sb->reserved_blocks = 0;
+            r->repaired++;
+        }
+    }
+    unsigned int known = SB_FLAG_SNAPSHOT | SB_FLAG_DEDUP | SB_FLAG_COMPRESS | SB_FLAG_CHECKSUMS |
+                         SB_FLAG_BITMAP_STALE;
+    if (sb->flags & ~known) {
+        printf("[Fsck] Superbloco: flags desconhecidas 0x%x\n", sb->flags & ~known);
+        r->badSuperblock++;
+        if (c->repair) {
+            sb->flags &= known;
+            r->repaired++;
+        }
+    }
+    return 0;
+}
+
+// Lê a tabela de referências registrada no superbloco para c->m->refcount,
+// contando seus setores como metadados. Um setor inválido ou ilegível fica
+// zerado (o reparo o regrava a partir das contagens)
+static void fsck_load_refcounts(fsck_t *c, MyFSCheckReport *r) {
+    myfs_mount_t *m = c->m;
+    for (int i = 0; i < REFCOUNT_SECTORS; i++) {
+        if (m->sb.refcount_block[i] == 0) continue;
+        if (fsck_meta_block(c, m->sb.refcount_block[i], "tabela de referências", r) < 0) {
+            if (c->repair) {
+                m->sb.refcount_block[i] = 0;
+                r->repaired++;
+            }
+            continue;
+        }
+        if (diskReadSector(m->disk, m->sb.refcount_block[i], &m->refcount[512 * i]) < 0) {
+            printf("[Fsck] Tabela de referências: setor %d ilegível\n", i);
+            memset(&m->refcount[512 * i], 0, 512);
+            r->badRefcounts++;
+        }
+    }
+}
+
+// Compara o mapa de bits e a tabela de referências do disco com as
+// contagens de donos e, no reparo, grava os corrigidos. expected recebe o
+// mapa de bits esperado. bitmap_ok indica se o mapa do disco foi lido
+static void fsck_compare_maps(fsck_t *c, int bitmap_ok, unsigned char *expected, MyFSCheckReport *r) {
+    myfs_mount_t *m = c->m;
+    unsigned char table[REFCOUNT_SECTORS * 512];
+    memset(expected, 0, 512);
+    memset(table, 0, sizeof(table));
+
+    for (unsigned int b = 0; b < c->limit; b++) {
+        unsigned int data = atomic_load(&c->data_uses[b]);
+        unsigned int meta = atomic_load(&c->meta_uses[b]) + (layout_meta(m, b) != 0);
+        if (data + meta > 0) map_set(expected, b);
+        if (meta > 1 || (meta > 0 && data > 0)) {
+            printf("[Fsck] Bloco %u: metadado usado por %u donos\n", b, data + meta);
+            r->crossLinked++;
+        }
+        if (data > 1) table[b] = (data - 1 > REFCOUNT_MAX ? REFCOUNT_MAX : data - 1);
+    }
+
+    unsigned int leaked = 0, missing = 0, refs = 0;
+    for (unsigned int b = 0; b < BITMAP_BLOCKS; b++) {
+        int used = b < c->limit && map_test(expected, b);
+        if (bitmap_ok && b < c->limit && map_test(m->block_bitmap, b) && !used) leaked++;
+        if (bitmap_ok && b < c->limit && !map_test(m->block_bitmap, b) && used) missing++;
+        if (m->refcount[b] != table[b]) refs++;
+    }
+    if (!bitmap_ok) {
+        printf("[Fsck] Mapa de bits ilegível\n");
+        r->badSuperblock++;
+    }
+    if (leaked) printf("[Fsck] %u bloco(s) marcado(s) em uso sem dono\n", leaked);
+    if (missing) printf("[Fsck] %u bloco(s) em uso marcado(s) como livre(s)\n", missing);
+    if (refs) printf("[Fsck] %u contador(es) errado(s) na tabela de referências\n", refs);
+    r->leakedBlocks += leaked;
+    r->missingBlocks += missing;
+    r->badRefcounts += refs;
+    if (!c->repair) return;
+
+    // Setores da tabela: um setor com algum bloco compartilhado precisa de
+    // um bloco (tirado do mapa esperado); um setor todo zerado o devolve
+    for (int i = 0; i < REFCOUNT_SECTORS; i++) {
+        unsigned char *sector = &table[512 * i];
+        int needed = 0, changed = memcmp(sector, &m->refcount[512 * i], 512) != 0;
+        for (int j = 0; j < 512 && !needed; j++) needed = sector[j] != 0;
+
+        unsigned int blk = m->sb.refcount_block[i];
+        if (!needed && blk != 0) {
+            if (atomic_load(&c->meta_uses[blk]) == 1) map_clear(expected, blk);
+            m->sb.refcount_block[i] = 0;
+        } else if (needed && blk == 0) {
+            for (unsigned int b = m->sb.data_start_block; b < c->limit && blk == 0; b++)
+                if (!map_test(expected, b)) blk = b;
+            if (blk == 0) {
+                printf("[Fsck] Sem blocos livres para a tabela de referências\n");
+                continue;
+            }
+            map_set(expected, blk);
+            if (diskWriteSector(m->disk, blk, sector) == 0) m->sb.refcount_block[i] = blk;
+        } else if (needed && changed) {
+            diskWriteSector(m->disk, blk, sector);
+        }
+    }
+    if (!bitmap_ok || leaked || missing || memcmp(expected, m->block_bitmap, 512) != 0)
+        diskWriteSector(m->disk, 1, expected);
+    r->repaired += leaked + missing + refs + !bitmap_ok;
+}
+
+// Verifica (e, com c->repair, corrige) o volume cujo superbloco, já validado,
+// está em c->m->sb. Os problemas encontrados são somados a *r
+// Retorna 0 em caso de sucesso ou -1 se o volume não puder ser verificado
+static int fsck_volume(fsck_t *c, MyFSCheckReport *r) {
+    myfs_mount_t *m = c->m;
+    unsigned int count = m->sb.inode_count, root = m->sb.root_inode;
+    unsigned char expected[512];
+    int ret = -1;
+
+    c->limit = (m->sb.total_blocks < BITMAP_BLOCKS ? m->sb.total_blocks : BITMAP_BLOCKS);
+    c->state = calloc(count + 1, 1);
+    c->type = calloc(count + 1, 1);
+    c->links = calloc(count + 1, sizeof(atomic_uint));
+    c->data_uses = calloc(c->limit, sizeof(atomic_uint));
+    c->meta_uses = calloc(c->limit, sizeof(atomic_uint));
+    c->cache = malloc((size_t)c->limit * 512);
+    c->cached = calloc(c->limit, 1);
+    m->block_bitmap = calloc(1, 512);
+    if (!c->state || !c->type || !c->links || !c->data_uses || !c->meta_uses || !c->cache ||
+        !c->cached || !m->block_bitmap)
+        goto out;
+    int bitmap_ok = (diskReadSector(m->disk, 1, m->block_bitmap) == 0);
+
+    c->cache_sectors = c->limit;
+    fsck_prefetch(c);
+    fsck_run(c, fsck_scan_inode, r);
+    if (c->state[root] != FSCK_USED || c->type[root] != INODE_TYPE_DIRECTORY) {
+        printf("[Fsck] Erro: O i-node raiz (%u) não é um diretório válido.\n", root);
+        goto out;
+    }
+    fsck_run(c, fsck_scan_dir, r);
+
+    // I-nodes em uso que nenhuma entrada alcança (myFSUnlink não os devolve)
+    for (unsigned int inum = 1; inum <= count; inum++) {
+        if (c->state[inum] != FSCK_USED || inum == root || atomic_load(&c->links[inum]) != 0) continue;
+        printf("[Fsck] I-node %u: em uso, mas sem nenhuma entrada de diretório\n", inum);
+        r->orphanInodes++;
+        if (c->repair && fsck_clear_inode(c, inum) == 0) {
+            c->state[inum] = FSCK_FREE;
+            r->repaired++;
+        }
+    }
+
+    fsck_run(c, fsck_count_blocks, r);
+    fsck_load_refcounts(c, r);
+    fsck_count_snapshots(c, r);
+    fsck_compare_maps(c, bitmap_ok, expected, r);
+
+    for (unsigned int inum = 1; inum <= count; inum++)
+        if (c->state[inum] != FSCK_FREE) r->inodesUsed++;
+    for (unsigned int b = 0; b < c->limit; b++) {
+        if (map_test(expected, b)) r->blocksUsed++;
+        else if (!layout_meta(m, b)) r->freeBlocks++;
+    }
+    // Com o mapa de bits refeito, o volume deixa de precisar da verificação na montagem
+    if (c->repair && (r->repaired > 0 || m->sb.free_blocks != r->freeBlocks || (m->sb.flags & SB_FLAG_BITMAP_STALE))) {
+        unsigned char sb_buf[512];
+        m->sb.flags &= ~SB_FLAG_BITMAP_STALE;
+        sb_encode(m, sb_buf, r->freeBlocks, 1);
+        diskWriteSector(m->disk, 0, sb_buf);
+    }
+    ret = 0;
+
+out:
+    c->cache_sectors = 0;
+    free(c->state);
+    free(c->type);
+    free(c->links);
+    free(c->data_uses);
+    free(c->meta_uses);
+    free(c->cache);
+    free(c->cached);
+    return ret;
+}
+
+// ================= Desfragmentação ===============
+// Um arquivo que cresceu bloco a bloco ao lado de outros fica espalhado pela
+// área de dados, e cada troca de cilindro numa leitura sequencial custa
+// tempo de busca. A desfragmentação copia os blocos de dados do arquivo para
+// uma faixa contígua livre (na ordem de leitura, com os blocos de indireção
+// antes dos blocos que eles apontam), regrava a árvore de indireção na faixa
+// e troca o mapa do i-node com a gravação do seu setor (inodeRelocate). Só
+// depois os blocos antigos voltam ao mapa de bits: uma queda no meio deixa
+// apenas blocos perdidos, que myFSCheck recupera. Blocos compartilhados
+// (clones e deduplicação) não são movidos.
+
+// Acrescenta à lista um bloco visitado por inodeWalkBlocks (os buracos dos
+// arquivos esparsos e comprimidos ficam de fora)
+static int defrag_collect(unsigned int block_num, int level, void *arg) {
+    defrag_list_t *l = arg;
+    if (block_num == 0 || block_num == COMPRESS_HOLE) return 0;
+    if (l->count == l->cap) {
+        unsigned int cap = l->cap + DEFRAG_LIST_CHUNK;
+        unsigned int *blocks = realloc(l->blocks, cap * sizeof(unsigned int));
+        if (blocks) l->blocks = blocks;
+        unsigned char *levels = realloc(l->levels, cap);
+        if (levels) l->levels = levels;
+        if (!blocks || !levels) {
+            l->failed = 1;
+            return 1;
+        }
+        l->cap = cap;
+    }
+    if (ref_shared(l->m, block_num)) l->shared = 1;
+    l->blocks[l->count] = block_num;
+    l->levels[l->count++] = (unsigned char)level;
+    return 0;
+}
+
+// Dá a cada bloco o seu lugar na faixa nova, na mesma ordem de
+// defrag_collect (os buracos continuam buracos)
+static unsigned int defrag_map(unsigned int block_num, int level, void *arg) {
+    defrag_list_t *l = arg;
+    (void)level;
+    if (block_num == 0 || block_num == COMPRESS_HOLE || l->next == l->count) return block_num;
+    return l->run + l->next++;
+}
+
+// Conta os trechos contíguos dos count blocos de blocks e, em *seek, os
+// cilindros que as cabeças percorrem ao lê-los nessa ordem
+static unsigned int defrag_measure(myfs_mount_t *m, const unsigned int *blocks, unsigned int count,
+                                   unsigned long *seek) {
+    unsigned int extents = 0;
+    unsigned long cyl = 0, prev = 0;
+    *seek = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        if (i == 0 || blocks[i] != blocks[i - 1] + 1) extents++;
+        if (diskAddrToCylinder(m->disk, blocks[i], &cyl) < 0) cyl = prev;
+        if (i > 0) *seek += (cyl > prev ? cyl - prev : prev - cyl);
+        prev = cyl;
+    }
+    return extents;
 }
 
-// Encontra um descritor de arquivo livre na tabela
-// Retorna o índice da entrada livre ou -1 se a tabela estiver cheia
-static int find_free_fd(void) {
-    for (int fd_index = 0; fd_index < MAX_OPEN_FILES; fd_index++) {
-        if (!open_files_table[fd_index].is_used) {
-            return fd_index;
+// Move os blocos da lista l, do i-node inode, para uma faixa contígua nova.
+// Deve ser chamada com o lock de escrita do i-node
+// Retorna 0 em caso de sucesso ou -1 se não houver faixa livre ou a cópia
+// falhar (o arquivo continua onde estava)
+static int defrag_move(myfs_mount_t *m, Inode *inode, defrag_list_t *l) {
+    unsigned char data[IO_RUN_MAX * 512];
+    unsigned int from[IO_RUN_MAX], to[IO_RUN_MAX], n = 0;
+    unsigned int *fresh = malloc(l->count * sizeof(unsigned int));
+    int run = (fresh ? alloc_run(m, l->count) : -1), ok = 1;
+    if (run == -1) {
+        free(fresh);
+        return -1;
+    }
+    for (unsigned int i = 0; i < l->count; i++) fresh[i] = (unsigned int)run + i;
+
+    // Copia os blocos de dados; os de indireção são regravados por inodeRelocate
+    for (unsigned int i = 0; ok && i <= l->count; i++) {
+        if (n == IO_RUN_MAX || (i == l->count && n > 0)) {
+            ok = (read_sectors(m, from, n, data) == 0 && write_sectors(m, to, n, data) == 0);
+            n = 0;
+        }
+        if (i < l->count && l->levels[i] == 0) {
+            from[n] = l->blocks[i];
+            to[n++] = fresh[i];
         }
     }
-    return -1;  // Tabela de arquivos abertos cheia
+    l->run = (unsigned int)run;
+    l->next = 0;
+    if (ok) ok = (inodeRelocate(inode, defrag_map, l) == 0);
+
+    // Sucesso: os blocos antigos são devolvidos e a lista passa a descrever a
+    // faixa nova. Falha: a faixa nova é devolvida
+    if (ok) {
+        unsigned int *old = l->blocks;
+        l->blocks = fresh;
+        fresh = old;
+    }
+    release_blocks(m, fresh, l->count);
+    free(fresh);
+    return ok ? 0 : -1;
 }
 
+// Mede o i-node inum e, sem measure_only, desfragmenta-o se tiver mais de um
+// trecho contíguo, somando o resultado em *r
+static void defrag_inode(myfs_mount_t *m, unsigned int inum, int measure_only, MyFSDefragReport *r) {
+    defrag_list_t l;
+    memset(&l, 0, sizeof(l));
+    l.m = m;
+
+    if (measure_only) inode_rdlock(m, inum);
+    else inode_wrlock(m, inum);
+    Inode *inode = inodeLoad(inum, m->disk);
+    unsigned int type = (inode ? inodeGetFileType(inode) : 0);
+    if (inode && !(type & INODE_FLAG_INLINEDATA) &&
+        ((type & ~INODE_TYPE_FLAGS) == INODE_TYPE_REGULAR || (type & ~INODE_TYPE_FLAGS) == INODE_TYPE_DIRECTORY) &&
+        inodeWalkBlocks(inode, defrag_collect, &l) == 0 && !l.failed && l.count > 0) {
+        unsigned long seek;
+        unsigned int extents = defrag_measure(m, l.blocks, l.count, &seek);
+        r->filesScanned++;
+        r->extentsBefore += extents;
+        r->seekBefore += seek;
+
+        if (!measure_only && extents > 1) {
+            if (!l.shared && defrag_move(m, inode, &l) == 0) {
+                r->filesMoved++;
+                extents = defrag_measure(m, l.blocks, l.count, &seek);
+            } else {
+                r->filesSkipped++;
+            }
+        }
+        r->extentsAfter += extents;
+        r->seekAfter += seek;
+    }
+    inodeFree(inode);
+    inode_unlock(m, inum);
+    free(l.blocks);
+    free(l.levels);
+}
 
 //Funcao para verificacao se o sistema de arquivos está ocioso, ou seja,
 //se nao ha quisquer descritores de arquivos em uso atualmente. Retorna
 //um positivo se ocioso ou, caso contrario, 0.
 
 int myFSIsIdle (Disk *d) {
-    for (int i = 0; i < MAX_OPEN_FILES; i++) {
-        if (open_files_table[i].is_used) {
-            return 0;  // Não está ocioso - há arquivos abertos
-        }
-    }
-    return 1;  // Está ocioso - nenhum arquivo aberto
+    // Ocioso apenas se nenhum arquivo ou diretório do volume estiver aberto
+    myfs_mount_t *m = mount_of(d);
+    return !m || atomic_load(&m->open_count) == 0;
 }
 
-//Funcao para formatacao de um disco com o novo sistema de arquivos
-//com tamanho de blocos igual a blockSize. Retorna o numero total de
-//blocos disponiveis no disco, se formatado com sucesso. Caso contrario,
-//retorna -1.
-int myFSFormat (Disk *d, unsigned int blockSize) {
-	if (blockSize != 512) return -1; 
-
+// Grava as estruturas de um volume vazio (superbloco, mapa de bits, i-nodes,
+// área do diário e diretório raiz) no disco do volume m, que o mount irá
+// carregar depois, com as opções opt (já com os padrões preenchidos)
+// Retorna o número de blocos livres ou -1 em caso de falha ou opções que
+// não cabem no disco
+static int format_volume(myfs_mount_t *m, unsigned int blockSize, const MyFSFormatOptions *opt) {
+    Disk *d = m->disk;
     unsigned long total_sectors = diskGetNumSectors(d);
-    
+
+    // 0. Grava todos os setores uma vez: nenhum fica com o campo ECC de setor
+    // nunca escrito, então o volume (SB_FLAG_CHECKSUMS) confere toda leitura
+    static unsigned char zero_run[FORMAT_ZERO_RUN * 512];
+    for (unsigned long s = 0; s < total_sectors; s += FORMAT_ZERO_RUN) {
+        unsigned long n = (total_sectors - s < FORMAT_ZERO_RUN ? total_sectors - s : FORMAT_ZERO_RUN);
+        if (diskWriteSectors(d, s, n, zero_run) < 0) return -1;
+    }
+
     // 1. Configura e Grava Superbloco
-    sb_cache.magic_number = MYFS;
-    sb_cache.block_size = blockSize;
-    sb_cache.total_blocks = total_sectors;
-    sb_cache.inode_start_block = 2; 
+    m->sb.magic_number = MYFS;
+    m->sb.flags = SB_FLAG_CHECKSUMS;
+    m->sb.block_size = blockSize;
+    m->sb.total_blocks = total_sectors;
+    m->sb.inode_start_block = 2; 
     
-    // Define 10% do disco para inodes
-    unsigned int num_inode_blocks = (total_sectors / 10);
-    if (num_inode_blocks < 1) num_inode_blocks = 1;
-    
-    sb_cache.inode_count = num_inode_blocks * (blockSize / 64); // 64 bytes por inode (assumindo inode.c padrão)
-    sb_cache.data_start_block = sb_cache.inode_start_block + num_inode_blocks;
-    sb_cache.free_blocks = total_sectors - sb_cache.data_start_block;
-    sb_cache.root_inode = ROOT_INODE_NUM;
+    // Grupos de cilindros (como no FFS): cada grupo começa com a sua fatia
+    // da tabela de i-nodes, seguida dos dados dos seus arquivos. Os grupos
+    // têm opt->groupCylinders cilindros (ou, sem a opção, o suficiente para
+    // o disco caber em ALLOC_GROUPS_MAX grupos); o último leva os que sobram.
+    // Com MYFS_FORMAT_NO_GROUPS, a tabela é única, logo depois do mapa de bits
+    unsigned long usable = (total_sectors < BITMAP_BLOCKS ? total_sectors : BITMAP_BLOCKS);
+    unsigned int per_sector = inodeNumInodesPerSector();
+    unsigned int num_inode_blocks;
+    if (opt->groupCylinders == MYFS_FORMAT_NO_GROUPS) {
+        m->sb.cg_count = 0;
+        m->sb.cg_sectors = 0;
+        m->sb.cg_inode_blocks = 0;
+        num_inode_blocks = (unsigned long)usable * blockSize / opt->bytesPerInode / per_sector;
+        if (num_inode_blocks < 1) num_inode_blocks = 1;
+        m->sb.data_start_block = m->sb.inode_start_block + num_inode_blocks;
+    } else {
+        unsigned long cylinders = diskGetNumCylinders(d);
+        unsigned long cyl_sectors = (cylinders > 0 && total_sectors / cylinders > 0 ? total_sectors / cylinders : usable);
+        unsigned long cyl_per_group = opt->groupCylinders;
+        if (cyl_per_group == 0) cyl_per_group = ((usable / cyl_sectors) + ALLOC_GROUPS_MAX - 1) / ALLOC_GROUPS_MAX;
+        if (cyl_per_group < 1) cyl_per_group = 1;
+        if (cyl_per_group * cyl_sectors > usable) cyl_per_group = usable / cyl_sectors;
+        m->sb.cg_sectors = cyl_per_group * cyl_sectors;
+        m->sb.cg_count = (m->sb.cg_sectors > 0 ? usable / m->sb.cg_sectors : 0);
+        if (m->sb.cg_count < 1) {
+            m->sb.cg_count = 1;
+            m->sb.cg_sectors = usable;
+        }
+        if (m->sb.cg_count > ALLOC_GROUPS_MAX) {
+            printf("[MyFS] Erro: Grupos de %u cilindros passam de %d grupos.\n", opt->groupCylinders, ALLOC_GROUPS_MAX);
+            return -1;
+        }
 
-    unsigned char sb_buf[512] = {0};
-    unsigned int pos = 0;
-    ul2char(sb_cache.magic_number, &sb_buf[pos]); pos += 4;
-    ul2char(sb_cache.block_size, &sb_buf[pos]); pos += 4;
-    ul2char(sb_cache.total_blocks, &sb_buf[pos]); pos += 4;
-    ul2char(sb_cache.inode_start_block, &sb_buf[pos]); pos += 4;
-    ul2char(sb_cache.inode_count, &sb_buf[pos]); pos += 4;
-    ul2char(sb_cache.data_start_block, &sb_buf[pos]); pos += 4;
-    ul2char(sb_cache.free_blocks, &sb_buf[pos]); pos += 4;
-    ul2char(sb_cache.root_inode, &sb_buf[pos]); pos += 4;
-    
-    if (diskWriteSector(d, 0, sb_buf) < 0) return -1;
+        // Densidade de i-nodes: um i-node para cada opt->bytesPerInode bytes do
+        // grupo, em setores inteiros de i-nodes (pelo menos um)
+        unsigned long inodes_per_group = (unsigned long)m->sb.cg_sectors * blockSize / opt->bytesPerInode;
+        m->sb.cg_inode_blocks = inodes_per_group / per_sector;
+        if (m->sb.cg_inode_blocks < 1) m->sb.cg_inode_blocks = 1;
+        num_inode_blocks = m->sb.cg_count * m->sb.cg_inode_blocks;
+        m->sb.data_start_block = m->sb.inode_start_block + m->sb.cg_inode_blocks;
+    }
+    m->sb.bytes_per_inode = opt->bytesPerInode;
+    m->sb.inode_count = num_inode_blocks * per_sector;
+    m->sb.root_inode = ROOT_INODE_NUM;
+
+    // Área do diário: logo depois dos i-nodes do grupo 0, que ainda precisa
+    // de um bloco para o diretório raiz
+    unsigned long first_group_end = (m->sb.cg_count > 0 ? m->sb.cg_sectors : usable);
+    m->sb.journal_start = m->sb.data_start_block;
+    m->sb.journal_blocks = opt->journalBlocks;
+    if (m->sb.data_start_block >= first_group_end ||
+        (unsigned long)m->sb.journal_start + m->sb.journal_blocks >= first_group_end) {
+        printf("[MyFS] Erro: I-nodes e diário não cabem nos grupos de %lu setores.\n", first_group_end);
+        return -1;
+    }
+    m->sb.free_blocks = total_sectors - m->sb.data_start_block; // recontado ao fim
+    m->sb.reserved_blocks = 0; // calculado ao fim, sobre os blocos livres
 
-    // 2. Inicializa o Bitmap Global (Necessário para find_free_block funcionar agora)
-    if (block_bitmap) free(block_bitmap);
+    if (save_superblock(m) < 0) return -1;
+
+    // 2. Inicializa o Bitmap (Necessário para find_free_block funcionar agora)
+    inodeSetBlockAllocator(alloc_inode_block, free_inode_block);
+    inodeSetLayout(inode_sector_of);
     unsigned int bitmap_size = (total_sectors + 7) / 8; // Tamanho em bytes
     // Arredonda para tamanho de setor para escrita
     unsigned int bitmap_sector_size = (bitmap_size + 512 - 1) / 512 * 512;
-    block_bitmap = calloc(1, bitmap_sector_size);
-    if (!block_bitmap) return -1;
+    m->block_bitmap = calloc(1, bitmap_sector_size);
+    if (!m->block_bitmap) return -1;
 
-    // Marca blocos ocupados (SB + Bitmap + Inodes)
-    for (unsigned int i = 0; i < sb_cache.data_start_block; i++) {
-        block_bitmap[i/8] |= (1 << (i%8));
+    // Marca blocos ocupados (SB + Bitmap + Inodes de cada grupo)
+    for (unsigned int i = 0; i < usable; i++) {
+        if (layout_meta(m, i)) m->block_bitmap[i/8] |= (1 << (i%8));
     }
     // Grava Bitmap no disco (Bloco 1)
-    if (diskWriteSector(d, 1, block_bitmap) < 0) {
-        free(block_bitmap); block_bitmap = NULL; return -1;
+    if (diskWriteSector(d, 1, m->block_bitmap) < 0) {
+        return -1;
     }
 
+    setup_alloc_groups(m);
+
     // 3. Zera a área de i-nodes (CRUCIAL: Remove lixo para inodeCreate não falhar ao ler 'next')
     unsigned char zero_buf[512] = {0};
     for (unsigned int i = 0; i < num_inode_blocks; i++) {
-        if (diskWriteSector(d, sb_cache.inode_start_block + i, zero_buf) < 0) {
-             free(block_bitmap); block_bitmap = NULL; return -1;
+        unsigned int sector = (m->sb.cg_count > 0 ?
+                               group_inode_start(m, i / m->sb.cg_inode_blocks) + i % m->sb.cg_inode_blocks :
+                               m->sb.inode_start_block + i);
+        if (diskWriteSector(d, sector, zero_buf) < 0) {
+             return -1;
         }
     }
+    // e a do diário
+    for (unsigned int i = 0; i < m->sb.journal_blocks; i++) {
+        if (diskWriteSector(d, m->sb.journal_start + i, zero_buf) < 0) return -1;
+    }
 
     // 4. Inicializa TODOS os i-nodes (CRUCIAL: Escreve os números 1..N no disco)
     // Sem isso, inodeFindFreeInode lê número 0 e acha que é inválido.
-    for (unsigned int i = 1; i <= sb_cache.inode_count; i++) {
+    for (unsigned int i = 1; i <= m->sb.inode_count; i++) {
         Inode *temp = inodeCreate(i, d);
         if (temp) {
-            free(temp); // Apenas cria/grava e libera
+            inodeFree(temp); // Apenas cria/grava e libera
         }
     }
 
-    // 5. Configura o Diretório Raiz
+    // 5. Configura o Diretório Raiz (o bloco fica no grupo do seu i-node)
+    inode_wrlock(m, ROOT_INODE_NUM);
     Inode *root = inodeLoad(ROOT_INODE_NUM, d);
     if (!root) {
-        free(block_bitmap); block_bitmap = NULL; return -1;
+        inode_unlock(m, ROOT_INODE_NUM);
+        return -1;
     }
     
     inodeSetFileType(root, INODE_TYPE_DIRECTORY);
     
     // Aloca bloco de dados para o diretório
-    int root_block = find_free_block(d);
+    int root_block = find_free_block(m);
     if (root_block != -1) {
-        diskWriteSector(d, root_block, zero_buf); // Limpa conteúdo do diretório
+        unsigned char dir_buf[512];
+        dir_init_block(m, dir_buf); // Bloco de diretório vazio
+        diskWriteSector(d, root_block, dir_buf);
         inodeAddBlock(root, root_block);
     }
     
-    inodeSetFileSize(root, 0);
+    inodeSetFileSize(root, inodeGetNumBlocks(root) * m->sb.block_size);
     inodeSave(root);
-    free(root);
+    inodeFree(root);
+    inode_unlock(m, ROOT_INODE_NUM);
+
+    // Regrava o mapa de bits, com o bloco da raiz, e o superbloco com o total
+    // de blocos livres dos grupos e a parte deles reservada
+    m->sb.free_blocks = count_free_blocks(m);
+    m->sb.reserved_blocks = (unsigned long)m->sb.free_blocks * opt->reservedPercent / 100;
+    if (save_bitmap(m) < 0) return -1;
+    save_superblock(m);
+
+    return m->sb.free_blocks;
+}
+
+//Funcao para formatacao de um disco com o novo sistema de arquivos
+//com tamanho de blocos igual a blockSize. Retorna o numero total de
+//blocos disponiveis no disco, se formatado com sucesso. Caso contrario,
+//retorna -1.
+int myFSFormat (Disk *d, unsigned int blockSize) {
+    return myFSFormatEx(d, blockSize, NULL);
+}
 
-    // Limpeza: Libera bitmap global pois o mount irá carregá-lo novamente depois
-    free(block_bitmap);
-    block_bitmap = NULL;
+//Funcao para formatacao de um disco com as opcoes de options (NULL ou
+//campos com 0 = padrao de myFSFormat), gravadas no superbloco. Retorna o
+//numero de blocos disponiveis no disco ou -1 em caso de falha ou opcoes
+//invalidas
+int myFSFormatEx (Disk *d, unsigned int blockSize, const MyFSFormatOptions *options) {
+	if (blockSize != 512) return -1; 
 
-    return sb_cache.free_blocks;
+    MyFSFormatOptions opt = { 0, 0, 0, 0 };
+    if (options) opt = *options;
+    if (opt.bytesPerInode == 0) opt.bytesPerInode = FORMAT_BYTES_PER_INODE;
+    // Um i-node não pode ocupar menos que o seu lugar na tabela
+    if (opt.bytesPerInode < blockSize / inodeNumInodesPerSector() || opt.reservedPercent > FORMAT_RESERVED_MAX)
+        return -1;
 
+    // O volume em formatação fica visível (mount_of) para o alocador de
+    // blocos dos i-nodes; um disco já montado não pode ser formatado
+    myfs_mount_t *m = mount_create(d);
+    if (!m) return -1;
+    if (mount_attach(m) < 0) {
+        mount_destroy(m);
+        return -1;
+    }
+    int ret = format_volume(m, blockSize, &opt);
+    mount_detach(m);
+    mount_destroy(m);
+    return ret;
 }
 
 //Funcao para montagem/desmontagem do sistema de arquivos, se possível.
@@ -241,48 +3776,121 @@ int myFSFormat (Disk *d, unsigned int blockSize) {
 int myFSxMount (Disk *d, int x) {
 	if (x == 1) { // Mount
         unsigned char buf[512];
-        if (diskReadSector(d, 0, buf) != 0) return 0;
-        
-        unsigned int pos = 0;
-        char2ul(&buf[pos], &sb_cache.magic_number); pos += 4;
+        if (mount_of(d)) return 0; // Disco já montado
+        if (diskReadSector(d, 0, buf) != 0) {
+            printf("[MyFS] Erro: Falha ao ler o superbloco (setor corrompido?).\n");
+            return 0;
+        }
+
+        myfs_mount_t *m = mount_create(d);
+        if (!m) return 0;
         
-        if (sb_cache.magic_number != MYFS) {
+        sb_decode(m, buf);
+        if (m->sb.magic_number != MYFS) {
             printf("[MyFS] Erro: Assinatura inválida.\n");
+            mount_destroy(m);
+            return 0;
+        }
+        if (m->sb.cg_count > 0 && (m->sb.cg_sectors == 0 || m->sb.cg_inode_blocks == 0)) {
+            printf("[MyFS] Erro: Grupos de cilindros inválidos.\n");
+            mount_destroy(m);
+            return 0;
+        }
+        if (m->sb.reserved_blocks >= m->sb.total_blocks ||
+            (m->sb.journal_blocks > 0 && (m->sb.journal_start < m->sb.data_start_block ||
+                                          m->sb.journal_blocks > m->sb.total_blocks - m->sb.journal_start))) {
+            printf("[MyFS] Erro: Área do diário ou blocos reservados inválidos.\n");
+            mount_destroy(m);
+            return 0;
+        }
+        if (verify_all_sectors(m) < 0) {
+            printf("[MyFS] Erro: Superbloco corrompido.\n");
+            mount_destroy(m);
             return 0;
         }
-        char2ul(&buf[pos], &sb_cache.block_size); pos += 4;
-        char2ul(&buf[pos], &sb_cache.total_blocks); pos += 4;
-        char2ul(&buf[pos], &sb_cache.inode_start_block); pos += 4;
-        char2ul(&buf[pos], &sb_cache.inode_count); pos += 4;
-        char2ul(&buf[pos], &sb_cache.data_start_block); pos += 4;
-        char2ul(&buf[pos], &sb_cache.free_blocks); pos += 4;
-        char2ul(&buf[pos], &sb_cache.root_inode); pos += 4;
-
-        if (block_bitmap) free(block_bitmap);
-        block_bitmap = calloc(1, 512); 
-        if (!block_bitmap) return 0;
-
-        if (diskReadSector(d, 1, block_bitmap) != 0) {
-            free(block_bitmap);
-            block_bitmap = NULL;
+
+        // Volume que não foi desmontado: o mapa de bits no disco pode dar como
+        // livres blocos já usados, então a verificação o refaz antes da montagem
+        if ((m->sb.flags & SB_FLAG_BITMAP_STALE) && !(m->sb.flags & SB_FLAG_SNAPSHOT)) {
+            mount_destroy(m);
+            printf("[MyFS] Volume não foi desmontado: refazendo o mapa de bits...\n");
+            unsigned int flags;
+            if (myFSCheck(d, 1, 0, NULL) < 0 || diskReadSector(d, 0, buf) != 0) return 0;
+            char2ul(&buf[32], &flags);
+            return (flags & SB_FLAG_BITMAP_STALE ? 0 : myFSxMount(d, 1));
+        }
+
+        m->block_bitmap = calloc(1, 512); 
+        if (!m->block_bitmap || diskReadSector(d, 1, m->block_bitmap) != 0) {
+            // Um mapa de bits ilegível faria o alocador entregar blocos em uso
+            printf("[MyFS] Erro: Falha ao ler o mapa de bits (setor corrompido?).\n");
+            mount_destroy(m);
             return 0;
         }
+        for (int i = 0; i < REFCOUNT_SECTORS; i++) {
+            if (m->sb.refcount_block[i] == 0) continue;
+            if (diskReadSector(d, m->sb.refcount_block[i], &m->refcount[512 * i]) != 0) {
+                mount_destroy(m);
+                return 0;
+            }
+        }
+
+        // O total de blocos livres gravado no superbloco pode estar
+        // desatualizado; os grupos recontam a partir do mapa de bits
+        setup_alloc_groups(m);
+        m->sb.free_blocks = count_free_blocks(m);
+
+        // A visão de um snapshot é somente leitura; num volume comum, os
+        // snapshots existentes voltam a receber cópias antes das escritas
+        m->read_only = (m->sb.flags & SB_FLAG_SNAPSHOT) != 0;
+        atomic_init(&m->dedup_enabled, !m->read_only && (m->sb.flags & SB_FLAG_DEDUP) != 0);
+        atomic_init(&m->compress_enabled, (m->sb.flags & SB_FLAG_COMPRESS) != 0);
+        if (!m->read_only) {
+            for (int k = 0; k < SNAP_MAX; k++) {
+                if (m->sb.snap_sb_block[k] == 0 || snap_load(m, k) == 0) continue;
+                printf("[MyFS] Erro: Falha ao carregar o snapshot %d.\n", k + 1);
+                mount_destroy(m);
+                return 0;
+            }
+            snap_update_held(m);
+            // A partir daqui o mapa de bits no disco só é atualizado na desmontagem
+            m->sb.flags |= SB_FLAG_BITMAP_STALE;
+            if (save_superblock(m) < 0) {
+                mount_destroy(m);
+                return 0;
+            }
+            diskSetWriteHook(d, snap_write_hook, m);
+        }
 
-        memset(open_files_table, 0, sizeof(open_files_table));
-        current_disk = d;
-        fs_mounted = 1;
-        printf("[MyFS] Sistema montado com sucesso! %u blocos livres\n", sb_cache.free_blocks);
+        inodeSetBlockAllocator(alloc_inode_block, free_inode_block);
+        inodeSetLayout(inode_sector_of);
+        if (mount_attach(m) < 0) {
+            printf("[MyFS] Erro: Limite de %d volumes montados atingido.\n", MYFS_MAX_MOUNTS);
+            if (!m->read_only) diskSetWriteHook(d, NULL, NULL);
+            mount_destroy(m);
+            return 0;
+        }
+        printf("[MyFS] Sistema montado com sucesso! %u blocos livres\n", m->sb.free_blocks);
         return 1;
     } else { // Unmount
-        if (!myFSIsIdle(d)) return 0;
-        
-        if (block_bitmap) { 
-            free(block_bitmap); 
-            block_bitmap = NULL; 
+        myfs_mount_t *m = mount_of(d);
+        if (!m || !myFSIsIdle(d)) return 0;
+
+        // O índice de deduplicação devolve suas referências; o mapa de bits e
+        // o total de blocos livres, somado dos grupos, são persistidos, e só
+        // com o mapa gravado o superbloco deixa de marcá-lo como atrasado
+        if (!m->read_only) {
+            dedup_clear(m);
+            if (save_bitmap(m) == 0) {
+                pthread_mutex_lock(&m->sb_lock);
+                m->sb.flags &= ~SB_FLAG_BITMAP_STALE;
+                pthread_mutex_unlock(&m->sb_lock);
+            }
+            save_superblock(m);
         }
-        
-        current_disk = NULL;
-        fs_mounted = 0;
+        mount_detach(m);
+        if (!m->read_only) diskSetWriteHook(d, NULL, NULL);
+        mount_destroy(m);
         printf("[MyFS] Sistema desmontado.\n");
         return 1;
     }
@@ -292,117 +3900,32 @@ int myFSxMount (Disk *d, int x) {
 //Funcao para abertura de um arquivo, a partir do caminho especificado
 //em path, no disco montado especificado em d, no modo Read/Write,
 //criando o arquivo se nao existir. Retorna um descritor de arquivo,
-//em caso de sucesso. Retorna -1, caso contrario.
-int myFSOpen (Disk *d, const char *path) {
-	if (!fs_mounted || !path || path[0] != '/') return -1;
-    const char *name = path + 1;
-    if (strlen(name) > MAX_FILENAME_LEN || strlen(name) == 0) return -1;
-
-	//carrega inode do diretorio raiz
-    Inode *root = inodeLoad(sb_cache.root_inode, d);
-    if (!root) {
-        fprintf(stderr, "[Open] Falha ao carregar inode raiz (SB: %u)\n", sb_cache.root_inode);
-        return -1;
-    }
-
-	//procura entrada de diretorio com o nome solicitado
-    unsigned int found_inumber = 0;
-    unsigned int size = inodeGetFileSize(root);
-	unsigned int num_blocks = (size + sb_cache.block_size - 1) / sb_cache.block_size;
-    unsigned char block_buf[512];
-
-	//percorre todos os blocos do diretorio raiz
-    for (unsigned int i = 0; i < num_blocks; i++) {
-        unsigned int addr = inodeGetBlockAddr(root, i);
-        if (addr == 0) continue;
-        //le blocos do diretorio
-		diskReadSector(d, addr, block_buf);
-        
-		//percorre todas as entradas do bloco
-        for (int off = 0; off < 512; off += sizeof(dir_entry_t)) {
-            dir_entry_t *entry = (dir_entry_t *)(block_buf + off);
-            if (entry->inode_number != 0 && strncmp(entry->filename, name, MAX_FILENAME_LEN) == 0) {
-                fprintf(stderr, "[DEBUG Open] Lendo entrada: '%s' (inode %u)\n", entry->filename, entry->inode_number);
-                //arquivo encontrado
-				if (strncmp(entry->filename, name, MAX_FILENAME_LEN) == 0) {
-                    found_inumber = entry->inode_number;
-                    break;
-                }
-            }
-        }
-        if (found_inumber) break;
-    }
+//em caso de sucesso. Retorna -1, caso contrario.
+int myFSOpen (Disk *d, const char *path) {
+    char name[MAX_FILENAME_LENGTH + 1];
+    unsigned int parent, type = 0;
+    myfs_mount_t *m = mount_of(d);
 
-    if (found_inumber == 0) {
-        found_inumber = inodeFindFreeInode(1, d);
-        if (found_inumber == 0) { 
-            fprintf(stderr, "[Open] Erro: Sem inodes livres\n");
-            free(root); return -1; 
-        }
-        // cria novo arquivo
-        Inode *new_file = inodeCreate(found_inumber, d);
-        if (!new_file) { free(root); return -1; }
-        inodeSetFileType(new_file, INODE_TYPE_REGULAR);
-        inodeSave(new_file);
-        free(new_file);
-		// adiciona entrada no diretorio raiz
-        unsigned int entries_per_block = sb_cache.block_size / sizeof(dir_entry_t);
-        int added = 0;
-        
-        for (unsigned int pos = 0; ; pos++) {
-            unsigned int block_idx = pos / entries_per_block;
-            unsigned int offset = (pos % entries_per_block) * sizeof(dir_entry_t);
-            unsigned int block_addr = inodeGetBlockAddr(root, block_idx);
-
-            // Se precisa alocar novo bloco para o diretório
-            if (block_addr == 0) {
-                int new_block = find_free_block(d);
-                if (new_block == -1) break; // Disco cheio
-                
-                memset(block_buf, 0, 512);
-                diskWriteSector(d, new_block, block_buf);
-                if (inodeAddBlock(root, new_block) < 0) break;
-                block_addr = new_block;
-            } else {
-                diskReadSector(d, block_addr, block_buf);
-            }
+	//localiza o diretorio pai, percorrendo as componentes do caminho
+    if (!m || resolve_parent(m, path, &parent, name) < 0 || name[0] == '\0')
+        return -1;
 
-            dir_entry_t *entry = (dir_entry_t *)(block_buf + offset);
-            
-            // Encontrou slot livre
-            if (entry->inode_number == 0) {
-                entry->inode_number = (unsigned short)found_inumber;
-                memset(entry->filename, 0, MAX_FILENAME_LEN);
-                strncpy(entry->filename, name, MAX_FILENAME_LEN);
-                
-                if (diskWriteSector(d, block_addr, block_buf) < 0) {
-                    fprintf(stderr, "[Open] Erro critico: falha ao gravar entrada no dir\n");
-                    free(root); return -1;
-                }
+	//procura entrada de diretorio com o nome solicitado
+    unsigned int found_inumber = lookup_entry(m, parent, name, &type);
+    if (found_inumber != 0 && type == INODE_TYPE_DIRECTORY) return -1;
 
-                unsigned int cur_size = inodeGetFileSize(root);
-                unsigned int end_pos = (pos + 1) * sizeof(dir_entry_t);
-                if (end_pos > cur_size) {
-                    inodeSetFileSize(root, end_pos);
-                }
-                inodeSave(root);
-                added = 1;
-                break;
-            }
-        }
-        if (!added) { free(root); return -1; }
+    if (found_inumber == 0) {
+        if (m->read_only) return -1;
+        // cria novo arquivo, que comeca com os dados embutidos no proprio i-node
+        unsigned int flags = INODE_FLAG_INLINEDATA |
+                             (atomic_load(&m->compress_enabled) ? INODE_FLAG_COMPRESSED : 0);
+        found_inumber = create_entry(m, parent, name, INODE_TYPE_REGULAR | flags, &type);
+        if (found_inumber == 0 || type == INODE_TYPE_DIRECTORY) return -1;
     }
-    free(root);
 
-    int fd = find_free_fd();
-    if (fd == -1) return -1;
-	// preenche a tabela de arquivos abertos
-    open_files_table[fd].is_used = 1;
-    open_files_table[fd].inode_number = found_inumber;
-    open_files_table[fd].current_position = 0;
-    open_files_table[fd].is_directory = 0;
-    
-    return fd + 1; // VFS espera descritores iniciando em 1
+	// reserva e preenche uma posicao na tabela de arquivos abertos
+    // o descritor ja vem com o indice (a partir de 1) e a geracao da entrada
+    return alloc_fd(m, found_inumber, 0);
 }
 	
 //Funcao para a leitura de um arquivo, a partir de um descritor de arquivo
@@ -412,47 +3935,168 @@ int myFSOpen (Disk *d, const char *path) {
 //do próximo byte apos o ultimo lido. Retorna o numero de bytes
 //efetivamente lidos em caso de sucesso ou -1, caso contrario.
 int myFSRead (int fd, char *buf, unsigned int nbytes) {
-	int idx = fd - 1;
-    if (idx < 0 || idx >= MAX_OPEN_FILES || !open_files_table[idx].is_used) return -1;
-    if (open_files_table[idx].is_directory) return -1;
-    if (current_disk == NULL) return -1;
+    open_file_t *of = fd_get(fd);
+    if (!of || of->is_directory) return -1;
 
-    Inode *inode = inodeLoad(open_files_table[idx].inode_number, current_disk);
-    if (!inode) return -1;
+    struct iovec iov = { buf, nbytes };
+    return file_read_iov(of, &iov, 1, nbytes);
+}
 
-    unsigned int size = inodeGetFileSize(inode);
-    unsigned int pos = open_files_table[idx].current_position;
-    
-    if (pos >= size) { free(inode); return 0; }
-    if (pos + nbytes > size) nbytes = size - pos;
+//Funcao para a leitura de um arquivo, a partir de um descritor de arquivo
+//existente, para os iovcnt trechos de iov, preenchidos em ordem (como
+//readv): equivale a um myFSRead para cada trecho, mas o arquivo e'
+//percorrido uma so' vez. Retorna o numero de bytes efetivamente lidos em
+//caso de sucesso ou -1, caso contrario
+int myFSReadv (int fd, const struct iovec *iov, int iovcnt) {
+    open_file_t *of = fd_get(fd);
+    iov_cursor_t c;
+    long total = iov_start(&c, iov, iovcnt);
+    if (!of || of->is_directory || total < 0) return -1;
 
-    unsigned int read_count = 0;
-    unsigned char block_buf[512];
+    return file_read_iov(of, iov, iovcnt, (unsigned int)total);
+}
 
-    while (read_count < nbytes) {
-        unsigned int blk_idx = pos / 512;
-        unsigned int offset = pos % 512;
-        unsigned int chunk = 512 - offset;
-        if (chunk > nbytes - read_count) chunk = nbytes - read_count;
+//Funcao para a leitura sem copia de ate' nbytes (no maximo 32 KB por
+//chamada) do arquivo fd, a partir do cursor: em vez de copiar os dados para
+//um buffer do chamador, preenche iov[0..iovcnt-1] com pares (endereco,
+//tamanho) das paginas do MyFS que os contem, na ordem do arquivo, e avanca o
+//cursor pelo total dessas entradas. As paginas sao somente leitura e ficam
+//fixadas (nao mudam com escritas posteriores no arquivo) ate' a chamada de
+//myFSReleasePages com o *pages devolvido. Retorna o numero de entradas
+//preenchidas (0 no fim do arquivo) ou -1 em caso de falha
+int myFSReadPages (int fd, unsigned int nbytes, struct iovec *iov, int iovcnt, MyFSPages **pages) {
+    open_file_t *of = fd_get(fd);
+    if (!of || of->is_directory || !iov || !pages) return -1;
 
-        unsigned int addr = inodeGetBlockAddr(inode, blk_idx);
-        if (addr != 0) {
-            if (diskReadSector(current_disk, addr, block_buf) < 0) {
-                free(inode); return -1;
-            }
-            memcpy(buf + read_count, block_buf + offset, chunk);
-        } else {
-            memset(buf + read_count, 0, chunk);
+    *pages = NULL;
+    // Um vetor numa região de myFSMmap só é preenchido depois de soltar o
+    // lock do i-node (ver iov_mapped)
+    struct iovec *out = iov;
+    if (iovcnt > 0 && mmap_overlaps(iov, (size_t)iovcnt * sizeof(struct iovec))) {
+        out = malloc((size_t)iovcnt * sizeof(struct iovec));
+        if (!out) return -1;
+    }
+    unsigned int inum = of->inode_number;
+    inode_rdlock(of->mnt, inum);
+    int ret = file_read_pages(of, nbytes, out, iovcnt, pages);
+    inode_unlock(of->mnt, inum);
+    if (out != iov) {
+        if (ret > 0) memcpy(iov, out, (size_t)ret * sizeof(struct iovec));
+        free(out);
+    }
+    return ret;
+}
+
+//Funcao que libera as paginas fixadas por myFSReadPages (NULL e' aceito);
+//as entradas de iov que as referenciavam deixam de valer
+void myFSReleasePages (MyFSPages *pages) {
+    free(pages);
+}
+
+//Funcao que mapeia em memoria length bytes do arquivo regular fd, a partir
+//de offset (multiplo do tamanho da pagina do sistema). Nada e' lido agora:
+//cada pagina e' carregada do arquivo no primeiro acesso e as alteradas sao
+//gravadas de volta por myFSMsync e myFSMunmap (so' ate' o fim do arquivo,
+//que o mapeamento nao aumenta). O mapeamento tem descritor proprio, entao fd
+//pode ser fechado. Retorna o endereco da regiao ou NULL em caso de falha
+void* myFSMmap (int fd, unsigned int offset, unsigned int length) {
+    open_file_t *of = fd_get(fd);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (!of || of->is_directory || length == 0 || page_size <= 0 || offset % page_size != 0) return NULL;
+
+    pthread_once(&mmap_once, mmap_install_handler);
+    if (!mmap_ready) return NULL;
+    mmap_t *mp = calloc(1, sizeof(mmap_t));
+    if (!mp) return NULL;
+    mp->page_size = (size_t)page_size;
+    mp->length = (length + mp->page_size - 1) / mp->page_size * mp->page_size;
+    mp->offset = offset;
+    mp->writable = !of->mnt->read_only;
+    mp->state = calloc(mp->length / mp->page_size, 1);
+    mp->fd = -1;
+    pthread_mutex_init(&mp->lock, NULL);
+    void *base = (mp->state ? mmap(NULL, mp->length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) : MAP_FAILED);
+    if (base != MAP_FAILED) {
+        mp->base = base;
+        mp->fd = alloc_fd(of->mnt, of->inode_number, 0);
+    }
+
+    int slot = -1;
+    pthread_mutex_lock(&mmap_table_lock);
+    for (int i = 0; mp->fd > 0 && i < MMAP_MAX && slot < 0; i++)
+        if (!atomic_load(&mmap_table[i])) {
+            atomic_store(&mmap_table[i], mp);
+            slot = i;
         }
-        
-        pos += chunk;
-        read_count += chunk;
+    pthread_mutex_unlock(&mmap_table_lock);
+    if (slot < 0) {
+        if (mp->fd > 0) free_fd(mp->fd);
+        if (mp->base) munmap(mp->base, mp->length);
+        pthread_mutex_destroy(&mp->lock);
+        free(mp->state);
+        free(mp);
+        return NULL;
     }
+    return mp->base;
+}
 
-    open_files_table[idx].current_position = pos;
-    free(inode);
-    return read_count;
+//Funcao que carrega ja' as paginas ainda nao carregadas de length bytes de
+//um mapeamento de myFSMmap, a partir de addr, sem esperar o primeiro acesso.
+//Retorna 0 caso bem sucedido, ou -1 caso contrario
+int myFSMtouch (void *addr, size_t length) {
+    mmap_t *mp = mmap_find(addr);
+    if (!mp) return -1;
+    size_t first, last;
+    int ret = 0;
+    mmap_range(mp, addr, length, &first, &last);
+    pthread_mutex_lock(&mp->lock);
+    for (size_t page = first; page < last && ret == 0; page++)
+        if (mp->state[page] == MMAP_ABSENT) ret = mmap_load(mp, page);
+    pthread_mutex_unlock(&mp->lock);
+    return ret;
+}
 
+//Funcao que grava no arquivo as paginas alteradas de length bytes de um
+//mapeamento de myFSMmap, a partir de addr. Retorna 0 caso bem sucedido, ou
+//-1 caso contrario
+int myFSMsync (void *addr, size_t length) {
+    mmap_t *mp = mmap_find(addr);
+    if (!mp) return -1;
+    size_t first, last;
+    mmap_range(mp, addr, length, &first, &last);
+    pthread_mutex_lock(&mp->lock);
+    int ret = mmap_flush(mp, first, last);
+    pthread_mutex_unlock(&mp->lock);
+    return ret;
+}
+
+//Funcao que desfaz o mapeamento iniciado em addr (devolvido por myFSMmap),
+//gravando antes as paginas alteradas. Retorna 0 caso bem sucedido, ou -1
+//caso contrario (o mapeamento e' desfeito mesmo se a gravacao falhar)
+int myFSMunmap (void *addr) {
+    mmap_t *mp = NULL;
+    pthread_mutex_lock(&mmap_table_lock);
+    for (int i = 0; i < MMAP_MAX && !mp; i++) {
+        mmap_t *cand = atomic_load(&mmap_table[i]);
+        if (cand && cand->base == addr) mp = cand;
+    }
+    pthread_mutex_unlock(&mmap_table_lock);
+    if (!mp) return -1;
+
+    pthread_mutex_lock(&mp->lock);
+    int ret = mmap_flush(mp, 0, mp->length / mp->page_size);
+    pthread_mutex_unlock(&mp->lock);
+
+    pthread_mutex_lock(&mmap_table_lock);
+    for (int i = 0; i < MMAP_MAX; i++)
+        if (atomic_load(&mmap_table[i]) == mp) atomic_store(&mmap_table[i], NULL);
+    pthread_mutex_unlock(&mmap_table_lock);
+    munmap(mp->base, mp->length);
+    free_fd(mp->fd);
+    pthread_mutex_destroy(&mp->lock);
+    free(mp->state);
+    free(mp);
+    return ret;
 }
 
 //Funcao para a escrita de um arquivo, a partir de um descritor de arquivo
@@ -462,95 +4106,43 @@ int myFSRead (int fd, char *buf, unsigned int nbytes) {
 //proximo byte apos o ultimo escrito. Retorna o numero de bytes
 //efetivamente escritos em caso de sucesso ou -1, caso contrario
 int myFSWrite (int fd, const char *buf, unsigned int nbytes) {
-    int idx = fd - 1;
-    
-    if (idx < 0 || idx >= MAX_OPEN_FILES) {
-        printf("[Write] Erro: FD invalido (%d -> idx %d)\n", fd, idx);
-        return -1;
-    }
-    
-    if (!open_files_table[idx].is_used) {
-        printf("[Write] Erro: Arquivo nao esta aberto (idx %d)\n", idx);
+    open_file_t *of = fd_get(fd);
+
+    if (!of) {
+        printf("[Write] Erro: FD invalido ou fechado (%d)\n", fd);
         return -1;
     }
     
-    if (open_files_table[idx].is_directory) {
+    if (of->is_directory) {
         printf("[Write] Erro: Tentativa de escrita em diretorio\n");
         return -1;
     }
-    
-    if (current_disk == NULL) {
-        printf("[Write] Erro: current_disk eh NULL\n");
-        return -1;
-    }
-
-    unsigned int inum = open_files_table[idx].inode_number;
-    Inode *inode = inodeLoad(inum, current_disk);
-    if (!inode) {
-        printf("[Write] Erro: inodeLoad falhou para inumber %u\n", inum);
-        return -1;
-    }
-
-    unsigned int pos = open_files_table[idx].current_position;
-    unsigned int written_count = 0;
-    unsigned char block_buf[512];
-
-    while (written_count < nbytes) {
-        unsigned int blk_idx = pos / 512;
-        unsigned int offset = pos % 512;
-        unsigned int chunk = 512 - offset;
-        if (chunk > nbytes - written_count) chunk = nbytes - written_count;
-
-        unsigned int addr = inodeGetBlockAddr(inode, blk_idx);
-        
-        if (addr == 0) {
-            int new_blk = find_free_block(current_disk);
-            if (new_blk == -1) {
-                printf("[Write] Erro: Disco cheio (find_free_block)\n");
-                break; 
-            }
-            
-            memset(block_buf, 0, 512);
-            diskWriteSector(current_disk, new_blk, block_buf);
-            
-            if (inodeAddBlock(inode, new_blk) < 0) {
-                printf("[Write] Erro: inodeAddBlock falhou\n");
-                break; 
-            }
-            addr = new_blk;
-        } else {
-            if (chunk < 512) {
-                diskReadSector(current_disk, addr, block_buf);
-            }
-        }
 
-        memcpy(block_buf + offset, buf + written_count, chunk);
-        if (diskWriteSector(current_disk, addr, block_buf) < 0) {
-            printf("[Write] Erro: diskWriteSector falhou\n");
-            break;
-        }
+    if (of->mnt->read_only) return -1;
 
-        pos += chunk;
-        written_count += chunk;
-    }
+    struct iovec iov = { (void *)buf, nbytes };
+    return file_write_iov(of, &iov, 1, nbytes);
+}
 
-    if (pos > inodeGetFileSize(inode)) {
-        inodeSetFileSize(inode, pos);
-        inodeSave(inode);
-    }
+//Funcao para a escrita de um arquivo, a partir de um descritor de arquivo
+//existente, dos iovcnt trechos de iov, em ordem (como writev): o arquivo
+//recebe os trechos emendados, com um so' carregamento do i-node e uma so'
+//atualizacao do tamanho, e cada bloco e' gravado uma vez mesmo que reuna
+//varios trechos. Retorna o numero de bytes efetivamente escritos em caso de
+//sucesso ou -1, caso contrario
+int myFSWritev (int fd, const struct iovec *iov, int iovcnt) {
+    open_file_t *of = fd_get(fd);
+    iov_cursor_t c;
+    long total = iov_start(&c, iov, iovcnt);
+    if (!of || of->is_directory || of->mnt->read_only || total < 0) return -1;
 
-    open_files_table[idx].current_position = pos;
-    free(inode);
-    return written_count;
+    return file_write_iov(of, iov, iovcnt, (unsigned int)total);
 }
 
 //Funcao para fechar um arquivo, a partir de um descritor de arquivo
 //existente. Retorna 0 caso bem sucedido, ou -1 caso contrario
 int myFSClose (int fd) {
-	int idx = fd - 1;
-    if (idx < 0 || idx >= MAX_OPEN_FILES || !open_files_table[idx].is_used) return -1;
-    open_files_table[idx].is_used = 0;
-    return 0;
+    return free_fd(fd);
 }
 
 //Funcao para abertura de um diretorio, a partir do caminho
@@ -559,41 +4151,33 @@ int myFSClose (int fd) {
 //em caso de sucesso. Retorna -1, caso contrario.
 int myFSOpenDir (Disk *d, const char *path) {
 
-    //  Verifica se o FS está montado
-    if (!fs_mounted || !d || !path)
-        return -1;
-
-    //  Por enquanto, só aceita o diretório raiz "/"
-    if (strcmp(path, "/") != 0)
+    //  Verifica se o FS está montado no disco d
+    myfs_mount_t *m = mount_of(d);
+    if (!m || !path)
         return -1;
 
-    //  Encontra posição livre na tabela de arquivos abertos
-    int fd = find_free_fd();
-    if (fd < 0)
+    //  Localiza o diretório pai e a última componente do caminho
+    char name[MAX_FILENAME_LENGTH + 1];
+    unsigned int parent, inumber, type = INODE_TYPE_DIRECTORY;
+    if (resolve_parent(m, path, &parent, name) < 0)
         return -1;
 
-    //  Carrega o i-node do diretório raiz
-    Inode *root = inodeLoad(sb_cache.root_inode, d);
-    if (!root)
-        return -1;
+    if (name[0] == '\0') {
+        inumber = m->sb.root_inode;         // Diretório raiz "/"
+    } else {
+        inumber = lookup_entry(m, parent, name, &type);
+        //  Cria o diretório se não existir
+        if (inumber == 0 && !m->read_only)
+            inumber = create_entry(m, parent, name, INODE_TYPE_DIRECTORY, &type);
+    }
 
     //  Verifica se realmente é um diretório
-    if (inodeGetFileType(root) != INODE_TYPE_DIRECTORY) {
-        free(root);
+    if (inumber == 0 || type != INODE_TYPE_DIRECTORY)
         return -1;
-    }
-
-    // Preenche a tabela de arquivos abertos
-    open_files_table[fd].is_used = 1;
-    open_files_table[fd].inode_number = sb_cache.root_inode;
-    open_files_table[fd].is_directory = 1;
-    open_files_table[fd].dir_read_position = 0;      // posição da leitura no diretório
-
-    free(root);
-
-    //  Retorna o descritor (fd começa em 0 internamente)
-    return fd + 1; // VFS espera descritores iniciando em 1
 
+    //  Reserva e preenche uma posição livre na tabela de arquivos abertos
+    //  Retorna o descritor (índice a partir de 1 e geração da entrada)
+    return alloc_fd(m, inumber, 1);
 }
 
 //Funcao para a leitura de um diretorio, identificado por um descritor
@@ -604,232 +4188,517 @@ int myFSOpenDir (Disk *d, const char *path) {
 //Retorna 1 se uma entrada foi lida, 0 se fim de diretorio ou -1 caso
 //mal sucedido
 int myFSReadDir (int fd, char *filename, unsigned int *inumber) {
-    int idx = fd - 1;
-	   // Verifica se o descritor de diretório é válido
-    if (idx < 0 || idx >= MAX_OPEN_FILES)
-        return -1;
-
     // Verifica se o descritor está em uso e se realmente é um diretório
-    if (!open_files_table[idx].is_used || !open_files_table[idx].is_directory)
+    open_file_t *of = fd_get(fd);
+    if (!of || !of->is_directory)
         return -1;
-    
-    if (current_disk == NULL) return -1;
 
-    // Carrega o i-node do diretório a partir do número armazenado na tabela open_files_table
-    Inode *dir_inode = inodeLoad(open_files_table[idx].inode_number, current_disk);
-    if (!dir_inode)
+    unsigned int dir_inum = of->inode_number;
+    inode_rdlock(of->mnt, dir_inum);
+    int ret = dir_read_next(of, filename, inumber);
+    inode_unlock(of->mnt, dir_inum);
+    return ret;
+}
+
+//Funcao para a leitura em lote de um diretorio, identificado por um
+//descritor de arquivo existente. A partir da posicao atual do cursor,
+//copia para buf tantas entradas (VFSDirent) quantas couberem em nbytes,
+//lendo cada bloco do diretorio uma unica vez. Se withAttrs for diferente
+//de 0, o tamanho de cada arquivo tambem e' preenchido. Retorna o numero
+//de bytes preenchidos, 0 se fim do diretorio ou -1 caso mal sucedido.
+int myFSGetDents (int fd, char *buf, unsigned int nbytes, int withAttrs) {
+    open_file_t *of = fd_get(fd);
+    if (!of || !of->is_directory || !buf)
         return -1;
-    
-    unsigned int dir_size = inodeGetFileSize(dir_inode);
-    
-    while (1)
-    {
-        // Posição atual do cursor no diretório (qual entrada será lida)
-        unsigned int pos = open_files_table[idx].dir_read_position;
 
-        // Calcula qual bloco do diretório contém a entrada atual
-        unsigned int block_index = (pos * sizeof(dir_entry_t)) / sb_cache.block_size;
+    unsigned int dir_inum = of->inode_number;
+    inode_rdlock(of->mnt, dir_inum);
+    int ret = dir_read_bulk(of, buf, nbytes, withAttrs);
+    inode_unlock(of->mnt, dir_inum);
+    return ret;
+}
 
-        // Calcula o deslocamento da entrada dentro do bloco
-        unsigned int offset = (pos * sizeof(dir_entry_t)) % sb_cache.block_size;
+//Funcao para garantir que os dados e metadados do arquivo identificado
+//pelo descritor fd estejam gravados no disco. Dados e i-nodes ja sao
+//gravados a cada operacao; restam o mapa de bits, que as alocacoes so'
+//alteram na memoria, e o total de blocos livres do superbloco, que e'
+//somado dos grupos de alocacao. Retorna 0 caso bem sucedido, ou -1 caso
+//contrario.
+int myFSSync (int fd) {
+    open_file_t *of = fd_get(fd);
+    if (!of) return -1;
+    if (of->mnt->read_only) return 0;
+    return (save_bitmap(of->mnt) < 0 || save_superblock(of->mnt) < 0 ? -1 : 0);
+}
 
-        // Obtém o endereço do bloco no disco a partir do i-node
-        unsigned int block_addr = inodeGetBlockAddr(dir_inode, block_index);
+//Funcao para adicionar uma entrada a um diretorio, identificado por um
+//descritor de arquivo existente. A nova entrada tera' o nome indicado
+//por filename e apontara' para o numero de i-node indicado por inumber.
+//Retorna 0 caso bem sucedido, ou -1 caso contrario.
+int myFSLink (int fd, const char *filename, unsigned int inumber) {
+    // Verifica se o descritor está em uso e se é um diretório
+    open_file_t *of = fd_get(fd);
+    if (!of || !of->is_directory || of->mnt->read_only)
+        return -1;
 
-        // Se não houver bloco associado, chegou ao fim do diretório
-        if (block_addr == 0) {
-            free(dir_inode);
-            return 0; // fim do diretório
-        }
-        // Buffer para leitura do bloco do disco
-        unsigned char block[512];
+    // Nome inválido
+    if (!filename || strlen(filename) == 0 || strlen(filename) > MAX_FILENAME_LENGTH)
+        return -1;
 
-        // Lê o bloco do disco
-        if (diskReadSector(current_disk, block_addr, block) < 0) {
-            free(dir_inode);
-            return -1;
-        }
+    // Carrega o i-node do diretório, que fica bloqueado até o fim da operação
+    myfs_mount_t *m = of->mnt;
+    unsigned int dir_inumber = of->inode_number;
+    inode_wrlock(m, dir_inumber);
+    Inode *dir_inode = inodeLoad(dir_inumber, m->disk);
+    if (!dir_inode) {
+        inode_unlock(m, dir_inumber);
+        return -1;
+    }
 
-        dir_entry_t entry;
+    // O i-node apontado precisa estar em uso; seu tipo vai para a entrada
+    Inode *target = inodeLoad(inumber, m->disk);
+    unsigned int type = (target ? inodeGetFileType(target) & ~INODE_TYPE_FLAGS : 0);
+    inodeFree(target);
+    if (type == 0) {
+        inodeFree(dir_inode);
+        inode_unlock(m, dir_inumber);
+        return -1;
+    }
 
-        // Copia os dados da entrada a partir do bloco
-        memcpy(&entry, block + offset, sizeof(dir_entry_t));
+    int ret = dir_add_entry(m, dir_inode, filename, inumber, type);
 
-       // Se o número do i-node for 0, a entrada é vazia → fim do diretório
-       if (entry.inode_number == 0) {
-            free(dir_inode);
-            return 0;
-        }
+    inodeFree(dir_inode);
+    inode_unlock(m, dir_inumber);
+    return ret; 
+}
 
-        // Copia o nome do arquivo para o buffer de saída
-        strncpy(filename, entry.filename, MAX_FILENAME_LEN);
-        // Garante que o nome termine com '\0'
-        filename[MAX_FILENAME_LEN] = '\0';
+//Funcao para remover uma entrada existente em um diretorio, 
+//identificado por um descritor de arquivo existente. A entrada e'
+//identificada pelo nome indicado em filename. Retorna 0 caso bem
+//sucedido, ou -1 caso contrario.
+int myFSUnlink (int fd, const char *filename) {
+    // Verifica se o descritor está em uso e se é um diretório
+    open_file_t *of = fd_get(fd);
+    if (!of || !of->is_directory || of->mnt->read_only)
+        return -1;
 
-        // Retorna o número do i-node associado à entrada
-        *inumber = entry.inode_number;
+    // Nome inválido
+    if (!filename || strlen(filename) == 0 || strlen(filename) > MAX_FILENAME_LENGTH)
+        return -1;
 
-       // Avança o cursor do diretório para a próxima entrada
-        open_files_table[idx].dir_read_position++;
+    // Carrega o i-node do diretório, que fica bloqueado até o fim da operação
+    myfs_mount_t *m = of->mnt;
+    unsigned int dir_inumber = of->inode_number;
+    inode_wrlock(m, dir_inumber);
+    Inode *dir_inode = inodeLoad(dir_inumber, m->disk);
+    if (!dir_inode) {
+        inode_unlock(m, dir_inumber);
+        return -1;
+    }
 
-        if (entry.inode_number != 0) {
-            strncpy(filename, entry.filename, MAX_FILENAME_LEN);
-            filename[MAX_FILENAME_LEN] = '\0';
-            *inumber = entry.inode_number;
-            free(dir_inode);
-            return 1;
+    // Subdiretórios só podem ser removidos quando vazios
+    unsigned int type = 0;
+    unsigned int inumber = dir_lookup(m, dir_inode, filename, &type);
+    if (inumber != 0 && type == INODE_TYPE_DIRECTORY) {
+        Inode *child = inodeLoad(inumber, m->disk);
+        int empty = (child && dir_is_empty(m, child));
+        inodeFree(child);
+        if (!empty) {
+            inodeFree(dir_inode);
+            inode_unlock(m, dir_inumber);
+            return -1;
         }
     }
+
+    // Remove a entrada, juntando seu espaço ao das entradas vizinhas
+    unsigned int removed = dir_remove_entry(m, dir_inode, filename);
+
+    inodeFree(dir_inode);
+    inode_unlock(m, dir_inumber);
+    return removed ? 0 : -1;
 }
 
-//Funcao para adicionar uma entrada a um diretorio, identificado por um
-//descritor de arquivo existente. A nova entrada tera' o nome indicado
-//por filename e apontara' para o numero de i-node indicado por inumber.
-//Retorna 0 caso bem sucedido, ou -1 caso contrario.
-int myFSLink (int fd, const char *filename, unsigned int inumber) {
-	int idx = fd - 1;
-	// Verifica se o descritor é válido
-    if (idx < 0 || idx >= MAX_OPEN_FILES)
-        return -1;
+//Funcao para fechar um diretorio, identificado por um descritor de
+//arquivo existente. Retorna 0 caso bem sucedido, ou -1 caso contrario.	
+int myFSCloseDir (int fd) {
+	return myFSClose(fd);
+}
 
-    // Verifica se está em uso e se é um diretório
-    if (!open_files_table[idx].is_used || !open_files_table[idx].is_directory)
-        return -1;
+//Funcao para clonar o arquivo regular srcPath como dstPath, no volume
+//montado no disco d. O clone compartilha os blocos de dados do original:
+//so' o i-node e os blocos de indirecao sao gravados, e cada bloco
+//compartilhado e' copiado na primeira escrita de um dos arquivos. dstPath
+//nao pode existir. Retorna 0 caso bem sucedido, ou -1 caso contrario
+int myFSClone (Disk *d, const char *srcPath, const char *dstPath) {
+    char name[MAX_FILENAME_LENGTH + 1];
+    unsigned int parent, type = 0;
+    myfs_mount_t *m = mount_of(d);
+    if (!m || m->read_only) return -1;
 
-    // Nome inválido
-    if (!filename || strlen(filename) == 0 || strlen(filename) > MAX_FILENAME_LEN)
-        return -1;
+    // Origem: arquivo regular existente
+    if (resolve_parent(m, srcPath, &parent, name) < 0 || name[0] == '\0') return -1;
+    unsigned int src_inum = lookup_entry(m, parent, name, &type);
+    if (src_inum == 0 || type != INODE_TYPE_REGULAR) return -1;
 
-    // Carrega o i-node do diretório
-    Inode *dir_inode = inodeLoad(open_files_table[idx].inode_number, current_disk);
-    if (!dir_inode)
+    // Destino: nome ainda livre em um diretório existente
+    if (resolve_parent(m, dstPath, &parent, name) < 0 || name[0] == '\0' ||
+        lookup_entry(m, parent, name, &type) != 0)
         return -1;
 
-    unsigned int entries_per_block = sb_cache.block_size / sizeof(dir_entry_t);
-    unsigned char block_buf[512];
+    // O clone fica completo antes de ganhar nome
+    unsigned int inumber = clone_inode(m, src_inum);
+    if (inumber == 0) return -1;
+
     int ret = -1;
+    inode_wrlock(m, parent);
+    Inode *dir_inode = inodeLoad(parent, m->disk);
+    if (dir_inode && dir_lookup(m, dir_inode, name, &type) == 0)
+        ret = dir_add_entry(m, dir_inode, name, inumber, INODE_TYPE_REGULAR);
+    inodeFree(dir_inode);
+    inode_unlock(m, parent);
 
-    for (unsigned int pos = 0; ; pos++) {
-        unsigned int block_idx = pos / entries_per_block;
-        unsigned int offset = (pos % entries_per_block) * sizeof(dir_entry_t);
-        unsigned int block_addr = inodeGetBlockAddr(dir_inode, block_idx);
+    if (ret < 0) {
+        // Nome criado por outra thread nesse meio tempo: desfaz o clone
+        Inode *clone = inodeLoad(inumber, m->disk);
+        if (clone) inodeClear(clone);
+        inodeFree(clone);
+    }
+    return ret;
+}
 
-        if (block_addr == 0) {
-            int new_block = find_free_block(current_disk);
-            if (new_block == -1) break; // Disco cheio
-            
-            memset(block_buf, 0, 512);
-            diskWriteSector(current_disk, new_block, block_buf);
-            if (inodeAddBlock(dir_inode, new_block) < 0) break;
-            block_addr = new_block;
-        } else {
-            diskReadSector(current_disk, block_addr, block_buf);
-        }
+//Funcao para ligar (enable diferente de 0) ou desligar o modo de
+//deduplicacao do volume montado no disco d, que fica gravado no
+//superbloco. Ligado, cada bloco inteiro escrito com o mesmo conteudo de um
+//bloco ja' indexado passa a usar esse bloco em vez de ocupar um novo. O
+//indice fica so' em memoria e recomeca vazio a cada montagem. Retorna 0
+//caso bem sucedido, ou -1 caso contrario
+int myFSSetDedup (Disk *d, int enable) {
+    myfs_mount_t *m = mount_of(d);
+    if (!m || m->read_only) return -1;
 
-        dir_entry_t *entry = (dir_entry_t *)(block_buf + offset);
-        
-        // Verifica duplicata
-        if (entry->inode_number != 0 && strncmp(entry->filename, filename, MAX_FILENAME_LEN) == 0) {
-            ret = -1; // Já existe
-            break;
-        }
+    pthread_mutex_lock(&m->sb_lock);
+    if (enable) m->sb.flags |= SB_FLAG_DEDUP;
+    else m->sb.flags &= ~SB_FLAG_DEDUP;
+    pthread_mutex_unlock(&m->sb_lock);
+    atomic_store(&m->dedup_enabled, enable != 0);
+    if (!enable) dedup_clear(m);
+    return (save_superblock(m) < 0 ? -1 : 0);
+}
+
+//Funcao que percorre os arquivos regulares do volume montado no disco d e
+//faz os blocos de dados de mesmo conteudo passarem a ser um so',
+//compartilhado, devolvendo os demais ao volume. Pode ser usada com o
+//volume em uso. Retorna o numero de blocos devolvidos ou -1 em caso de
+//falha
+int myFSDedupScan (Disk *d) {
+    unsigned char block_buf[512];
+    myfs_mount_t *m = mount_of(d);
+    if (!m || m->read_only) return -1;
 
-        if (entry->inode_number == 0) {
-            entry->inode_number = (unsigned short)inumber;
-            memset(entry->filename, 0, MAX_FILENAME_LEN);
-            strncpy(entry->filename, filename, MAX_FILENAME_LEN);
-            
-            diskWriteSector(current_disk, block_addr, block_buf);
-            
-            unsigned int size = inodeGetFileSize(dir_inode);
-            unsigned int end_pos = (pos + 1) * sizeof(dir_entry_t);
-            if (end_pos > size) {
-                inodeSetFileSize(dir_inode, end_pos);
-                inodeSave(dir_inode);
+    int saved = 0;
+    for (unsigned int inum = 1; inum <= m->sb.inode_count; inum++) {
+        inode_wrlock(m, inum);
+        Inode *inode = inodeLoad(inum, m->disk);
+        // Dados embutidos (INODE_FLAG_INLINEDATA) e diretórios ficam de fora
+        if (inode && inodeGetFileType(inode) == INODE_TYPE_REGULAR) {
+            for (unsigned int i = 0; i < inodeGetNumBlocks(inode); i++) {
+                unsigned int addr = inodeGetBlockAddr(inode, i);
+                if (addr == 0 || diskReadSector(m->disk, addr, block_buf) < 0) continue;
+                unsigned char digest[SHA256_DIGEST_SIZE];
+                sha256Digest(block_buf, 512, digest);
+                unsigned int same = dedup_lookup(m, digest);
+                if (same == 0)
+                    dedup_insert(m, digest, addr);
+                else if (same == addr || ref_flush(m) < 0 || inodeSetBlockAddr(inode, i, same) < 0)
+                    ref_put(m, same);
+                else
+                    saved += ref_put(m, addr);
             }
-            ret = 0;
-            break;
         }
+        inodeFree(inode);
+        inode_unlock(m, inum);
     }
+    // Fora do modo de deduplicação, o índice não fica guardando blocos
+    if (!atomic_load(&m->dedup_enabled)) dedup_clear(m);
+    return saved;
+}
 
+//Funcao para ligar (enable diferente de 0) ou desligar a compressao dos
+//arquivos criados dali em diante no volume montado no disco d, o que fica
+//gravado no superbloco. Os dados de um arquivo comprimido sao guardados em
+//grupos de 8 blocos comprimidos (LZ), que ocupam menos setores; arquivos ja'
+//existentes nao mudam. Retorna 0 caso bem sucedido, ou -1 caso contrario
+int myFSSetCompression (Disk *d, int enable) {
+    myfs_mount_t *m = mount_of(d);
+    if (!m || m->read_only) return -1;
 
-    free(dir_inode);
-    return ret; 
+    pthread_mutex_lock(&m->sb_lock);
+    if (enable) m->sb.flags |= SB_FLAG_COMPRESS;
+    else m->sb.flags &= ~SB_FLAG_COMPRESS;
+    pthread_mutex_unlock(&m->sb_lock);
+    atomic_store(&m->compress_enabled, enable != 0);
+    return (save_superblock(m) < 0 ? -1 : 0);
 }
 
-//Funcao para remover uma entrada existente em um diretorio, 
-//identificado por um descritor de arquivo existente. A entrada e'
-//identificada pelo nome indicado em filename. Retorna 0 caso bem
-//sucedido, ou -1 caso contrario.
-int myFSUnlink (int fd, const char *filename) {
-	int idx = fd - 1;
-	// Verifica se o descritor é válido
-    if (idx < 0 || idx >= MAX_OPEN_FILES)
-        return -1;
+//Funcao para ligar (enable diferente de 0) ou desligar a compressao do
+//arquivo regular path, no volume montado no disco d, independentemente do
+//modo do volume (myFSSetCompression). O arquivo ainda nao pode ocupar
+//blocos de dados (vazio ou com dados embutidos no i-node). Retorna 0 caso
+//bem sucedido, ou -1 caso contrario
+int myFSSetFileCompression (Disk *d, const char *path, int enable) {
+    char name[MAX_FILENAME_LENGTH + 1];
+    unsigned int parent, type = 0;
+    myfs_mount_t *m = mount_of(d);
+    if (!m || m->read_only) return -1;
 
-    // Verifica se o descritor está em uso e se é um diretório
-    if (!open_files_table[idx].is_used || !open_files_table[idx].is_directory)
-        return -1;
+    if (resolve_parent(m, path, &parent, name) < 0 || name[0] == '\0') return -1;
+    unsigned int inum = lookup_entry(m, parent, name, &type);
+    if (inum == 0 || type != INODE_TYPE_REGULAR) return -1;
 
-    // Nome inválido
-    if (!filename || strlen(filename) == 0 || strlen(filename) > MAX_FILENAME_LEN)
-        return -1;
+    int ret = -1;
+    inode_wrlock(m, inum);
+    Inode *inode = inodeLoad(inum, m->disk);
+    if (inode && inodeGetNumBlocks(inode) == 0) {
+        unsigned int file_type = inodeGetFileType(inode);
+        inodeSetFileType(inode, enable ? file_type | INODE_FLAG_COMPRESSED : file_type & ~INODE_FLAG_COMPRESSED);
+        ret = inodeSave(inode);
+    }
+    inodeFree(inode);
+    inode_unlock(m, inum);
+    return ret;
+}
 
-    // Carrega o i-node do diretório
-    Inode *dir_inode = inodeLoad(open_files_table[idx].inode_number, current_disk);
-    if (!dir_inode)
-        return -1;
+//Funcao que retorna o numero de blocos livres do volume montado no disco d
+//ou -1 se d nao estiver montado
+int myFSGetFreeBlocks (Disk *d) {
+    myfs_mount_t *m = mount_of(d);
+    return (m ? (int)count_free_blocks(m) : -1);
+}
 
-    unsigned int entry_size = sizeof(dir_entry_t);
-    unsigned int entries_per_block = sb_cache.block_size / entry_size;
+//Funcao para criar um snapshot do volume montado no disco d: uma copia
+//somente leitura do volume no instante atual. A criacao nao copia dados; os
+//setores em uso sao copiados para blocos livres antes de serem
+//sobrescritos. Retorna o identificador do snapshot (a partir de 1) ou -1
+//em caso de falha
+int myFSSnapshotCreate (Disk *d) {
+    myfs_mount_t *m = mount_of(d);
+    if (!m || m->read_only) return -1;
 
-    // Percorre todas as entradas do diretório
-    for (unsigned int pos = 0; ; pos++) {
+    pthread_mutex_lock(&m->snap_admin_lock);
+    int k = 0;
+    while (k < SNAP_MAX && m->snaps[k]) k++;
+    int sb_block = (k < SNAP_MAX ? snap_alloc_block(m) : -1);
+    int bitmap_block = (sb_block != -1 ? snap_alloc_block(m) : -1);
+    snapshot_t *sn = (bitmap_block != -1 ? snap_new(m, sb_block, bitmap_block) : NULL);
+    if (!sn) {
+        if (sb_block != -1) snap_release_block(m, sb_block);
+        if (bitmap_block != -1) snap_release_block(m, bitmap_block);
+        pthread_mutex_unlock(&m->snap_admin_lock);
+        return -1;
+    }
 
-        unsigned int block_index = pos / entries_per_block;
-        unsigned int offset = (pos % entries_per_block) * entry_size;
+    // Congela o volume: só cópias em memória, sem escritas no disco em
+    // andamento. Blocos de outros snapshots não entram no mapa congelado
+    unsigned char sb_buf[512];
+    unsigned int free_blocks = count_free_blocks(m);
+    pthread_rwlock_wrlock(&m->snap_lock);
+    for (int i = 0; i < 512; i++)
+        sn->frozen[i] = __atomic_load_n(&m->block_bitmap[i], __ATOMIC_RELAXED) &
+                        ~__atomic_load_n(&m->snap_owned[i], __ATOMIC_RELAXED);
+    m->snaps[k] = sn;
+    snap_update_held(m);
+    atomic_fetch_add(&m->snap_count, 1);
+    pthread_rwlock_unlock(&m->snap_lock);
 
-        // Obtém o endereço do bloco do diretório
-        unsigned int block_addr = inodeGetBlockAddr(dir_inode, block_index);
+    // O superbloco visto pelo snapshot não tem registros de snapshots e
+    // marca o volume como somente leitura
+    sb_encode(m, sb_buf, free_blocks, 0);
+    ul2char(SB_FLAG_SNAPSHOT | (m->sb.flags & SB_FLAG_CHECKSUMS), &sb_buf[32]);
+    int ret = -1;
+    if (diskWriteSector(d, sb_block, sb_buf) == 0 &&
+        diskWriteSector(d, bitmap_block, sn->frozen) == 0) {
+        pthread_mutex_lock(&m->sb_lock);
+        m->sb.snap_sb_block[k] = sb_block;
+        m->sb.snap_bitmap_block[k] = bitmap_block;
+        pthread_mutex_unlock(&m->sb_lock);
+        if (save_superblock(m) == 0) ret = k + 1;
+    }
+    if (ret < 0) snap_remove(m, k);
+    pthread_mutex_unlock(&m->snap_admin_lock);
+    return ret;
+}
 
-        // Se não houver mais blocos, a entrada não existe
-        if (block_addr == 0) {
-            free(dir_inode);
-            return -1;
-        }
+//Funcao para remover o snapshot snapId do volume montado no disco d,
+//devolvendo ao volume os blocos usados pelas copias. O snapshot nao pode
+//ter uma visao aberta. Retorna 0 caso bem sucedido, ou -1 caso contrario
+int myFSSnapshotDelete (Disk *d, int snapId) {
+    myfs_mount_t *m = mount_of(d);
+    if (!m || m->read_only || snapId < 1 || snapId > SNAP_MAX) return -1;
 
-        // Lê o bloco do disco
-        unsigned char block[512];
-        if (diskReadSector(current_disk, block_addr, block) < 0) {
-            free(dir_inode);
-            return -1;
-        }
+    pthread_mutex_lock(&m->snap_admin_lock);
+    snapshot_t *sn = m->snaps[snapId - 1];
+    int ret = -1;
+    if (sn && !sn->view) {
+        snap_remove(m, snapId - 1);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&m->snap_admin_lock);
+    return ret;
+}
 
-        dir_entry_t *entry = (dir_entry_t *)(block + offset);
+//Funcao para abrir uma visao do snapshot snapId do volume montado no disco
+//d: um disco somente leitura, com identificador diskId, que mostra o volume
+//como estava no instante do snapshot e pode ser montado (myFSxMount ou
+//vfsMount) e lido como o original. Enquanto a visao estiver aberta, o
+//volume nao pode ser desmontado nem o snapshot removido. Retorna a visao
+//ou NULL em caso de falha
+Disk* myFSSnapshotOpen (Disk *d, int snapId, int diskId) {
+    myfs_mount_t *m = mount_of(d);
+    if (!m || m->read_only || snapId < 1 || snapId > SNAP_MAX) return NULL;
 
-        // Se a entrada for válida e o nome bater
-        if (entry->inode_number != 0 &&
-            strncmp(entry->filename, filename, MAX_FILENAME_LEN) == 0) {
-            // Remove a entrada: zera o i-node e o nome
-            entry->inode_number = 0;
-            memset(entry->filename, 0, MAX_FILENAME_LEN);
+    Disk *view = NULL;
+    pthread_mutex_lock(&m->snap_admin_lock);
+    snapshot_t *sn = m->snaps[snapId - 1];
+    if (sn && !sn->view) {
+        view = diskCreateView(diskId, diskGetNumSectors(d), snap_view_read, sn);
+        sn->view = view;
+        if (view) atomic_fetch_add(&m->open_count, 1);
+    }
+    pthread_mutex_unlock(&m->snap_admin_lock);
+    return view;
+}
 
-            // Grava o bloco atualizado no disco
-            if (diskWriteSector(current_disk, block_addr, block) < 0) {
-                free(dir_inode);
-                return -1;
-            }
+//Funcao para fechar uma visao aberta por myFSSnapshotOpen, que nao pode
+//estar montada. Retorna 0 caso bem sucedido, ou -1 caso contrario
+int myFSSnapshotClose (Disk *view) {
+    if (!view || mount_of(view)) return -1;
 
-            free(dir_inode);
-            return 0; // 
+    int ret = -1;
+    // Com mounts_lock, nenhum volume é desmontado durante a busca
+    pthread_mutex_lock(&mounts_lock);
+    for (int i = 0; i < MYFS_MAX_MOUNTS && ret < 0; i++) {
+        myfs_mount_t *m = atomic_load(&mounts[i]);
+        if (!m) continue;
+        pthread_mutex_lock(&m->snap_admin_lock);
+        for (int k = 0; k < SNAP_MAX; k++) {
+            if (!m->snaps[k] || m->snaps[k]->view != view) continue;
+            diskDisconnect(view);
+            m->snaps[k]->view = NULL;
+            atomic_fetch_sub(&m->open_count, 1);
+            ret = 0;
         }
+        pthread_mutex_unlock(&m->snap_admin_lock);
     }
+    pthread_mutex_unlock(&mounts_lock);
+    return ret;
 }
 
-//Funcao para fechar um diretorio, identificado por um descritor de
-//arquivo existente. Retorna 0 caso bem sucedido, ou -1 caso contrario.	
-int myFSCloseDir (int fd) {
-	return myFSClose(fd);
+//Funcao para verificar a consistencia do volume MyFS no disco d, que nao
+//pode estar montado: valida o superbloco, refaz o mapa de bits esperado a
+//partir dos blocos de cada i-node (e dos metadados e snapshots), confere as
+//entradas de diretorio e a tabela de referencias dos blocos compartilhados.
+//As faixas da tabela de i-nodes sao percorridas por numThreads threads (0 =
+//padrao). Com repair diferente de 0, corrige o que encontrar: i-nodes
+//invalidos e orfaos sao esvaziados, entradas invalidas sao liberadas e o mapa
+//de bits, a tabela de referencias e o superbloco sao regravados. O resultado
+//e' copiado para *report (se nao for NULL). Retorna o numero de problemas
+//encontrados (0 = volume consistente) ou -1 se o volume nao puder ser
+//verificado
+int myFSCheck (Disk *d, int repair, int numThreads, MyFSCheckReport *report) {
+    MyFSCheckReport r;
+    unsigned char buf[512];
+    memset(&r, 0, sizeof(r));
+    if (report) *report = r;
+
+    if (!d || diskReadSector(d, 0, buf) != 0) {
+        printf("[Fsck] Erro: Falha ao ler o superbloco.\n");
+        return -1;
+    }
+
+    // Como na formatação, o contexto fica publicado durante a verificação:
+    // o disco não pode ser montado enquanto isso
+    // As passagens leem pela visão c.view (ver fsck_prefetch), que faz parte
+    // do volume desde antes de ele ser publicado
+    fsck_t c;
+    memset(&c, 0, sizeof(c));
+    myfs_mount_t *m = mount_create(d);
+    if (!m) return -1;
+    c.m = m;
+    c.view = diskCreateView(diskGetId(d), diskGetNumSectors(d), fsck_view_read, &c);
+    if (!c.view) {
+        mount_destroy(m);
+        return -1;
+    }
+    m->check_view = c.view;
+    if (mount_attach(m) < 0) {
+        printf("[Fsck] Erro: O disco está montado.\n");
+        mount_destroy(m);
+        diskDisconnect(c.view);
+        return -1;
+    }
+    m->read_only = 1;
+    sb_decode(m, buf);
+    inodeSetLayout(inode_sector_of);
+    if (verify_all_sectors(m) < 0) {
+        printf("[Fsck] Erro: Superbloco corrompido.\n");
+        mount_detach(m);
+        mount_destroy(m);
+        diskDisconnect(c.view);
+        return -1;
+    }
+
+    // A visão de um snapshot é somente leitura: só é verificada
+    c.repair = repair && !(m->sb.flags & SB_FLAG_SNAPSHOT);
+    c.threads = (numThreads > 0 ? (unsigned int)numThreads : FSCK_THREADS_DEFAULT);
+    if (c.threads > FSCK_THREADS_MAX) c.threads = FSCK_THREADS_MAX;
+
+    int ret = fsck_check_superblock(&c, &r);
+    if (ret == 0) ret = fsck_volume(&c, &r);
+    mount_detach(m);
+    mount_destroy(m);
+    diskDisconnect(c.view);
+
+    if (report) *report = r;
+    if (ret < 0) return -1;
+    return r.badSuperblock + r.badInodes + r.badBlockRefs + r.badEntries + r.orphanInodes +
+           r.leakedBlocks + r.missingBlocks + r.badRefcounts + r.crossLinked;
+}
+
+//Funcao para desfragmentar o arquivo (ou diretorio) path do volume montado
+//no disco d ou, com path NULL, todos os arquivos do volume. Cada arquivo
+//com mais de um trecho contiguo tem seus blocos (dados e indirecao) copiados
+//para uma faixa contigua livre e o mapa do i-node e' trocado de uma vez; o
+//volume continua em uso e so' o arquivo movido fica bloqueado. Arquivos com
+//blocos compartilhados (clones e deduplicacao) nao sao movidos. Com
+//measureOnly diferente de 0, so' mede a fragmentacao. O resultado e' copiado
+//para *report (se nao for NULL). Retorna o numero de arquivos movidos ou -1
+//em caso de falha
+int myFSDefrag (Disk *d, const char *path, int measureOnly, MyFSDefragReport *report) {
+    char name[MAX_FILENAME_LENGTH + 1];
+    unsigned int parent;
+    MyFSDefragReport r;
+    memset(&r, 0, sizeof(r));
+    if (report) *report = r;
+
+    // A visão de um snapshot só pode ser medida
+    myfs_mount_t *m = mount_of(d);
+    if (!m || (m->read_only && !measureOnly)) return -1;
+
+    if (path) {
+        if (resolve_parent(m, path, &parent, name) < 0) return -1;
+        unsigned int inum = (name[0] == '\0' ? parent : lookup_entry(m, parent, name, NULL));
+        if (inum == 0) return -1;
+        defrag_inode(m, inum, measureOnly, &r);
+    } else {
+        for (unsigned int inum = 1; inum <= m->sb.inode_count; inum++)
+            defrag_inode(m, inum, measureOnly, &r);
+    }
+
+    unsigned int delay = diskGetSeekDelay(m->disk);
+    r.readMsBefore = (double)r.seekBefore * delay;
+    r.readMsAfter = (double)r.seekAfter * delay;
+    if (report) *report = r;
+    return (int)r.filesMoved;
 }
 
 //Funcao para instalar seu sistema de arquivos no S.O., registrando-o junto
@@ -860,6 +4729,11 @@ int installMyFS (void) {
     fs_info_ptr->linkFn = myFSLink;
     fs_info_ptr->unlinkFn = myFSUnlink;
     fs_info_ptr->closedirFn = myFSCloseDir;
+    fs_info_ptr->getdentsFn = myFSGetDents;
+    fs_info_ptr->syncFn = myFSSync;
+    fs_info_ptr->cloneFn = myFSClone;
+    fs_info_ptr->readvFn = myFSReadv;
+    fs_info_ptr->writevFn = myFSWritev;
     
     // Registra o sistema no VFS 
     if (vfsRegisterFS(fs_info_ptr) != 0) {
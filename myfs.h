@@ -1,23 +1,209 @@
-/*
-*  myfs.h - Funcao que permite a instalacao de seu sistema de arquivos no S.O.
-*
-*  Autor: SUPER_PROGRAMADORES C
-*  Projeto: Trabalho Pratico II - Sistemas Operacionais
-*  Organizacao: Universidade Federal de Juiz de Fora
-*  Departamento: Dep. Ciencia da Computacao
-*
-*
-*/
-
-#ifndef MYFS_H
-#define MYFS_H
-
-#include "vfs.h"
-
-//Funcao para instalar seu sistema de arquivos no S.O., registrando-o junto
-//ao virtual FS (vfs). Retorna um identificador unico (slot), caso
-//o sistema de arquivos tenha sido registrado com sucesso.
-//Caso contrario, retorna -1
-int installMyFS ( void );
-
-#endif
+/*
+*  myfs.h - Funcao que permite a instalacao de seu sistema de arquivos no S.O.
+*
+*  Autor: SUPER_PROGRAMADORES C
+*  Projeto: Trabalho Pratico II - Sistemas Operacionais
+*  Organizacao: Universidade Federal de Juiz de Fora
+*  Departamento: Dep. Ciencia da Computacao
+*
+*
+*/
+
+#ifndef MYFS_H
+#define MYFS_H
+
+#include <sys/uio.h>
+#include "vfs.h"
+
+//Funcao para instalar seu sistema de arquivos no S.O., registrando-o junto
+//ao virtual FS (vfs). Retorna um identificador unico (slot), caso
+//o sistema de arquivos tenha sido registrado com sucesso.
+//Caso contrario, retorna -1
+int installMyFS ( void );
+
+//Paginas fixadas por myFSReadPages (opaco), liberadas com myFSReleasePages
+typedef struct MyFSPages MyFSPages;
+
+//Funcao para a leitura sem copia de ate' nbytes (no maximo 32 KB por
+//chamada) do arquivo fd, a partir do cursor: em vez de copiar os dados para
+//um buffer do chamador, preenche iov[0..iovcnt-1] com pares (endereco,
+//tamanho) das paginas do MyFS que os contem, na ordem do arquivo, e avanca o
+//cursor pelo total dessas entradas. As paginas sao somente leitura e ficam
+//fixadas (nao mudam com escritas posteriores no arquivo) ate' a chamada de
+//myFSReleasePages com o *pages devolvido. Retorna o numero de entradas
+//preenchidas (0 no fim do arquivo) ou -1 em caso de falha
+int myFSReadPages (int fd, unsigned int nbytes, struct iovec *iov, int iovcnt, MyFSPages **pages);
+
+//Funcao que libera as paginas fixadas por myFSReadPages (NULL e' aceito);
+//as entradas de iov que as referenciavam deixam de valer
+void myFSReleasePages (MyFSPages *pages);
+
+//Funcao que mapeia em memoria length bytes do arquivo regular fd, a partir
+//de offset (multiplo do tamanho da pagina do sistema). Nada e' lido agora:
+//cada pagina e' carregada do arquivo no primeiro acesso e as alteradas sao
+//gravadas de volta por myFSMsync e myFSMunmap (so' ate' o fim do arquivo,
+//que o mapeamento nao aumenta). O mapeamento tem descritor proprio, entao fd
+//pode ser fechado, e o volume nao pode ser desmontado enquanto ele existir.
+//A regiao pode ser passada como buffer das leituras e escritas do MyFS,
+//sobre qualquer arquivo: os dados passam entao por um buffer intermediario,
+//copiado fora dos locks que a carga de uma pagina usa. Uma escrita num
+//mapeamento de volume somente leitura (ou uma pagina que nao pode ser lida)
+//gera o SIGSEGV que o programa receberia sem o mapeamento: vai ao tratador
+//que ele tinha instalado antes do primeiro myFSMmap, ou termina o programa.
+//Retorna o endereco da regiao ou NULL em caso de falha
+void* myFSMmap (int fd, unsigned int offset, unsigned int length);
+
+//Funcao que carrega ja' as paginas ainda nao carregadas de length bytes de
+//um mapeamento de myFSMmap, a partir de addr, sem esperar o primeiro acesso.
+//Retorna 0 caso bem sucedido, ou -1 caso contrario
+int myFSMtouch (void *addr, size_t length);
+
+//Funcao que grava no arquivo as paginas alteradas de length bytes de um
+//mapeamento de myFSMmap, a partir de addr. Retorna 0 caso bem sucedido, ou
+//-1 caso contrario
+int myFSMsync (void *addr, size_t length);
+
+//Funcao que desfaz o mapeamento iniciado em addr (devolvido por myFSMmap),
+//gravando antes as paginas alteradas. Retorna 0 caso bem sucedido, ou -1
+//caso contrario (o mapeamento e' desfeito mesmo se a gravacao falhar)
+int myFSMunmap (void *addr);
+
+//Opcoes de formatacao de myFSFormatEx, como as do mkfs. Campos com 0 usam
+//o padrao de myFSFormat
+#define MYFS_FORMAT_NO_GROUPS 0xFFFFFFFFu //groupCylinders: volume sem grupos de cilindros
+
+typedef struct {
+	unsigned int bytesPerInode;	// Bytes do disco por i-node (padrao 640: 10% dos setores para i-nodes)
+	unsigned int reservedPercent;	// Porcentagem dos blocos livres vedada aos dados de arquivos (ate' 50)
+	unsigned int journalBlocks;	// Blocos reservados para o diario, depois dos i-nodes do grupo 0
+	unsigned int groupCylinders;	// Cilindros de cada grupo (padrao: o disco dividido em 8 grupos; MYFS_FORMAT_NO_GROUPS: tabela de i-nodes unica)
+} MyFSFormatOptions;
+
+//Funcao para formatacao do disco d com blocos de blockSize bytes e as
+//opcoes de options (NULL = padrao de myFSFormat), que ficam gravadas no
+//superbloco e valem a cada montagem. Retorna o numero de blocos disponiveis
+//no disco ou -1 em caso de falha ou opcoes que nao cabem no disco
+int myFSFormatEx (Disk *d, unsigned int blockSize, const MyFSFormatOptions *options);
+
+//Funcao para clonar o arquivo regular srcPath como dstPath, no volume
+//montado no disco d. O clone compartilha os blocos de dados do original:
+//so' o i-node e os blocos de indirecao sao gravados, e cada bloco
+//compartilhado e' copiado na primeira escrita de um dos arquivos. dstPath
+//nao pode existir. Retorna 0 caso bem sucedido, ou -1 caso contrario
+int myFSClone (Disk *d, const char *srcPath, const char *dstPath);
+
+//Funcao para ligar (enable diferente de 0) ou desligar o modo de
+//deduplicacao do volume montado no disco d, que fica gravado no
+//superbloco. Ligado, cada bloco inteiro escrito com o mesmo conteudo de um
+//bloco ja' indexado passa a usar esse bloco em vez de ocupar um novo. O
+//indice fica so' em memoria e recomeca vazio a cada montagem. Retorna 0
+//caso bem sucedido, ou -1 caso contrario
+int myFSSetDedup (Disk *d, int enable);
+
+//Funcao que percorre os arquivos regulares do volume montado no disco d e
+//faz os blocos de dados de mesmo conteudo passarem a ser um so',
+//compartilhado, devolvendo os demais ao volume. Pode ser usada com o
+//volume em uso. Retorna o numero de blocos devolvidos ou -1 em caso de
+//falha
+int myFSDedupScan (Disk *d);
+
+//Funcao para ligar (enable diferente de 0) ou desligar a compressao dos
+//arquivos criados dali em diante no volume montado no disco d, o que fica
+//gravado no superbloco. Os dados de um arquivo comprimido sao guardados em
+//grupos de 8 blocos comprimidos (LZ), que ocupam menos setores; arquivos ja'
+//existentes nao mudam. Retorna 0 caso bem sucedido, ou -1 caso contrario
+int myFSSetCompression (Disk *d, int enable);
+
+//Funcao para ligar (enable diferente de 0) ou desligar a compressao do
+//arquivo regular path, no volume montado no disco d, independentemente do
+//modo do volume (myFSSetCompression). O arquivo ainda nao pode ocupar
+//blocos de dados (vazio ou com dados embutidos no i-node). Retorna 0 caso
+//bem sucedido, ou -1 caso contrario
+int myFSSetFileCompression (Disk *d, const char *path, int enable);
+
+//Funcao que retorna o numero de blocos livres do volume montado no disco d
+//ou -1 se d nao estiver montado
+int myFSGetFreeBlocks (Disk *d);
+
+//Funcao para criar um snapshot do volume montado no disco d: uma copia
+//somente leitura do volume no instante atual. A criacao nao copia dados; os
+//setores em uso sao copiados para blocos livres antes de serem
+//sobrescritos. Retorna o identificador do snapshot (a partir de 1) ou -1
+//em caso de falha
+int myFSSnapshotCreate (Disk *d);
+
+//Funcao para remover o snapshot snapId do volume montado no disco d,
+//devolvendo ao volume os blocos usados pelas copias. O snapshot nao pode
+//ter uma visao aberta. Retorna 0 caso bem sucedido, ou -1 caso contrario
+int myFSSnapshotDelete (Disk *d, int snapId);
+
+//Funcao para abrir uma visao do snapshot snapId do volume montado no disco
+//d: um disco somente leitura, com identificador diskId, que mostra o volume
+//como estava no instante do snapshot e pode ser montado (myFSxMount ou
+//vfsMount) e lido como o original. Enquanto a visao estiver aberta, o
+//volume nao pode ser desmontado nem o snapshot removido. Retorna a visao
+//ou NULL em caso de falha
+Disk* myFSSnapshotOpen (Disk *d, int snapId, int diskId);
+
+//Funcao para fechar uma visao aberta por myFSSnapshotOpen, que nao pode
+//estar montada. Retorna 0 caso bem sucedido, ou -1 caso contrario
+int myFSSnapshotClose (Disk *view);
+
+//Resultado de myFSCheck: o que foi encontrado no volume e, com repair,
+//quantos problemas foram corrigidos
+typedef struct {
+	unsigned int inodesUsed;	// I-nodes em uso
+	unsigned int blocksUsed;	// Blocos em uso (metadados, arquivos e snapshots)
+	unsigned int freeBlocks;	// Blocos livres da area de dados
+	unsigned int badSuperblock;	// Campos invalidos no superbloco
+	unsigned int badInodes;		// I-nodes com numero, tipo ou tamanho invalidos
+	unsigned int badBlockRefs;	// Enderecos de blocos fora da area de dados
+	unsigned int badEntries;	// Entradas de diretorio invalidas ou para i-nodes livres
+	unsigned int orphanInodes;	// I-nodes em uso sem nenhuma entrada de diretorio
+	unsigned int leakedBlocks;	// Blocos marcados em uso sem nenhum dono
+	unsigned int missingBlocks;	// Blocos em uso marcados como livres
+	unsigned int badRefcounts;	// Contadores errados na tabela de referencias
+	unsigned int crossLinked;	// Blocos de metadados usados por mais de um dono
+	unsigned int repaired;		// Problemas corrigidos
+} MyFSCheckReport;
+
+//Funcao para verificar a consistencia do volume MyFS no disco d, que nao
+//pode estar montado: valida o superbloco, refaz o mapa de bits esperado a
+//partir dos blocos de cada i-node (e dos metadados e snapshots), confere as
+//entradas de diretorio e a tabela de referencias dos blocos compartilhados.
+//As faixas da tabela de i-nodes sao percorridas por numThreads threads (0 =
+//padrao). Com repair diferente de 0, corrige o que encontrar: i-nodes
+//invalidos e orfaos sao esvaziados, entradas invalidas sao liberadas e o mapa
+//de bits, a tabela de referencias e o superbloco sao regravados. O resultado
+//e' copiado para *report (se nao for NULL). Retorna o numero de problemas
+//encontrados (0 = volume consistente) ou -1 se o volume nao puder ser
+//verificado
+int myFSCheck (Disk *d, int repair, int numThreads, MyFSCheckReport *report);
+
+//Resultado de myFSDefrag: fragmentacao dos arquivos examinados antes e
+//depois da desfragmentacao. O tempo de leitura simulado e' o das buscas de
+//uma leitura sequencial de cada arquivo (blocos de indirecao incluidos)
+typedef struct {
+	unsigned int filesScanned;	// Arquivos e diretorios com blocos examinados
+	unsigned int filesMoved;	// Arquivos movidos para uma faixa contigua
+	unsigned int filesSkipped;	// Fragmentados e nao movidos (blocos compartilhados ou sem faixa livre)
+	unsigned int extentsBefore;	// Trechos contiguos dos arquivos antes
+	unsigned int extentsAfter;	// Trechos contiguos dos arquivos depois
+	unsigned long seekBefore;	// Cilindros percorridos nas leituras antes
+	unsigned long seekAfter;	// Cilindros percorridos nas leituras depois
+	double readMsBefore;		// Tempo simulado das buscas antes, em ms
+	double readMsAfter;		// Tempo simulado das buscas depois, em ms
+} MyFSDefragReport;
+
+//Funcao para desfragmentar o arquivo (ou diretorio) path do volume montado
+//no disco d ou, com path NULL, todos os arquivos do volume. Cada arquivo
+//com mais de um trecho contiguo tem seus blocos (dados e indirecao) copiados
+//para uma faixa contigua livre e o mapa do i-node e' trocado de uma vez; o
+//volume continua em uso e so' o arquivo movido fica bloqueado. Arquivos com
+//blocos compartilhados (clones e deduplicacao) nao sao movidos. Com
+//measureOnly diferente de 0, so' mede a fragmentacao. O resultado e' copiado
+//para *report (se nao for NULL). Retorna o numero de arquivos movidos ou -1
+//em caso de falha
+int myFSDefrag (Disk *d, const char *path, int measureOnly, MyFSDefragReport *report);
+
+#endif
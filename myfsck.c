@@ -0,0 +1,109 @@
+/*
+*  myfsck.c - Verificador de consistencia de volumes MyFS (programa avulso)
+*
+*  Autores: Lara Dias - 202376010, Sarah Cristina - 202376034, Willian Santos
+*  Projeto: Trabalho Pratico II - Sistemas Operacionais
+*  Organizacao: Universidade Federal de Juiz de Fora
+*  Departamento: Dep. Ciencia da Computacao
+*
+*  Uso: myfsck [-r] [-j threads] disco.dsk
+*
+*  Codigos de saida (como no e2fsck): 0 = volume consistente, 1 = problemas
+*  corrigidos, 4 = problemas nao corrigidos, 8 = erro de operacao
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "disk.h"
+#include "myfs.h"
+
+#define FSCK_EXIT_OK 0                     // Volume consistente
+#define FSCK_EXIT_FIXED 1                  // Problemas encontrados e corrigidos
+#define FSCK_EXIT_UNCORRECTED 4            // Problemas que continuam no volume
+#define FSCK_EXIT_ERROR 8                  // Disco ou volume ilegível, argumentos inválidos
+
+// Mostra a forma de uso do programa
+static void usage(const char *prog) {
+    fprintf(stderr, "Uso: %s [-r] [-j threads] disco.dsk\n", prog);
+    fprintf(stderr, "  -r          corrige os problemas encontrados\n");
+    fprintf(stderr, "  -j threads  threads que percorrem a tabela de i-nodes (padrão: 4)\n");
+}
+
+// Mostra os contadores de um relatório de myFSCheck
+static void print_report(const MyFSCheckReport *r) {
+    printf("I-nodes em uso: %u\n", r->inodesUsed);
+    printf("Blocos em uso: %u, livres: %u\n", r->blocksUsed, r->freeBlocks);
+    printf("Superbloco e mapas inválidos: %u\n", r->badSuperblock);
+    printf("I-nodes inválidos: %u\n", r->badInodes);
+    printf("Endereços de blocos inválidos: %u\n", r->badBlockRefs);
+    printf("Entradas de diretório inválidas: %u\n", r->badEntries);
+    printf("I-nodes órfãos: %u\n", r->orphanInodes);
+    printf("Blocos perdidos (em uso sem dono): %u\n", r->leakedBlocks);
+    printf("Blocos em uso marcados como livres: %u\n", r->missingBlocks);
+    printf("Contadores de referências errados: %u\n", r->badRefcounts);
+    printf("Blocos de metadados com vários donos: %u\n", r->crossLinked);
+}
+
+int main(int argc, char **argv) {
+    int repair = 0, threads = 0;
+    char *path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            repair = 1;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            if (threads <= 0) {
+                usage(argv[0]);
+                return FSCK_EXIT_ERROR;
+            }
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return FSCK_EXIT_ERROR;
+        }
+    }
+    if (!path) {
+        usage(argv[0]);
+        return FSCK_EXIT_ERROR;
+    }
+
+    Disk *d = diskConnect(0, path);
+    if (!d) {
+        fprintf(stderr, "[Fsck] Erro: Não foi possível abrir o disco %s\n", path);
+        return FSCK_EXIT_ERROR;
+    }
+
+    struct timespec t0, t1;
+    MyFSCheckReport report;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int problems = myFSCheck(d, repair, threads, &report);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (problems < 0) {
+        diskDisconnect(d);
+        return FSCK_EXIT_ERROR;
+    }
+    print_report(&report);
+    printf("Verificação em %.2f s: %d problema(s)", (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9,
+           problems);
+    if (repair) printf(", %u corrigido(s)", report.repaired);
+    printf("\n");
+
+    // Depois do reparo, uma nova verificação mostra o que ainda ficou
+    int status = (problems == 0 ? FSCK_EXIT_OK : FSCK_EXIT_UNCORRECTED);
+    if (repair && problems > 0) {
+        int left = myFSCheck(d, 0, threads, &report);
+        if (left == 0) {
+            status = FSCK_EXIT_FIXED;
+        } else {
+            printf("Depois do reparo: %d problema(s) continuam no volume\n", left);
+            status = (left < 0 ? FSCK_EXIT_ERROR : FSCK_EXIT_UNCORRECTED);
+        }
+    }
+    diskDisconnect(d);
+    return status;
+}
@@ -0,0 +1,21 @@
+/*
+*  sha256.h - Resumo SHA-256 (FIPS 180-4) do conteudo dos blocos do MyFS
+*
+*  Autores: Lara Dias - 202376010, Sarah Cristina - 202376034, Willian Santos
+*  Projeto: Trabalho Pratico II - Sistemas Operacionais
+*  Organizacao: Universidade Federal de Juiz de Fora
+*  Departamento: Dep. Ciencia da Computacao
+*
+*/
+
+#ifndef SHA256_H
+#define SHA256_H
+
+//Tamanho do resumo, em bytes
+#define SHA256_DIGEST_SIZE 32
+
+//Funcao que calcula em digest o resumo SHA-256 dos len bytes de data
+void sha256Digest (const unsigned char *data, unsigned int len,
+                   unsigned char *digest);
+
+#endif
@@ -1,6 +1,6 @@
 /*
  * test_suite.c - Script de teste automatizado para MyFS
- * Compilar com: gcc test_suite.c myfs.c vfs.c inode.c disk.c util.c -o teste_auto
+ * Compilar com: gcc -pthread test_suite.c myfs.c vfs.c inode.c disk.c util.c dcache.c aio.c -o teste_auto
  * Executar: ./teste_auto
  */
 
@@ -8,23 +8,78 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
 #include "myfs.h"
 #include "disk.h"
 #include "vfs.h"
+#include "aio.h"
+#include "util.h"
+#include "inode.h"
 
 #define DISK_NAME "autotest.dsk"
 #define DISK_CYLINDERS 20
 #define MYFS_ID 'M'
 #define BLOCK_SIZE 1 // 1 setor (512 bytes)
+#define THREAD_WRITERS 4
+#define THREAD_READERS 2
+#define THREAD_FILE_SIZE 600 // Maior que um bloco: exercita a alocação
+#define MANY_FDS 300 // Bem acima do antigo limite de 20 arquivos abertos
+#define APPEND_DISK "append.dsk"
+#define APPEND_CYLINDERS 16
+#define APPEND_THREADS 4
+#define APPEND_BLOCKS 16 // Total de blocos anexados, dividido entre as threads
+#define STRIPE_DISK_A "stripe_a.dsk"
+#define STRIPE_DISK_B "stripe_b.dsk"
+#define STRIPE_CYLINDERS 6
+#define STRIPE_SECTORS 8
+#define MIRROR_DISK_A "mirror_a.dsk"
+#define MIRROR_DISK_B "mirror_b.dsk"
+#define MIRROR_CYLINDERS 2
+#define MOUNT_DISK "mount_b.dsk"
+#define MOUNT_CYLINDERS 3
+#define CRC_DISK "crc.dsk"
+#define CRC_CYLINDERS 3
+#define FSCK_DISK "fsck.dsk"
+#define FSCK_CYLINDERS 3
+#define DEFRAG_DISK "defrag.dsk"
+#define DEFRAG_CYLINDERS 10
+#define DEFRAG_ROUNDS 8 // Blocos de /a.bin e /b.bin, separados por blocos do enchimento
+#define CG_DISK "cg.dsk"
+#define CG_CYLINDERS 16
+#define CG_DIRS 3
+#define CG_FILES 3 // Arquivos por diretório, escritos intercalados
+#define CG_CRASH_DISK "cg_queda.dsk" // Cópia do disco tirada com o volume montado
+#define FMT_DISK "fmt.dsk"
+#define FMT_CYLINDERS 4
+#define FMT_SPARSE_BPI 8192 // Poucos i-nodes: um setor de i-nodes por grupo
+#define FMT_RESERVED 50 // Porcentagem reservada
+#define FMT_JOURNAL 16
+#define ZC_FILE_SIZE 5000 // Arquivo lido sem cópia: blocos inteiros e um pedaço
+#define ZC_CHUNK 1500 // Leituras desalinhadas com os blocos
+#define IOV_RECORDS 6 // Registros (cabeçalho + conteúdo) gravados por um único writev
+#define IOV_HEADER 12
+#define IOV_PAYLOAD 500
+#define MAP_PAGES 3 // Páginas inteiras do arquivo mapeado, mais MAP_TAIL bytes
+#define MAP_TAIL 100
+#define MAP_THREADS 4 // Threads que tocam juntas uma página ainda não carregada
+#define SLAB_WRITES 256 // Escritas pequenas medidas pelo teste do alocador de i-nodes
+#define RAW_SECTOR_SIZE 518 // Setor no arquivo do disco: 3 bytes de preâmbulo, 512 de dados, 3 de ECC
 
 // ====================================================================
 // PROTÓTIPOS MANUAIS (Necessário pois myfs.h só expõe installMyFS)
 // ====================================================================
 int myFSFormat (Disk *d, unsigned int blockSize);
 int myFSxMount (Disk *d, int x);
+int myFSIsIdle (Disk *d);
 int myFSOpen (Disk *d, const char *path);
 int myFSRead (int fd, char *buf, unsigned int nbytes);
 int myFSWrite (int fd, const char *buf, unsigned int nbytes);
+int myFSReadv (int fd, const struct iovec *iov, int iovcnt);
+int myFSWritev (int fd, const struct iovec *iov, int iovcnt);
 int myFSClose (int fd);
 int myFSOpenDir (Disk *d, const char *path);
 int myFSReadDir (int fd, char *filename, unsigned int *inumber);
@@ -35,6 +90,175 @@ int myFSCloseDir (int fd);
 
 void cleanup_disk() {
     remove(DISK_NAME);
+    remove(STRIPE_DISK_A);
+    remove(STRIPE_DISK_B);
+    remove(MIRROR_DISK_A);
+    remove(MIRROR_DISK_B);
+    remove(MOUNT_DISK);
+    remove(APPEND_DISK);
+    remove(CRC_DISK);
+    remove(FSCK_DISK);
+    remove(DEFRAG_DISK);
+    remove(CG_DISK);
+    remove(CG_CRASH_DISK);
+    remove(FMT_DISK);
+}
+
+// Inverte um bit do byte offset do arquivo do disco (com o disco desconectado)
+// Retorna 0 em caso de sucesso ou -1 em caso de falha
+int flip_raw_byte(const char *path, long offset) {
+    FILE *raw = fopen(path, "r+b");
+    if (!raw || fseek(raw, offset, SEEK_SET) != 0) { if (raw) fclose(raw); return -1; }
+    int c = fgetc(raw);
+    fseek(raw, offset, SEEK_SET);
+    fputc(c ^ 0x04, raw);
+    fclose(raw);
+    return (c == EOF ? -1 : 0);
+}
+
+// Grava n bytes de data na posição offset do arquivo path (fora do emulador)
+int write_raw_bytes(const char *path, long offset, const char *data, size_t n) {
+    FILE *raw = fopen(path, "r+b");
+    if (!raw || fseek(raw, offset, SEEK_SET) != 0) { if (raw) fclose(raw); return -1; }
+    size_t w = fwrite(data, 1, n, raw);
+    fclose(raw);
+    return (w == n ? 0 : -1);
+}
+
+// Carga do teste de grupos de cilindros: cria CG_DIRS diretórios e escreve
+// intercalados os seus CG_FILES arquivos; depois remonta o volume (nada fica
+// em cache) e relê os arquivos diretório a diretório, como um cp -r da árvore.
+// Guarda em write_ms e read_ms o tempo de cada fase
+// Retorna 0 em caso de sucesso ou -1 se algum arquivo vier incorreto
+int cg_workload(Disk *d, double *write_ms, double *read_ms) {
+    char data[2048], in[2048], path[64];
+    struct timespec w0, w1, r0, r1;
+    clock_gettime(CLOCK_MONOTONIC, &w0);
+    for (int k = 0; k < CG_DIRS; k++) {
+        sprintf(path, "/dir%d", k);
+        myFSCloseDir(myFSOpenDir(d, path));
+    }
+    for (int f = 0; f < CG_FILES; f++)
+        for (int k = 0; k < CG_DIRS; k++) {
+            sprintf(path, "/dir%d/arq%d.txt", k, f);
+            memset(data, 'a' + k * CG_FILES + f, sizeof(data));
+            int fd = myFSOpen(d, path);
+            myFSWrite(fd, data, sizeof(data));
+            myFSClose(fd);
+        }
+    // A escrita inclui a desmontagem, que grava o mapa de bits
+    if (myFSxMount(d, 0) != 1) return -1;
+    clock_gettime(CLOCK_MONOTONIC, &w1);
+    if (myFSxMount(d, 1) != 1) return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &r0);
+    for (int k = 0; k < CG_DIRS; k++)
+        for (int f = 0; f < CG_FILES; f++) {
+            sprintf(path, "/dir%d/arq%d.txt", k, f);
+            int fd = myFSOpen(d, path);
+            int ok = (myFSRead(fd, in, sizeof(in)) == (int)sizeof(in) && in[0] == 'a' + k * CG_FILES + f);
+            myFSClose(fd);
+            if (!ok) { printf("FALHA! Conteúdo de %s incorreto.\n", path); return -1; }
+        }
+    clock_gettime(CLOCK_MONOTONIC, &r1);
+    *write_ms = (w1.tv_sec - w0.tv_sec) * 1e3 + (w1.tv_nsec - w0.tv_nsec) / 1e6;
+    *read_ms = (r1.tv_sec - r0.tv_sec) * 1e3 + (r1.tv_nsec - r0.tv_nsec) / 1e6;
+    return 0;
+}
+
+// Argumentos e resultado de cada thread do teste de concorrência
+typedef struct {
+    Disk *d;
+    int id;
+    int ok;
+} thread_arg_t;
+
+// Escritora: grava um arquivo próprio com um padrão e confere a releitura
+void *writer_thread(void *p) {
+    thread_arg_t *a = p;
+    char path[32], out[THREAD_FILE_SIZE], in[THREAD_FILE_SIZE];
+    sprintf(path, "/thr_%d.txt", a->id);
+    for (int i = 0; i < THREAD_FILE_SIZE; i++) out[i] = 'a' + (a->id + i) % 26;
+
+    int fd = myFSOpen(a->d, path);
+    if (fd == -1) return NULL;
+    int w = myFSWrite(fd, out, THREAD_FILE_SIZE);
+    myFSClose(fd);
+
+    fd = myFSOpen(a->d, path);
+    if (fd == -1) return NULL;
+    int r = myFSRead(fd, in, THREAD_FILE_SIZE);
+    myFSClose(fd);
+    a->ok = (w == THREAD_FILE_SIZE && r == THREAD_FILE_SIZE &&
+             memcmp(in, out, THREAD_FILE_SIZE) == 0);
+    return NULL;
+}
+
+// Leitora: relê várias vezes um arquivo compartilhado que não muda
+void *reader_thread(void *p) {
+    thread_arg_t *a = p;
+    char buf[64];
+    a->ok = 1;
+    for (int k = 0; k < 5 && a->ok; k++) {
+        int fd = myFSOpen(a->d, "/compartilhado.txt");
+        memset(buf, 0, sizeof(buf));
+        if (fd == -1 || myFSRead(fd, buf, sizeof(buf) - 1) <= 0 ||
+            strcmp(buf, "conteudo compartilhado") != 0)
+            a->ok = 0;
+        if (fd != -1) myFSClose(fd);
+    }
+    return NULL;
+}
+
+// Argumentos e resultado de cada thread do teste de anexação
+typedef struct {
+    Disk *d;
+    int id;
+    int blocks;
+    int ok;
+} append_arg_t;
+
+// Anexadora: acrescenta blocks blocos, um por escrita, ao fim de um arquivo próprio
+void *append_thread(void *p) {
+    append_arg_t *a = p;
+    char path[32], block[512];
+    sprintf(path, "/anexo_%d.bin", a->id);
+    memset(block, 'A' + a->id, sizeof(block));
+
+    int fd = myFSOpen(a->d, path);
+    if (fd == -1) return NULL;
+    int ok = 1;
+    for (int b = 0; b < a->blocks && ok; b++)
+        ok = (myFSWrite(fd, block, sizeof(block)) == (int)sizeof(block));
+    myFSClose(fd);
+    a->ok = ok;
+    return NULL;
+}
+
+// Tratador de SIGSEGV do programa, instalado antes do primeiro myFSMmap: enquanto
+// map_fault_armed, volta ao último sigsetjmp em map_fault_env; senão, ação padrão
+sigjmp_buf map_fault_env;
+volatile sig_atomic_t map_fault_armed;
+void map_fault_guard(int sig) {
+    if (map_fault_armed) siglongjmp(map_fault_env, 1);
+    signal(sig, SIG_DFL);
+}
+
+// Toque no mapeamento: grava um byte próprio numa página ainda não carregada
+void *map_touch_thread(void *p) {
+    char *byte = p;
+    *byte = 'T';
+    return NULL;
+}
+
+// Gancho de escrita do teste de anexação: conta em arg[0] as gravações do
+// superbloco (setor 0) e em arg[1] as do mapa de bits (setor 1)
+int count_meta_writes(Disk *d, unsigned long addr, unsigned long count, void *arg) {
+    unsigned long *writes = arg;
+    (void)d;
+    if (addr == 0) __atomic_fetch_add(&writes[0], 1, __ATOMIC_RELAXED);
+    if (addr <= 1 && addr + count > 1) __atomic_fetch_add(&writes[1], 1, __ATOMIC_RELAXED);
+    return 0;
 }
 
 int main() {
@@ -176,13 +400,1152 @@ int main() {
     if (found_link) { printf("FALHA! Arquivo ainda existe após Unlink.\n"); exit(1); }
     printf("SUCESSO.\n");
 
-    // 10. Desmontar e Desconectar
-    printf("[10/10] Limpeza Final... ");
-    if (myFSxMount(d, 0) != 1) { // 0 = Unmount
-        printf("FALHA no Unmount!\n"); exit(1);
+    // [TESTE EXTRA] Subdiretórios e caminhos com várias componentes
+    printf("[EXTRA] Teste de Subdiretórios... ");
+    dir_fd = myFSOpenDir(d, "/docs");
+    if (dir_fd == -1) { printf("FALHA no OpenDir de /docs!\n"); exit(1); }
+    myFSCloseDir(dir_fd);
+    dir_fd = myFSOpenDir(d, "/docs/relatorios");
+    if (dir_fd == -1) { printf("FALHA no OpenDir de /docs/relatorios!\n"); exit(1); }
+    myFSCloseDir(dir_fd);
+
+    const char *sub_content = "Conteudo dentro de um subdiretorio";
+    fd = myFSOpen(d, "/docs/relatorios/nota_com_nome_bem_comprido.txt");
+    if (fd == -1) { printf("FALHA no Open em subdiretório!\n"); exit(1); }
+    myFSWrite(fd, sub_content, strlen(sub_content));
+    myFSClose(fd);
+
+    fd = myFSOpen(d, "/docs/relatorios/nota_com_nome_bem_comprido.txt");
+    memset(buffer, 0, sizeof(buffer));
+    myFSRead(fd, buffer, sizeof(buffer));
+    myFSClose(fd);
+    if (strcmp(buffer, sub_content) != 0) { printf("FALHA! Conteúdo lido incorreto no subdiretório.\n"); exit(1); }
+
+    if (myFSOpen(d, "/inexistente/x.txt") != -1) { printf("FALHA! Abriu arquivo em diretório inexistente.\n"); exit(1); }
+
+    dir_fd = myFSOpenDir(d, "/docs");
+    int found_sub = 0;
+    while (myFSReadDir(dir_fd, entry_name, &inumber) == 1) {
+        if (strcmp(entry_name, "relatorios") == 0) found_sub = 1;
     }
-    diskDisconnect(d);
+    // Diretório não vazio não pode ser removido
+    if (myFSUnlink(dir_fd, "relatorios") == 0) { printf("FALHA! Removeu diretório não vazio.\n"); exit(1); }
+    myFSCloseDir(dir_fd);
+    if (!found_sub) { printf("FALHA! 'relatorios' não encontrado em /docs.\n"); exit(1); }
+    printf("SUCESSO.\n");
+
+    // [TESTE EXTRA] Escritoras e leitoras simultâneas no mesmo disco
+    printf("[EXTRA] Teste de Concorrência (threads)... ");
+    fd = myFSOpen(d, "/compartilhado.txt");
+    myFSWrite(fd, "conteudo compartilhado", strlen("conteudo compartilhado"));
+    myFSClose(fd);
+
+    pthread_t threads[THREAD_WRITERS + THREAD_READERS];
+    thread_arg_t args[THREAD_WRITERS + THREAD_READERS];
+    for (int i = 0; i < THREAD_WRITERS + THREAD_READERS; i++) {
+        args[i].d = d;
+        args[i].id = i;
+        args[i].ok = 0;
+        pthread_create(&threads[i], NULL,
+                       (i < THREAD_WRITERS ? writer_thread : reader_thread), &args[i]);
+    }
+    for (int i = 0; i < THREAD_WRITERS + THREAD_READERS; i++) {
+        pthread_join(threads[i], NULL);
+        if (!args[i].ok) { printf("FALHA na thread %d!\n", i); exit(1); }
+    }
+    printf("SUCESSO.\n");
+
+    // [TESTE EXTRA] Anexação com várias threads: o mesmo total de blocos anexado por uma
+    // thread e por APPEND_THREADS, cada uma no seu arquivo, num volume sem grupos de cilindros
+    printf("[EXTRA] Teste de Anexação com Várias Threads... ");
+    if (diskCreateRawDisk(APPEND_DISK, APPEND_CYLINDERS) != 0) { printf("FALHA ao criar o disco!\n"); exit(1); }
+    Disk *dapp = diskConnect(2, APPEND_DISK);
+    MyFSFormatOptions app_flat = { 0, 0, 0, MYFS_FORMAT_NO_GROUPS };
+    double app_ms[2];
+    unsigned long app_writes[2][2] = { { 0, 0 }, { 0, 0 } };
+    int app_allocs[2];
+    for (int r = 0; r < 2; r++) {
+        int nthreads = (r == 0 ? 1 : APPEND_THREADS);
+        if (!dapp || myFSFormatEx(dapp, 512, &app_flat) <= 0 || myFSxMount(dapp, 1) != 1) {
+            printf("FALHA ao montar o disco!\n"); exit(1);
+        }
+        int app_free = myFSGetFreeBlocks(dapp);
+        pthread_t app_threads[APPEND_THREADS];
+        append_arg_t app_args[APPEND_THREADS];
+        struct timespec a0, a1;
+        diskSetWriteHook(dapp, count_meta_writes, app_writes[r]);
+        clock_gettime(CLOCK_MONOTONIC, &a0);
+        for (int i = 0; i < nthreads; i++) {
+            app_args[i] = (append_arg_t){ dapp, i, APPEND_BLOCKS / nthreads, 0 };
+            pthread_create(&app_threads[i], NULL, append_thread, &app_args[i]);
+        }
+        for (int i = 0; i < nthreads; i++) pthread_join(app_threads[i], NULL);
+        clock_gettime(CLOCK_MONOTONIC, &a1);
+        diskSetWriteHook(dapp, NULL, NULL);
+        app_ms[r] = (a1.tv_sec - a0.tv_sec) * 1e3 + (a1.tv_nsec - a0.tv_nsec) / 1e6;
+        app_allocs[r] = app_free - myFSGetFreeBlocks(dapp);
+        for (int i = 0; i < nthreads; i++) {
+            char app_path[32], app_in[512];
+            sprintf(app_path, "/anexo_%d.bin", i);
+            fd = myFSOpen(dapp, app_path);
+            int ok = app_args[i].ok;
+            for (int b = 0; b < app_args[i].blocks && ok; b++)
+                ok = (myFSRead(fd, app_in, sizeof(app_in)) == (int)sizeof(app_in) && app_in[0] == 'A' + i &&
+                      app_in[sizeof(app_in) - 1] == 'A' + i);
+            myFSClose(fd);
+            if (!ok) { printf("FALHA na thread %d de %d!\n", i, nthreads); exit(1); }
+        }
+        if (myFSxMount(dapp, 0) != 1 || myFSCheck(dapp, 0, 4, NULL) != 0) { printf("FALHA! Volume inconsistente.\n"); exit(1); }
+        // Alocar não grava o superbloco nem o mapa de bits (só na desmontagem)
+        if (app_allocs[r] < APPEND_BLOCKS || app_writes[r][0] != 0 || app_writes[r][1] != 0) {
+            printf("FALHA! %lu gravações do superbloco e %lu do mapa de bits para %d blocos.\n",
+                   app_writes[r][0], app_writes[r][1], app_allocs[r]); exit(1);
+        }
+    }
+    diskDisconnect(dapp);
+    // As threads dividem o disco, mas os blocos de todas ficam perto da tabela de i-nodes
+    if (app_ms[1] > app_ms[0]) {
+        printf("FALHA! %d threads mais lentas que 1 (%.0f ms -> %.0f ms).\n", APPEND_THREADS, app_ms[0], app_ms[1]);
+        exit(1);
+    }
+    printf("SUCESSO (%d blocos: %.1f blocos/s com 1 thread, %.1f com %d; superbloco e mapa de bits nenhuma vez "
+           "gravados para %d e %d blocos alocados).\n", APPEND_BLOCKS, APPEND_BLOCKS / (app_ms[0] / 1e3),
+           APPEND_BLOCKS / (app_ms[1] / 1e3), APPEND_THREADS, app_allocs[0], app_allocs[1]);
+
+    // [TESTE EXTRA] Muitos descritores abertos e rejeição de descritores antigos
+    printf("[EXTRA] Teste de Descritores (muitos abertos / antigos)... ");
+    static int many_fds[MANY_FDS];
+    for (int i = 0; i < MANY_FDS; i++) {
+        many_fds[i] = myFSOpen(d, "/compartilhado.txt");
+        if (many_fds[i] <= 0) { printf("FALHA ao abrir o descritor %d!\n", i); exit(1); }
+    }
+    for (int i = 0; i < MANY_FDS; i++) myFSClose(many_fds[i]);
+
+    int old_fd = myFSOpen(d, "/compartilhado.txt");
+    myFSClose(old_fd);
+    fd = myFSOpen(d, "/compartilhado.txt"); // reaproveita a entrada de old_fd
+    if (fd == old_fd || myFSRead(old_fd, buffer, 4) != -1 || myFSClose(old_fd) != -1) {
+        printf("FALHA! Descritor antigo ainda aceito.\n"); exit(1);
+    }
+    if (myFSRead(fd, buffer, 4) != 4) { printf("FALHA na leitura pelo descritor novo!\n"); exit(1); }
+    myFSClose(fd);
+    printf("SUCESSO.\n");
+
+    // [TESTE EXTRA] E/S assíncrona pelo VFS: abertura, escritas encadeadas,
+    // fsync e leitura de volta, colhendo as conclusões depois
+    printf("[EXTRA] Teste de E/S Assíncrona... ");
+    if (myFSxMount(d, 0) != 1 || vfsMountRoot(d, MYFS_ID) != 0) { printf("FALHA ao montar pelo VFS!\n"); exit(1); }
+    AIOContext *aio = aioCreate(8, 3);
+    if (!aio) { printf("FALHA no aioCreate!\n"); exit(1); }
+    AIOSubmission sqe[4] = {{0}};
+    AIOCompletion cqe[4];
+
+    sqe[0].op = AIO_OP_OPEN; sqe[0].path = "/assincrono.txt"; sqe[0].userTag = 100;
+    if (aioSubmit(aio, sqe, 1) != 1 || aioReap(aio, cqe, 4, 1) != 1 ||
+        cqe[0].userTag != 100 || cqe[0].result <= 0) { printf("FALHA na abertura assíncrona!\n"); exit(1); }
+    int afd = cqe[0].result;
+
+    char part1[] = "primeira parte, ", part2[] = "segunda parte";
+    for (int i = 0; i < 4; i++) { sqe[i].fd = afd; sqe[i].userTag = i; }
+    sqe[0].op = AIO_OP_WRITE; sqe[0].buf = part1; sqe[0].nbytes = strlen(part1);
+    sqe[1].op = AIO_OP_WRITE; sqe[1].buf = part2; sqe[1].nbytes = strlen(part2);
+    sqe[2].op = AIO_OP_FSYNC;
+    sqe[3].op = AIO_OP_CLOSE;
+    if (aioSubmit(aio, sqe, 4) != 4) { printf("FALHA na submissão!\n"); exit(1); }
+    int reaped = 0;
+    while (reaped < 4) {
+        int n = aioReap(aio, cqe, 4, 1);
+        for (int i = 0; i < n; i++)
+            if (cqe[i].result < 0) { printf("FALHA no pedido %llu!\n", cqe[i].userTag); exit(1); }
+        reaped += n;
+    }
+    aioDestroy(aio);
+
+    afd = vfsOpen("/assincrono.txt");
+    memset(buffer, 0, sizeof(buffer));
+    vfsRead(afd, buffer, sizeof(buffer));
+    vfsClose(afd);
+    if (strcmp(buffer, "primeira parte, segunda parte") != 0) { printf("FALHA! Ordem das escritas não mantida.\n"); exit(1); }
+    if (vfsUnmountRoot() != 0 || myFSxMount(d, 1) != 1) { printf("FALHA ao remontar!\n"); exit(1); }
     printf("SUCESSO.\n");
+
+    // [TESTE EXTRA] Volume com faixas (RAID-0) de dois discos sob o MyFS
+    printf("[EXTRA] Teste de Volume com Faixas (RAID-0)... ");
+    if (diskCreateRawDisk(STRIPE_DISK_A, STRIPE_CYLINDERS) != 0 ||
+        diskCreateRawDisk(STRIPE_DISK_B, STRIPE_CYLINDERS) != 0) { printf("FALHA ao criar membros!\n"); exit(1); }
+    Disk *members[2] = { diskConnect(1, STRIPE_DISK_A), diskConnect(2, STRIPE_DISK_B) };
+    Disk *vol = diskCreateStriped(3, members, 2, STRIPE_SECTORS);
+    if (!vol || diskGetNumSectors(vol) != 2 * diskGetNumSectors(members[0])) { printf("FALHA no diskCreateStriped!\n"); exit(1); }
+
+    // Setores consecutivos do volume alternam entre os membros a cada faixa
+    unsigned char sectors[3 * STRIPE_SECTORS * DISK_SECTORDATASIZE], sector[DISK_SECTORDATASIZE];
+    for (unsigned int i = 0; i < sizeof(sectors); i++) sectors[i] = (unsigned char)(i / DISK_SECTORDATASIZE);
+    if (diskWriteSectors(vol, 4, 3 * STRIPE_SECTORS, sectors) != 0) { printf("FALHA no diskWriteSectors!\n"); exit(1); }
+    diskReadSector(members[1], 0, sector); // setor 8 do volume = setor 0 do membro 1
+    if (sector[0] != 8 - 4) { printf("FALHA! Faixa no membro errado.\n"); exit(1); }
+    memset(sectors, 0, sizeof(sectors));
+    diskReadSectors(vol, 4, 3 * STRIPE_SECTORS, sectors);
+    for (unsigned int i = 0; i < sizeof(sectors); i++)
+        if (sectors[i] != (unsigned char)(i / DISK_SECTORDATASIZE)) { printf("FALHA! Leitura do volume incorreta.\n"); exit(1); }
+
+    // MyFS sobre o volume: arquivo de vários blocos atravessando as faixas
+    if (myFSxMount(d, 0) != 1 || myFSFormat(vol, 512) <= 0 || myFSxMount(vol, 1) != 1) { printf("FALHA ao formatar/montar o volume!\n"); exit(1); }
+    static char big_out[20 * 512], big_in[20 * 512];
+    for (unsigned int i = 0; i < sizeof(big_out); i++) big_out[i] = 'A' + i % 23;
+    fd = myFSOpen(vol, "/grande.bin");
+    if (myFSWrite(fd, big_out, sizeof(big_out)) != (int)sizeof(big_out)) { printf("FALHA na escrita no volume!\n"); exit(1); }
+    myFSClose(fd);
+    fd = myFSOpen(vol, "/grande.bin");
+    if (myFSRead(fd, big_in, sizeof(big_in)) != (int)sizeof(big_in) || memcmp(big_in, big_out, sizeof(big_in)) != 0) {
+        printf("FALHA! Conteúdo lido do volume incorreto.\n"); exit(1);
+    }
+    myFSClose(fd);
+    if (myFSxMount(vol, 0) != 1 || myFSxMount(d, 1) != 1) { printf("FALHA ao remontar!\n"); exit(1); }
+    diskDisconnect(vol);
+    diskDisconnect(members[0]);
+    diskDisconnect(members[1]);
+    printf("SUCESSO.\n");
+
+    // [TESTE EXTRA] Volume espelhado (RAID-1): leitura pelo membro mais próximo e ressincronização
+    printf("[EXTRA] Teste de Volume Espelhado (RAID-1)... ");
+    if (diskCreateRawDisk(MIRROR_DISK_A, MIRROR_CYLINDERS) != 0 ||
+        diskCreateRawDisk(MIRROR_DISK_B, MIRROR_CYLINDERS) != 0) { printf("FALHA ao criar membros!\n"); exit(1); }
+    Disk *mirrors[2] = { diskConnect(1, MIRROR_DISK_A), diskConnect(2, MIRROR_DISK_B) };
+    Disk *mvol = diskCreateMirrored(3, mirrors, 2);
+    if (!mvol || diskGetNumSectors(mvol) != diskGetNumSectors(mirrors[0])) { printf("FALHA no diskCreateMirrored!\n"); exit(1); }
+
+    // Toda escrita chega aos dois membros
+    memset(sector, 'x', sizeof(sector));
+    if (diskWriteSector(mvol, 10, sector) != 0) { printf("FALHA no diskWriteSector!\n"); exit(1); }
+    for (int m = 0; m < 2; m++) {
+        unsigned char copy[DISK_SECTORDATASIZE];
+        diskReadSector(mirrors[m], 10, copy);
+        if (copy[0] != 'x') { printf("FALHA! Membro %d sem a escrita.\n", m); exit(1); }
+    }
+
+    // Com as cabeças em cilindros diferentes, cada leitura vai ao membro mais próximo
+    diskReadSector(mirrors[1], 100, sector); // membro 1 no cilindro 1, membro 0 no 0
+    diskReadSector(mvol, 120, sector);
+    if (diskGetCurrentCylinder(mirrors[0]) != 0) { printf("FALHA! Leitura não foi ao membro mais próximo.\n"); exit(1); }
+    diskReadSector(mvol, 5, sector);
+    if (diskGetCurrentCylinder(mirrors[1]) != 1) { printf("FALHA! Leitura não foi ao membro mais próximo.\n"); exit(1); }
+
+    // Membro retirado não recebe escritas até ser ressincronizado
+    Disk *detached = diskMirrorDetach(mvol, 1);
+    if (detached != mirrors[1] || diskMirrorDetach(mvol, 0) != NULL) { printf("FALHA no diskMirrorDetach!\n"); exit(1); }
+    memset(sector, 'y', sizeof(sector));
+    diskWriteSector(mvol, 10, sector);
+    diskReadSector(detached, 10, sector);
+    if (sector[0] != 'x') { printf("FALHA! Membro retirado recebeu escrita.\n"); exit(1); }
+    if (diskMirrorResync(mvol, 1, detached) != 0 || diskMirrorGetState(mvol, 1) != DISK_MIRROR_ACTIVE) { printf("FALHA no diskMirrorResync!\n"); exit(1); }
+    diskReadSector(detached, 10, sector);
+    if (sector[0] != 'y') { printf("FALHA! Membro não foi ressincronizado.\n"); exit(1); }
+    diskDisconnect(mvol);
+    diskDisconnect(mirrors[0]);
+    diskDisconnect(mirrors[1]);
+    printf("SUCESSO.\n");
+
+    // [TESTE EXTRA] Dois volumes MyFS montados ao mesmo tempo na árvore do VFS
+    printf("[EXTRA] Teste de Múltiplas Montagens... ");
+    if (diskCreateRawDisk(MOUNT_DISK, MOUNT_CYLINDERS) != 0) { printf("FALHA ao criar o disco!\n"); exit(1); }
+    Disk *d2 = diskConnect(1, MOUNT_DISK);
+    if (!d2 || myFSFormat(d2, 512) <= 0) { printf("FALHA ao formatar o segundo disco!\n"); exit(1); }
+    if (myFSxMount(d, 0) != 1 || vfsMount(d2, MYFS_ID, "/dados") == 0 ||  // raiz primeiro
+        vfsMountRoot(d, MYFS_ID) != 0 || vfsMount(d2, MYFS_ID, "/dados") != 0) { printf("FALHA ao montar!\n"); exit(1); }
+    if (vfsMount(d2, MYFS_ID, "/outro") == 0 || vfsMount(d, MYFS_ID, "/raiz") == 0 ||
+        myFSFormat(d2, 512) != -1) { printf("FALHA! Disco montado aceito de novo.\n"); exit(1); }
+
+    // Caminhos dentro de /dados vão ao segundo volume; os demais, à raiz
+    int fa = vfsOpen("/dados/nota.txt"), fb = vfsOpen("/dadosx.txt");
+    if (fa <= 0 || fb <= 0 || vfsWrite(fa, "segundo", 7) != 7 || vfsWrite(fb, "raiz", 4) != 4) { printf("FALHA na escrita!\n"); exit(1); }
+    if (vfsUnmount("/dados") == 0) { printf("FALHA! Desmontou volume com arquivo aberto.\n"); exit(1); }
+    vfsClose(fa);
+    if (vfsUnmount("/dados") != 0) { printf("FALHA! Volume ocioso não desmontou.\n"); exit(1); }
+    vfsClose(fb);
+
+    // Remontado, o segundo volume mantém o arquivo; a raiz não desmonta antes dele
+    if (vfsMount(d2, MYFS_ID, "/dados") != 0 || vfsUnmountRoot() == 0) { printf("FALHA ao remontar!\n"); exit(1); }
+    fa = vfsOpen("/dados/nota.txt");
+    memset(buffer, 0, sizeof(buffer));
+    if (fa <= 0 || vfsRead(fa, buffer, sizeof(buffer)) != 7 || strcmp(buffer, "segundo") != 0) {
+        printf("FALHA! Arquivo não foi ao segundo volume.\n"); exit(1);
+    }
+    vfsClose(fa);
+    if (vfsUnmount("/dados") != 0 || vfsUnmountRoot() != 0 || myFSxMount(d, 1) != 1) { printf("FALHA ao desmontar!\n"); exit(1); }
+    diskDisconnect(d2);
+    printf("SUCESSO.\n");
+
+    // [TESTE EXTRA] Snapshot: o volume congelado continua legível enquanto o original muda
+    printf("[EXTRA] Teste de Snapshots (Copy-on-Write)... ");
+    static char snap_old[3 * 512], snap_new[3 * 512], snap_in[3 * 512];
+    memset(snap_old, 'a', sizeof(snap_old));
+    memset(snap_new, 'b', sizeof(snap_new));
+    fd = myFSOpen(d, "/foto.txt");
+    myFSWrite(fd, "versao 1", 8); // dados embutidos no i-node
+    myFSClose(fd);
+    fd = myFSOpen(d, "/foto.bin");
+    myFSWrite(fd, snap_old, sizeof(snap_old));
+    myFSClose(fd);
+    int snap = myFSSnapshotCreate(d);
+    if (snap <= 0) { printf("FALHA no myFSSnapshotCreate!\n"); exit(1); }
+
+    fd = myFSOpen(d, "/foto.txt");
+    myFSWrite(fd, "versao 2", 8);
+    myFSClose(fd);
+    fd = myFSOpen(d, "/foto.bin");
+    myFSWrite(fd, snap_new, sizeof(snap_new));
+    myFSClose(fd);
+    myFSClose(myFSOpen(d, "/depois.txt"));
+
+    for (int round = 0; round < 2; round++) { // a segunda volta confere o snapshot após remontar
+        Disk *view = myFSSnapshotOpen(d, snap, 5);
+        if (!view || myFSxMount(view, 1) != 1) { printf("FALHA ao montar a visão do snapshot!\n"); exit(1); }
+        if (myFSxMount(d, 0) == 1) { printf("FALHA! Desmontou volume com visão aberta.\n"); exit(1); }
+        memset(buffer, 0, sizeof(buffer));
+        fd = myFSOpen(view, "/foto.txt");
+        if (fd <= 0 || myFSRead(fd, buffer, sizeof(buffer)) != 8 || strcmp(buffer, "versao 1") != 0 ||
+            myFSWrite(fd, "x", 1) != -1) { printf("FALHA! Arquivo pequeno do snapshot alterado.\n"); exit(1); }
+        myFSClose(fd);
+        fd = myFSOpen(view, "/foto.bin");
+        if (myFSRead(fd, snap_in, sizeof(snap_in)) != (int)sizeof(snap_in) || memcmp(snap_in, snap_old, sizeof(snap_in)) != 0) {
+            printf("FALHA! Blocos do snapshot alterados.\n"); exit(1);
+        }
+        myFSClose(fd);
+        if (myFSOpen(view, "/depois.txt") != -1) { printf("FALHA! Snapshot vê arquivo criado depois.\n"); exit(1); }
+        if (myFSSnapshotDelete(d, snap) == 0 || myFSSnapshotClose(view) == 0) { printf("FALHA! Visão em uso liberada.\n"); exit(1); }
+        if (myFSxMount(view, 0) != 1 || myFSSnapshotClose(view) != 0) { printf("FALHA ao fechar a visão!\n"); exit(1); }
+        if (myFSxMount(d, 0) != 1 || myFSxMount(d, 1) != 1) { printf("FALHA ao remontar!\n"); exit(1); }
+    }
+    fd = myFSOpen(d, "/foto.txt");
+    memset(buffer, 0, sizeof(buffer));
+    myFSRead(fd, buffer, sizeof(buffer));
+    myFSClose(fd);
+    if (strcmp(buffer, "versao 2") != 0) { printf("FALHA! Volume original não mudou.\n"); exit(1); }
+    if (myFSSnapshotDelete(d, snap) != 0 || myFSSnapshotDelete(d, snap) != -1) { printf("FALHA no myFSSnapshotDelete!\n"); exit(1); }
+    printf("SUCESSO.\n");
+
+    // [TESTE EXTRA] Clone: o arquivo novo usa os blocos do original até a primeira escrita
+    printf("[EXTRA] Teste de Clone de Arquivos (Reflink)... ");
+    static char clone_src[8 * 512], clone_in[8 * 512]; // blocos diretos e de indireção simples
+    for (int i = 0; i < (int)sizeof(clone_src); i++) clone_src[i] = 'a' + i % 26;
+    fd = myFSOpen(d, "/origem.bin");
+    myFSWrite(fd, clone_src, sizeof(clone_src));
+    myFSClose(fd);
+    if (myFSClone(d, "/origem.bin", "/clone.bin") != 0 || vfsClone("/foto.txt", "/foto2.txt") != -1 ||
+        myFSClone(d, "/foto.txt", "/foto2.txt") != 0) { printf("FALHA no myFSClone!\n"); exit(1); }
+    if (myFSClone(d, "/origem.bin", "/clone.bin") != -1 || myFSClone(d, "/nada.bin", "/x.bin") != -1) {
+        printf("FALHA! Clone aceito sobre nome existente ou de arquivo inexistente.\n"); exit(1);
+    }
+
+    // Escrita parcial num bloco de indireção do clone e escrita de bloco inteiro no original
+    fd = myFSOpen(d, "/clone.bin");
+    myFSRead(fd, clone_in, 6 * 512 + 100);
+    myFSWrite(fd, "XYZ", 3);
+    myFSClose(fd);
+    memcpy(clone_in, clone_src, sizeof(clone_src));
+    memset(clone_in, 'z', 512);
+    fd = myFSOpen(d, "/origem.bin");
+    myFSWrite(fd, clone_in, 512);
+    myFSClose(fd);
+
+    // Após remontar, a tabela de referências continua valendo
+    if (myFSxMount(d, 0) != 1 || myFSxMount(d, 1) != 1) { printf("FALHA ao remontar!\n"); exit(1); }
+    fd = myFSOpen(d, "/origem.bin");
+    myFSRead(fd, clone_in, 3 * 512);
+    myFSWrite(fd, "QQ", 2);
+    myFSClose(fd);
+
+    fd = myFSOpen(d, "/clone.bin");
+    if (myFSRead(fd, clone_in, sizeof(clone_in)) != (int)sizeof(clone_in) ||
+        memcmp(clone_in, clone_src, 6 * 512 + 100) != 0 || memcmp(clone_in + 6 * 512 + 100, "XYZ", 3) != 0 ||
+        memcmp(clone_in + 6 * 512 + 103, clone_src + 6 * 512 + 103, 2 * 512 - 103) != 0) {
+        printf("FALHA! Conteúdo do clone incorreto.\n"); exit(1);
+    }
+    myFSClose(fd);
+    memcpy(clone_src + 3 * 512, "QQ", 2);
+    memset(clone_src, 'z', 512);
+    fd = myFSOpen(d, "/origem.bin");
+    if (myFSRead(fd, clone_in, sizeof(clone_in)) != (int)sizeof(clone_in) || memcmp(clone_in, clone_src, sizeof(clone_in)) != 0) {
+        printf("FALHA! Escrita no clone alterou o original.\n"); exit(1);
+    }
+    myFSClose(fd);
+    fd = myFSOpen(d, "/foto2.txt");
+    memset(buffer, 0, sizeof(buffer));
+    if (myFSRead(fd, buffer, sizeof(buffer)) != 8 || strcmp(buffer, "versao 2") != 0) { printf("FALHA no clone de arquivo pequeno!\n"); exit(1); }
+    myFSClose(fd);
+    printf("SUCESSO.\n");
+
+    // [TESTE EXTRA] Deduplicação: blocos repetidos ocupam um só bloco (relata espaço e tempo de escrita)
+    printf("[EXTRA] Teste de Deduplicação de Blocos... ");
+    static char dedup_data[16 * 512], dedup_in[16 * 512]; // 8 blocos zerados + 8 cabeçalhos iguais
+    memset(dedup_data, 0, sizeof(dedup_data));
+    for (int b = 8; b < 16; b++) memcpy(dedup_data + b * 512, "CABECALHO v1", 12);
+    struct timespec t0, t1;
+    int free0 = myFSGetFreeBlocks(d);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    fd = myFSOpen(d, "/semdedup.bin");
+    myFSWrite(fd, dedup_data, sizeof(dedup_data));
+    myFSClose(fd);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ms_plain = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    int free1 = myFSGetFreeBlocks(d);
+    if (myFSSetDedup(d, 1) != 0) { printf("FALHA no myFSSetDedup!\n"); exit(1); }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    fd = myFSOpen(d, "/comdedup.bin");
+    myFSWrite(fd, dedup_data, sizeof(dedup_data));
+    myFSClose(fd);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ms_dedup = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    int free2 = myFSGetFreeBlocks(d);
+    // Sem deduplicação: 16 blocos + 1 de indireção; com: 2 distintos + indireção + tabela de referências
+    if (free0 - free1 != 17 || free1 - free2 > 4) { printf("FALHA! Blocos repetidos ocuparam espaço.\n"); exit(1); }
+    // Um bloco repetido não é lido do disco para a comparação e as referências
+    // vão à tabela de uma vez: o custo fica abaixo de uma busca (10 ms) por bloco
+    if (ms_dedup - ms_plain >= 16 * 10) {
+        printf("FALHA! Deduplicação custou %.0f ms a mais que a escrita normal.\n", ms_dedup - ms_plain);
+        exit(1);
+    }
+
+    // O modo fica gravado no superbloco; a varredura junta os blocos do arquivo gravado sem ele
+    if (myFSxMount(d, 0) != 1 || myFSxMount(d, 1) != 1) { printf("FALHA ao remontar!\n"); exit(1); }
+    int free3 = myFSGetFreeBlocks(d);
+    fd = myFSOpen(d, "/comdedup2.bin");
+    myFSWrite(fd, dedup_data, sizeof(dedup_data));
+    myFSClose(fd);
+    if (free3 - myFSGetFreeBlocks(d) > 3 || myFSSetDedup(d, 0) != 0) { printf("FALHA! Modo de deduplicação perdido.\n"); exit(1); }
+    int dedup_saved = myFSDedupScan(d);
+    if (dedup_saved < 16) { printf("FALHA no myFSDedupScan (%d blocos)!\n", dedup_saved); exit(1); }
+
+    // Escrever num bloco compartilhado não altera os outros arquivos
+    fd = myFSOpen(d, "/comdedup.bin");
+    myFSRead(fd, dedup_in, 8 * 512);
+    myFSWrite(fd, "CABECALHO v2", 12);
+    myFSClose(fd);
+    const char *dedup_files[] = {"/semdedup.bin", "/comdedup.bin", "/comdedup2.bin"};
+    for (int f = 0; f < 3; f++) {
+        fd = myFSOpen(d, dedup_files[f]);
+        if (myFSRead(fd, dedup_in, sizeof(dedup_in)) != (int)sizeof(dedup_in) ||
+            memcmp(dedup_in, dedup_data, 8 * 512) != 0 ||
+            memcmp(dedup_in + 8 * 512, f == 1 ? "CABECALHO v2" : "CABECALHO v1", 12) != 0 ||
+            memcmp(dedup_in + 9 * 512, dedup_data + 9 * 512, 7 * 512) != 0) {
+            printf("FALHA! Conteúdo de %s incorreto.\n", dedup_files[f]); exit(1);
+        }
+        myFSClose(fd);
+    }
+    printf("SUCESSO (16 blocos escritos: %d blocos e %.0f ms sem dedup, %d blocos e %.0f ms com dedup; "
+           "varredura devolveu %d blocos).\n", free0 - free1,
+           ms_plain, free1 - free2, ms_dedup, dedup_saved);
+
+    // [TESTE EXTRA] Compressão: log repetitivo ocupa menos setores e é lido de volta igual
+    printf("[EXTRA] Teste de Compressão de Arquivos... ");
+    static char comp_data[64 * 1024], comp_in[64 * 1024];
+    unsigned int comp_len = 0;
+    for (int l = 0; comp_len + 64 < sizeof(comp_data); l++)
+        comp_len += sprintf(comp_data + comp_len,
+                            "2024-05-%02d 12:%02d:%02d INFO [sensor-%02d] leitura concluida: temperatura=%d.%d C, estado=OK\n",
+                            l / 3600 % 28 + 1, l / 60 % 60, l % 60, l % 16, l * 7 % 40, l % 10);
+    double comp_ms[2];
+    int comp_used[2];
+    const char *comp_files[] = {"/log_plain.txt", "/log_lz.txt"};
+    for (int c = 0; c < 2; c++) {
+        if (myFSSetCompression(d, c) != 0) { printf("FALHA no myFSSetCompression!\n"); exit(1); }
+        int before = myFSGetFreeBlocks(d);
+        fd = myFSOpen(d, comp_files[c]);
+        myFSWrite(fd, comp_data, comp_len);
+        myFSClose(fd);
+        comp_used[c] = before - myFSGetFreeBlocks(d);
+    }
+    if (myFSSetCompression(d, 0) != 0 || comp_used[1] * 3 > comp_used[0]) {
+        printf("FALHA! Arquivo comprimido ocupou %d blocos (sem compressão: %d).\n", comp_used[1], comp_used[0]);
+        exit(1);
+    }
+    // Leitura sequencial (após remontar, sem nada em memória) medida nos dois arquivos
+    if (myFSxMount(d, 0) != 1 || myFSxMount(d, 1) != 1) { printf("FALHA ao remontar!\n"); exit(1); }
+    for (int c = 0; c < 2; c++) {
+        struct timespec r0, r1;
+        clock_gettime(CLOCK_MONOTONIC, &r0);
+        fd = myFSOpen(d, comp_files[c]);
+        int n = myFSRead(fd, comp_in, sizeof(comp_in));
+        myFSClose(fd);
+        clock_gettime(CLOCK_MONOTONIC, &r1);
+        comp_ms[c] = (r1.tv_sec - r0.tv_sec) * 1e3 + (r1.tv_nsec - r0.tv_nsec) / 1e6;
+        if (n != (int)comp_len || memcmp(comp_in, comp_data, comp_len) != 0) {
+            printf("FALHA! Conteúdo de %s incorreto.\n", comp_files[c]); exit(1);
+        }
+    }
+    if (comp_ms[1] >= comp_ms[0]) {
+        printf("FALHA! Leitura comprimida (%.0f ms) não foi mais rápida que a normal (%.0f ms).\n",
+               comp_ms[1], comp_ms[0]);
+        exit(1);
+    }
+
+    // Sobrescrita no meio (atravessando grupos) e leitura em pedaços de tamanho ímpar
+    fd = myFSOpen(d, "/log_lz.txt");
+    myFSRead(fd, comp_in, 10000);
+    memset(comp_data + 10000, 'Z', 3000);
+    myFSWrite(fd, comp_data + 10000, 3000);
+    myFSClose(fd);
+    fd = myFSOpen(d, "/log_lz.txt");
+    unsigned int comp_pos = 0;
+    int n;
+    while ((n = myFSRead(fd, comp_in + comp_pos, 777)) > 0) comp_pos += n;
+    myFSClose(fd);
+    if (comp_pos != comp_len || memcmp(comp_in, comp_data, comp_len) != 0) {
+        printf("FALHA! Sobrescrita do arquivo comprimido incorreta.\n"); exit(1);
+    }
+
+    // Dados aleatórios não se comprimem: o arquivo (comprimido só ele) ocupa o mesmo espaço
+    int before = myFSGetFreeBlocks(d);
+    fd = myFSOpen(d, "/aleatorio.bin");
+    myFSClose(fd);
+    if (myFSSetFileCompression(d, "/aleatorio.bin", 1) != 0) { printf("FALHA no myFSSetFileCompression!\n"); exit(1); }
+    srand(42);
+    for (int i = 0; i < 4096; i++) comp_data[i] = (char)rand();
+    fd = myFSOpen(d, "/aleatorio.bin");
+    myFSWrite(fd, comp_data, 4096);
+    myFSClose(fd);
+    fd = myFSOpen(d, "/aleatorio.bin");
+    // 8 blocos de dados + 1 de indireção
+    if (before - myFSGetFreeBlocks(d) != 9 || myFSRead(fd, comp_in, 4096) != 4096 ||
+        memcmp(comp_in, comp_data, 4096) != 0 || myFSSetFileCompression(d, "/aleatorio.bin", 0) == 0) {
+        printf("FALHA no arquivo incompressível!\n"); exit(1);
+    }
+    myFSClose(fd);
+    printf("SUCESSO (%u bytes de log: %d blocos e leitura em %.0f ms sem compressão, %d blocos e %.0f ms com).\n",
+           comp_len, comp_used[0], comp_ms[0], comp_used[1], comp_ms[1]);
+
+    // [TESTE EXTRA] Checksums: setores corrompidos falham a leitura; custo da conferência
+    printf("[EXTRA] Teste de Checksums (CRC32C) dos Setores... ");
+    double crc_ms[2] = {1e9, 1e9}; // Melhor de 3 leituras sem e com conferência
+    for (int rep = -1; rep < 6; rep++) { // A leitura -1 só leva a cabeça à posição das demais
+        struct timespec r0, r1;
+        diskSetVerify(d, rep != 0 && rep % 2);
+        clock_gettime(CLOCK_MONOTONIC, &r0);
+        fd = myFSOpen(d, "/log_plain.txt");
+        myFSRead(fd, comp_in, sizeof(comp_in));
+        myFSClose(fd);
+        clock_gettime(CLOCK_MONOTONIC, &r1);
+        double ms = (r1.tv_sec - r0.tv_sec) * 1e3 + (r1.tv_nsec - r0.tv_nsec) / 1e6;
+        if (rep >= 0 && ms < crc_ms[rep % 2]) crc_ms[rep % 2] = ms;
+    }
+    double crc_overhead = (crc_ms[1] - crc_ms[0]) * 100.0 / crc_ms[0];
+    if (crc_overhead >= 10.0) { printf("FALHA! Conferência custou %.1f%% na leitura.\n", crc_overhead); exit(1); }
+
+    if (diskCreateRawDisk(CRC_DISK, CRC_CYLINDERS) != 0) { printf("FALHA ao criar o disco!\n"); exit(1); }
+    Disk *dc = diskConnect(1, CRC_DISK);
+    char crc_text[600];
+    memset(crc_text, '.', sizeof(crc_text));
+    memcpy(crc_text, "MARCADOR-CRC", 12);
+    if (!dc || myFSFormat(dc, 512) <= 0 || myFSxMount(dc, 1) != 1) { printf("FALHA ao montar o disco!\n"); exit(1); }
+    fd = myFSOpen(dc, "/marcado.txt");
+    myFSWrite(fd, crc_text, sizeof(crc_text));
+    myFSClose(fd);
+    myFSxMount(dc, 0);
+    diskDisconnect(dc);
+
+    // Mapa de bits (setor 1) corrompido: a montagem falha em vez de usar o mapa
+    long bitmap_byte = 1 * RAW_SECTOR_SIZE + 3 + 10;
+    flip_raw_byte(CRC_DISK, bitmap_byte);
+    dc = diskConnect(1, CRC_DISK);
+    if (myFSxMount(dc, 1) == 1 || diskGetChecksumErrors(dc) == 0) { printf("FALHA! Mapa de bits corrompido não detectado.\n"); exit(1); }
+    diskDisconnect(dc);
+    flip_raw_byte(CRC_DISK, bitmap_byte);
+
+    // Bloco de dados corrompido: só a leitura do arquivo falha
+    static char raw_buf[CRC_CYLINDERS * 64 * RAW_SECTOR_SIZE];
+    FILE *raw = fopen(CRC_DISK, "rb");
+    size_t raw_len = raw ? fread(raw_buf, 1, sizeof(raw_buf), raw) : 0;
+    if (raw) fclose(raw);
+    long marker = -1;
+    for (size_t i = 0; i + 12 <= raw_len && marker < 0; i++)
+        if (memcmp(raw_buf + i, "MARCADOR-CRC", 12) == 0) marker = (long)i;
+    if (marker < 0 || flip_raw_byte(CRC_DISK, marker + 3) != 0) { printf("FALHA ao corromper o bloco!\n"); exit(1); }
+    dc = diskConnect(1, CRC_DISK);
+    if (myFSxMount(dc, 1) != 1) { printf("FALHA ao montar o disco restaurado!\n"); exit(1); }
+    fd = myFSOpen(dc, "/marcado.txt");
+    if (fd < 0 || myFSRead(fd, crc_text, sizeof(crc_text)) != -1 || diskGetChecksumErrors(dc) == 0) {
+        printf("FALHA! Bloco de dados corrompido não detectado.\n"); exit(1);
+    }
+    myFSClose(fd);
+    myFSxMount(dc, 0);
+    diskDisconnect(dc);
+
+    // Campo ECC trocado pelo de um setor nunca escrito: o volume formatado
+    // tem todos os setores gravados, então o campo não dispensa a conferência
+    flip_raw_byte(CRC_DISK, marker + 3);
+    long trailer = marker / RAW_SECTOR_SIZE * RAW_SECTOR_SIZE + 3 + 512;
+    if (write_raw_bytes(CRC_DISK, trailer, "]] ", 3) != 0) { printf("FALHA ao corromper o código!\n"); exit(1); }
+    dc = diskConnect(1, CRC_DISK);
+    if (myFSxMount(dc, 1) != 1) { printf("FALHA ao montar o disco restaurado!\n"); exit(1); }
+    fd = myFSOpen(dc, "/marcado.txt");
+    if (fd < 0 || myFSRead(fd, crc_text, sizeof(crc_text)) != -1) {
+        printf("FALHA! Código de setor nunca escrito aceito.\n"); exit(1);
+    }
+    myFSClose(fd);
+    myFSxMount(dc, 0);
+    diskDisconnect(dc);
+    printf("SUCESSO (leitura de 64 KB: %.1f ms sem conferência, %.1f ms com, %+.2f%%).\n",
+           crc_ms[0], crc_ms[1], crc_overhead);
+
+    // [TESTE EXTRA] Verificador: o volume dos testes é consistente; problemas injetados são corrigidos
+    printf("[EXTRA] Teste do Verificador de Consistência (fsck)... ");
+    MyFSCheckReport fsck_rep;
+    if (myFSCheck(d, 0, 4, &fsck_rep) != -1) { printf("FALHA! Verificou um disco montado.\n"); exit(1); }
+    if (myFSxMount(d, 0) != 1) { printf("FALHA no Unmount!\n"); exit(1); }
+    double fsck_ms[2]; // Verificação do volume dos testes com 1 e com 4 threads
+    int fsck_found[2];
+    for (int t = 0; t < 2; t++) {
+        struct timespec f0, f1;
+        clock_gettime(CLOCK_MONOTONIC, &f0);
+        fsck_found[t] = myFSCheck(d, 0, t == 0 ? 1 : 4, &fsck_rep);
+        clock_gettime(CLOCK_MONOTONIC, &f1);
+        fsck_ms[t] = (f1.tv_sec - f0.tv_sec) * 1e3 + (f1.tv_nsec - f0.tv_nsec) / 1e6;
+    }
+    // Arquivos removidos com myFSUnlink deixam i-nodes órfãos; nada mais pode aparecer
+    if (fsck_found[0] < 0 || fsck_found[0] != fsck_found[1] ||
+        fsck_found[1] != (int)fsck_rep.orphanInodes) {
+        printf("FALHA! Volume dos testes inconsistente (%d problemas).\n", fsck_found[1]); exit(1);
+    }
+    // Todas as leituras saem de varreduras em ordem de endereço feitas pela
+    // thread que chama: mais threads não podem deixar a verificação mais lenta
+    // (5% de folga para a variação do relógio)
+    if (fsck_ms[1] > fsck_ms[0] * 1.05) {
+        printf("FALHA! Verificação com 4 threads (%.0f ms) mais lenta que com 1 (%.0f ms).\n",
+               fsck_ms[1], fsck_ms[0]);
+        exit(1);
+    }
+    if (myFSxMount(d, 1) != 1) { printf("FALHA ao remontar!\n"); exit(1); }
+
+    if (diskCreateRawDisk(FSCK_DISK, FSCK_CYLINDERS) != 0) { printf("FALHA ao criar o disco!\n"); exit(1); }
+    Disk *df = diskConnect(2, FSCK_DISK);
+    if (!df || myFSFormat(df, 512) <= 0 || myFSxMount(df, 1) != 1) { printf("FALHA ao montar o disco!\n"); exit(1); }
+    char fsck_data[1500];
+    for (int i = 0; i < (int)sizeof(fsck_data); i++) fsck_data[i] = 'a' + i % 26;
+    const char *fsck_files[] = {"/a.txt", "/apagado.txt", "/docs/b.txt"};
+    myFSCloseDir(myFSOpenDir(df, "/docs"));
+    for (int i = 0; i < 3; i++) {
+        fd = myFSOpen(df, fsck_files[i]);
+        myFSWrite(fd, fsck_data, sizeof(fsck_data));
+        myFSClose(fd);
+    }
+    if (myFSClone(df, "/a.txt", "/a_clone.txt") != 0) { printf("FALHA no myFSClone!\n"); exit(1); }
+    dir_fd = myFSOpenDir(df, "/");
+    myFSUnlink(dir_fd, "apagado.txt"); // O i-node e os 3 blocos continuam ocupados
+    myFSCloseDir(dir_fd);
+    int fsck_free = myFSGetFreeBlocks(df);
+    myFSxMount(df, 0);
+    if (myFSCheck(df, 0, 4, &fsck_rep) != 1 || fsck_rep.orphanInodes != 1) {
+        printf("FALHA! I-node órfão não encontrado.\n"); exit(1);
+    }
+
+    // Injeta problemas: um bloco livre marcado em uso, o bloco da raiz marcado
+    // livre e a tabela de referências do clone zerada
+    unsigned char fsck_sector[512];
+    unsigned int total_blocks, data_start, refcount_block;
+    diskReadSector(df, 0, fsck_sector);
+    char2ul(&fsck_sector[8], &total_blocks);
+    char2ul(&fsck_sector[20], &data_start);
+    char2ul(&fsck_sector[36 + 12 * 4], &refcount_block);
+    diskReadSector(df, 1, fsck_sector);
+    fsck_sector[(total_blocks - 1) / 8] |= 1 << ((total_blocks - 1) % 8);
+    fsck_sector[data_start / 8] &= ~(1 << (data_start % 8));
+    diskWriteSector(df, 1, fsck_sector);
+    memset(fsck_sector, 0, 512);
+    if (refcount_block == 0 || diskWriteSector(df, refcount_block, fsck_sector) != 0) {
+        printf("FALHA! Clone sem tabela de referências.\n"); exit(1);
+    }
+
+    // O reparo devolve o bloco perdido e os do órfão, e recupera o resto
+    if (myFSCheck(df, 1, 4, &fsck_rep) <= 0 || fsck_rep.orphanInodes != 1 || fsck_rep.leakedBlocks != 4 ||
+        fsck_rep.missingBlocks != 1 || fsck_rep.badRefcounts != 3 || fsck_rep.repaired == 0) {
+        printf("FALHA! Problemas injetados não encontrados.\n"); exit(1);
+    }
+    if (myFSCheck(df, 0, 4, &fsck_rep) != 0 || myFSxMount(df, 1) != 1 ||
+        myFSGetFreeBlocks(df) != fsck_free + 3 || myFSGetFreeBlocks(df) != (int)fsck_rep.freeBlocks) {
+        printf("FALHA! Volume inconsistente depois do reparo.\n"); exit(1);
+    }
+    // Com a tabela refeita, escrever no original ainda copia os blocos do clone
+    fd = myFSOpen(df, "/a.txt");
+    myFSWrite(fd, "ALTERADO", 8);
+    myFSClose(fd);
+    char fsck_in[1500];
+    fd = myFSOpen(df, "/a_clone.txt");
+    if (myFSRead(fd, fsck_in, sizeof(fsck_in)) != (int)sizeof(fsck_in) || memcmp(fsck_in, fsck_data, sizeof(fsck_in)) != 0) {
+        printf("FALHA! Clone alterado depois do reparo.\n"); exit(1);
+    }
+    myFSClose(fd);
+    myFSxMount(df, 0);
+    diskDisconnect(df);
+    printf("SUCESSO (volume dos testes: %d i-nodes órfãos, %.0f ms com 1 thread, %.0f ms com 4).\n",
+           fsck_found[1], fsck_ms[0], fsck_ms[1]);
+
+    // [TESTE EXTRA] Desfragmentação: arquivos intercalados voltam a ser contíguos com o volume em uso
+    printf("[EXTRA] Teste de Desfragmentação... ");
+    if (diskCreateRawDisk(DEFRAG_DISK, DEFRAG_CYLINDERS) != 0) { printf("FALHA ao criar o disco!\n"); exit(1); }
+    Disk *dd = diskConnect(2, DEFRAG_DISK);
+    if (!dd || myFSFormat(dd, 512) <= 0 || myFSxMount(dd, 1) != 1) { printf("FALHA ao montar o disco!\n"); exit(1); }
+    static char defrag_fill[32 * 512], defrag_in[DEFRAG_ROUNDS * 512];
+    char defrag_block[512];
+    const char *defrag_files[] = {"/a.bin", "/b.bin", "/enchimento.bin"};
+    int defrag_fds[3];
+    for (int f = 0; f < 3; f++) defrag_fds[f] = myFSOpen(dd, defrag_files[f]);
+    // Cada rodada acrescenta um bloco a /a.bin e a /b.bin e 32 ao enchimento
+    for (int r = 0; r < DEFRAG_ROUNDS; r++) {
+        for (int f = 0; f < 2; f++) {
+            memset(defrag_block, 'A' + f * DEFRAG_ROUNDS + r, sizeof(defrag_block));
+            myFSWrite(defrag_fds[f], defrag_block, sizeof(defrag_block));
+        }
+        memset(defrag_fill, '0' + r, sizeof(defrag_fill));
+        myFSWrite(defrag_fds[2], defrag_fill, sizeof(defrag_fill));
+    }
+    for (int f = 1; f < 3; f++) myFSClose(defrag_fds[f]);
+    if (myFSClone(dd, "/b.bin", "/b_clone.bin") != 0) { printf("FALHA no myFSClone!\n"); exit(1); }
+    int defrag_free = myFSGetFreeBlocks(dd);
+
+    MyFSDefragReport rep_measure, rep_a, rep_b, rep_all;
+    if (myFSDefrag(dd, NULL, 1, &rep_measure) != 0 || rep_measure.extentsBefore != rep_measure.extentsAfter ||
+        rep_measure.extentsBefore <= rep_measure.filesScanned) {
+        printf("FALHA! Medição alterou o volume ou não achou fragmentação.\n"); exit(1);
+    }
+    // /a.bin é movido com um descritor aberto; /b.bin divide os blocos com o clone e fica
+    if (myFSDefrag(dd, "/a.bin", 0, &rep_a) != 1 || rep_a.extentsBefore <= 1 || rep_a.extentsAfter != 1 ||
+        rep_a.readMsAfter >= rep_a.readMsBefore) {
+        printf("FALHA! /a.bin não foi desfragmentado.\n"); exit(1);
+    }
+    if (myFSDefrag(dd, "/b.bin", 0, &rep_b) != 0 || rep_b.filesSkipped != 1) {
+        printf("FALHA! Arquivo com blocos compartilhados foi movido.\n"); exit(1);
+    }
+    if (myFSDefrag(dd, NULL, 0, &rep_all) < 0 || rep_all.extentsAfter > rep_all.extentsBefore ||
+        rep_all.readMsAfter > rep_all.readMsBefore || myFSGetFreeBlocks(dd) != defrag_free) {
+        printf("FALHA na desfragmentação do volume!\n"); exit(1);
+    }
+    if (myFSRead(defrag_fds[0], defrag_in, 512) != 0) { printf("FALHA! Descritor aberto perdeu a posição.\n"); exit(1); }
+    myFSClose(defrag_fds[0]);
+
+    // O conteúdo não muda e o volume continua consistente
+    const char *defrag_check[] = {"/a.bin", "/b.bin", "/b_clone.bin"};
+    for (int f = 0; f < 3; f++) {
+        fd = myFSOpen(dd, defrag_check[f]);
+        if (myFSRead(fd, defrag_in, sizeof(defrag_in)) != (int)sizeof(defrag_in)) {
+            printf("FALHA ao ler %s!\n", defrag_check[f]); exit(1);
+        }
+        for (int r = 0; r < DEFRAG_ROUNDS; r++)
+            if (defrag_in[r * 512] != 'A' + (f > 0) * DEFRAG_ROUNDS + r ||
+                memcmp(defrag_in + r * 512, defrag_in + r * 512 + 1, 511) != 0) {
+                printf("FALHA! Conteúdo de %s incorreto.\n", defrag_check[f]); exit(1);
+            }
+        myFSClose(fd);
+    }
+    fd = myFSOpen(dd, "/enchimento.bin");
+    for (int r = 0; r < DEFRAG_ROUNDS; r++)
+        if (myFSRead(fd, defrag_fill, sizeof(defrag_fill)) != (int)sizeof(defrag_fill) ||
+            defrag_fill[0] != '0' + r || defrag_fill[sizeof(defrag_fill) - 1] != '0' + r) {
+            printf("FALHA! Conteúdo do enchimento incorreto.\n"); exit(1);
+        }
+    myFSClose(fd);
+    if (myFSxMount(dd, 0) != 1 || myFSCheck(dd, 0, 4, NULL) != 0) {
+        printf("FALHA! Volume inconsistente depois da desfragmentação.\n"); exit(1);
+    }
+    diskDisconnect(dd);
+    printf("SUCESSO (/a.bin: %u trechos -> 1, buscas %.0f ms -> %.0f ms; volume: %u -> %u trechos, "
+           "%.0f ms -> %.0f ms).\n", rep_a.extentsBefore, rep_a.readMsBefore, rep_a.readMsAfter,
+           rep_measure.extentsBefore, rep_all.extentsAfter, rep_measure.readMsBefore, rep_all.readMsAfter);
+
+    // [TESTE EXTRA] Grupos de cilindros: diretórios espalhados, arquivos e dados no grupo do
+    // diretório. A mesma carga roda antes num volume sem grupos, com a tabela de i-nodes única
+    printf("[EXTRA] Teste de Grupos de Cilindros... ");
+    if (diskCreateRawDisk(CG_DISK, CG_CYLINDERS) != 0) { printf("FALHA ao criar o disco!\n"); exit(1); }
+    Disk *dg = diskConnect(2, CG_DISK);
+    MyFSFormatOptions cg_flat = { 0, 0, 0, MYFS_FORMAT_NO_GROUPS };
+    unsigned char cg_sb[512];
+    unsigned int cg_count, cg_sectors, cg_inode_blocks;
+    double flat_write_ms, flat_read_ms, cg_write_ms, cg_read_ms;
+    if (!dg || myFSFormatEx(dg, 512, &cg_flat) <= 0 || myFSxMount(dg, 1) != 1) { printf("FALHA ao montar o disco!\n"); exit(1); }
+    diskReadSector(dg, 0, cg_sb);
+    char2ul(&cg_sb[116], &cg_count);
+    if (cg_count != 0) { printf("FALHA! Volume sem grupos formatado com %u grupos.\n", cg_count); exit(1); }
+    if (cg_workload(dg, &flat_write_ms, &flat_read_ms) != 0) exit(1);
+    if (myFSxMount(dg, 0) != 1 || myFSCheck(dg, 0, 4, NULL) != 0) { printf("FALHA! Volume sem grupos inconsistente.\n"); exit(1); }
+
+    if (myFSFormat(dg, 512) <= 0 || myFSxMount(dg, 1) != 1) { printf("FALHA ao montar o disco!\n"); exit(1); }
+    diskReadSector(dg, 0, cg_sb);
+    char2ul(&cg_sb[116], &cg_count);
+    char2ul(&cg_sb[120], &cg_sectors);
+    char2ul(&cg_sb[124], &cg_inode_blocks);
+    unsigned int cg_per_group = cg_inode_blocks * inodeNumInodesPerSector();
+    if (cg_count < CG_DIRS || cg_sectors % (diskGetNumSectors(dg) / CG_CYLINDERS) != 0) {
+        printf("FALHA! Volume sem grupos de cilindros.\n"); exit(1);
+    }
+    if (cg_workload(dg, &cg_write_ms, &cg_read_ms) != 0) exit(1);
+
+    // Cada diretório fica num grupo; seus arquivos e blocos ficam no mesmo grupo
+    char cg_path[300];
+    unsigned int cg_used = 0, cg_found = 0;
+    dir_fd = myFSOpenDir(dg, "/");
+    while (myFSReadDir(dir_fd, entry_name, &inumber) == 1) {
+        if (strncmp(entry_name, "dir", 3) != 0) continue;
+        unsigned int g = (inumber - 1) / cg_per_group;
+        if (cg_used & (1u << g)) { printf("FALHA! Dois diretórios no grupo %u.\n", g); exit(1); }
+        cg_used |= 1u << g;
+        cg_found++;
+        sprintf(cg_path, "/%s", entry_name);
+        int sub_fd = myFSOpenDir(dg, cg_path);
+        char file_name[MAX_FILENAME_LENGTH + 1];
+        unsigned int file_inumber;
+        while (myFSReadDir(sub_fd, file_name, &file_inumber) == 1) {
+            if (file_name[0] == '.') continue;
+            Inode *cg_inode = inodeLoad(file_inumber, dg);
+            int ok = cg_inode && (file_inumber - 1) / cg_per_group == g && inodeGetNumBlocks(cg_inode) > 0;
+            for (unsigned int b = 0; ok && b < inodeGetNumBlocks(cg_inode); b++)
+                ok = inodeGetBlockAddr(cg_inode, b) / cg_sectors == g;
+            inodeFree(cg_inode);
+            if (!ok) { printf("FALHA! %s/%s fora do grupo do diretório.\n", cg_path, file_name); exit(1); }
+        }
+        myFSCloseDir(sub_fd);
+    }
+    myFSCloseDir(dir_fd);
+
+    // Queda com o volume montado: numa cópia do disco tirada depois de uma escrita, o mapa de
+    // bits ainda não tem o bloco novo; a montagem da cópia o refaz
+    unsigned char cg_sector[512];
+    char cg_data[1024], cg_in[1024];
+    memset(cg_data, 'q', sizeof(cg_data));
+    fd = myFSOpen(dg, "/dir0/queda.txt");
+    myFSWrite(fd, cg_data, sizeof(cg_data));
+    myFSClose(fd);
+    if (diskCreateRawDisk(CG_CRASH_DISK, CG_CYLINDERS) != 0) { printf("FALHA ao criar o disco!\n"); exit(1); }
+    Disk *dq = diskConnect(3, CG_CRASH_DISK);
+    for (unsigned long s = 0; dq && s < diskGetNumSectors(dg); s++)
+        if (diskReadSector(dg, s, cg_sector) != 0 || diskWriteSector(dq, s, cg_sector) != 0) {
+            printf("FALHA ao copiar o disco!\n"); exit(1);
+        }
+    MyFSCheckReport cg_rep;
+    if (!dq || myFSCheck(dq, 0, 4, &cg_rep) <= 0 || cg_rep.missingBlocks == 0 || myFSxMount(dq, 1) != 1) {
+        printf("FALHA! Mapa de bits atrasado não detectado.\n"); exit(1);
+    }
+    fd = myFSOpen(dq, "/dir0/queda.txt");
+    if (myFSRead(fd, cg_in, sizeof(cg_in)) != (int)sizeof(cg_in) || memcmp(cg_in, cg_data, sizeof(cg_in)) != 0) {
+        printf("FALHA! Arquivo perdido na queda.\n"); exit(1);
+    }
+    myFSClose(fd);
+    if (myFSxMount(dq, 0) != 1 || myFSCheck(dq, 0, 4, NULL) != 0) { printf("FALHA! Cópia inconsistente.\n"); exit(1); }
+    diskDisconnect(dq);
+
+    if (cg_found != CG_DIRS || myFSxMount(dg, 0) != 1 || myFSCheck(dg, 0, 4, NULL) != 0) {
+        printf("FALHA! Volume inconsistente.\n"); exit(1);
+    }
+    diskDisconnect(dg);
+    // Relidos diretório a diretório, os arquivos de um grupo não saem dos seus cilindros; como
+    // o mapa de bits só é gravado na desmontagem, a escrita também não fica mais lenta
+    if (cg_read_ms >= flat_read_ms || cg_write_ms + cg_read_ms >= flat_write_ms + flat_read_ms) {
+        printf("FALHA! Carga sem ganho com grupos (%.0f ms -> %.0f ms).\n", flat_write_ms + flat_read_ms,
+               cg_write_ms + cg_read_ms); exit(1);
+    }
+    printf("SUCESSO (%u grupos de %u setores; %d arquivos em %d diretórios escritos em %.0f ms -> %.0f ms, "
+           "relidos em %.0f ms -> %.0f ms, sem -> com grupos).\n", cg_count, cg_sectors, CG_DIRS * CG_FILES,
+           CG_DIRS, flat_write_ms, cg_write_ms, flat_read_ms, cg_read_ms);
+
+    // [TESTE EXTRA] Opções de formatação gravadas no superbloco e respeitadas na montagem
+    printf("[EXTRA] Teste de Opções de Formatação... ");
+    if (diskCreateRawDisk(FMT_DISK, FMT_CYLINDERS) != 0) { printf("FALHA ao criar o disco!\n"); exit(1); }
+    Disk *dm = diskConnect(2, FMT_DISK);
+    unsigned char fmt_sb[512];
+    unsigned int fmt_inodes_default, fmt_inodes, fmt_reserved, fmt_journal, fmt_cg_sectors;
+    int fmt_free_default = (dm ? myFSFormatEx(dm, 512, NULL) : -1);
+    diskReadSector(dm, 0, fmt_sb);
+    char2ul(&fmt_sb[16], &fmt_inodes_default);
+    MyFSFormatOptions fmt_bad[] = { { 32, 0, 0, 0 }, { 0, 90, 0, 0 }, { 0, 0, 1000, 0 } };
+    for (unsigned int k = 0; k < sizeof(fmt_bad) / sizeof(fmt_bad[0]); k++)
+        if (myFSFormatEx(dm, 512, &fmt_bad[k]) != -1) { printf("FALHA! Opções inválidas aceitas (%u).\n", k); exit(1); }
+
+    // Poucos arquivos grandes: menos i-nodes, mais blocos livres, e a tabela acaba no último i-node
+    MyFSFormatOptions fmt_sparse = { FMT_SPARSE_BPI, 0, 0, 0 };
+    int fmt_free = myFSFormatEx(dm, 512, &fmt_sparse);
+    diskReadSector(dm, 0, fmt_sb);
+    char2ul(&fmt_sb[16], &fmt_inodes);
+    if (fmt_free <= fmt_free_default || fmt_inodes >= fmt_inodes_default || myFSxMount(dm, 1) != 1) {
+        printf("FALHA! Densidade de i-nodes ignorada (%u -> %u i-nodes).\n", fmt_inodes_default, fmt_inodes); exit(1);
+    }
+    char fmt_path[32];
+    unsigned int fmt_files = 0;
+    for (;; fmt_files++) {
+        sprintf(fmt_path, "/f%u", fmt_files);
+        if ((fd = myFSOpen(dm, fmt_path)) < 0) break;
+        myFSClose(fd);
+    }
+    if (fmt_files != fmt_inodes - 1 || myFSxMount(dm, 0) != 1) {
+        printf("FALHA! %u arquivos criados com %u i-nodes.\n", fmt_files, fmt_inodes); exit(1);
+    }
+
+    // Blocos reservados e diário: os dados param na reserva, que ainda recebe um diretório
+    MyFSFormatOptions fmt_opts = { 0, FMT_RESERVED, FMT_JOURNAL, FMT_CYLINDERS / 2 };
+    if (myFSFormatEx(dm, 512, &fmt_opts) <= 0 || myFSxMount(dm, 1) != 1) { printf("FALHA ao formatar!\n"); exit(1); }
+    diskReadSector(dm, 0, fmt_sb);
+    char2ul(&fmt_sb[120], &fmt_cg_sectors);
+    char2ul(&fmt_sb[132], &fmt_reserved);
+    char2ul(&fmt_sb[140], &fmt_journal);
+    if (fmt_cg_sectors != diskGetNumSectors(dm) / 2 || fmt_journal != FMT_JOURNAL || fmt_reserved == 0) {
+        printf("FALHA! Opções não gravadas no superbloco.\n"); exit(1);
+    }
+    char fmt_block[512];
+    memset(fmt_block, 'r', sizeof(fmt_block));
+    fd = myFSOpen(dm, "/cheio.bin");
+    while (myFSWrite(fd, fmt_block, sizeof(fmt_block)) == (int)sizeof(fmt_block));
+    myFSClose(fd);
+    if ((unsigned int)myFSGetFreeBlocks(dm) < fmt_reserved) { printf("FALHA! Dados ocuparam a reserva.\n"); exit(1); }
+    if ((fd = myFSOpenDir(dm, "/sub")) < 0) { printf("FALHA! Diretório sem lugar na reserva.\n"); exit(1); }
+    myFSCloseDir(fd);
+
+    // Montado de novo, o volume continua a guardar a reserva
+    if (myFSxMount(dm, 0) != 1 || myFSxMount(dm, 1) != 1) { printf("FALHA ao remontar!\n"); exit(1); }
+    fd = myFSOpen(dm, "/outro.bin");
+    int fmt_written = myFSWrite(fd, fmt_block, sizeof(fmt_block));
+    myFSClose(fd);
+    if (fmt_written > 0 || myFSxMount(dm, 0) != 1 || myFSCheck(dm, 0, 0, NULL) != 0) {
+        printf("FALHA! Reserva perdida na montagem ou volume inconsistente.\n"); exit(1);
+    }
+    diskDisconnect(dm);
+    printf("SUCESSO (%u -> %u i-nodes, %d -> %d blocos livres; %u blocos reservados, diário de %u).\n",
+           fmt_inodes_default, fmt_inodes, fmt_free_default, fmt_free, fmt_reserved, fmt_journal);
+
+    // [TESTE EXTRA] Leitura sem cópia: páginas fixadas até a liberação, normal e comprimido
+    printf("[EXTRA] Teste de Leitura sem Cópia... ");
+    static char zc_data[ZC_FILE_SIZE], zc_check[ZC_FILE_SIZE];
+    for (int i = 0; i < ZC_FILE_SIZE; i++) zc_data[i] = (char)((i * 7 + 3) % 251);
+    const char *zc_paths[] = { "/zc.bin", "/zc_lz.bin" };
+    int zc_entries = 0;
+    for (int k = 0; k < 2; k++) {
+        fd = myFSOpen(d, zc_paths[k]);
+        if (k == 1 && myFSSetFileCompression(d, zc_paths[k], 1) != 0) { printf("FALHA ao comprimir!\n"); exit(1); }
+        myFSWrite(fd, zc_data, ZC_FILE_SIZE);
+        myFSClose(fd);
+
+        fd = myFSOpen(d, zc_paths[k]);
+        struct iovec zc_iov[8];
+        MyFSPages *zc_first = NULL, *zc_pages;
+        const char *zc_first_base = NULL;
+        unsigned int zc_total = 0;
+        int n;
+        while ((n = myFSReadPages(fd, ZC_CHUNK, zc_iov, 8, &zc_pages)) > 0) {
+            for (int e = 0; e < n; e++) {
+                if (zc_total + zc_iov[e].iov_len > ZC_FILE_SIZE) { printf("FALHA! Leitura além do fim.\n"); exit(1); }
+                memcpy(zc_check + zc_total, zc_iov[e].iov_base, zc_iov[e].iov_len);
+                zc_total += zc_iov[e].iov_len;
+            }
+            zc_entries += n;
+            if (!zc_first) {
+                zc_first = zc_pages;
+                zc_first_base = zc_iov[0].iov_base;
+            } else {
+                myFSReleasePages(zc_pages);
+            }
+        }
+        myFSClose(fd);
+        if (n < 0 || zc_total != ZC_FILE_SIZE || memcmp(zc_check, zc_data, ZC_FILE_SIZE) != 0) {
+            printf("FALHA! Conteúdo de %s incorreto.\n", zc_paths[k]); exit(1);
+        }
+
+        // Uma escrita posterior não altera as páginas ainda fixadas
+        fd = myFSOpen(d, zc_paths[k]);
+        myFSWrite(fd, "XXXXXXXX", 8);
+        myFSClose(fd);
+        if (memcmp(zc_first_base, zc_data, 8) != 0) { printf("FALHA! Página fixada alterada.\n"); exit(1); }
+        myFSReleasePages(zc_first);
+    }
+    printf("SUCESSO (2 arquivos de %d bytes em %d trechos).\n", ZC_FILE_SIZE, zc_entries);
+
+    // [TESTE EXTRA] readv/writev: registros em buffers separados, numa só passagem pelo arquivo
+    printf("[EXTRA] Teste de readv/writev... ");
+    static char iov_head[IOV_RECORDS][IOV_HEADER], iov_body[IOV_RECORDS][IOV_PAYLOAD];
+    static char iov_in_head[IOV_RECORDS][IOV_HEADER], iov_in_body[IOV_RECORDS][IOV_PAYLOAD];
+    static char iov_flat[IOV_RECORDS * (IOV_HEADER + IOV_PAYLOAD)];
+    struct iovec iov_out[2 * IOV_RECORDS], iov_in[2 * IOV_RECORDS];
+    for (int r = 0; r < IOV_RECORDS; r++) {
+        snprintf(iov_head[r], IOV_HEADER, "REG%07d", r);
+        memset(iov_body[r], 'A' + r, IOV_PAYLOAD);
+        iov_out[2 * r] = (struct iovec){ iov_head[r], IOV_HEADER };
+        iov_out[2 * r + 1] = (struct iovec){ iov_body[r], IOV_PAYLOAD };
+        iov_in[2 * r] = (struct iovec){ iov_in_head[r], IOV_HEADER };
+        iov_in[2 * r + 1] = (struct iovec){ iov_in_body[r], IOV_PAYLOAD };
+    }
+    const int iov_total = (int)sizeof(iov_flat);
+    double iov_ms[2];
+    const char *iov_paths[] = { "/registros.log", "/registros_lz.log", "/registros_sep.log" };
+    for (int k = 0; k < 3; k++) {
+        struct timespec v0, v1;
+        fd = myFSOpen(d, iov_paths[k]);
+        if (k == 1) myFSSetFileCompression(d, iov_paths[k], 1);
+        clock_gettime(CLOCK_MONOTONIC, &v0);
+        int w = 0;
+        if (k < 2) {
+            w = myFSWritev(fd, iov_out, 2 * IOV_RECORDS);
+        } else {
+            // O mesmo conteúdo com uma escrita por buffer, para comparar
+            for (int e = 0; e < 2 * IOV_RECORDS; e++) w += myFSWrite(fd, iov_out[e].iov_base, iov_out[e].iov_len);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &v1);
+        myFSClose(fd);
+        if (k != 1) iov_ms[k / 2] = (v1.tv_sec - v0.tv_sec) * 1e3 + (v1.tv_nsec - v0.tv_nsec) / 1e6;
+        if (w != iov_total) { printf("FALHA! %s: %d de %d bytes escritos.\n", iov_paths[k], w, iov_total); exit(1); }
+
+        // O arquivo é a concatenação dos buffers, lida de uma vez ou espalhada de novo
+        fd = myFSOpen(d, iov_paths[k]);
+        int r_flat = myFSRead(fd, iov_flat, sizeof(iov_flat));
+        myFSClose(fd);
+        fd = myFSOpen(d, iov_paths[k]);
+        memset(iov_in_head, 0, sizeof(iov_in_head));
+        memset(iov_in_body, 0, sizeof(iov_in_body));
+        int r_vec = myFSReadv(fd, iov_in, 2 * IOV_RECORDS);
+        myFSClose(fd);
+        int ok = r_flat == iov_total && r_vec == iov_total;
+        for (int r = 0; ok && r < IOV_RECORDS; r++) {
+            char *rec = iov_flat + r * (IOV_HEADER + IOV_PAYLOAD);
+            ok = memcmp(rec, iov_head[r], IOV_HEADER) == 0 && memcmp(rec + IOV_HEADER, iov_body[r], IOV_PAYLOAD) == 0 &&
+                 memcmp(iov_in_head[r], iov_head[r], IOV_HEADER) == 0 &&
+                 memcmp(iov_in_body[r], iov_body[r], IOV_PAYLOAD) == 0;
+        }
+        if (!ok) { printf("FALHA! Conteúdo de %s incorreto.\n", iov_paths[k]); exit(1); }
+    }
+    fd = myFSOpen(d, iov_paths[0]);
+    int iov_bad = myFSWritev(fd, iov_out, -1);
+    myFSClose(fd);
+    if (iov_bad != -1) { printf("FALHA! Vetor inválido aceito.\n"); exit(1); }
+    printf("SUCESSO (%d trechos: writev em %.0f ms, uma escrita por trecho em %.0f ms).\n",
+           2 * IOV_RECORDS, iov_ms[0], iov_ms[1]);
+
+    // [TESTE EXTRA] Mapeamento em memória: carga no primeiro acesso, gravação no msync/munmap
+    printf("[EXTRA] Teste de Mapeamento em Memória... ");
+    long map_page = sysconf(_SC_PAGESIZE);
+    unsigned int map_size = MAP_PAGES * map_page + MAP_TAIL;
+    char *map_data = malloc(map_size), *map_check = malloc(map_size);
+    for (unsigned int i = 0; i < map_size; i++) map_data[i] = (char)(i % 97);
+    signal(SIGSEGV, map_fault_guard);
+    fd = myFSOpen(d, "/mapa.bin");
+    myFSWrite(fd, map_data, map_size);
+    char *map = myFSMmap(fd, 0, map_size);
+    myFSClose(fd);
+    if (!map || myFSIsIdle(d)) { printf("FALHA ao mapear!\n"); exit(1); }
+
+    // Varredura com aritmética de ponteiros
+    unsigned long map_sum = 0, map_expected = 0;
+    for (unsigned int i = 0; i < (unsigned int)map_page; i++) {
+        map_sum += (unsigned char)map[i];
+        map_expected += (unsigned char)map_data[i];
+    }
+    // Página ainda não tocada: reflete uma escrita feita depois do mapeamento
+    fd = myFSOpen(d, "/mapa.bin");
+    myFSWrite(fd, map_data, 2 * map_page);
+    myFSWrite(fd, "NOVO", 4);
+    myFSClose(fd);
+    if (map_sum != map_expected || memcmp(map + 2 * map_page, "NOVO", 4) != 0 ||
+        memcmp(map + map_page, map_data + map_page, map_page) != 0) {
+        printf("FALHA! Conteúdo mapeado incorreto.\n"); exit(1);
+    }
+
+    // Escritas no mapeamento: gravadas no msync e no munmap, sem passar do fim do arquivo
+    map[10] = 'X';
+    map[MAP_PAGES * map_page + 50] = 'Y';
+    map[MAP_PAGES * map_page + MAP_TAIL + 20] = 'Z';
+    if (myFSMsync(map, map_size) != 0) { printf("FALHA no msync!\n"); exit(1); }
+    map[map_page + 5] = 'W';
+    if (myFSMunmap(map) != 0 || !myFSIsIdle(d)) { printf("FALHA no munmap!\n"); exit(1); }
+    memcpy(map_data + 2 * map_page, "NOVO", 4);
+    map_data[10] = 'X';
+    map_data[MAP_PAGES * map_page + 50] = 'Y';
+    map_data[map_page + 5] = 'W';
+    fd = myFSOpen(d, "/mapa.bin");
+    int map_read = myFSRead(fd, map_check, map_size + 1);
+    if (map_read != (int)map_size || memcmp(map_check, map_data, map_size) != 0) {
+        printf("FALHA! Alterações do mapeamento não gravadas (%d bytes).\n", map_read); exit(1);
+    }
+
+    // Regiões ainda não carregadas como buffers de escrita e de leitura de outro arquivo: a
+    // carga de cada página no primeiro acesso não pode esperar pelos locks que elas seguram
+    char *map_src = myFSMmap(fd, 0, 2 * map_page), *map_dst = myFSMmap(fd, 0, 2 * map_page);
+    int map_fd = myFSOpen(d, "/mapa_outro.bin");
+    int map_copied = (map_src ? myFSWrite(map_fd, map_src, 2 * map_page) : -1);
+    myFSClose(map_fd);
+    map_fd = myFSOpen(d, "/mapa_outro.bin");
+    int map_back = (map_dst ? myFSRead(map_fd, map_dst, 2 * map_page) : -1);
+    myFSClose(map_fd);
+    if (map_copied != 2 * map_page || map_back != 2 * map_page || memcmp(map_dst, map_data, 2 * map_page) != 0 ||
+        myFSMunmap(map_src) != 0 || myFSMunmap(map_dst) != 0) {
+        printf("FALHA! Mapeamento como buffer de outro arquivo (%d e %d bytes).\n", map_copied, map_back); exit(1);
+    }
+
+    // Escrita num mapeamento da visão somente leitura de um snapshot: a falta vai ao tratador
+    // do programa, e os mapeamentos continuam atendidos depois dela
+    int map_snap = myFSSnapshotCreate(d);
+    Disk *map_view = myFSSnapshotOpen(d, map_snap, 5);
+    if (!map_view || myFSxMount(map_view, 1) != 1) { printf("FALHA ao montar a visão do snapshot!\n"); exit(1); }
+    map_fd = myFSOpen(map_view, "/mapa.bin");
+    char *map_ro = myFSMmap(map_fd, 0, map_page);
+    myFSClose(map_fd);
+    map = myFSMmap(fd, 0, map_page);
+    if (!map_ro || !map) { printf("FALHA ao mapear!\n"); exit(1); }
+    volatile int map_faults = 0;
+    map_fault_armed = 1;
+    if (sigsetjmp(map_fault_env, 1) == 0) map_ro[1] = '!';
+    else map_faults++;
+    if (sigsetjmp(map_fault_env, 1) == 0) map[1] = map_ro[1] + 1;
+    else map_faults++;
+    map_fault_armed = 0;
+    map_data[1]++;
+    if (map_faults != 1 || map_ro[1] != map_data[1] - 1 || myFSMunmap(map_ro) != 0 || myFSMunmap(map) != 0 ||
+        myFSxMount(map_view, 0) != 1 || myFSSnapshotClose(map_view) != 0 || myFSSnapshotDelete(d, map_snap) != 0) {
+        printf("FALHA! Falta não atendida (%d tratadas pelo programa).\n", map_faults); exit(1);
+    }
+
+    // Primeiro acesso simultâneo: as escritas das threads que esperam a carga da página
+    // não podem ser cobertas pelo conteúdo lido do arquivo
+    map = myFSMmap(fd, 0, map_page);
+    pthread_t map_threads[MAP_THREADS];
+    for (int i = 0; map && i < MAP_THREADS; i++)
+        pthread_create(&map_threads[i], NULL, map_touch_thread, map + i * (map_page / MAP_THREADS));
+    for (int i = 0; map && i < MAP_THREADS; i++) {
+        pthread_join(map_threads[i], NULL);
+        map_data[i * (map_page / MAP_THREADS)] = 'T';
+    }
+    if (!map || memcmp(map, map_data, map_page) != 0 || myFSMunmap(map) != 0) {
+        printf("FALHA! Escrita perdida na carga da página.\n"); exit(1);
+    }
+
+    // Carga explícita antes de usar a região como buffer do próprio MyFS
+    map = myFSMmap(fd, map_page, map_size - map_page);
+    myFSClose(fd);
+    if (!map || myFSMtouch(map, map_size - map_page) != 0) { printf("FALHA no myFSMtouch!\n"); exit(1); }
+    fd = myFSOpen(d, "/mapa_copia.bin");
+    int map_written = myFSWrite(fd, map, map_size - map_page);
+    myFSClose(fd);
+    if (map_written != (int)(map_size - map_page) || memcmp(map, map_data + map_page, map_size - map_page) != 0 ||
+        myFSMunmap(map) != 0) {
+        printf("FALHA! Cópia a partir do mapeamento incorreta.\n"); exit(1);
+    }
+    free(map_data);
+    free(map_check);
+    printf("SUCESSO (%u bytes em %u páginas de %ld).\n", map_size, MAP_PAGES + 1, map_page);
+
+    // [TESTE EXTRA] Alocador de i-nodes: escritas repetidas reaproveitam os i-nodes liberados
+    printf("[EXTRA] Teste do Alocador de I-nodes... ");
+    unsigned long slab_allocs[2], slab_chunks[2];
+    char slab_buf[512];
+    memset(slab_buf, 's', sizeof(slab_buf));
+    fd = myFSOpen(d, "/slab.bin");
+    inodeAllocStats(&slab_allocs[0], &slab_chunks[0]);
+    int slab_written = 0;
+    for (int i = 0; i < SLAB_WRITES; i++) slab_written += myFSWrite(fd, slab_buf, sizeof(slab_buf));
+    inodeAllocStats(&slab_allocs[1], &slab_chunks[1]);
+    myFSClose(fd);
+    // Cada escrita carrega o i-node do arquivo; no máximo um bloco novo de i-nodes
+    if (slab_written != SLAB_WRITES * (int)sizeof(slab_buf) || slab_allocs[1] - slab_allocs[0] < SLAB_WRITES ||
+        slab_chunks[1] - slab_chunks[0] > 1) {
+        printf("FALHA! %lu i-nodes em %lu blocos novos.\n", slab_allocs[1] - slab_allocs[0],
+               slab_chunks[1] - slab_chunks[0]);
+        exit(1);
+    }
+    printf("SUCESSO (%d escritas: %lu i-nodes, %lu blocos do malloc no total).\n", SLAB_WRITES,
+           slab_allocs[1] - slab_allocs[0], slab_chunks[1]);
+
     // [TESTE EXTRA] Verificar se myFSIsIdle impede desmontagem com arquivo aberto
     printf("[EXTRA] Teste de IsIdle (Bloqueio de Desmonte)... ");
     int fd_extra = myFSOpen(d, "/temp.txt");
@@ -195,10 +1558,15 @@ int main() {
     
     myFSClose(fd_extra); // Fecha para liberar
     
-    // Agora o sistema deve estar ocioso (Idle), mas não vamos desmontar ainda
-    // Apenas verificamos se a lógica acima funcionou.
     printf("SUCESSO (Bloqueio funcionou).\n");
     
+    // 10. Desmontar e Desconectar
+    printf("[10/10] Limpeza Final... ");
+    if (myFSxMount(d, 0) != 1) { // 0 = Unmount
+        printf("FALHA no Unmount!\n"); exit(1);
+    }
+    diskDisconnect(d);
+    printf("SUCESSO.\n");
     printf("\n=== TODOS OS TESTES PASSARAM! ===\n");
     return 0;
 }
\ No newline at end of file
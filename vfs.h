@@ -6,21 +6,42 @@
 *  Organizacao: Universidade Federal de Juiz de Fora
 *  Departamento: Dep. Ciencia da Computacao
 *
-*  => NAO MODIFIQUE ESTE ARQUIVO <=
+*  Este arquivo era fornecido pronto e nao devia ser modificado. Deixou de
+*  ser congelado porque a montagem de varios volumes, readv/writev e a E/S
+*  assincrona estendem a API comum
 *
 */
 
 #ifndef VFS_H
 #define VFS_H
 
+#include <sys/uio.h>
 #include "disk.h"
 
 #define MAX_FDS 128             //Numero maximo de descritores de arquivos
 #define MAX_FILENAME_LENGTH 255 //Comprimento maximo do nome de arquivos
+#define VFS_MAX_MOUNTS 8        //Numero maximo de pontos de montagem
+
+//Bits de um descritor da VFS com o descritor do sistema de arquivos; os
+//bits acima deles guardam o ponto de montagem. Descritores devolvidos por
+//openFn e opendirFn devem ser positivos e menores que 1 << VFS_FSFD_BITS
+#define VFS_FSFD_BITS 28
 
 #define FILETYPE_DIR 128    //Identificador de tipo de arquivo: diretorio
 #define FILETYPE_REGULAR 64 //Identificador de tipo de arquivo: arq regular
 
+//Estrutura de uma entrada de diretorio devolvida em lote por vfsGetdents.
+//As entradas sao empacotadas em sequencia no buffer do chamador; reclen
+//indica o deslocamento ate a proxima entrada (multiplo de 4 bytes)
+typedef struct vfs_dirent {
+	unsigned int inumber;	// Numero do i-node da entrada
+	unsigned int size;	// Tamanho do arquivo em bytes (so' com atributos)
+	unsigned short reclen;	// Tamanho desta entrada no buffer
+	unsigned char type;	// FILETYPE_DIR ou FILETYPE_REGULAR
+	unsigned char namelen;	// Comprimento do nome, sem o \0
+	char name[];		// Nome da entrada, terminado em \0
+} VFSDirent;
+
 //Estrutura para definicao da API de sistemas de arquivos.
 //Deve ser preenchida com os ponteiros das respectivas funcoes e passada
 //para registro por meio da funcao vfsRegister()
@@ -100,6 +121,40 @@ typedef struct fs_info {
 	//arquivo existente. Retorna 0 caso bem sucedido, ou -1 caso contrario.	
 	int (*closedirFn) (int fd);
 
+	//Funcao para a leitura em lote de um diretorio, identificado por um
+	//descritor de arquivo existente. A partir da posicao atual do cursor,
+	//copia para buf tantas entradas (VFSDirent) quantas couberem em nbytes.
+	//Se withAttrs for diferente de 0, o tamanho de cada arquivo tambem e'
+	//preenchido (ao custo de ler seu i-node). Retorna o numero de bytes
+	//preenchidos, 0 se fim do diretorio ou -1 caso mal sucedido.
+	int (*getdentsFn) (int fd, char *buf, unsigned int nbytes,
+	                   int withAttrs);
+
+	//Funcao para garantir que os dados e metadados do arquivo identificado
+	//pelo descritor fd estejam gravados no disco. Retorna 0 caso bem
+	//sucedido, ou -1 caso contrario.
+	int (*syncFn) (int fd);
+
+	//Funcao para clonar o arquivo regular srcPath como dstPath, ambos no
+	//disco montado d. O clone deve ter o mesmo conteudo do original e ser
+	//independente dele; dstPath nao pode existir. Retorna 0 caso bem
+	//sucedido, ou -1 caso contrario. Pode ser NULL se nao houver suporte.
+	int (*cloneFn) (Disk *d, const char *srcPath, const char *dstPath);
+
+	//Funcao para a leitura de um arquivo, a partir de um descritor de
+	//arquivo existente, para os iovcnt trechos de iov, preenchidos em
+	//ordem (como readv). Retorna o numero de bytes efetivamente lidos em
+	//caso de sucesso ou -1, caso contrario. Pode ser NULL: a VFS chama
+	//readFn para cada trecho.
+	int (*readvFn) (int fd, const struct iovec *iov, int iovcnt);
+
+	//Funcao para a escrita de um arquivo, a partir de um descritor de
+	//arquivo existente, dos iovcnt trechos de iov, em ordem (como writev).
+	//Retorna o numero de bytes efetivamente escritos em caso de sucesso ou
+	//-1, caso contrario. Pode ser NULL: a VFS chama writeFn para cada
+	//trecho.
+	int (*writevFn) (int fd, const struct iovec *iov, int iovcnt);
+
 } FSInfo;
 
 //Funcao para inicializacao do sistema de arquivos virtual
@@ -114,6 +169,19 @@ int vfsMountRoot (Disk *d, char fsId);
 //caso contrario
 int vfsUnmountRoot ( void );
 
+//Funcao para a montagem do disco d, com o sistema de arquivos fsId, no
+//caminho absoluto mountPoint da arvore unica. A raiz ("/") deve ser montada
+//antes dos demais pontos. Caminhos dentro de mountPoint passam a ser
+//atendidos pelo sistema de arquivos montado. Retorna 0 caso bem sucedido e
+//-1 caso contrario
+int vfsMount (Disk *d, char fsId, const char *mountPoint);
+
+//Funcao para a desmontagem do sistema de arquivos montado em mountPoint. Nao
+//podem haver arquivos ou diretorios abertos nele e a raiz so' pode ser
+//desmontada depois dos demais pontos. Retorna 0 caso bem sucedido e -1 caso
+//contrario
+int vfsUnmount (const char *mountPoint);
+
 //Funcao para formatacao de um disco com o sistema de arquivos indicado pelo
 //identificador do sistema de arquivos (fsId), com tamanho de blocos igual a
 //blockSize. Retorna o numero total de blocos disponiveis no disco, se
@@ -169,6 +237,33 @@ int vfsUnlink (int fd, const char *filename);
 //existente. Retorna 0 caso bem sucedido, ou -1 caso contrario.
 int vfsClosedir (int fd);
 
+//Funcao para a leitura em lote de um diretorio, identificado por um descritor
+//de arquivo existente. Copia para buf tantas entradas (VFSDirent) quantas
+//couberem em nbytes, a partir da posicao atual do cursor. Se withAttrs for
+//diferente de 0, o tamanho de cada arquivo tambem e' preenchido. Retorna o
+//numero de bytes preenchidos, 0 se fim de diretorio ou -1 caso mal sucedido
+int vfsGetdents (int fd, char *buf, unsigned int nbytes, int withAttrs);
+
+//Funcao para garantir que os dados e metadados do arquivo identificado pelo
+//descritor fd estejam gravados no disco. Retorna 0 caso bem sucedido, ou -1
+//caso contrario
+int vfsSync (int fd);
+
+//Funcao para clonar o arquivo regular srcPath como dstPath, que nao pode
+//existir. Os dois caminhos devem estar no mesmo ponto de montagem. Retorna 0
+//caso bem sucedido, ou -1 caso contrario
+int vfsClone (const char *srcPath, const char *dstPath);
+
+//Funcao para a leitura de um arquivo, a partir de um descritor de arquivo
+//existente, para os iovcnt trechos de iov, preenchidos em ordem. Retorna o
+//numero de bytes efetivamente lidos em caso de sucesso ou -1, caso contrario
+int vfsReadv (int fd, const struct iovec *iov, int iovcnt);
+
+//Funcao para a escrita de um arquivo, a partir de um descritor de arquivo
+//existente, dos iovcnt trechos de iov, em ordem. Retorna o numero de bytes
+//efetivamente escritos em caso de sucesso ou -1, caso contrario
+int vfsWritev (int fd, const struct iovec *iov, int iovcnt);
+
 //Registra novo sistema de arquivos. Retorna um identificador unico (slot),
 //caso o sistema de arquivos tenha sido registrado com sucesso. Caso contrario,
 //retorna -1